@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Region allocator for data owned by a part. Allocation is a pointer
+ * increment in the current block; individual allocations are not freed,
+ * instead the whole region is recycled with CAD_ArenaReset() and released
+ * with CAD_ArenaDestroy(). A few blocks are kept across resets so that
+ * repeated regeneration passes do not go back to the system allocator.
+ *
+ * Objects which are destroyed individually (e.g., features) can be
+ * returned with CAD_ArenaFreeObj() and are reused for the next object of
+ * the same size. The list of released objects is kept outside of the
+ * objects themselves, so their memory is not written to after release.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+#define ARENA_ROUND(n) \
+	(((n) + CAD_ARENA_ALIGN-1) & ~((size_t)CAD_ARENA_ALIGN-1))
+#define ARENA_HDR	ARENA_ROUND(sizeof(CAD_ArenaBlock))
+#define ARENA_DATA(blk)	((Uint8 *)(blk) + ARENA_HDR)
+
+void
+CAD_ArenaInit(CAD_Arena *ar, size_t blockSize)
+{
+	AG_MutexInit(&ar->lock);
+	ar->blocks = NULL;
+	ar->cur = NULL;
+	ar->blockSize = ARENA_ROUND(blockSize);
+	ar->free = NULL;
+	ar->nFree = 0;
+}
+
+void
+CAD_ArenaDestroy(CAD_Arena *ar)
+{
+	CAD_ArenaBlock *blk, *blkNext;
+	Uint i;
+
+	for (blk = ar->blocks; blk != NULL; blk = blkNext) {
+		blkNext = blk->next;
+		Free(blk);
+	}
+	for (i = 0; i < ar->nFree; i++) {
+		Free(ar->free[i].slots);
+	}
+	Free(ar->free);
+	AG_MutexDestroy(&ar->lock);
+}
+
+/*
+ * Invalidate all allocations. Up to CAD_ARENA_KEEP blocks of the default
+ * size are kept for reuse and the others are released.
+ */
+void
+CAD_ArenaReset(CAD_Arena *ar)
+{
+	CAD_ArenaBlock *blk, *blkNext, **tail = &ar->blocks;
+	Uint i, nKept = 0;
+
+	AG_MutexLock(&ar->lock);
+	for (blk = ar->blocks; blk != NULL; blk = blkNext) {
+		blkNext = blk->next;
+		if (nKept < CAD_ARENA_KEEP && blk->size == ar->blockSize) {
+			blk->used = 0;
+			blk->last = 0;
+			*tail = blk;
+			tail = &blk->next;
+			nKept++;
+		} else {
+			Free(blk);
+		}
+	}
+	*tail = NULL;
+	ar->cur = ar->blocks;
+	for (i = 0; i < ar->nFree; i++) {
+		ar->free[i].n = 0;
+	}
+	AG_MutexUnlock(&ar->lock);
+}
+
+static void *
+AllocLocked(CAD_Arena *ar, size_t len)
+{
+	CAD_ArenaBlock *blk;
+	size_t size;
+
+	len = (len > 0) ? ARENA_ROUND(len) : CAD_ARENA_ALIGN;
+	while ((blk = ar->cur) != NULL) {
+		if (blk->size - blk->used >= len) {
+			blk->last = blk->used;
+			blk->used += len;
+			return (ARENA_DATA(blk) + blk->last);
+		}
+		if (blk->next == NULL) {
+			break;
+		}
+		ar->cur = blk->next;			/* Spare block */
+	}
+
+	/* Oversized requests get a block of their own. */
+	size = (len > ar->blockSize) ? len : ar->blockSize;
+	blk = Malloc(ARENA_HDR + size);
+	blk->size = size;
+	blk->used = len;
+	blk->last = 0;
+	if (ar->cur != NULL) {
+		blk->next = ar->cur->next;
+		ar->cur->next = blk;
+	} else {
+		blk->next = ar->blocks;
+		ar->blocks = blk;
+	}
+	ar->cur = blk;
+	return (ARENA_DATA(blk));
+}
+
+/* Allocate len bytes. The memory is valid until the next reset. */
+void *
+CAD_ArenaAlloc(CAD_Arena *ar, size_t len)
+{
+	void *p;
+
+	AG_MutexLock(&ar->lock);
+	p = AllocLocked(ar, len);
+	AG_MutexUnlock(&ar->lock);
+	return (p);
+}
+
+/*
+ * Resize an allocation. The last allocation of the current block is
+ * resized in place when possible; otherwise the data is copied.
+ */
+void *
+CAD_ArenaRealloc(CAD_Arena *ar, void *p, size_t oldLen, size_t len)
+{
+	CAD_ArenaBlock *blk;
+	void *pNew;
+
+	AG_MutexLock(&ar->lock);
+	if (p == NULL) {
+		pNew = AllocLocked(ar, len);
+		goto out;
+	}
+	if ((blk = ar->cur) != NULL &&
+	    (Uint8 *)p == ARENA_DATA(blk) + blk->last &&
+	    blk->size - blk->last >= ARENA_ROUND(len)) {
+		blk->used = blk->last + ARENA_ROUND(len);
+		pNew = p;
+		goto out;
+	}
+	pNew = AllocLocked(ar, len);
+	memcpy(pNew, p, (oldLen < len) ? oldLen : len);
+out:
+	AG_MutexUnlock(&ar->lock);
+	return (pNew);
+}
+
+/*
+ * Release an allocation. Only the last allocation of the current block
+ * is actually reclaimed; anything else is recovered on reset.
+ */
+void
+CAD_ArenaFree(CAD_Arena *ar, void *p, size_t len)
+{
+	CAD_ArenaBlock *blk;
+
+	AG_MutexLock(&ar->lock);
+	if ((blk = ar->cur) != NULL &&
+	    (Uint8 *)p == ARENA_DATA(blk) + blk->last &&
+	    blk->used == blk->last + ARENA_ROUND(len)) {
+		blk->used = blk->last;
+	}
+	AG_MutexUnlock(&ar->lock);
+}
+
+static CAD_ArenaSlots *
+GetSlots(CAD_Arena *ar, size_t size)
+{
+	CAD_ArenaSlots *sl;
+	Uint i;
+
+	for (i = 0; i < ar->nFree; i++) {
+		if (ar->free[i].size == size)
+			return (&ar->free[i]);
+	}
+	ar->free = Realloc(ar->free, (ar->nFree+1)*sizeof(CAD_ArenaSlots));
+	sl = &ar->free[ar->nFree++];
+	sl->size = size;
+	sl->slots = NULL;
+	sl->n = 0;
+	sl->max = 0;
+	return (sl);
+}
+
+/* Allocate an object, reusing one released by CAD_ArenaFreeObj(). */
+void *
+CAD_ArenaAllocObj(CAD_Arena *ar, size_t size)
+{
+	CAD_ArenaSlots *sl;
+	void *p;
+
+	AG_MutexLock(&ar->lock);
+	sl = GetSlots(ar, ARENA_ROUND(size));
+	if (sl->n > 0) {
+		p = sl->slots[--sl->n];
+	} else {
+		p = AllocLocked(ar, size);
+	}
+	AG_MutexUnlock(&ar->lock);
+	memset(p, 0, size);
+	return (p);
+}
+
+/* Make an object allocated with CAD_ArenaAllocObj() available for reuse. */
+void
+CAD_ArenaFreeObj(CAD_Arena *ar, void *p, size_t size)
+{
+	CAD_ArenaSlots *sl;
+
+	AG_MutexLock(&ar->lock);
+	sl = GetSlots(ar, ARENA_ROUND(size));
+	if (sl->n+1 > sl->max) {
+		sl->max = (sl->max > 0) ? sl->max*2 : 16;
+		sl->slots = Realloc(sl->slots, sl->max*sizeof(void *));
+	}
+	sl->slots[sl->n++] = p;
+	AG_MutexUnlock(&ar->lock);
+}
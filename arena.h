@@ -0,0 +1,50 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_ARENA_H_
+#define _CADTOOLS_ARENA_H_
+
+#include "begin_code.h"
+
+#define CAD_ARENA_ALIGN		16		/* Alignment of allocations */
+#define CAD_ARENA_KEEP		4		/* Blocks retained on reset */
+
+typedef struct cad_arena_block {
+	struct cad_arena_block *next;
+	size_t size;				/* Usable size */
+	size_t used;				/* Allocated bytes */
+	size_t last;				/* Offset of last allocation */
+} CAD_ArenaBlock;
+
+/* Released objects of a given size, available for reuse. */
+typedef struct cad_arena_slots {
+	size_t size;
+	void **slots;
+	Uint n, max;
+} CAD_ArenaSlots;
+
+/*
+ * Region allocator. Memory is handed out from large blocks and returned
+ * all at once by CAD_ArenaReset() or CAD_ArenaDestroy().
+ */
+typedef struct cad_arena {
+	AG_Mutex lock;
+	CAD_ArenaBlock *blocks;			/* Blocks in use, then spares */
+	CAD_ArenaBlock *cur;			/* Block being filled */
+	size_t blockSize;			/* Default block size */
+	CAD_ArenaSlots *free;			/* Released objects by size */
+	Uint nFree;
+} CAD_Arena;
+
+__BEGIN_DECLS
+void	 CAD_ArenaInit(CAD_Arena *, size_t);
+void	 CAD_ArenaDestroy(CAD_Arena *);
+void	 CAD_ArenaReset(CAD_Arena *);
+void	*CAD_ArenaAlloc(CAD_Arena *, size_t);
+void	*CAD_ArenaRealloc(CAD_Arena *, void *, size_t, size_t);
+void	 CAD_ArenaFree(CAD_Arena *, void *, size_t);
+void	*CAD_ArenaAllocObj(CAD_Arena *, size_t);
+void	 CAD_ArenaFreeObj(CAD_Arena *, void *, size_t);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_ARENA_H_ */
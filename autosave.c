@@ -0,0 +1,671 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Autosave of documents with unsaved changes. At a regular interval, the
+ * datasets of modified documents are serialized on the GUI thread into
+ * memory buffers, since objects are edited in place by widgets bound to
+ * their fields and cannot be read from another thread. The imported
+ * geometry of a part, which can be much larger, is not copied: the
+ * snapshot holds its arrays with CAD_MeshAcquire(), and the owner only
+ * makes a copy if it modifies them before the snapshot is written. The
+ * snapshots are written out (including the serialization of the geometry)
+ * by a job on the pool, each file being written under a temporary name
+ * and renamed into place.
+ *
+ * Autosave files are kept next to the archive of the document, or in the
+ * save directory for documents which have never been saved. They are
+ * listed in an index, which is used on startup to offer the recovery of
+ * the documents of a session which did not exit cleanly.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cadtools.h"
+
+#define AUTOSAVE_EXT	".autosave"
+
+Uint cadAutosaveInterval = CAD_AUTOSAVE_INTERVAL;
+
+static CAD_Autosave cadAutosave;
+
+/* Write a file under a temporary name and move it into place. */
+static int
+WriteFileAtomic(const char *path, const void *data, size_t len)
+{
+	char tmpPath[AG_PATHNAME_MAX];
+	AG_DataSource *ds;
+
+	Strlcpy(tmpPath, path, sizeof(tmpPath));
+	Strlcat(tmpPath, ".new", sizeof(tmpPath));
+	if ((ds = AG_OpenFile(tmpPath, "wb")) == NULL) {
+		return (-1);
+	}
+	if (AG_Write(ds, data, len) == -1) {
+		AG_CloseFile(ds);
+		AG_FileDelete(tmpPath);
+		return (-1);
+	}
+	AG_CloseFile(ds);
+	if (rename(tmpPath, path) == -1) {
+		AG_SetError("%s: %s", path, strerror(errno));
+		AG_FileDelete(tmpPath);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Return the path of the autosave file of a document, based on its
+ * archive path or its name if it has never been saved.
+ */
+static void
+AutosavePath(AG_Object *obj, const char *archive, char *path, size_t len)
+{
+	char *c;
+	size_t start;
+
+	if (archive[0] != '\0') {
+		Strlcpy(path, archive, len);
+	} else {
+		AG_GetString(agConfig, "save-path", path, len);
+		Strlcat(path, AG_PATHSEP, len);
+		start = strlen(path);
+		Strlcat(path, obj->name, len);
+		for (c = &path[start]; *c != '\0'; c++) {
+			if (*c == '/' || *c == '\\')
+				*c = '_';
+		}
+	}
+	Strlcat(path, AUTOSAVE_EXT, len);
+}
+
+/*
+ * Serialize an object into a snapshot. With type 0, the whole object is
+ * serialized as by AG_ObjectSave(); otherwise only its dataset is, for
+ * storage in a .part container. The memory buffer is kept as-is until
+ * the snapshot is written.
+ */
+static int
+SnapDataset(CAD_AutosaveSnap *snap, Uint32 type, void *p)
+{
+	AG_Object *obj = p;
+	CAD_AutosaveChunk *ch;
+	AG_DataSource *ds;
+	int rv;
+
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	if (type != 0) {
+		rv = CAD_ObjectWriteDataset(ds, obj);
+	} else {
+		rv = AG_ObjectSerialize(obj, ds);
+	}
+	if (rv == -1) {
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	snap->chunks = Realloc(snap->chunks,
+	    (snap->nChunks+1)*sizeof(CAD_AutosaveChunk));
+	ch = &snap->chunks[snap->nChunks++];
+	ch->type = type;
+	Strlcpy(ch->name, obj->name, sizeof(ch->name));
+	Strlcpy(ch->cls, obj->cls->hier, sizeof(ch->cls));
+	ch->ds = ds;
+	return (0);
+}
+
+/* Release a snapshot (may be called from the autosave job). */
+static void
+FreeSnap(CAD_AutosaveSnap *snap)
+{
+	Uint i;
+
+	for (i = 0; i < snap->nChunks; i++) {
+		AG_CloseAutoCore(snap->chunks[i].ds);
+	}
+	Free(snap->chunks);
+	if (snap->meshPin != NULL) {
+		CAD_MeshRelease(snap->meshPin);
+	}
+	if (snap->progText != NULL) {
+		CAM_ProgramReleaseText(snap->progText);
+	}
+	Free(snap);
+}
+
+/*
+ * Capture the state of a document. The imported geometry of a part is
+ * only included if it differs from the one in its archive, in which case
+ * its arrays are held rather than copied. The text of a program is also
+ * held, and serialized by the job.
+ */
+static CAD_AutosaveSnap *
+Snapshot(AG_Object *obj, const char *archive, const char *path)
+{
+	CAD_AutosaveSnap *snap;
+
+	snap = Malloc(sizeof(CAD_AutosaveSnap));
+	Strlcpy(snap->path, path, sizeof(snap->path));
+	snap->isPart = 0;
+	snap->chunks = NULL;
+	snap->nChunks = 0;
+	snap->meshPin = NULL;
+	snap->progText = NULL;
+
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		CAD_Part *part = (CAD_Part *)obj;
+		CAD_Feature *ft;
+
+		snap->isPart = 1;
+		if (SnapDataset(snap, CAD_CHUNK_INFO, part) == -1) {
+			goto fail;
+		}
+		TAILQ_FOREACH(ft, &part->features, features) {
+			if (ft->ndepNames > 0) {
+				CAD_FeatureResolveDeps(ft, part);
+			}
+			if (SnapDataset(snap, CAD_CHUNK_FEAT, ft) == -1)
+				goto fail;
+		}
+		if (!(part->flags & CAD_PART_NOMESH) && part->base.nv > 0 &&
+		    (part->file == NULL ||
+		     (part->flags & CAD_PART_MESH_DIRTY) ||
+		     strcmp(part->file->path, archive) != 0)) {
+			snap->meshPin = CAD_MeshAcquire(&part->base,
+			    &snap->mesh);
+		}
+	} else if (AG_OfClass(obj, "CAM_Program:*")) {
+		CAM_Program *prog = (CAM_Program *)obj;
+
+		Strlcpy(snap->progName, obj->name, sizeof(snap->progName));
+		snap->progType = prog->type;
+		snap->progFlags = prog->flags;
+		snap->progText = CAM_ProgramHoldText(prog);
+	} else {
+		if (SnapDataset(snap, 0, obj) == -1)
+			goto fail;
+	}
+	return (snap);
+fail:
+	FreeSnap(snap);
+	return (NULL);
+}
+
+/* Write out a snapshot (called from the autosave job). */
+static int
+WriteSnap(CAD_AutosaveSnap *snap)
+{
+	CAD_PartWriter w;
+	CAD_PartFile *pf;
+	CAD_AutosaveChunk *ch;
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+	Uint i;
+	int rv;
+
+	if (snap->progText != NULL) {
+		if ((ds = AG_OpenAutoCore()) == NULL) {
+			return (-1);
+		}
+		rv = CAM_ProgramSerialize(snap->progName, snap->progType,
+		    snap->progFlags, snap->progText, ds);
+		snap->progText = NULL;
+		if (rv == 0) {
+			cs = AG_CORE_SOURCE(ds);
+			rv = WriteFileAtomic(snap->path, cs->data, cs->size);
+		}
+		AG_CloseAutoCore(ds);
+		return (rv);
+	}
+	if (!snap->isPart) {
+		cs = AG_CORE_SOURCE(snap->chunks[0].ds);
+		return WriteFileAtomic(snap->path, cs->data, cs->size);
+	}
+	if (CAD_PartWriterOpen(&w, snap->path) == -1) {
+		return (-1);
+	}
+	for (i = 0; i < snap->nChunks; i++) {
+		ch = &snap->chunks[i];
+		cs = AG_CORE_SOURCE(ch->ds);
+		if (CAD_PartWriterChunk(&w, ch->type, ch->name, ch->cls,
+		    cs->data, cs->size) == -1)
+			goto fail;
+	}
+	if (snap->meshPin != NULL &&
+	    CAD_PartWriterMesh(&w, CAD_CHUNK_MESH, "base", &snap->mesh) == -1) {
+		goto fail;
+	}
+	if ((pf = CAD_PartWriterCommit(&w)) == NULL) {
+		return (-1);
+	}
+	CAD_PartFileClose(pf);
+	return (0);
+fail:
+	CAD_PartWriterAbort(&w);
+	return (-1);
+}
+
+static void
+AutosaveJob(void *p)
+{
+	CAD_Autosave *as = p;
+	CAD_AutosaveSnap *snap, *snapNext;
+	char errMsg[256];
+
+	errMsg[0] = '\0';
+	for (snap = as->snaps; snap != NULL; snap = snapNext) {
+		snapNext = snap->next;
+		if (WriteSnap(snap) == -1) {
+			Strlcpy(errMsg, AG_GetError(), sizeof(errMsg));
+		}
+		FreeSnap(snap);
+	}
+	as->snaps = NULL;
+
+	if (as->idx[0] == '\0') {
+		AG_FileDelete(as->idxPath);
+	} else if (WriteFileAtomic(as->idxPath, as->idx, strlen(as->idx))
+	    == -1) {
+		Strlcpy(errMsg, AG_GetError(), sizeof(errMsg));
+	}
+	Free(as->idx);
+	as->idx = NULL;
+
+	AG_MutexLock(&as->lock);
+	Strlcpy(as->errMsg, errMsg, sizeof(as->errMsg));
+	as->status = CAD_AUTOSAVE_DONE;
+	AG_MutexUnlock(&as->lock);
+}
+
+/* Wait for the autosave job and release it. */
+static void
+FinishJob(CAD_Autosave *as)
+{
+	CAD_JobGroupWait(&as->group);
+	CAD_JobGroupDestroy(&as->group);
+	as->status = CAD_AUTOSAVE_IDLE;
+	if (as->errMsg[0] != '\0')
+		Verbose("autosave: %s\n", as->errMsg);
+}
+
+static void
+IndexEntries(char *idx, size_t len, const CAD_AutosaveEntry *ents, Uint n)
+{
+	Uint i;
+
+	for (i = 0; i < n; i++) {
+		Strlcat(idx, ents[i].cls, len);
+		Strlcat(idx, "\t", len);
+		Strlcat(idx, ents[i].name, len);
+		Strlcat(idx, "\t", len);
+		Strlcat(idx, ents[i].path, len);
+		Strlcat(idx, "\t", len);
+		Strlcat(idx, ents[i].archive, len);
+		Strlcat(idx, "\n", len);
+	}
+}
+
+/*
+ * Generate the recovery index: one line per autosave file, with the
+ * class, name, autosave path and archive path of the document.
+ */
+static char *
+MakeIndex(CAD_Autosave *as)
+{
+	char *idx;
+	size_t len = 1;
+
+	len += (as->nEnts + as->nRecover)*sizeof(CAD_AutosaveEntry);
+	idx = Malloc(len);
+	idx[0] = '\0';
+	IndexEntries(idx, len, as->ents, as->nEnts);
+	IndexEntries(idx, len, as->recover, as->nRecover);
+	return (idx);
+}
+
+static CAD_AutosaveEntry *
+FindEntry(CAD_Autosave *as, void *obj)
+{
+	Uint i;
+
+	for (i = 0; i < as->nEnts; i++) {
+		if (as->ents[i].obj == obj)
+			return (&as->ents[i]);
+	}
+	return (NULL);
+}
+
+/* Forget recovery entries superseded by an autosave of this session. */
+static void
+DropRecovered(CAD_Autosave *as, const char *path)
+{
+	Uint i;
+
+	for (i = 0; i < as->nRecover; ) {
+		if (strcmp(as->recover[i].path, path) == 0) {
+			memmove(&as->recover[i], &as->recover[i+1],
+			    (as->nRecover-i-1)*sizeof(CAD_AutosaveEntry));
+			as->nRecover--;
+		} else {
+			i++;
+		}
+	}
+}
+
+static Uint32
+AutosaveTick(AG_Timer *to, AG_Event *event)
+{
+	CAD_Autosave *as = AG_PTR(1);
+	CAD_AutosaveSnap *snap, *snaps = NULL;
+	CAD_AutosaveEntry *ent;
+	CAD_Generation *g;
+	AG_Object *obj;
+	char archive[AG_PATHNAME_MAX], path[AG_PATHNAME_MAX];
+	int status;
+	Uint i;
+
+	AG_MutexLock(&as->lock);
+	status = as->status;
+	AG_MutexUnlock(&as->lock);
+	if (status == CAD_AUTOSAVE_RUNNING) {
+		return (to->ival);
+	} else if (status == CAD_AUTOSAVE_DONE) {
+		FinishJob(as);
+	}
+
+	/* Forget documents which have been saved, closed or discarded. */
+	for (i = 0; i < as->nEnts; ) {
+		ent = &as->ents[i];
+		AGOBJECT_FOREACH_CHILD(obj, &vfsRoot, ag_object) {
+			if (obj == ent->obj)
+				break;
+		}
+		if (obj != NULL && CAD_ObjectChanged(obj)) {
+			i++;
+			continue;
+		}
+		AG_FileDelete(ent->path);
+		memmove(ent, &as->ents[i+1],
+		    (as->nEnts-i-1)*sizeof(CAD_AutosaveEntry));
+		as->nEnts--;
+		as->reindex = 1;
+	}
+
+	/* Capture documents modified since their last snapshot. */
+	AGOBJECT_FOREACH_CHILD(obj, &vfsRoot, ag_object) {
+		if ((g = CAD_ObjectGeneration(obj)) == NULL ||
+		    g->gen == g->genSaved) {
+			continue;
+		}
+		if ((ent = FindEntry(as, obj)) != NULL && ent->gen == g->gen) {
+			continue;
+		}
+		archive[0] = '\0';
+		if (AG_Defined(obj, "archive-path")) {
+			AG_GetString(obj, "archive-path", archive,
+			    sizeof(archive));
+		}
+		AutosavePath(obj, archive, path, sizeof(path));
+		if ((snap = Snapshot(obj, archive, path)) == NULL) {
+			Verbose("%s: autosave: %s\n", obj->name, AG_GetError());
+			continue;
+		}
+		snap->next = snaps;
+		snaps = snap;
+
+		if (ent == NULL) {
+			as->ents = Realloc(as->ents,
+			    (as->nEnts+1)*sizeof(CAD_AutosaveEntry));
+			ent = &as->ents[as->nEnts++];
+			ent->obj = obj;
+			ent->path[0] = '\0';
+		} else if (strcmp(ent->path, path) != 0) {
+			AG_FileDelete(ent->path);	/* Renamed */
+		}
+		ent->gen = g->gen;
+		Strlcpy(ent->cls, obj->cls->hier, sizeof(ent->cls));
+		Strlcpy(ent->name, obj->name, sizeof(ent->name));
+		Strlcpy(ent->path, path, sizeof(ent->path));
+		Strlcpy(ent->archive, archive, sizeof(ent->archive));
+		DropRecovered(as, path);
+		as->reindex = 1;
+	}
+	if (!as->reindex) {
+		return (to->ival);
+	}
+	as->reindex = 0;
+
+	as->snaps = snaps;
+	as->idx = MakeIndex(as);
+	as->status = CAD_AUTOSAVE_RUNNING;
+	CAD_JobGroupInit(&as->group);
+	CAD_JobSubmit(&as->group, AutosaveJob, as);
+	return (to->ival);
+}
+
+/* Loader (see CAD_ImportStart()) for a document recovered from autosave. */
+static int
+LoadAutosave(CAD_Import *imp)
+{
+	CAD_AutosaveEntry *ent = imp->arg;
+	AG_ObjectClass *cls;
+	AG_Object *obj;
+	int rv = -1;
+
+	if ((cls = AG_LookupClass(ent->cls)) == NULL ||
+	    (obj = AG_ObjectNew(NULL, NULL, cls)) == NULL) {
+		goto out;
+	}
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		rv = CAD_PartRecover((CAD_Part *)obj, imp->path,
+		    (ent->archive[0] != '\0') ? ent->archive : NULL);
+	} else {
+		rv = AG_ObjectLoadFromFile(obj, imp->path);
+	}
+	if (rv == -1) {
+		AG_ObjectDestroy(obj);
+		goto out;
+	}
+	if (ent->archive[0] != '\0') {
+		AG_SetString(obj, "archive-path", ent->archive);
+	}
+	AG_ObjectSetNameS(obj, ent->name);
+	CAD_ObjectModified(obj);
+	snprintf(imp->info, sizeof(imp->info),
+	    _("Recovered unsaved changes to %s"), ent->name);
+	imp->obj = obj;
+out:
+	Free(ent);
+	return (rv);
+}
+
+static void
+RecoverDocuments(AG_Event *event)
+{
+	CAD_Autosave *as = AG_PTR(1);
+	AG_Window *win = AG_PTR(2);
+	CAD_AutosaveEntry *ent;
+	Uint i;
+
+	for (i = 0; i < as->nRecover; i++) {
+		if (strncmp(as->recover[i].cls, "SK", 2) == 0) {
+			CAD_InitSketches();
+		}
+		ent = Malloc(sizeof(CAD_AutosaveEntry));
+		memcpy(ent, &as->recover[i], sizeof(CAD_AutosaveEntry));
+		CAD_ImportStart(ent->path, LoadAutosave, ent);
+	}
+	as->recoverAsked = 1;
+	AG_ObjectDetach(win);
+}
+
+static void
+DiscardRecovery(AG_Event *event)
+{
+	CAD_Autosave *as = AG_PTR(1);
+	AG_Window *win = AG_PTR(2);
+	Uint i;
+
+	for (i = 0; i < as->nRecover; i++) {
+		AG_FileDelete(as->recover[i].path);
+	}
+	Free(as->recover);
+	as->recover = NULL;
+	as->nRecover = 0;
+	as->recoverAsked = 1;
+	as->reindex = 1;
+	AG_ObjectDetach(win);
+}
+
+/* Read the recovery index left by a previous session. */
+static void
+LoadIndex(CAD_Autosave *as)
+{
+	char line[AG_OBJECT_HIER_MAX + AG_OBJECT_NAME_MAX + AG_PATHNAME_MAX*2];
+	char *s, *c, *cls, *name, *path, *archive;
+	CAD_AutosaveEntry *ent;
+	FILE *f;
+
+	if ((f = fopen(as->idxPath, "r")) == NULL) {
+		return;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((c = strchr(line, '\n')) != NULL) {
+			*c = '\0';
+		}
+		s = line;
+		cls = AG_Strsep(&s, "\t");
+		name = AG_Strsep(&s, "\t");
+		path = AG_Strsep(&s, "\t");
+		archive = AG_Strsep(&s, "\t");
+		if (archive == NULL || AG_FileExists(path) != 1) {
+			continue;
+		}
+		as->recover = Realloc(as->recover,
+		    (as->nRecover+1)*sizeof(CAD_AutosaveEntry));
+		ent = &as->recover[as->nRecover++];
+		ent->obj = NULL;
+		ent->gen = 0;
+		Strlcpy(ent->cls, cls, sizeof(ent->cls));
+		Strlcpy(ent->name, name, sizeof(ent->name));
+		Strlcpy(ent->path, path, sizeof(ent->path));
+		Strlcpy(ent->archive, archive, sizeof(ent->archive));
+	}
+	fclose(f);
+}
+
+/*
+ * Start the autosave service. If documents were left unsaved by a
+ * previous session, offer to recover them.
+ */
+void
+CAD_AutosaveInit(void)
+{
+	CAD_Autosave *as = &cadAutosave;
+	AG_Button *bOpts[2];
+	AG_Window *wDlg;
+
+	AG_MutexInit(&as->lock);
+	as->status = CAD_AUTOSAVE_IDLE;
+	as->errMsg[0] = '\0';
+	AG_GetString(agConfig, "save-path", as->idxPath, sizeof(as->idxPath));
+	Strlcat(as->idxPath, AG_PATHSEP "autosave.idx", sizeof(as->idxPath));
+	as->ents = NULL;
+	as->nEnts = 0;
+	as->recover = NULL;
+	as->nRecover = 0;
+	as->recoverAsked = 0;
+	as->reindex = 0;
+	as->snaps = NULL;
+	as->idx = NULL;
+	AG_InitTimer(&as->timer, "autosave", 0);
+
+	LoadIndex(as);
+	if (as->nRecover > 0) {
+		wDlg = AG_TextPromptOptions(bOpts, 2,
+		    _("%u document(s) with unsaved changes were left by a "
+		      "previous session. Recover them?"), as->nRecover);
+		AG_ButtonText(bOpts[0], _("Recover"));
+		AG_SetEvent(bOpts[0], "button-pushed", RecoverDocuments,
+		    "%p,%p", as, wDlg);
+		AG_WidgetFocus(bOpts[0]);
+		AG_ButtonText(bOpts[1], _("Discard"));
+		AG_SetEvent(bOpts[1], "button-pushed", DiscardRecovery,
+		    "%p,%p", as, wDlg);
+	} else {
+		as->recoverAsked = 1;
+	}
+	if (cadAutosaveInterval > 0) {
+		AG_AddTimer(&vfsRoot, &as->timer, cadAutosaveInterval*1000,
+		    AutosaveTick, "%p", as);
+	}
+}
+
+/*
+ * Stop the autosave service on exit. Changes which have not been saved
+ * by now were discarded by the user, so the autosave files are removed
+ * (except for those of a previous session the user has not been asked
+ * about yet).
+ */
+void
+CAD_AutosaveDestroy(void)
+{
+	CAD_Autosave *as = &cadAutosave;
+	Uint i;
+
+	if (cadAutosaveInterval > 0) {
+		AG_DelTimer(&vfsRoot, &as->timer);
+	}
+	if (as->status != CAD_AUTOSAVE_IDLE) {
+		FinishJob(as);
+	}
+	for (i = 0; i < as->nEnts; i++) {
+		AG_FileDelete(as->ents[i].path);
+	}
+	as->nEnts = 0;
+	if (as->recoverAsked) {
+		for (i = 0; i < as->nRecover; i++) {
+			AG_FileDelete(as->recover[i].path);
+		}
+		AG_FileDelete(as->idxPath);
+	} else {
+		as->idx = MakeIndex(as);
+		if (WriteFileAtomic(as->idxPath, as->idx, strlen(as->idx))
+		    == -1) {
+			Verbose("autosave: %s\n", AG_GetError());
+		}
+		Free(as->idx);
+	}
+	Free(as->ents);
+	Free(as->recover);
+	AG_MutexDestroy(&as->lock);
+}
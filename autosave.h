@@ -0,0 +1,72 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_AUTOSAVE_H_
+#define _CADTOOLS_AUTOSAVE_H_
+
+#include "begin_code.h"
+
+#define CAD_AUTOSAVE_INTERVAL	60		/* Default interval (seconds) */
+
+/* Serialized dataset captured in a snapshot. */
+typedef struct cad_autosave_chunk {
+	Uint32 type;				/* CAD_CHUNK_* */
+	char name[AG_OBJECT_NAME_MAX];
+	char cls[AG_OBJECT_HIER_MAX];
+	AG_DataSource *ds;			/* Memory buffer (AG_CoreSource) */
+} CAD_AutosaveChunk;
+
+/* State of a document captured for writing by the autosave job. */
+typedef struct cad_autosave_snap {
+	char path[AG_PATHNAME_MAX];		/* Autosave file */
+	int isPart;				/* Write as a .part container */
+	CAD_AutosaveChunk *chunks;		/* Datasets (or whole object) */
+	Uint nChunks;
+	CAD_Mesh mesh;				/* View of imported geometry */
+	CAD_MeshPin *meshPin;			/* Holds mesh (or NULL) */
+	CAM_ProgramText *progText;		/* Holds program (or NULL) */
+	char progName[AG_OBJECT_NAME_MAX];
+	enum cam_program_type progType;
+	Uint progFlags;
+	struct cad_autosave_snap *next;
+} CAD_AutosaveSnap;
+
+/* Autosaved document, as recorded in the recovery index. */
+typedef struct cad_autosave_entry {
+	void *obj;				/* Document (only compared) */
+	Uint32 gen;				/* Generation captured */
+	char cls[AG_OBJECT_HIER_MAX];		/* Document class */
+	char name[AG_OBJECT_NAME_MAX];		/* Document name */
+	char path[AG_PATHNAME_MAX];		/* Autosave file */
+	char archive[AG_PATHNAME_MAX];		/* Document file (or "") */
+} CAD_AutosaveEntry;
+
+/* Autosave service. */
+typedef struct cad_autosave {
+	AG_Mutex lock;
+	int status;				/* Autosave job status */
+#define CAD_AUTOSAVE_IDLE	0
+#define CAD_AUTOSAVE_RUNNING	1
+#define CAD_AUTOSAVE_DONE	2
+	char errMsg[256];			/* Last error from job */
+	char idxPath[AG_PATHNAME_MAX];		/* Recovery index */
+	CAD_AutosaveEntry *ents;		/* Documents of this session */
+	Uint nEnts;
+	CAD_AutosaveEntry *recover;		/* From a previous session */
+	Uint nRecover;
+	int recoverAsked;			/* User chose recover/discard */
+	int reindex;				/* Index needs rewriting */
+	CAD_AutosaveSnap *snaps;		/* Being written by job */
+	char *idx;				/* Index being written by job */
+	CAD_JobGroup group;
+	AG_Timer timer;
+} CAD_Autosave;
+
+__BEGIN_DECLS
+extern Uint cadAutosaveInterval;
+
+void	CAD_AutosaveInit(void);
+void	CAD_AutosaveDestroy(void);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_AUTOSAVE_H_ */
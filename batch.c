@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Batch mode. Documents given on the command line are processed without
+ * a display, one job per document on the job pool. Each job reports its
+ * own result; the exit status of the process is the highest status of
+ * all jobs.
+ *
+ * Features look up their source sketches among the open documents (see
+ * exboss.c). Sketches given on the command line are attached to vfsRoot
+ * before the jobs are started (and are processed by their own jobs as
+ * any other document); the job of a part loads the sketches it
+ * references which are not loaded yet from files of the same name next
+ * to the part.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "cadtools.h"
+#include "exboss.h"
+
+static AG_Mutex sketchLock;		/* For loading sketches in jobs */
+
+const char *cadBatchOpNames[] = {
+	"regen",
+	"validate",
+	"convert",
+	"export-ply",
+	"export-obj",
+	"render",
+	NULL
+};
+
+/* Return the operation named by s, or -1 if there is none. */
+int
+CAD_BatchOpLookup(const char *s)
+{
+	int i;
+
+	for (i = 0; i < CAD_BATCH_OP_LAST; i++) {
+		if (strcmp(cadBatchOpNames[i], s) == 0)
+			return (i);
+	}
+	return (-1);
+}
+
+/*
+ * Check the merged geometry of a part for out-of-range indices, invalid
+ * coordinates and degenerate triangles.
+ */
+static int
+ValidateMesh(CAD_BatchJob *job, const CAD_Mesh *m)
+{
+	Uint i, nDegen = 0;
+
+	for (i = 0; i < m->nv*3; i++) {
+		if (!isfinite(m->v[i])) {
+			AG_SetError(_("Vertex %u has invalid coordinates"),
+			    i/3);
+			return (-1);
+		}
+	}
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+
+		if (t[0] >= m->nv || t[1] >= m->nv || t[2] >= m->nv) {
+			AG_SetError(_("Triangle %u has invalid vertices"), i);
+			return (-1);
+		}
+		if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+			nDegen++;
+	}
+	snprintf(job->msg, sizeof(job->msg),
+	    _("valid, %u vertices, %u triangles (%u degenerate)"),
+	    m->nv, m->nt, nDegen);
+	return (0);
+}
+
+/* Export the geometry of a part next to its archive. */
+static int
+ExportPart(CAD_BatchJob *job, CAD_Part *part)
+{
+	char path[AG_PATHNAME_MAX], *ext;
+	const CAD_Mesh *m;
+	int rv;
+
+	Strlcpy(path, job->path, sizeof(path));
+	if ((ext = strrchr(path, '.')) != NULL) {
+		*ext = '\0';
+	}
+	if (CAD_PartRegen(part) == -1) {
+		return (-1);
+	}
+	m = CAD_PartMesh(part);
+	if (job->op == CAD_BATCH_EXPORT_PLY) {
+		Strlcat(path, ".ply", sizeof(path));
+		rv = CAD_MeshSavePLY(m, path, CAD_MESH_NORMALS|
+		    CAD_MESH_COLORS|CAD_MESH_TEXCOORDS, NULL);
+	} else {
+		Strlcat(path, ".obj", sizeof(path));
+		rv = CAD_MeshSaveOBJ(m, path, CAD_MESH_NORMALS, NULL);
+	}
+	if (rv == 0) {
+		snprintf(job->msg, sizeof(job->msg),
+		    _("exported %u triangles to %s"), m->nt, path);
+	}
+	return (rv);
+}
+
+/*
+ * Render the front, top and left views of a part (each scaled to fit)
+ * next to its archive.
+ */
+static int
+RenderViews(CAD_BatchJob *job, CAD_Part *part)
+{
+	static const char *cams[] = {
+		"CameraFront", "CameraTop", "CameraLeft"
+	};
+	static const char *sfx[] = { "-front.ppm", "-top.ppm", "-left.ppm" };
+	char base[AG_PATHNAME_MAX], path[AG_PATHNAME_MAX], *ext;
+	CAD_Image img;
+	int i, rv = -1;
+
+	Strlcpy(base, job->path, sizeof(base));
+	if ((ext = strrchr(base, '.')) != NULL) {
+		*ext = '\0';
+	}
+	if (CAD_PartRegen(part) == -1) {
+		return (-1);
+	}
+	CAD_ImageInit(&img, CAD_BATCH_IMAGE_SIZE, CAD_BATCH_IMAGE_SIZE);
+	for (i = 0; i < 3; i++) {
+		Strlcpy(path, base, sizeof(path));
+		Strlcat(path, sfx[i], sizeof(path));
+		if (CAD_RenderPart(&img, part, cams[i], CAD_RENDER_FIT) == -1 ||
+		    CAD_ImageSavePPM(&img, path) == -1)
+			goto out;
+	}
+	snprintf(job->msg, sizeof(job->msg),
+	    _("rendered %u triangles to %s-{front,top,left}.ppm"),
+	    CAD_PartMesh(part)->nt, base);
+	rv = 0;
+out:
+	CAD_ImageFree(&img);
+	return (rv);
+}
+
+/* Rewrite a document in the current format of its class. */
+static int
+ConvertDocument(CAD_BatchJob *job, AG_Object *obj)
+{
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		if (CAD_PartFileProbe(job->path)) {
+			Strlcpy(job->msg, _("already in current format"),
+			    sizeof(job->msg));
+			return (0);
+		}
+		if (CAD_PartRegen((CAD_Part *)obj) == -1 ||
+		    CAD_PartSave((CAD_Part *)obj, job->path) == -1)
+			return (-1);
+	} else {
+		if (AG_ObjectSaveToFile(obj, job->path) == -1)
+			return (-1);
+	}
+	Strlcpy(job->msg, _("converted"), sizeof(job->msg));
+	return (0);
+}
+
+static int
+RunOp(CAD_BatchJob *job, AG_Object *obj)
+{
+	CAD_Part *part;
+
+	if (job->op == CAD_BATCH_CONVERT) {
+		return ConvertDocument(job, obj);
+	}
+	if (!AG_OfClass(obj, "CAD_Part:*")) {
+		/* Loading is all there is to check for other documents. */
+		Strlcpy(job->msg, _("loaded"), sizeof(job->msg));
+		return (0);
+	}
+	part = (CAD_Part *)obj;
+
+	switch (job->op) {
+	case CAD_BATCH_REGEN:
+		if (CAD_PartRegen(part) == -1) {
+			return (-1);
+		}
+		snprintf(job->msg, sizeof(job->msg),
+		    _("regenerated, %u triangles"), CAD_PartMesh(part)->nt);
+		return (0);
+	case CAD_BATCH_VALIDATE:
+		if (CAD_PartRegen(part) == -1) {
+			return (-1);
+		}
+		return ValidateMesh(job, CAD_PartMesh(part));
+	case CAD_BATCH_EXPORT_PLY:
+	case CAD_BATCH_EXPORT_OBJ:
+		return ExportPart(job, part);
+	case CAD_BATCH_RENDER:
+		return RenderViews(job, part);
+	default:
+		break;
+	}
+	return (0);
+}
+
+/* Load a sketch and attach it to vfsRoot under the given name. */
+static int
+LoadSketch(const char *path, const char *name)
+{
+	AG_Object *sk;
+
+	if ((sk = CAD_LoadDocument(&skClass, path)) == NULL) {
+		return (-1);
+	}
+	AG_ObjectSetNameS(sk, name);
+	AG_ObjectAttach(&vfsRoot, sk);
+	return (0);
+}
+
+/*
+ * Load the sketches referenced by the features of a part which are not
+ * loaded yet, from files named after them (with or without the ".sk"
+ * extension) in the directory of the part. Jobs share the sketches, so
+ * this is serialized by sketchLock.
+ */
+static int
+LoadPartSketches(CAD_BatchJob *job, CAD_Part *part)
+{
+	char path[AG_PATHNAME_MAX], *c;
+	CAD_Feature *ft;
+	const char *skName;
+	size_t dirLen;
+	int rv = 0;
+
+	Strlcpy(path, job->path, sizeof(path));
+	if ((c = strrchr(path, AG_PATHSEPCHAR)) != NULL) {
+		c[1] = '\0';
+	} else {
+		path[0] = '\0';
+	}
+	dirLen = strlen(path);
+
+	AG_MutexLock(&sketchLock);
+	TAILQ_FOREACH(ft, &part->features, features) {
+		if (!AG_OfClass(ft, "CAD_Feature:CAD_ExtrudedBoss:*")) {
+			continue;
+		}
+		skName = ((CAD_ExtrudedBoss *)ft)->skName;
+		if (skName[0] == '\0' ||
+		    AG_ObjectFindChild(&vfsRoot, skName) != NULL) {
+			continue;
+		}
+		path[dirLen] = '\0';
+		Strlcat(path, skName, sizeof(path));
+		if (AG_FileExists(path) != 1) {
+			Strlcat(path, ".sk", sizeof(path));
+		}
+		if (AG_FileExists(path) != 1) {
+			AG_SetError(_("Sketch %s used by %s was not found; "
+			              "give it on the command line or place it "
+			              "next to the part"), skName,
+			              AGOBJECT(ft)->name);
+			rv = -1;
+			break;
+		}
+		if (LoadSketch(path, skName) == -1) {
+			rv = -1;
+			break;
+		}
+	}
+	AG_MutexUnlock(&sketchLock);
+	return (rv);
+}
+
+static void
+ReportJob(const CAD_BatchJob *job)
+{
+	if (job->status == CAD_BATCH_OK) {
+		printf("%s: %s\n", job->path, job->msg);
+	} else {
+		fprintf(stderr, "%s: %s\n", job->path, job->msg);
+	}
+}
+
+static void
+BatchJob(void *p)
+{
+	CAD_BatchJob *job = p;
+	AG_Object *obj;
+
+	if ((obj = CAD_LoadDocument(job->cls, job->path)) == NULL ||
+	    (AG_OfClass(obj, "CAD_Part:*") &&
+	     LoadPartSketches(job, (CAD_Part *)obj) == -1)) {
+		job->status = CAD_BATCH_ELOAD;
+		Strlcpy(job->msg, AG_GetError(), sizeof(job->msg));
+	} else if (RunOp(job, obj) == -1) {
+		job->status = CAD_BATCH_EOP;
+		Strlcpy(job->msg, AG_GetError(), sizeof(job->msg));
+	}
+	if (obj != NULL) {
+		AG_ObjectDestroy(obj);
+	}
+	ReportJob(job);
+}
+
+/*
+ * Apply an operation to a set of documents in parallel and return the
+ * exit status of the process.
+ */
+int
+CAD_BatchRun(enum cad_batch_op op, char **files, int nFiles)
+{
+	CAD_BatchJob *jobs;
+	CAD_JobGroup group;
+	int i, nFailed = 0, rv = CAD_BATCH_OK;
+
+	if (nFiles == 0) {
+		fprintf(stderr, "%s: No files to process\n", agProgName);
+		return (CAD_BATCH_EUSAGE);
+	}
+	jobs = Malloc(nFiles*sizeof(CAD_BatchJob));
+	for (i = 0; i < nFiles; i++) {
+		CAD_BatchJob *job = &jobs[i];
+
+		job->path = files[i];
+		job->op = op;
+		job->status = CAD_BATCH_OK;
+		job->msg[0] = '\0';
+		if ((job->cls = CAD_DocumentClass(files[i])) == NULL) {
+			job->status = CAD_BATCH_EUSAGE;
+			fprintf(stderr, "%s: %s\n", files[i],
+			    _("Unknown document type"));
+			continue;
+		}
+		if (job->cls == &cadPartClass) {
+			CAD_InitSketches();		/* Before any job */
+		}
+		if (job->cls == &skClass &&
+		    LoadSketch(files[i], AG_ShortFilename(files[i])) == -1) {
+			job->status = CAD_BATCH_ELOAD;
+			Strlcpy(job->msg, AG_GetError(), sizeof(job->msg));
+			ReportJob(job);
+		}
+	}
+
+	AG_MutexInit(&sketchLock);
+	CAD_JobGroupInit(&group);
+	for (i = 0; i < nFiles; i++) {
+		if (jobs[i].status == CAD_BATCH_OK)
+			CAD_JobSubmit(&group, BatchJob, &jobs[i]);
+	}
+	CAD_JobGroupWait(&group);
+	CAD_JobGroupDestroy(&group);
+	AG_MutexDestroy(&sketchLock);
+
+	for (i = 0; i < nFiles; i++) {
+		if (jobs[i].status != CAD_BATCH_OK) {
+			nFailed++;
+		}
+		if (jobs[i].status > rv)
+			rv = jobs[i].status;
+	}
+	printf("%s: %d file(s) processed, %d failed\n", cadBatchOpNames[op],
+	    nFiles, nFailed);
+	Free(jobs);
+	return (rv);
+}
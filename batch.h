@@ -0,0 +1,44 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_BATCH_H_
+#define _CADTOOLS_BATCH_H_
+
+#include "begin_code.h"
+
+/* Operations of batch mode. */
+enum cad_batch_op {
+	CAD_BATCH_REGEN,		/* Regenerate parts */
+	CAD_BATCH_VALIDATE,		/* Regenerate and check geometry */
+	CAD_BATCH_CONVERT,		/* Rewrite in the current format */
+	CAD_BATCH_EXPORT_PLY,		/* Export part geometry to PLY */
+	CAD_BATCH_EXPORT_OBJ,		/* Export part geometry to OBJ */
+	CAD_BATCH_RENDER,		/* Render standard views to PPM */
+	CAD_BATCH_OP_LAST
+};
+
+/* Exit status of a batch job; the process exits with the highest. */
+#define CAD_BATCH_OK		0
+#define CAD_BATCH_EUSAGE	1	/* Bad command line */
+#define CAD_BATCH_ELOAD		2	/* Failed to load document */
+#define CAD_BATCH_EOP		3	/* Operation failed */
+
+#define CAD_BATCH_IMAGE_SIZE	512	/* Size of rendered views */
+
+/* Processing of one document. */
+typedef struct cad_batch_job {
+	const char *path;
+	AG_ObjectClass *cls;		/* Document class */
+	enum cad_batch_op op;
+	int status;			/* Exit status */
+	char msg[256];			/* Result or error message */
+} CAD_BatchJob;
+
+__BEGIN_DECLS
+extern const char *cadBatchOpNames[];
+
+int	CAD_BatchOpLookup(const char *);
+int	CAD_BatchRun(enum cad_batch_op, char **, int);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_BATCH_H_ */
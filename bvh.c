@@ -0,0 +1,854 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bounding volume hierarchy over mesh triangles, for picking, distance
+ * and collision queries.
+ *
+ * The tree is built top-down with a binned surface area heuristic. A
+ * subtree over n triangles never uses more than 2n-1 nodes, so the node
+ * slots of both children of a split are known in advance: the left child
+ * follows its parent and the right child starts 2*nLeft-1 slots later.
+ * Large subtrees are therefore built in parallel by the job pool without
+ * any synchronization, at the cost of leaving unused slots in the array.
+ *
+ * After a change in geometry which preserves the number of triangles,
+ * the tree is refit (its boxes recomputed bottom-up) instead of rebuilt.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "cadtools.h"
+
+#define BVH_BINS		16	/* SAH bins per axis */
+#define BVH_LEAF_MAX		4	/* Max. triangles per leaf */
+#define BVH_COST_TRAVERSE	1.0f	/* SAH cost of an inner node */
+#define BVH_COST_INTERSECT	1.0f	/* SAH cost of a triangle test */
+#define BVH_PARALLEL_MIN	32768	/* Min. triangles to spawn a job */
+#define BVH_CHUNK		16384	/* Triangles per job (flat passes) */
+#define BVH_REFIT_DEGRADE	1.5f	/* Rebuild beyond this cost increase */
+#define BVH_DEPTH_MAX		64	/* Split by count below this depth */
+#define BVH_STACK_MAX		128
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+/* State shared by the build jobs. */
+typedef struct bvh_build {
+	CAD_BVH *bvh;
+	float *box;			/* Triangle bounds (min,max) */
+	CAD_JobGroup group;
+} BVHBuild;
+
+/* Subtree built by a job. */
+typedef struct bvh_task {
+	BVHBuild *b;
+	Uint32 node;
+	Uint begin, end;
+	Uint depth;
+} BVHTask;
+
+/* Range of triangles or nodes processed by a flat job. */
+typedef struct bvh_range {
+	CAD_BVH *bvh;
+	float *box;
+	Uint i1, i2;
+} BVHRange;
+
+void
+CAD_BVHInit(CAD_BVH *bvh)
+{
+	bvh->m = NULL;
+	bvh->nodes = NULL;
+	bvh->nNodes = 0;
+	bvh->tris = NULL;
+	bvh->nTris = 0;
+	bvh->cost = 0.0f;
+	bvh->flags = 0;
+}
+
+void
+CAD_BVHFree(CAD_BVH *bvh)
+{
+	Free(bvh->nodes);
+	Free(bvh->tris);
+	CAD_BVHInit(bvh);
+}
+
+static __inline__ float
+BoxArea(const float *min, const float *max)
+{
+	float dx = max[0]-min[0], dy = max[1]-min[1], dz = max[2]-min[2];
+
+	return (2.0f*(dx*dy + dy*dz + dz*dx));
+}
+
+static __inline__ void
+BoxEmpty(float *min, float *max)
+{
+	min[0] = min[1] = min[2] = FLT_MAX;
+	max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+static __inline__ void
+BoxGrow(float *min, float *max, const float *bmin, const float *bmax)
+{
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		if (bmin[k] < min[k]) { min[k] = bmin[k]; }
+		if (bmax[k] > max[k]) { max[k] = bmax[k]; }
+	}
+}
+
+/* Compute the bounds of a triangle. */
+static __inline__ void
+TriBounds(const CAD_Mesh *m, Uint32 t, float *min, float *max)
+{
+	const Uint32 *tri = &m->tri[t*3];
+	const float *a = &m->v[tri[0]*3];
+	const float *b = &m->v[tri[1]*3];
+	const float *c = &m->v[tri[2]*3];
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = MIN(a[k], MIN(b[k], c[k]));
+		max[k] = MAX(a[k], MAX(b[k], c[k]));
+	}
+}
+
+/* Split count items into jobs running fn over [i1,i2) ranges. */
+static void
+RunRanges(CAD_BVH *bvh, float *box, Uint count, CAD_JobFn fn)
+{
+	CAD_JobGroup g;
+	BVHRange *jobs;
+	Uint n, per, i;
+
+	n = CAD_JobPoolThreads()*4;
+	if (count/n < BVH_CHUNK) {
+		n = count/BVH_CHUNK;
+	}
+	if (n <= 1) {
+		BVHRange r;
+
+		r.bvh = bvh;
+		r.box = box;
+		r.i1 = 0;
+		r.i2 = count;
+		fn(&r);
+		return;
+	}
+	per = count/n;
+	jobs = Malloc(n*sizeof(BVHRange));
+	CAD_JobGroupInit(&g);
+	for (i = 0; i < n; i++) {
+		jobs[i].bvh = bvh;
+		jobs[i].box = box;
+		jobs[i].i1 = i*per;
+		jobs[i].i2 = (i == n-1) ? count : (i+1)*per;
+		CAD_JobSubmit(&g, fn, &jobs[i]);
+	}
+	CAD_JobGroupWait(&g);
+	CAD_JobGroupDestroy(&g);
+	Free(jobs);
+}
+
+static void
+TriBoundsJob(void *arg)
+{
+	BVHRange *r = arg;
+	Uint i;
+
+	for (i = r->i1; i < r->i2; i++) {
+		TriBounds(r->bvh->m, i, &r->box[i*6], &r->box[i*6+3]);
+		r->bvh->tris[i] = i;
+	}
+}
+
+/*
+ * Find the best binned SAH split of a range along any axis. Returns -1
+ * if making a leaf is cheaper, otherwise sets the axis and the split
+ * position (in centroid space).
+ */
+static int
+FindSplit(const BVHBuild *b, Uint begin, Uint end, const float *nodeMin,
+    const float *nodeMax, int *axisOut, float *posOut)
+{
+	const Uint32 *tris = b->bvh->tris;
+	const float *box = b->box;
+	float cmin[3], cmax[3], best, leafCost;
+	Uint i, k, n = end - begin;
+	int axis, found = -1;
+
+	BoxEmpty(cmin, cmax);
+	for (i = begin; i < end; i++) {
+		const float *bb = &box[tris[i]*6];
+
+		for (k = 0; k < 3; k++) {
+			float c = (bb[k] + bb[k+3])*0.5f;
+
+			if (c < cmin[k]) { cmin[k] = c; }
+			if (c > cmax[k]) { cmax[k] = c; }
+		}
+	}
+	leafCost = BVH_COST_INTERSECT*n;
+	best = (n > BVH_LEAF_MAX) ? FLT_MAX : leafCost;
+
+	for (axis = 0; axis < 3; axis++) {
+		float binMin[BVH_BINS][3], binMax[BVH_BINS][3];
+		Uint binCount[BVH_BINS];
+		float lArea[BVH_BINS], lmin[3], lmax[3], rmin[3], rmax[3];
+		Uint lCount[BVH_BINS], nRight;
+		float ext = cmax[axis] - cmin[axis], scale;
+
+		if (ext <= 0.0f) {
+			continue;
+		}
+		scale = BVH_BINS/ext;
+		for (k = 0; k < BVH_BINS; k++) {
+			BoxEmpty(binMin[k], binMax[k]);
+			binCount[k] = 0;
+		}
+		for (i = begin; i < end; i++) {
+			const float *bb = &box[tris[i]*6];
+			float c = (bb[axis] + bb[axis+3])*0.5f;
+			Uint bin = (Uint)((c - cmin[axis])*scale);
+
+			if (bin >= BVH_BINS) { bin = BVH_BINS-1; }
+			binCount[bin]++;
+			BoxGrow(binMin[bin], binMax[bin], bb, bb+3);
+		}
+
+		/* Sweep from the left, then evaluate from the right. */
+		BoxEmpty(lmin, lmax);
+		for (k = 0, i = 0; k < BVH_BINS-1; k++) {
+			i += binCount[k];
+			if (binCount[k] > 0) {
+				BoxGrow(lmin, lmax, binMin[k], binMax[k]);
+			}
+			lCount[k] = i;
+			lArea[k] = (i > 0) ? BoxArea(lmin, lmax) : 0.0f;
+		}
+		BoxEmpty(rmin, rmax);
+		for (k = BVH_BINS-1, nRight = 0; k > 0; k--) {
+			float cost;
+
+			nRight += binCount[k];
+			if (binCount[k] > 0) {
+				BoxGrow(rmin, rmax, binMin[k], binMax[k]);
+			}
+			if (lCount[k-1] == 0 || nRight == 0) {
+				continue;
+			}
+			cost = BVH_COST_TRAVERSE + BVH_COST_INTERSECT*
+			    (lArea[k-1]*lCount[k-1] +
+			     BoxArea(rmin, rmax)*nRight) /
+			    BoxArea(nodeMin, nodeMax);
+			if (cost < best) {
+				best = cost;
+				*axisOut = axis;
+				*posOut = cmin[axis] + k/scale;
+				found = 0;
+			}
+		}
+	}
+	return (found);
+}
+
+/* Partition a range by centroid; returns the start of the right half. */
+static Uint
+Partition(BVHBuild *b, Uint begin, Uint end, int axis, float pos)
+{
+	Uint32 *tris = b->bvh->tris;
+	const float *box = b->box;
+	Uint i = begin, j = end;
+
+	while (i < j) {
+		const float *bb = &box[tris[i]*6];
+
+		if ((bb[axis] + bb[axis+3])*0.5f < pos) {
+			i++;
+		} else {
+			Uint32 tmp = tris[i];
+
+			tris[i] = tris[--j];
+			tris[j] = tmp;
+		}
+	}
+	if (i == begin || i == end) {		/* Degenerate; split evenly */
+		i = begin + (end - begin)/2;
+	}
+	return (i);
+}
+
+static void BuildTaskJob(void *);
+
+/* Build the subtree rooted at node over tris[begin..end). */
+static void
+BuildRange(BVHBuild *b, Uint32 node, Uint begin, Uint end, Uint depth)
+{
+	CAD_BVH *bvh = b->bvh;
+
+	for (;; depth++) {
+		CAD_BVHNode *nd = &bvh->nodes[node];
+		Uint i, mid;
+		float pos;
+		int axis;
+
+		BoxEmpty(nd->min, nd->max);
+		for (i = begin; i < end; i++) {
+			const float *bb = &b->box[bvh->tris[i]*6];
+
+			BoxGrow(nd->min, nd->max, bb, bb+3);
+		}
+		if (depth >= BVH_DEPTH_MAX ||
+		    FindSplit(b, begin, end, nd->min, nd->max, &axis, &pos)
+		    == -1) {
+			if (end - begin > BVH_LEAF_MAX) {
+				/*
+				 * All centroids coincide or the tree is too
+				 * deep (which would overflow the traversal
+				 * stacks); split by count.
+				 */
+				axis = -1;
+				mid = begin + (end - begin)/2;
+			} else {
+				nd->first = begin;
+				nd->count = end - begin;
+				return;
+			}
+		} else {
+			mid = Partition(b, begin, end, axis, pos);
+		}
+		nd->count = 0;
+		nd->first = node + 2*(mid - begin);
+
+		/* Build the left child in parallel if large enough. */
+		if (mid - begin >= BVH_PARALLEL_MIN) {
+			BVHTask *task;
+
+			task = Malloc(sizeof(BVHTask));
+			task->b = b;
+			task->node = node+1;
+			task->begin = begin;
+			task->end = mid;
+			task->depth = depth+1;
+			CAD_JobSubmit(&b->group, BuildTaskJob, task);
+		} else {
+			BuildRange(b, node+1, begin, mid, depth+1);
+		}
+		node = nd->first;
+		begin = mid;
+	}
+}
+
+static void
+BuildTaskJob(void *arg)
+{
+	BVHTask *task = arg;
+
+	BuildRange(task->b, task->node, task->begin, task->end, task->depth);
+	Free(task);
+}
+
+/* Compute the SAH cost of the tree, relative to the root area. */
+static float
+TreeCost(const CAD_BVH *bvh)
+{
+	const CAD_BVHNode *root = &bvh->nodes[0];
+	double sum = 0.0, rootArea = BoxArea(root->min, root->max);
+	Uint i;
+
+	if (rootArea <= 0.0) {
+		return (0.0f);
+	}
+	for (i = 0; i < bvh->nNodes; i++) {
+		const CAD_BVHNode *nd = &bvh->nodes[i];
+
+		if (nd->count == CAD_BVH_UNUSED) {
+			continue;
+		}
+		sum += BoxArea(nd->min, nd->max)*((nd->count > 0) ?
+		       BVH_COST_INTERSECT*nd->count : BVH_COST_TRAVERSE);
+	}
+	return (float)(sum/rootArea);
+}
+
+/* Build a hierarchy over the triangles of a mesh. */
+int
+CAD_BVHBuild(CAD_BVH *bvh, const CAD_Mesh *m)
+{
+	BVHBuild b;
+	CAD_BVHNode *nodes;
+	Uint32 *tris;
+	Uint nNodes = (m->nt > 0) ? m->nt*2 - 1 : 1;
+
+	if ((nodes = TryMalloc(nNodes*sizeof(CAD_BVHNode))) == NULL) {
+		return (-1);
+	}
+	if ((tris = TryMalloc((m->nt+1)*sizeof(Uint32))) == NULL) {
+		Free(nodes);
+		return (-1);
+	}
+	if ((b.box = TryMalloc(((size_t)m->nt*6+1)*sizeof(float))) == NULL) {
+		Free(tris);
+		Free(nodes);
+		return (-1);
+	}
+	CAD_BVHFree(bvh);
+	bvh->m = m;
+	bvh->nodes = nodes;
+	bvh->nNodes = nNodes;
+	bvh->tris = tris;
+	bvh->nTris = m->nt;
+	memset(nodes, 0xff, nNodes*sizeof(CAD_BVHNode));
+
+	if (m->nt == 0) {
+		BoxEmpty(nodes[0].min, nodes[0].max);
+		nodes[0].first = 0;
+		nodes[0].count = 0;
+		bvh->nTris = 0;
+		bvh->cost = 0.0f;
+		Free(b.box);
+		return (0);
+	}
+	RunRanges(bvh, b.box, m->nt, TriBoundsJob);
+
+	b.bvh = bvh;
+	CAD_JobGroupInit(&b.group);
+	BuildRange(&b, 0, 0, m->nt, 0);
+	CAD_JobGroupWait(&b.group);
+	CAD_JobGroupDestroy(&b.group);
+	Free(b.box);
+
+	bvh->cost = TreeCost(bvh);
+	bvh->flags &= ~(CAD_BVH_STALE);
+	return (0);
+}
+
+static void
+RefitLeavesJob(void *arg)
+{
+	BVHRange *r = arg;
+	CAD_BVH *bvh = r->bvh;
+	Uint i, j;
+
+	for (i = r->i1; i < r->i2; i++) {
+		CAD_BVHNode *nd = &bvh->nodes[i];
+
+		if (nd->count == 0 || nd->count == CAD_BVH_UNUSED) {
+			continue;
+		}
+		BoxEmpty(nd->min, nd->max);
+		for (j = 0; j < nd->count; j++) {
+			float bmin[3], bmax[3];
+
+			TriBounds(bvh->m, bvh->tris[nd->first + j], bmin, bmax);
+			BoxGrow(nd->min, nd->max, bmin, bmax);
+		}
+	}
+}
+
+/*
+ * Recompute the bounds of the hierarchy after the vertices of the mesh
+ * have moved. The mesh must still have the same number of triangles.
+ * Falls back to a full rebuild if the quality of the tree degrades too
+ * much.
+ */
+int
+CAD_BVHRefit(CAD_BVH *bvh)
+{
+	Uint i;
+
+	if (bvh->m == NULL || bvh->m->nt != bvh->nTris) {
+		AG_SetError(_("Triangle count has changed"));
+		return (-1);
+	}
+	if (bvh->nTris == 0) {
+		bvh->flags &= ~(CAD_BVH_STALE);
+		return (0);
+	}
+	RunRanges(bvh, NULL, bvh->nNodes, RefitLeavesJob);
+
+	/* Children always follow their parent. */
+	for (i = bvh->nNodes; i > 0; i--) {
+		CAD_BVHNode *nd = &bvh->nodes[i-1];
+		const CAD_BVHNode *l, *r;
+
+		if (nd->count != 0) {
+			continue;
+		}
+		l = &bvh->nodes[i];
+		r = &bvh->nodes[nd->first];
+		memcpy(nd->min, l->min, sizeof(nd->min));
+		memcpy(nd->max, l->max, sizeof(nd->max));
+		BoxGrow(nd->min, nd->max, r->min, r->max);
+	}
+	if (TreeCost(bvh) > bvh->cost*BVH_REFIT_DEGRADE) {
+		return CAD_BVHBuild(bvh, bvh->m);
+	}
+	bvh->flags &= ~(CAD_BVH_STALE);
+	return (0);
+}
+
+/*
+ * Queries.
+ */
+
+/* Slab test; returns the entry distance or -1 if the box is missed. */
+static __inline__ float
+RayBox(const CAD_BVHNode *nd, const float *org, const float *inv, float tMax)
+{
+	float t0 = 0.0f, t1 = tMax;
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		float tn = (nd->min[k] - org[k])*inv[k];
+		float tf = (nd->max[k] - org[k])*inv[k];
+
+		if (tn > tf) {
+			float tmp = tn;
+			tn = tf;
+			tf = tmp;
+		}
+		t0 = MAX(t0, tn);
+		t1 = MIN(t1, tf);
+		if (t0 > t1)
+			return (-1.0f);
+	}
+	return (t0);
+}
+
+/* Moller-Trumbore ray/triangle intersection. */
+static int
+RayTri(const CAD_Mesh *m, Uint32 t, const float *org, const float *dir,
+    float tMax, CAD_BVHHit *hit)
+{
+	const Uint32 *tri = &m->tri[t*3];
+	const float *a = &m->v[tri[0]*3];
+	const float *b = &m->v[tri[1]*3];
+	const float *c = &m->v[tri[2]*3];
+	float e1[3], e2[3], p[3], s[3], q[3], det, inv, u, v, d;
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		e1[k] = b[k] - a[k];
+		e2[k] = c[k] - a[k];
+	}
+	p[0] = dir[1]*e2[2] - dir[2]*e2[1];
+	p[1] = dir[2]*e2[0] - dir[0]*e2[2];
+	p[2] = dir[0]*e2[1] - dir[1]*e2[0];
+	det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+	if (det > -1e-12f && det < 1e-12f) {
+		return (0);
+	}
+	inv = 1.0f/det;
+	for (k = 0; k < 3; k++) {
+		s[k] = org[k] - a[k];
+	}
+	u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv;
+	if (u < 0.0f || u > 1.0f) {
+		return (0);
+	}
+	q[0] = s[1]*e1[2] - s[2]*e1[1];
+	q[1] = s[2]*e1[0] - s[0]*e1[2];
+	q[2] = s[0]*e1[1] - s[1]*e1[0];
+	v = (dir[0]*q[0] + dir[1]*q[1] + dir[2]*q[2])*inv;
+	if (v < 0.0f || u+v > 1.0f) {
+		return (0);
+	}
+	d = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv;
+	if (d < 0.0f || d >= tMax) {
+		return (0);
+	}
+	hit->tri = t;
+	hit->t = d;
+	hit->u = u;
+	hit->v = v;
+	return (1);
+}
+
+/*
+ * Find the nearest intersection of the ray org+t*dir (0 <= t < tMax) with
+ * the mesh. Returns 1 and fills in hit if found, 0 otherwise.
+ */
+int
+CAD_BVHRaycast(const CAD_BVH *bvh, const float *org, const float *dir,
+    float tMax, CAD_BVHHit *hit)
+{
+	Uint32 stack[BVH_STACK_MAX];
+	float inv[3];
+	Uint sp = 0, k;
+	int found = 0;
+
+	if (bvh->nTris == 0) {
+		return (0);
+	}
+	for (k = 0; k < 3; k++) {
+		inv[k] = (dir[k] != 0.0f) ? 1.0f/dir[k] :
+		         (dir[k] >= 0.0f ? FLT_MAX : -FLT_MAX);
+	}
+	if (RayBox(&bvh->nodes[0], org, inv, tMax) < 0.0f) {
+		return (0);
+	}
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const CAD_BVHNode *nd = &bvh->nodes[stack[--sp]];
+		Uint32 l, r;
+		float tl, tr;
+
+		if (nd->count > 0) {
+			for (k = 0; k < nd->count; k++) {
+				if (RayTri(bvh->m, bvh->tris[nd->first + k],
+				    org, dir, tMax, hit)) {
+					tMax = hit->t;
+					found = 1;
+				}
+			}
+			continue;
+		}
+		l = (Uint32)(nd - bvh->nodes) + 1;
+		r = nd->first;
+		tl = RayBox(&bvh->nodes[l], org, inv, tMax);
+		tr = RayBox(&bvh->nodes[r], org, inv, tMax);
+
+		/* Push the farther child first so the nearer one is visited. */
+		if (tl >= 0.0f && tr >= 0.0f) {
+			if (tl < tr) {
+				stack[sp++] = r;
+				stack[sp++] = l;
+			} else {
+				stack[sp++] = l;
+				stack[sp++] = r;
+			}
+		} else if (tl >= 0.0f) {
+			stack[sp++] = l;
+		} else if (tr >= 0.0f) {
+			stack[sp++] = r;
+		}
+	}
+	return (found);
+}
+
+/* Squared distance from p to a box. */
+static __inline__ float
+BoxDist2(const CAD_BVHNode *nd, const float *p)
+{
+	float d2 = 0.0f;
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		float d = 0.0f;
+
+		if (p[k] < nd->min[k]) {
+			d = nd->min[k] - p[k];
+		} else if (p[k] > nd->max[k]) {
+			d = p[k] - nd->max[k];
+		}
+		d2 += d*d;
+	}
+	return (d2);
+}
+
+/* Closest point on triangle abc to p (Ericson, Real-Time Collision Det.) */
+static void
+ClosestOnTri(const float *p, const float *a, const float *b, const float *c,
+    float *out)
+{
+	float ab[3], ac[3], ap[3], bp[3], cp[3];
+	float d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		ab[k] = b[k]-a[k];
+		ac[k] = c[k]-a[k];
+		ap[k] = p[k]-a[k];
+	}
+	d1 = ab[0]*ap[0] + ab[1]*ap[1] + ab[2]*ap[2];
+	d2 = ac[0]*ap[0] + ac[1]*ap[1] + ac[2]*ap[2];
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		memcpy(out, a, 3*sizeof(float));
+		return;
+	}
+	for (k = 0; k < 3; k++) { bp[k] = p[k]-b[k]; }
+	d3 = ab[0]*bp[0] + ab[1]*bp[1] + ab[2]*bp[2];
+	d4 = ac[0]*bp[0] + ac[1]*bp[1] + ac[2]*bp[2];
+	if (d3 >= 0.0f && d4 <= d3) {
+		memcpy(out, b, 3*sizeof(float));
+		return;
+	}
+	vc = d1*d4 - d3*d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		v = d1/(d1 - d3);
+		for (k = 0; k < 3; k++) { out[k] = a[k] + v*ab[k]; }
+		return;
+	}
+	for (k = 0; k < 3; k++) { cp[k] = p[k]-c[k]; }
+	d5 = ab[0]*cp[0] + ab[1]*cp[1] + ab[2]*cp[2];
+	d6 = ac[0]*cp[0] + ac[1]*cp[1] + ac[2]*cp[2];
+	if (d6 >= 0.0f && d5 <= d6) {
+		memcpy(out, c, 3*sizeof(float));
+		return;
+	}
+	vb = d5*d2 - d1*d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		w = d2/(d2 - d6);
+		for (k = 0; k < 3; k++) { out[k] = a[k] + w*ac[k]; }
+		return;
+	}
+	va = d3*d6 - d5*d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		w = (d4 - d3)/((d4 - d3) + (d5 - d6));
+		for (k = 0; k < 3; k++) { out[k] = b[k] + w*(c[k]-b[k]); }
+		return;
+	}
+	denom = 1.0f/(va + vb + vc);
+	v = vb*denom;
+	w = vc*denom;
+	for (k = 0; k < 3; k++)
+		out[k] = a[k] + ab[k]*v + ac[k]*w;
+}
+
+/*
+ * Find the point of the mesh closest to p, within maxDist. Returns 1 and
+ * fills in the point (and the triangle index, if tri is not NULL) if
+ * found, 0 otherwise.
+ */
+int
+CAD_BVHClosestPoint(const CAD_BVH *bvh, const float *p, float maxDist,
+    float *closest, Uint32 *tri)
+{
+	const CAD_Mesh *m = bvh->m;
+	Uint32 stack[BVH_STACK_MAX];
+	float best = maxDist*maxDist;
+	Uint sp = 0, k;
+	int found = 0;
+
+	if (bvh->nTris == 0 || BoxDist2(&bvh->nodes[0], p) > best) {
+		return (0);
+	}
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const CAD_BVHNode *nd = &bvh->nodes[stack[--sp]];
+		Uint32 l, r;
+		float dl, dr;
+
+		if (BoxDist2(nd, p) > best) {
+			continue;
+		}
+		if (nd->count > 0) {
+			for (k = 0; k < nd->count; k++) {
+				Uint32 t = bvh->tris[nd->first + k];
+				const Uint32 *ti = &m->tri[t*3];
+				float q[3], d2;
+
+				ClosestOnTri(p, &m->v[ti[0]*3], &m->v[ti[1]*3],
+				    &m->v[ti[2]*3], q);
+				d2 = (q[0]-p[0])*(q[0]-p[0]) +
+				     (q[1]-p[1])*(q[1]-p[1]) +
+				     (q[2]-p[2])*(q[2]-p[2]);
+				if (d2 <= best) {
+					best = d2;
+					memcpy(closest, q, 3*sizeof(float));
+					if (tri != NULL) {
+						*tri = t;
+					}
+					found = 1;
+				}
+			}
+			continue;
+		}
+		l = (Uint32)(nd - bvh->nodes) + 1;
+		r = nd->first;
+		dl = BoxDist2(&bvh->nodes[l], p);
+		dr = BoxDist2(&bvh->nodes[r], p);
+		if (dl < dr) {
+			if (dr <= best) { stack[sp++] = r; }
+			if (dl <= best) { stack[sp++] = l; }
+		} else {
+			if (dl <= best) { stack[sp++] = l; }
+			if (dr <= best) { stack[sp++] = r; }
+		}
+	}
+	return (found);
+}
+
+/*
+ * Invoke fn for every triangle whose bounding box overlaps the box
+ * [min,max]. The traversal stops early if fn returns nonzero. Returns the
+ * number of triangles reported.
+ */
+int
+CAD_BVHQueryBox(const CAD_BVH *bvh, const float *min, const float *max,
+    CAD_BVHBoxFn fn, void *arg)
+{
+	const CAD_Mesh *m = bvh->m;
+	Uint32 stack[BVH_STACK_MAX];
+	Uint sp = 0, k;
+	int n = 0;
+
+	if (bvh->nTris == 0) {
+		return (0);
+	}
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const CAD_BVHNode *nd = &bvh->nodes[stack[--sp]];
+
+		if (nd->min[0] > max[0] || nd->max[0] < min[0] ||
+		    nd->min[1] > max[1] || nd->max[1] < min[1] ||
+		    nd->min[2] > max[2] || nd->max[2] < min[2]) {
+			continue;
+		}
+		if (nd->count == 0) {
+			stack[sp++] = nd->first;
+			stack[sp++] = (Uint32)(nd - bvh->nodes) + 1;
+			continue;
+		}
+		for (k = 0; k < nd->count; k++) {
+			Uint32 t = bvh->tris[nd->first + k];
+			float tmin[3], tmax[3];
+
+			TriBounds(m, t, tmin, tmax);
+			if (tmin[0] > max[0] || tmax[0] < min[0] ||
+			    tmin[1] > max[1] || tmax[1] < min[1] ||
+			    tmin[2] > max[2] || tmax[2] < min[2]) {
+				continue;
+			}
+			n++;
+			if (fn(arg, t) != 0)
+				return (n);
+		}
+	}
+	return (n);
+}
@@ -0,0 +1,54 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_BVH_H_
+#define _CADTOOLS_BVH_H_
+
+#include "begin_code.h"
+
+/*
+ * Node of the hierarchy. The left child of an inner node immediately
+ * follows it; the right child is given by "first".
+ */
+typedef struct cad_bvh_node {
+	float min[3], max[3];			/* Bounding box */
+	Uint32 first;				/* Right child or first triangle */
+	Uint32 count;				/* Triangles (0 = inner node) */
+#define CAD_BVH_UNUSED 0xffffffff		/* Unused node slot */
+} CAD_BVHNode;
+
+/* Bounding volume hierarchy over the triangles of a mesh. */
+typedef struct cad_bvh {
+	const CAD_Mesh *m;			/* Indexed mesh */
+	CAD_BVHNode *nodes;
+	Uint nNodes;				/* Node slots */
+	Uint32 *tris;				/* Triangle indices by leaf */
+	Uint nTris;
+	float cost;				/* SAH cost after last build */
+	Uint flags;
+#define CAD_BVH_STALE	0x01			/* Geometry has changed */
+} CAD_BVH;
+
+/* Result of a ray query. */
+typedef struct cad_bvh_hit {
+	Uint32 tri;				/* Triangle index */
+	float t;				/* Distance along ray */
+	float u, v;				/* Barycentric coordinates */
+} CAD_BVHHit;
+
+typedef int (*CAD_BVHBoxFn)(void *, Uint32);
+
+__BEGIN_DECLS
+void	CAD_BVHInit(CAD_BVH *);
+void	CAD_BVHFree(CAD_BVH *);
+int	CAD_BVHBuild(CAD_BVH *, const CAD_Mesh *);
+int	CAD_BVHRefit(CAD_BVH *);
+int	CAD_BVHRaycast(const CAD_BVH *, const float *, const float *, float,
+	               CAD_BVHHit *);
+int	CAD_BVHClosestPoint(const CAD_BVH *, const float *, float, float *,
+	                    Uint32 *);
+int	CAD_BVHQueryBox(const CAD_BVH *, const float *, const float *,
+	                CAD_BVHBoxFn, void *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_BVH_H_ */
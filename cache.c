@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Content-addressed tessellation cache. Feature meshes are keyed by a
+ * hash of everything that went into generating them, so a feature whose
+ * inputs are unchanged never needs to be tessellated twice. The cache
+ * is persisted in the .part file (see CAD_PartSave()); parts saved in the
+ * older format start with an empty cache.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+/* 64-bit FNV-1a. */
+Uint64
+CAD_HashBytes(Uint64 h, const void *p, size_t len)
+{
+	const Uint8 *s = p;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (Uint64)s[i];
+		h *= 0x100000001b3ULL;
+	}
+	return (h);
+}
+
+static size_t
+MeshSize(const CAD_Mesh *m)
+{
+	size_t size = m->nv*3*sizeof(float) + m->nt*3*sizeof(Uint32);
+
+	if (m->flags & CAD_MESH_NORMALS) { size += m->nv*3*sizeof(float); }
+	if (m->flags & CAD_MESH_COLORS) { size += m->nv*4; }
+	if (m->flags & CAD_MESH_TEXCOORDS) { size += m->nv*2*sizeof(float); }
+	return (size);
+}
+
+void
+CAD_MeshCacheInit(CAD_MeshCache *mc)
+{
+	AG_MutexInit(&mc->lock);
+	mc->flags = 0;
+	memset(mc->buckets, 0, sizeof(mc->buckets));
+	mc->nEnts = 0;
+	mc->size = 0;
+	mc->maxSize = CAD_MESH_CACHE_MAX;
+	mc->useCounter = 0;
+}
+
+void
+CAD_MeshCacheDestroy(CAD_MeshCache *mc)
+{
+	CAD_MeshCacheEnt *ent, *entNext;
+	Uint i;
+
+	for (i = 0; i < CAD_MESH_CACHE_BUCKETS; i++) {
+		for (ent = mc->buckets[i]; ent != NULL; ent = entNext) {
+			entNext = ent->next;
+			CAD_MeshFree(&ent->mesh);
+			Free(ent);
+		}
+		mc->buckets[i] = NULL;
+	}
+	mc->nEnts = 0;
+	mc->size = 0;
+	AG_MutexDestroy(&mc->lock);
+}
+
+/*
+ * Copy the cached mesh for the given hash into m.
+ * Return 1 on a cache hit, 0 on a miss and -1 on failure.
+ */
+int
+CAD_MeshCacheLookup(CAD_MeshCache *mc, Uint64 hash, CAD_Mesh *m)
+{
+	CAD_MeshCacheEnt *ent;
+	int rv = 0;
+
+	AG_MutexLock(&mc->lock);
+	for (ent = mc->buckets[hash % CAD_MESH_CACHE_BUCKETS];
+	     ent != NULL;
+	     ent = ent->next) {
+		if (ent->hash == hash)
+			break;
+	}
+	if (ent != NULL) {
+		ent->lastUsed = ++mc->useCounter;
+		if (m->flags != ent->mesh.flags) {
+			CAD_MeshFree(m);
+			CAD_MeshInit(m, ent->mesh.flags);
+		} else {
+			CAD_MeshClear(m);
+		}
+		rv = (CAD_MeshAppend(m, &ent->mesh) == -1) ? -1 : 1;
+	}
+	AG_MutexUnlock(&mc->lock);
+	return (rv);
+}
+
+/* Evict least recently used entries until the size limit is met. */
+static void
+Evict(CAD_MeshCache *mc)
+{
+	CAD_MeshCacheEnt *ent, **pEnt, **pOldest;
+	Uint i;
+
+	while (mc->size > mc->maxSize && mc->nEnts > 1) {
+		pOldest = NULL;
+		for (i = 0; i < CAD_MESH_CACHE_BUCKETS; i++) {
+			for (pEnt = &mc->buckets[i];
+			     *pEnt != NULL;
+			     pEnt = &(*pEnt)->next) {
+				if (pOldest == NULL ||
+				    (*pEnt)->lastUsed < (*pOldest)->lastUsed)
+					pOldest = pEnt;
+			}
+		}
+		ent = *pOldest;
+		*pOldest = ent->next;
+		mc->size -= ent->size;
+		mc->nEnts--;
+		CAD_MeshFree(&ent->mesh);
+		Free(ent);
+	}
+}
+
+/* Store a copy of mesh m under the given hash. */
+int
+CAD_MeshCacheInsert(CAD_MeshCache *mc, Uint64 hash, const CAD_Mesh *m)
+{
+	CAD_MeshCacheEnt *ent;
+	Uint b = hash % CAD_MESH_CACHE_BUCKETS;
+
+	AG_MutexLock(&mc->lock);
+	for (ent = mc->buckets[b]; ent != NULL; ent = ent->next) {
+		if (ent->hash == hash)
+			goto out;
+	}
+	if ((ent = TryMalloc(sizeof(CAD_MeshCacheEnt))) == NULL) {
+		goto fail;
+	}
+	ent->hash = hash;
+	CAD_MeshInit(&ent->mesh, m->flags);
+	if (CAD_MeshAppend(&ent->mesh, m) == -1) {
+		CAD_MeshFree(&ent->mesh);
+		Free(ent);
+		goto fail;
+	}
+	ent->size = MeshSize(m);
+	ent->lastUsed = ++mc->useCounter;
+	ent->next = mc->buckets[b];
+	mc->buckets[b] = ent;
+	mc->nEnts++;
+	mc->size += ent->size;
+	mc->flags |= CAD_MESH_CACHE_DIRTY;
+	Evict(mc);
+out:
+	AG_MutexUnlock(&mc->lock);
+	return (0);
+fail:
+	AG_MutexUnlock(&mc->lock);
+	return (-1);
+}
+
+/*
+ * Invoke fn on every entry, with the cache locked. Stop and return -1 if
+ * fn returns -1.
+ */
+int
+CAD_MeshCacheForeach(CAD_MeshCache *mc,
+    int (*fn)(void *, Uint64, const CAD_Mesh *), void *arg)
+{
+	CAD_MeshCacheEnt *ent;
+	Uint i;
+	int rv = 0;
+
+	AG_MutexLock(&mc->lock);
+	for (i = 0; i < CAD_MESH_CACHE_BUCKETS; i++) {
+		for (ent = mc->buckets[i]; ent != NULL; ent = ent->next) {
+			if ((rv = fn(arg, ent->hash, &ent->mesh)) == -1)
+				goto out;
+		}
+	}
+out:
+	AG_MutexUnlock(&mc->lock);
+	return (rv);
+}
@@ -0,0 +1,43 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_CACHE_H_
+#define _CADTOOLS_CACHE_H_
+
+#include "begin_code.h"
+
+#define CAD_MESH_CACHE_BUCKETS	256
+#define CAD_MESH_CACHE_MAX	(256*1024*1024)	/* Default size limit */
+
+typedef struct cad_mesh_cache_ent {
+	Uint64 hash;				/* Content hash of inputs */
+	CAD_Mesh mesh;				/* Tessellated result */
+	size_t size;				/* Memory used by mesh */
+	Uint32 lastUsed;			/* Use counter */
+	struct cad_mesh_cache_ent *next;	/* In bucket */
+} CAD_MeshCacheEnt;
+
+/* Tessellation cache keyed by feature content hash. */
+typedef struct cad_mesh_cache {
+	AG_Mutex lock;
+	Uint flags;
+#define CAD_MESH_CACHE_DIRTY	0x01		/* Differs from saved part */
+	CAD_MeshCacheEnt *buckets[CAD_MESH_CACHE_BUCKETS];
+	Uint nEnts;
+	size_t size, maxSize;
+	Uint32 useCounter;
+} CAD_MeshCache;
+
+__BEGIN_DECLS
+void	CAD_MeshCacheInit(CAD_MeshCache *);
+void	CAD_MeshCacheDestroy(CAD_MeshCache *);
+int	CAD_MeshCacheLookup(CAD_MeshCache *, Uint64, CAD_Mesh *);
+int	CAD_MeshCacheInsert(CAD_MeshCache *, Uint64, const CAD_Mesh *);
+int	CAD_MeshCacheForeach(CAD_MeshCache *,
+	                     int (*)(void *, Uint64, const CAD_Mesh *), void *);
+
+Uint64	CAD_HashBytes(Uint64, const void *, size_t);
+#define CAD_HASH_INIT 0xcbf29ce484222325ULL	/* FNV-1a offset basis */
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_CACHE_H_ */
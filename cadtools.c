@@ -35,6 +35,7 @@
 #include <agar/dev.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef HAVE_GETOPT
@@ -42,6 +43,7 @@
 #endif
 
 #include "cadtools.h"
+#include "exboss.h"
 
 #include <cadtools/config/have_getopt.h>
 #include <cadtools/config/cadtools_version.h>
@@ -53,12 +55,15 @@ AG_Object vfsRoot;
 
 static void *objFocus = NULL;
 static int terminating = 0;
+static Uint64 tLoad = 0;			/* Start of document loading */
 
 static void
 RegisterClasses(void)
 {
 	AG_RegisterClass(&camProgramClass);
 	AG_RegisterClass(&cadPartClass);
+	AG_RegisterClass(&cadFeatureClass);
+	AG_RegisterClass(&cadExtrudedBossClass);
 	AG_RegisterClass(&camMachineClass);
 	AG_RegisterClass(&camLatheClass);
 	AG_RegisterClass(&camMillClass);
@@ -86,7 +91,7 @@ SaveChangesDlg(AG_Event *event)
 	AG_Window *win = AG_SELF();
 	AG_Object *obj = AG_PTR(1);
 
-	if (!AG_ObjectChanged(obj)) {
+	if (!CAD_ObjectChanged(obj)) {
 		SaveAndClose(obj, win);
 	} else {
 		AG_Button *bOpts[3];
@@ -128,6 +133,13 @@ WindowLostFocus(AG_Event *event)
 	objFocus = NULL;
 }
 
+/* A sketch may have been edited; update the parts using it. */
+static void
+SketchEditDone(AG_Event *event)
+{
+	CAD_PartsCheckInputs();
+}
+
 /* Open a given object for edition. */
 AG_Window *
 CAD_OpenObject(void *p)
@@ -138,12 +150,19 @@ CAD_OpenObject(void *p)
 	if ((win = obj->cls->edit(obj)) == NULL) {
 		return (NULL);
 	}
+	CAD_TrackEdits(win, obj);
 	AG_SetEvent(win, "window-close", SaveChangesDlg, "%p", obj);
 	AG_AddEvent(win, "window-gainfocus", WindowGainedFocus, "%p", obj);
 	AG_AddEvent(win, "window-lostfocus", WindowLostFocus, "%p", obj);
 	AG_AddEvent(win, "window-hidden", WindowLostFocus, "%p", obj);
+	if (AG_OfClass(obj, "SK:*")) {
+		AG_AddEvent(win, "window-lostfocus", SketchEditDone, NULL);
+		AG_AddEvent(win, "window-hidden", SketchEditDone, NULL);
+	}
 	AG_SetPointer(win, "object", obj);
 	AG_PostEvent(obj, "edit-open", NULL);
+	if (CAD_UndoTrack(obj) == -1)
+		Verbose("%s\n", AG_GetError());
 
 	AG_WindowShow(win);
 	return (win);
@@ -155,6 +174,9 @@ CAD_GUI_NewObject(AG_Event *event)
 {
 	AG_ObjectClass *cls = AG_PTR(1);
 
+	if (cls == &skClass) {
+		CAD_InitSketches();
+	}
 	CAD_OpenObject(AG_ObjectNew(&vfsRoot, NULL, cls));
 }
 
@@ -174,22 +196,11 @@ CAD_GUI_OpenObject(AG_Event *event)
 {
 	AG_ObjectClass *cls = AG_PTR(1);
 	char *path = AG_STRING(2);
-	AG_Object *obj;
 
-	if ((obj = AG_ObjectNew(&vfsRoot, NULL, cls)) == NULL) {
-		goto fail;
+	if (cls == &skClass) {
+		CAD_InitSketches();
 	}
-	if (AG_ObjectLoadFromFile(obj, path) == -1) {
-		AG_ObjectDetach(obj);
-		AG_ObjectDestroy(obj);
-		goto fail;
-	}
-	AG_SetString(obj, "archive-path", path);
-	AG_ObjectSetNameS(obj, AG_ShortFilename(path));
-	CAD_OpenObject(obj);
-	return;
-fail:
-	AG_TextMsgFromError();
+	CAD_ImportStart(path, CAD_ImportObject, cls);
 }
 
 void
@@ -198,6 +209,7 @@ CAD_GUI_OpenDlg(AG_Event *event)
 	AG_Window *win;
 	AG_FileDlg *fd;
 	AG_Pane *hPane;
+	AG_Box *vBox;
 
 	win = AG_WindowNew(0);
 	AG_WindowSetCaptionS(win, _("Open..."));
@@ -207,7 +219,9 @@ CAD_GUI_OpenDlg(AG_Event *event)
 	    AG_FILEDLG_LOAD|AG_FILEDLG_CLOSEWIN|AG_FILEDLG_EXPAND|
 	    AG_FILEDLG_ASYNC);
 
-	AG_FileDlgSetOptionContainer(fd, hPane->div[1]);
+	vBox = AG_BoxNewVert(hPane->div[1], AG_BOX_EXPAND);
+	CAD_PreviewPaneNew(vBox, fd);
+	AG_FileDlgSetOptionContainer(fd, AG_BoxNewVert(vBox, AG_BOX_EXPAND));
 
 	AG_FileDlgAddType(fd, _("cadtools sketch"), "*.sk",
 	    CAD_GUI_OpenObject, "%p", &skClass);
@@ -270,6 +284,7 @@ void
 CAD_GUI_Save(AG_Event *event)
 {
 	AG_Object *obj = AG_PTR(1);
+	int rv;
 
 	if (obj == NULL) {
 		AG_TextError(_("No object is selected for saving"));
@@ -279,10 +294,19 @@ CAD_GUI_Save(AG_Event *event)
 		CAD_GUI_SaveAsDlg(event);
 		return;
 	}
-	if (AG_ObjectSave(obj) == -1) {
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		char path[AG_PATHNAME_MAX];
+
+		AG_GetString(obj, "archive-path", path, sizeof(path));
+		rv = CAD_PartSave((CAD_Part *)obj, path);
+	} else {
+		rv = AG_ObjectSave(obj);
+	}
+	if (rv == -1) {
 		AG_TextMsg(AG_MSG_ERROR, _("Error saving object: %s"),
 		    AG_GetError());
 	} else {
+		CAD_ObjectSaved(obj);
 		AG_TextInfo("saved-object",
 		    _("Saved object %s successfully"),
 		    AGOBJECT(obj)->name);
@@ -317,7 +341,7 @@ CAD_GUI_Quit(AG_Event *event)
 	terminating = 1;
 
 	AGOBJECT_FOREACH_CHILD(obj, &vfsRoot, ag_object) {
-		if (AG_ObjectChanged(obj))
+		if (CAD_ObjectChanged(obj))
 			break;
 	}
 	if (obj == NULL) {
@@ -345,6 +369,45 @@ CAD_GUI_Quit(AG_Event *event)
 	}
 }
 		
+#if defined(HAVE_AGAR_DEV) && defined(CAD_DEBUG)
+/* Build the "Debug" menu (and initialize DEV) when first expanded. */
+static void
+PollDebugMenu(AG_Event *event)
+{
+	AG_MenuItem *mi = AG_SENDER();
+	static int initedDev = 0;
+	Uint64 t;
+
+	if (!initedDev) {
+		t = CAD_ProfileNow();
+		DEV_InitSubsystem(0);
+		CAD_ProfileRecord("DEV_InitSubsystem", t);
+		initedDev = 1;
+	}
+	AG_MenuItemFreeChildren(mi);
+	DEV_ToolMenu(mi);
+}
+#endif /* HAVE_AGAR_DEV and CAD_DEBUG */
+
+/*
+ * Initialize the sketch subsystem. This is deferred until a sketch is
+ * first created or loaded. Must be called from the main thread.
+ */
+void
+CAD_InitSketches(void)
+{
+	static int initedSK = 0;
+	Uint64 t;
+
+	if (initedSK) {
+		return;
+	}
+	t = CAD_ProfileNow();
+	SK_InitSubsystem();
+	CAD_ProfileRecord("SK_InitSubsystem", t);
+	initedSK = 1;
+}
+
 void
 CAD_InitMenuMDI(void)
 {
@@ -355,8 +418,8 @@ CAD_InitMenuMDI(void)
 	CAD_FileMenu(AG_MenuNode(mdiMenu->root, _("File"), NULL), NULL);
 	CAD_EditMenu(AG_MenuNode(mdiMenu->root, _("Edit"), NULL), NULL);
 #if defined(HAVE_AGAR_DEV) && defined(CAD_DEBUG)
-	DEV_InitSubsystem(0);
-	DEV_ToolMenu(AG_MenuNode(mdiMenu->root, _("Debug"), NULL));
+	AG_MenuDynamicItem(mdiMenu->root, _("Debug"), NULL, PollDebugMenu,
+	    NULL);
 #endif
 }
 
@@ -418,15 +481,32 @@ CAD_FileMenu(AG_MenuItem *m, void *obj)
 static void
 Undo(AG_Event *event)
 {
-	/* TODO */
-	printf("undo!\n");
+	AG_Object *obj = AG_PTR(1);
+	CAD_Journal *jnl;
+
+	if (obj == NULL)					/* MDI */
+		obj = objFocus;
+	if (obj == NULL || (jnl = CAD_JournalOf(obj)) == NULL) {
+		return;
+	}
+	CAD_UndoCommit(obj, _("Edit"));		/* Pending edits */
+	if (CAD_Undo(jnl) == -1)
+		AG_TextTmsg(AG_MSG_INFO, 1000, "%s", AG_GetError());
 }
 
 static void
 Redo(AG_Event *event)
 {
-	/* TODO */
-	printf("redo!\n");
+	AG_Object *obj = AG_PTR(1);
+	CAD_Journal *jnl;
+
+	if (obj == NULL)					/* MDI */
+		obj = objFocus;
+	if (obj == NULL || (jnl = CAD_JournalOf(obj)) == NULL) {
+		return;
+	}
+	if (CAD_Redo(jnl) == -1)
+		AG_TextTmsg(AG_MSG_INFO, 1000, "%s", AG_GetError());
 }
 
 /* Build a generic "Edit" menu. */
@@ -444,29 +524,73 @@ CAD_EditMenu(AG_MenuItem *m, void *obj)
 	    Redo, "%p", obj);
 }
 
+#ifdef HAVE_GETOPT
+/* Process documents without a display (see batch.c). */
+static int
+BatchMain(enum cad_batch_op op, char **files, int nFiles)
+{
+	Uint64 t;
+	int rv;
+
+	t = CAD_ProfileNow();
+	SG_InitSubsystem();
+	CAD_ProfileRecord("SG_InitSubsystem", t);
+	if (CAD_JobPoolInit(0) == -1) {
+		fprintf(stderr, "%s\n", AG_GetError());
+		AG_Destroy();
+		return (CAD_BATCH_EUSAGE);
+	}
+	AG_ObjectInitStatic(&vfsRoot, NULL);		/* Holds sketches */
+	AG_ObjectSetName(&vfsRoot, "cadtools");
+	RegisterClasses();
+	t = CAD_ProfileNow();
+	rv = CAD_BatchRun(op, files, nFiles);
+	CAD_ProfileRecord("Batch operation", t);
+	CAD_ProfileReport();
+	AG_ObjectDestroy(&vfsRoot);
+	CAD_JobPoolDestroy();
+	AG_Destroy();
+	return (rv);
+}
+#endif /* HAVE_GETOPT */
+
+/* Startup is complete once the documents given as arguments are open. */
+static void
+StartupDone(void)
+{
+	CAD_ProfileRecord("Loading documents", tLoad);
+	CAD_ProfileReport();
+}
+
 int
 main(int argc, char *argv[])
 {
-	int c, i;
+	int c, i, batchOp = -1;
 	char *driverSpec = "<OpenGL>";
+	Uint64 t;
 
 #ifdef ENABLE_NLS
 	bindtextdomain("cadtools", LOCALEDIR);
 	bind_textdomain_codeset("cadtools", "UTF-8");
 	textdomain("cadtools");
 #endif
+	t = CAD_ProfileNow();
 	if (AG_InitCore("cadtools", AG_VERBOSE|AG_CREATE_DATADIR) == -1) {
 		fprintf(stderr, "InitCore: %s\n", AG_GetError());
 		return (1);
 	}
+	CAD_ProfileRecord("AG_InitCore", t);
 #ifdef HAVE_GETOPT
-	while ((c = getopt(argc, argv, "?vd:t:T:")) != -1) {
+	while ((c = getopt(argc, argv, "?vPd:t:T:u:a:b:")) != -1) {
 		extern char *optarg;
 
 		switch (c) {
 		case 'v':
 			printf("cadtools %s\n", CADTOOLS_VERSION);
 			return (0);
+		case 'P':
+			cadProfileStartup = 1;
+			break;
 		case 'd':
 			driverSpec = optarg;
 			break;
@@ -476,30 +600,65 @@ main(int argc, char *argv[])
 		case 't':
 			AG_TextParseFontSpec(optarg);
 			break;
+		case 'u':
+			cadUndoBudget = (size_t)strtoul(optarg, NULL, 10)*1024;
+			break;
+		case 'a':
+			cadAutosaveInterval = (Uint)strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			if ((batchOp = CAD_BatchOpLookup(optarg)) == -1) {
+				fprintf(stderr, "%s: Bad batch operation "
+				    "\"%s\"; expected one of:", agProgName,
+				    optarg);
+				for (i = 0; cadBatchOpNames[i] != NULL; i++) {
+					fprintf(stderr, " %s",
+					    cadBatchOpNames[i]);
+				}
+				fprintf(stderr, "\n");
+				return (1);
+			}
+			break;
 		case '?':
 		default:
-			printf("Usage: %s [-v] [-d agar-driver-spec] "
-			       "[-t font-spec] [-T font-path]\n", agProgName);
+			printf("Usage: %s [-vP] [-d agar-driver-spec] "
+			       "[-t font-spec] [-T font-path] "
+			       "[-u undo-budget-kb] [-a autosave-secs] "
+			       "[-b batch-op] [file ...]\n", agProgName);
 			return (1);
 		}
 	}
+	if (batchOp != -1) {
+		return BatchMain((enum cad_batch_op)batchOp, &argv[optind],
+		    argc - optind);
+	}
 #endif /* HAVE_GETOPT */
 
+	t = CAD_ProfileNow();
 	if (AG_InitGraphics(driverSpec) == -1) {
 		goto fail;
 	}
+	CAD_ProfileRecord("AG_InitGraphics", t);
+	t = CAD_ProfileNow();
 	SG_InitSubsystem();
-	SK_InitSubsystem();
+	CAD_ProfileRecord("SG_InitSubsystem", t);
 	AG_BindGlobalKeyEv(AG_KEY_ESCAPE, AG_KEYMOD_ANY, CAD_GUI_Quit);
 	AG_BindGlobalKey(AG_KEY_F8, AG_KEYMOD_ANY, AG_ViewCapture);
 
+	if (CAD_JobPoolInit(0) == -1) {
+		goto fail;
+	}
+
 	AG_ObjectInitStatic(&vfsRoot, NULL);
 	AG_ObjectSetName(&vfsRoot, "cadtools");
 
 	/* Register our classes. */
+	t = CAD_ProfileNow();
 	RegisterClasses();
+	CAD_ProfileRecord("RegisterClasses", t);
 
 	/* Create the application menu. */ 
+	t = CAD_ProfileNow();
 	if (agDriverSw != NULL) {
 		CAD_InitMenuMDI();
 	} else {
@@ -512,36 +671,23 @@ main(int argc, char *argv[])
 		if (CAD_OpenObject(objNew) == NULL)
 			goto fail;
 	}
+	CAD_ProfileRecord("Menus", t);
+	t = CAD_ProfileNow();
+	CAD_AutosaveInit();
+	CAD_ProfileRecord("CAD_AutosaveInit", t);
 
+	tLoad = CAD_ProfileNow();
 #ifdef HAVE_GETOPT
-	for (i = optind; i < argc; i++) {
+	CAD_ImportDocuments(&argv[optind], (Uint)(argc - optind), StartupDone);
 #else
-	for (i = 1; i < argc; i++) {
+	CAD_ImportDocuments(&argv[1], (Uint)(argc - 1), StartupDone);
 #endif
-		AG_Event ev;
-		char *ext;
-
-		Verbose("Loading: %s\n", argv[i]);
-		if ((ext = strrchr(argv[i], '.')) == NULL)
-			continue;
-
-		AG_EventInit(&ev);
-		if (strcasecmp(ext, ".sk") == 0) {
-			AG_EventPushPointer(&ev, "", &skClass);
-		} else if (strcasecmp(ext, ".part") == 0) {
-			AG_EventPushPointer(&ev, "", &cadPartClass);
-		} else if (strcasecmp(ext, ".prog") == 0) {
-			AG_EventPushPointer(&ev, "", &camProgramClass);
-		} else {
-			Verbose("Ignoring argument: %s\n", argv[i]);
-			continue;
-		}
-		AG_EventPushString(&ev, "", argv[i]);
-		CAD_GUI_OpenObject(&ev);
-	}
 
 	AG_EventLoop();
+	CAD_AutosaveDestroy();
+	CAD_PreviewDestroy();
 	AG_ObjectDestroy(&vfsRoot);
+	CAD_JobPoolDestroy();
 	AG_Destroy();
 	return (0);
 fail:
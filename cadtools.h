@@ -37,6 +37,8 @@
 #endif
 #endif /* _CADTOOLS_INTERNAL */
 
+#include "gen.h"
+#include "undo.h"
 #include "program.h"
 
 #include "fixture.h"
@@ -44,8 +46,28 @@
 #include "lathe.h"
 #include "mill.h"
 
+#include "arena.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "triangulate.h"
+#include "import.h"
+#include "ply.h"
+#include "weld.h"
+#include "decimate.h"
+#include "lod.h"
+#include "bvh.h"
+#include "csg.h"
+#include "export.h"
+#include "cache.h"
+#include "partfile.h"
+#include "autosave.h"
+#include "batch.h"
+#include "profile.h"
+#include "names.h"
 #include "part.h"
 #include "feature.h"
+#include "preview.h"
+#include "render.h"
 
 #include "begin_code.h"
 __BEGIN_DECLS
@@ -61,6 +83,7 @@ void       CAD_GUI_Save(AG_Event *);
 void       CAD_GUI_SaveAsDlg(AG_Event *);
 void       CAD_GUI_Quit(AG_Event *);
 
+void       CAD_InitSketches(void);
 void       CAD_InitMenuMDI(void);
 void       CAD_FileMenu(AG_MenuItem *, void *);
 void       CAD_EditMenu(AG_MenuItem *, void *);
@@ -0,0 +1,2858 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Boolean operations (union, difference and intersection) on closed
+ * triangle meshes.
+ *
+ * The triangles of each operand which overlap the bounds of the other
+ * operand are tested for intersection against a BVH of the second
+ * operand, in parallel. The tests are built on an orientation predicate
+ * which is evaluated exactly whenever the floating-point result is not
+ * certain. Coplanar and touching configurations are resolved by symbolic
+ * perturbation: the second operand is treated as if it were translated
+ * by an infinitesimal amount, so that every test has a definite outcome
+ * which is consistent with all other tests.
+ *
+ * Intersection points are identified by the edge and the triangle which
+ * produce them, so that triangles sharing an edge are split at the same
+ * points. Each intersected triangle is retriangulated with its
+ * intersection segments as constraints, and the resulting triangles are
+ * grouped into patches bounded by the intersection curves. A patch is
+ * inside or outside the other operand according to the side of the
+ * adjacent intersecting triangles or, if it is not bounded by any
+ * intersection, by the parity of a ray cast through the other operand.
+ *
+ * Both operands must be closed surfaces; their vertices need not be
+ * shared between triangles (vertices are merged by position).
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "cadtools.h"
+
+#define CSG_CHUNK	1024		/* Minimum triangles per job */
+#define CSG_SPLIT_CHUNK	32		/* Minimum split triangles per job */
+#define CSG_EXP_MAX	1024		/* Expansion length limit */
+#define CSG_EPS		1.1102230246251565e-16		/* 2^-53 */
+#define CSG_O3D_BOUND	((7.0 + 56.0*CSG_EPS)*CSG_EPS)
+#define CSG_TOL		1e-10		/* Coincident points (relative) */
+#define CSG_FLIPS_MAX	100000		/* Constraint recovery limit */
+#define CSG_SEAM_TOL	(8.0*FLT_EPSILON)	/* Seam welding (relative) */
+
+#define CSG_FAR		0xffffffff	/* Triangle is away from other operand */
+#define CSG_NEAR	0xfffffffe	/* Near but not intersected */
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+/*
+ * Intersection segment between triangle t[0] of A and t[1] of B. The
+ * endpoints are given as events: 0-2 for edge k of t[0] crossing t[1],
+ * 4-6 for edge k of t[1] crossing t[0].
+ */
+typedef struct csg_seg {
+	Uint32 t[2];
+	Uint32 pt[2];			/* Endpoints (point table) */
+	Uint8 ev[2];
+} CSGSeg;
+
+/* Intersection point, keyed by its edge (merged vertices) and triangle. */
+typedef struct csg_point {
+	Uint32 key[4];
+	double x[3];
+} CSGPoint;
+
+/* Triangle resulting from the retriangulation of an intersected one. */
+typedef struct csg_sub {
+	Uint32 v[3];			/* Corner (0-2) or 3+point */
+	Uint8 con;			/* Intersection edges (bit k) */
+	Sint8 vote;			/* >0 = outside, <0 = inside */
+} CSGSub;
+
+/* Intersected triangle. */
+typedef struct csg_split {
+	Uint32 tri;
+	Uint segFirst, nSegs;		/* Range in segList */
+	CSGSub *sub;
+	Uint nSub;
+} CSGSplit;
+
+typedef struct csg_operand {
+	const CAD_Mesh *m;
+	Uint side;			/* 0 = A, 1 = B (perturbed) */
+	float min[3], max[3];
+	Uint32 *tag;			/* CSG_FAR, CSG_NEAR or split index */
+	Uint32 *near;			/* Near triangles */
+	Uint nNear;
+	Uint32 *canon;			/* Merged vertex of each vertex */
+	CSGSplit *splits;
+	Uint nSplits;
+	Uint *segList;			/* Segments by split triangle */
+} CSGOperand;
+
+/* Perturbation of B (see OrientP()). */
+typedef struct csg_perturb {
+	double ctr[3];			/* Center of scaling */
+	int grow;			/* Scale up (1) or down (-1) */
+} CSGPerturb;
+
+typedef struct csg_ctx {
+	CSGPerturb P;
+	CSGOperand op[2];
+	CAD_BVH bvh;			/* Over B */
+	CSGSeg *segs;
+	Uint nSegs;
+	CSGPoint *pts;
+	Uint nPts;
+} CSGCtx;
+
+/* Triangle of the local triangulation of an intersected triangle. */
+typedef struct csg_ltri {
+	int v[3];			/* Points (counterclockwise) */
+	int nb[3];			/* Neighbor across edge v[k],v[k+1] */
+	Uint8 con;			/* Constrained edges (bit k) */
+	int vote;
+} CSGLTri;
+
+typedef struct csg_lsort {
+	double lambda;
+	int i;
+} CSGLSort;
+
+typedef struct csg_local {
+	double *xy;			/* Projected points */
+	Uint32 *ref;			/* Corner (0-2) or 3+point */
+	int nPts, maxPts;
+	CSGLTri *t;
+	int nTris, maxTris;
+	Uint32 *pids;			/* Points used by segments (sorted) */
+	int *edge;			/* Edge containing each point or -1 */
+	int *local;			/* Local point of each point */
+	int nPids, maxPids;
+	CSGLSort *order;
+	int *queue;			/* Edges crossing a constraint */
+	int maxQueue;
+	double tol, tolCirc;
+} CSGLocal;
+
+typedef struct csg_job {
+	CSGCtx *ctx;
+	CSGOperand *X;
+	Uint i1, i2;
+	Uint32 *near;			/* Near triangles found */
+	Uint nNear, maxNear;
+	CSGSeg *segs;			/* Intersections found */
+	Uint nSegs, maxSegs;
+	Uint32 tri;			/* Triangle being tested */
+	double T[3][3];
+	CSGLocal loc;
+} CSGJob;
+
+typedef struct csg_face {
+	Uint32 v[3];			/* Merged vertex or nv+point */
+	Uint32 tri;			/* Source triangle */
+	Uint32 sub;			/* Index in split's sub or CSG_NEAR */
+	Uint8 con;
+	Sint8 vote;
+} CSGFace;
+
+typedef struct csg_edge {
+	Uint32 a, b;
+	Uint32 face;
+	Uint32 con;
+} CSGEdge;
+
+/*
+ * Exact arithmetic on floating-point expansions, after J.R. Shewchuk,
+ * "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric
+ * Predicates". Expansions are stored in order of increasing magnitude
+ * without zero components.
+ */
+static __inline__ void
+TwoSum(double a, double b, double *x, double *y)
+{
+	double bv, av;
+
+	*x = a + b;
+	bv = *x - a;
+	av = *x - bv;
+	*y = (a - av) + (b - bv);
+}
+
+static __inline__ void
+TwoDiff(double a, double b, double *x, double *y)
+{
+	double bv, av;
+
+	*x = a - b;
+	bv = a - *x;
+	av = *x + bv;
+	*y = (a - av) + (bv - b);
+}
+
+static __inline__ void
+TwoProduct(double a, double b, double *x, double *y)
+{
+	*x = a*b;
+	*y = fma(a, b, -(*x));
+}
+
+static int
+ExpSum(int elen, const double *e, int flen, const double *f, double *h)
+{
+	double Q, Qn, hh;
+	int i = 0, j = 0, n = 0;
+
+	if (elen == 0 || flen == 0) {
+		if (elen == 0) {
+			memcpy(h, f, flen*sizeof(double));
+			return (flen);
+		}
+		memcpy(h, e, elen*sizeof(double));
+		return (elen);
+	}
+	if (fabs(e[0]) < fabs(f[0])) {
+		Q = e[i++];
+	} else {
+		Q = f[j++];
+	}
+	while (i < elen && j < flen) {
+		if (fabs(e[i]) < fabs(f[j])) {
+			TwoSum(Q, e[i++], &Qn, &hh);
+		} else {
+			TwoSum(Q, f[j++], &Qn, &hh);
+		}
+		Q = Qn;
+		if (hh != 0.0) { h[n++] = hh; }
+	}
+	while (i < elen) {
+		TwoSum(Q, e[i++], &Qn, &hh);
+		Q = Qn;
+		if (hh != 0.0) { h[n++] = hh; }
+	}
+	while (j < flen) {
+		TwoSum(Q, f[j++], &Qn, &hh);
+		Q = Qn;
+		if (hh != 0.0) { h[n++] = hh; }
+	}
+	if (Q != 0.0) {
+		h[n++] = Q;
+	}
+	return (n);
+}
+
+static int
+ExpScale(int elen, const double *e, double b, double *h)
+{
+	double Q, sum, hh, p1, p0;
+	int i, n = 0;
+
+	if (elen == 0 || b == 0.0) {
+		return (0);
+	}
+	TwoProduct(e[0], b, &Q, &hh);
+	if (hh != 0.0) { h[n++] = hh; }
+	for (i = 1; i < elen; i++) {
+		TwoProduct(e[i], b, &p1, &p0);
+		TwoSum(Q, p0, &sum, &hh);
+		if (hh != 0.0) { h[n++] = hh; }
+		TwoSum(p1, sum, &Q, &hh);
+		if (hh != 0.0) { h[n++] = hh; }
+	}
+	if (Q != 0.0) {
+		h[n++] = Q;
+	}
+	return (n);
+}
+
+static int
+ExpMul(int elen, const double *e, int flen, const double *f, double *h)
+{
+	double t[CSG_EXP_MAX], s[CSG_EXP_MAX];
+	int i, n = 0, nt;
+
+	for (i = 0; i < flen; i++) {
+		nt = ExpScale(elen, e, f[i], t);
+		n = ExpSum(n, h, nt, t, s);
+		memcpy(h, s, n*sizeof(double));
+	}
+	return (n);
+}
+
+static __inline__ void
+ExpNeg(int n, double *e)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		e[i] = -e[i];
+}
+
+static __inline__ int
+ExpSign(int n, const double *e)
+{
+	return (n == 0) ? 0 : (e[n-1] > 0.0) ? 1 : -1;
+}
+
+/* Exact difference of two points as three 2-component expansions. */
+static void
+ExpDiff3(const double *a, const double *b, double d[3][2], int *nd)
+{
+	double x, y;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		TwoDiff(a[k], b[k], &x, &y);
+		nd[k] = 0;
+		if (y != 0.0) { d[k][nd[k]++] = y; }
+		if (x != 0.0) { d[k][nd[k]++] = x; }
+	}
+}
+
+/* Component k of the cross product p x q. */
+static int
+ExpCross(double p[3][2], const int *np, double q[3][2], const int *nq, int k,
+    double *h)
+{
+	double t1[8], t2[8];
+	int i = (k+1)%3, j = (k+2)%3, n1, n2;
+
+	n1 = ExpMul(np[i], p[i], nq[j], q[j], t1);
+	n2 = ExpMul(np[j], p[j], nq[i], q[i], t2);
+	ExpNeg(n2, t2);
+	return ExpSum(n1, t1, n2, t2, h);
+}
+
+/* Exact determinant of the 3x3 matrix with rows u, v and w. */
+static int
+ExpDet3(double u[3][2], const int *nu, double v[3][2], const int *nv,
+    double w[3][2], const int *nw, double *h)
+{
+	double x[16], y[64], tmp[CSG_EXP_MAX/4];
+	int k, nx, ny, n = 0;
+
+	for (k = 0; k < 3; k++) {
+		nx = ExpCross(v, nv, w, nw, k, x);
+		ny = ExpMul(nx, x, nu[k], u[k], y);
+		n = ExpSum(n, h, ny, y, tmp);
+		memcpy(h, tmp, n*sizeof(double));
+	}
+	return (n);
+}
+
+static int
+OrientExact(const double *a, const double *b, const double *c,
+    const double *e)
+{
+	double u[3][2], v[3][2], w[3][2], det[CSG_EXP_MAX/4];
+	int nu[3], nv[3], nw[3];
+
+	ExpDiff3(b, a, u, nu);
+	ExpDiff3(c, a, v, nv);
+	ExpDiff3(e, a, w, nw);
+	return ExpSign(ExpDet3(u, nu, v, nv, w, nw, det), det);
+}
+
+/*
+ * Orientation of e with respect to the plane through a, b and c: the
+ * value is positive if e lies on the side of the normal (b-a)x(c-a).
+ */
+static __inline__ double
+OrientValue(const double *a, const double *b, const double *c,
+    const double *e)
+{
+	double ux = b[0]-a[0], uy = b[1]-a[1], uz = b[2]-a[2];
+	double vx = c[0]-a[0], vy = c[1]-a[1], vz = c[2]-a[2];
+	double wx = e[0]-a[0], wy = e[1]-a[1], wz = e[2]-a[2];
+
+	return (ux*(vy*wz - vz*wy) + uy*(vz*wx - vx*wz) + uz*(vx*wy - vy*wx));
+}
+
+static int
+Orient(const double *a, const double *b, const double *c, const double *e)
+{
+	double ux = b[0]-a[0], uy = b[1]-a[1], uz = b[2]-a[2];
+	double vx = c[0]-a[0], vy = c[1]-a[1], vz = c[2]-a[2];
+	double wx = e[0]-a[0], wy = e[1]-a[1], wz = e[2]-a[2];
+	double det, perm;
+
+	det = ux*(vy*wz - vz*wy) + uy*(vz*wx - vx*wz) + uz*(vx*wy - vy*wx);
+	perm = fabs(ux)*(fabs(vy*wz) + fabs(vz*wy)) +
+	       fabs(uy)*(fabs(vz*wx) + fabs(vx*wz)) +
+	       fabs(uz)*(fabs(vx*wy) + fabs(vy*wx));
+	if (det > CSG_O3D_BOUND*perm) {
+		return (1);
+	}
+	if (-det > CSG_O3D_BOUND*perm) {
+		return (-1);
+	}
+	return OrientExact(a, b, c, e);
+}
+
+/*
+ * Orientation with symbolic perturbation. The points flagged in mask
+ * (bit 0 for a through bit 3 for e) belong to B, which is considered
+ * scaled about P->ctr by a factor 1+P->grow*eps1, and then translated by
+ * eps2*(1,d,d^2), for infinitesimals 0 < eps2 << eps1 << 1, d << 1.
+ *
+ * The scaling moves the faces of B off the coincident faces of A in the
+ * direction which gives the expected result for coplanar contacts (a
+ * cutting tool flush with a face of the part extends past it). Writing
+ * the rows of the determinant as r_i + eps1*s_i, its coefficients in
+ * eps1 are sums of determinants mixing the r_i and s_i. If they all
+ * vanish, the sign is that of the dot product of the translation with
+ * the sum of the gradients with respect to the moving points. Returns 0
+ * only if the configuration is degenerate regardless of the perturbation.
+ */
+static int
+OrientP(const CSGPerturb *P, const double *a, const double *b,
+    const double *c, const double *e, Uint mask)
+{
+	const double *pts[3];
+	double r[3][3][2], sr[3][3][2], g[3][CSG_EXP_MAX/4];
+	double t[CSG_EXP_MAX/4], h[CSG_EXP_MAX/4], acc[CSG_EXP_MAX];
+	double tmp[CSG_EXP_MAX];
+	int nr[3][3], ns[3][3], ng[3], i, j, k, n, nt, sgn;
+	Uint moving, S;
+	int rv;
+
+	if ((rv = Orient(a, b, c, e)) != 0 || mask == 0 || mask == 0xf) {
+		return (rv);
+	}
+	pts[0] = b;
+	pts[1] = c;
+	pts[2] = e;
+	for (i = 0; i < 3; i++) {
+		int mi = (mask >> (i+1)) & 1, ma = mask & 1;
+
+		ExpDiff3(pts[i], a, r[i], nr[i]);
+		if (mi && ma) {
+			memcpy(sr[i], r[i], sizeof(r[i]));
+			memcpy(ns[i], nr[i], sizeof(nr[i]));
+		} else if (mi) {
+			ExpDiff3(pts[i], P->ctr, sr[i], ns[i]);
+		} else if (ma) {
+			ExpDiff3(P->ctr, a, sr[i], ns[i]);
+		} else {
+			ns[i][0] = ns[i][1] = ns[i][2] = 0;
+		}
+	}
+
+	/* Scaling: coefficients of eps1^k (k = 1 to 3). */
+	for (k = 1; k <= 3; k++) {
+		n = 0;
+		for (S = 0; S < 8; S++) {
+			double (*x[3])[2];
+			int *nx[3], m = 0;
+
+			for (j = 0; j < 3; j++) {
+				if (S & (1<<j)) {
+					x[j] = sr[j];
+					nx[j] = ns[j];
+					m++;
+				} else {
+					x[j] = r[j];
+					nx[j] = nr[j];
+				}
+			}
+			if (m != k) {
+				continue;
+			}
+			nt = ExpDet3(x[0], nx[0], x[1], nx[1], x[2], nx[2], h);
+			n = ExpSum(n, acc, nt, h, tmp);
+			memcpy(acc, tmp, n*sizeof(double));
+		}
+		if ((rv = ExpSign(n, acc)) != 0)
+			return ((P->grow < 0 && (k & 1)) ? -rv : rv);
+	}
+
+	/* Translation. The gradients sum to zero, so use the complement. */
+	if (mask & 0x1) {
+		moving = (~mask) & 0xe;
+		sgn = -1;
+	} else {
+		moving = mask;
+		sgn = 1;
+	}
+	for (k = 0; k < 3; k++) {
+		ng[k] = 0;
+		if (moving & 0x2) {			/* d/db = v x w */
+			nt = ExpCross(r[1], nr[1], r[2], nr[2], k, t);
+			ng[k] = ExpSum(ng[k], g[k], nt, t, h);
+			memcpy(g[k], h, ng[k]*sizeof(double));
+		}
+		if (moving & 0x4) {			/* d/dc = w x u */
+			nt = ExpCross(r[2], nr[2], r[0], nr[0], k, t);
+			ng[k] = ExpSum(ng[k], g[k], nt, t, h);
+			memcpy(g[k], h, ng[k]*sizeof(double));
+		}
+		if (moving & 0x8) {			/* d/de = u x v */
+			nt = ExpCross(r[0], nr[0], r[1], nr[1], k, t);
+			ng[k] = ExpSum(ng[k], g[k], nt, t, h);
+			memcpy(g[k], h, ng[k]*sizeof(double));
+		}
+		if ((rv = ExpSign(ng[k], g[k])) != 0)
+			return (sgn*rv);
+	}
+	return (0);
+}
+
+/*
+ * Test whether the segment pq crosses the interior of triangle x, where
+ * the points flagged in mask (see OrientP()) belong to B.
+ */
+static __inline__ int
+EdgeThruTri(const CSGPerturb *P, const double *p, const double *q,
+    double x[3][3], Uint mask)
+{
+	int s0, s1, s2;
+
+	if ((s0 = OrientP(P, p, q, x[0], x[1], mask)) == 0 ||
+	    (s1 = OrientP(P, p, q, x[1], x[2], mask)) != s0) {
+		return (0);
+	}
+	s2 = OrientP(P, p, q, x[2], x[0], mask);
+	return (s2 == s0);
+}
+
+/* Same as EdgeThruTri(), but also test p and q against the plane. */
+static int
+SegThruTri(const CSGPerturb *P, const double *p, const double *q,
+    double x[3][3], int segIsB)
+{
+	Uint planeMask = segIsB ? 0x8 : 0x7;
+	int sp, sq;
+
+	if ((sp = OrientP(P, x[0], x[1], x[2], p, planeMask)) == 0 ||
+	    (sq = OrientP(P, x[0], x[1], x[2], q, planeMask)) == 0 ||
+	    sp == sq) {
+		return (0);
+	}
+	return EdgeThruTri(P, p, q, x, segIsB ? 0x3 : 0xc);
+}
+
+/*
+ * Intersect triangle T of A with triangle U of B, given the merged vertex
+ * numbers of their corners (which order the edges consistently between
+ * the triangles sharing them). Return 1 and the events at the endpoints
+ * of the intersection segment, or 0 if they do not intersect.
+ */
+static int
+TriTri(const CSGPerturb *P, double T[3][3], const Uint32 *tc, double U[3][3],
+    const Uint32 *uc, Uint8 *ev)
+{
+	int sT[3], sU[3], k, k2, n = 0;
+
+	for (k = 0; k < 3; k++) {
+		if ((sT[k] = OrientP(P, U[0], U[1], U[2], T[k], 0x7)) == 0)
+			return (0);
+	}
+	if (sT[0] == sT[1] && sT[1] == sT[2]) {
+		return (0);
+	}
+	for (k = 0; k < 3; k++) {
+		if ((sU[k] = OrientP(P, T[0], T[1], T[2], U[k], 0x8)) == 0)
+			return (0);
+	}
+	if (sU[0] == sU[1] && sU[1] == sU[2]) {
+		return (0);
+	}
+	for (k = 0; k < 3; k++) {
+		k2 = (k+1)%3;
+		if (sT[k] == sT[k2]) {
+			continue;
+		}
+		if (tc[k] < tc[k2] ? EdgeThruTri(P, T[k], T[k2], U, 0xc) :
+		                     EdgeThruTri(P, T[k2], T[k], U, 0xc)) {
+			if (n == 2) { return (0); }
+			ev[n++] = (Uint8)k;
+		}
+	}
+	for (k = 0; k < 3; k++) {
+		k2 = (k+1)%3;
+		if (sU[k] == sU[k2]) {
+			continue;
+		}
+		if (uc[k] < uc[k2] ? EdgeThruTri(P, U[k], U[k2], T, 0x3) :
+		                     EdgeThruTri(P, U[k2], U[k], T, 0x3)) {
+			if (n == 2) { return (0); }
+			ev[n++] = (Uint8)(4+k);
+		}
+	}
+	return (n == 2);
+}
+
+static __inline__ void
+Pos(const CAD_Mesh *m, Uint32 v, double *p)
+{
+	const float *s = &m->v[v*3];
+
+	p[0] = (double)s[0];
+	p[1] = (double)s[1];
+	p[2] = (double)s[2];
+}
+
+static __inline__ void
+TriPos(const CAD_Mesh *m, Uint32 t, double P[3][3])
+{
+	const Uint32 *tri = &m->tri[t*3];
+
+	Pos(m, tri[0], P[0]);
+	Pos(m, tri[1], P[1]);
+	Pos(m, tri[2], P[2]);
+}
+
+static __inline__ void
+TriBounds(const CAD_Mesh *m, Uint32 t, float *min, float *max)
+{
+	const Uint32 *tri = &m->tri[t*3];
+	const float *a = &m->v[tri[0]*3];
+	const float *b = &m->v[tri[1]*3];
+	const float *c = &m->v[tri[2]*3];
+	Uint k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = MIN(a[k], MIN(b[k], c[k]));
+		max[k] = MAX(a[k], MAX(b[k], c[k]));
+	}
+}
+
+static __inline__ int
+BoxOverlap(const float *min1, const float *max1, const float *min2,
+    const float *max2)
+{
+	return (min1[0] <= max2[0] && max1[0] >= min2[0] &&
+	        min1[1] <= max2[1] && max1[1] >= min2[1] &&
+	        min1[2] <= max2[2] && max1[2] >= min2[2]);
+}
+
+/* Split count items into jobs running fn over [i1,i2) ranges. */
+static CSGJob *
+RunJobs(CSGCtx *ctx, CSGOperand *X, Uint count, Uint chunk, CAD_JobFn fn,
+    Uint *nJobs)
+{
+	CAD_JobGroup g;
+	CSGJob *jobs;
+	Uint n, per, i;
+
+	n = CAD_JobPoolThreads()*4;
+	if (count/n < chunk) {
+		n = count/chunk;
+	}
+	if (n < 1) {
+		n = 1;
+	}
+	per = count/n;
+	jobs = Malloc(n*sizeof(CSGJob));
+	memset(jobs, 0, n*sizeof(CSGJob));
+	for (i = 0; i < n; i++) {
+		jobs[i].ctx = ctx;
+		jobs[i].X = X;
+		jobs[i].i1 = i*per;
+		jobs[i].i2 = (i == n-1) ? count : (i+1)*per;
+	}
+	if (n == 1) {
+		fn(&jobs[0]);
+	} else {
+		CAD_JobGroupInit(&g);
+		for (i = 0; i < n; i++) {
+			CAD_JobSubmit(&g, fn, &jobs[i]);
+		}
+		CAD_JobGroupWait(&g);
+		CAD_JobGroupDestroy(&g);
+	}
+	*nJobs = n;
+	return (jobs);
+}
+
+/* Tag the triangles of X which overlap the bounds of the other operand. */
+static void
+NearJob(void *p)
+{
+	CSGJob *job = p;
+	CSGOperand *X = job->X, *Y = &job->ctx->op[!X->side];
+	float min[3], max[3];
+	Uint i;
+
+	for (i = job->i1; i < job->i2; i++) {
+		TriBounds(X->m, i, min, max);
+		if (!BoxOverlap(min, max, Y->min, Y->max)) {
+			X->tag[i] = CSG_FAR;
+			continue;
+		}
+		X->tag[i] = CSG_NEAR;
+		if (job->nNear+1 > job->maxNear) {
+			job->maxNear = (job->maxNear > 0) ? job->maxNear*2 : 256;
+			job->near = Realloc(job->near,
+			    job->maxNear*sizeof(Uint32));
+		}
+		job->near[job->nNear++] = (Uint32)i;
+	}
+}
+
+static int
+FindNear(CSGCtx *ctx, CSGOperand *X)
+{
+	CSGJob *jobs;
+	Uint nJobs, i;
+
+	if ((X->tag = TryMalloc((X->m->nt+1)*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	jobs = RunJobs(ctx, X, X->m->nt, CSG_CHUNK, NearJob, &nJobs);
+	for (i = 0, X->nNear = 0; i < nJobs; i++) {
+		X->nNear += jobs[i].nNear;
+	}
+	if ((X->near = TryMalloc((X->nNear+1)*sizeof(Uint32))) == NULL) {
+		goto fail;
+	}
+	for (i = 0, X->nNear = 0; i < nJobs; i++) {
+		if (jobs[i].nNear > 0) {
+			memcpy(&X->near[X->nNear], jobs[i].near,
+			    jobs[i].nNear*sizeof(Uint32));
+			X->nNear += jobs[i].nNear;
+		}
+		Free(jobs[i].near);
+	}
+	Free(jobs);
+	return (0);
+fail:
+	for (i = 0; i < nJobs; i++) {
+		Free(jobs[i].near);
+	}
+	Free(jobs);
+	return (-1);
+}
+
+static __inline__ Uint32
+HashFloats(const float *v)
+{
+	Uint32 h = 2166136261U, x;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		float f = v[k] + 0.0f;			/* Fold -0 into 0 */
+
+		memcpy(&x, &f, sizeof(x));
+		h = (h ^ x)*16777619U;
+		h ^= h >> 15;
+	}
+	return (h);
+}
+
+/*
+ * Merge the vertices of the near triangles of X by position. Every such
+ * vertex is mapped to the first vertex found at the same position.
+ */
+static int
+MergeVertices(CSGOperand *X)
+{
+	const CAD_Mesh *m = X->m;
+	Uint32 *table, mask, size = 64;
+	Uint i, k;
+
+	if ((X->canon = TryMalloc((m->nv+1)*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	memset(X->canon, 0xff, m->nv*sizeof(Uint32));
+	while (size < X->nNear*6) {
+		size <<= 1;
+	}
+	if ((table = TryMalloc(size*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	memset(table, 0xff, size*sizeof(Uint32));
+	mask = size-1;
+	for (i = 0; i < X->nNear; i++) {
+		const Uint32 *tri = &m->tri[X->near[i]*3];
+
+		for (k = 0; k < 3; k++) {
+			Uint32 v = tri[k], h;
+			const float *p = &m->v[v*3];
+
+			if (X->canon[v] != 0xffffffff) {
+				continue;
+			}
+			for (h = HashFloats(p) & mask; ; h = (h+1) & mask) {
+				const float *q;
+
+				if (table[h] == 0xffffffff) {
+					table[h] = v;
+					X->canon[v] = v;
+					break;
+				}
+				q = &m->v[table[h]*3];
+				if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+					X->canon[v] = table[h];
+					break;
+				}
+			}
+		}
+	}
+	Free(table);
+	return (0);
+}
+
+static int
+TestPair(void *arg, Uint32 u)
+{
+	CSGJob *job = arg;
+	CSGCtx *ctx = job->ctx;
+	const CAD_Mesh *ma = ctx->op[0].m, *mb = ctx->op[1].m;
+	const Uint32 *ta = &ma->tri[job->tri*3], *tb = &mb->tri[u*3];
+	Uint32 tc[3], uc[3];
+	double U[3][3];
+	Uint8 ev[2];
+	CSGSeg *s;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		tc[k] = ctx->op[0].canon[ta[k]];
+		uc[k] = ctx->op[1].canon[tb[k]];
+	}
+	TriPos(mb, u, U);
+	if (!TriTri(&ctx->P, job->T, tc, U, uc, ev)) {
+		return (0);
+	}
+	if (job->nSegs+1 > job->maxSegs) {
+		job->maxSegs = (job->maxSegs > 0) ? job->maxSegs*2 : 64;
+		job->segs = Realloc(job->segs, job->maxSegs*sizeof(CSGSeg));
+	}
+	s = &job->segs[job->nSegs++];
+	s->t[0] = job->tri;
+	s->t[1] = u;
+	s->ev[0] = ev[0];
+	s->ev[1] = ev[1];
+	return (0);
+}
+
+/* Intersect the near triangles of A with B. */
+static void
+IntersectJob(void *p)
+{
+	CSGJob *job = p;
+	CSGCtx *ctx = job->ctx;
+	const CAD_Mesh *ma = ctx->op[0].m;
+	float min[3], max[3];
+	Uint i;
+
+	for (i = job->i1; i < job->i2; i++) {
+		job->tri = ctx->op[0].near[i];
+		TriBounds(ma, job->tri, min, max);
+		TriPos(ma, job->tri, job->T);
+		CAD_BVHQueryBox(&ctx->bvh, min, max, TestPair, job);
+	}
+}
+
+static int
+Intersect(CSGCtx *ctx)
+{
+	CSGJob *jobs;
+	Uint nJobs, i;
+
+	jobs = RunJobs(ctx, &ctx->op[0], ctx->op[0].nNear, CSG_CHUNK/4,
+	    IntersectJob, &nJobs);
+	for (i = 0, ctx->nSegs = 0; i < nJobs; i++) {
+		ctx->nSegs += jobs[i].nSegs;
+	}
+	if ((ctx->segs = TryMalloc((ctx->nSegs+1)*sizeof(CSGSeg))) == NULL) {
+		goto fail;
+	}
+	for (i = 0, ctx->nSegs = 0; i < nJobs; i++) {
+		if (jobs[i].nSegs > 0) {
+			memcpy(&ctx->segs[ctx->nSegs], jobs[i].segs,
+			    jobs[i].nSegs*sizeof(CSGSeg));
+			ctx->nSegs += jobs[i].nSegs;
+		}
+		Free(jobs[i].segs);
+	}
+	Free(jobs);
+	return (0);
+fail:
+	for (i = 0; i < nJobs; i++) {
+		Free(jobs[i].segs);
+	}
+	Free(jobs);
+	return (-1);
+}
+
+static __inline__ Uint32
+HashKey(const Uint32 *key)
+{
+	Uint32 h = 2166136261U;
+	int k;
+
+	for (k = 0; k < 4; k++) {
+		h = (h ^ key[k])*16777619U;
+		h ^= h >> 13;
+	}
+	return (h);
+}
+
+/*
+ * Compute the position of an intersection point. The edge crosses the
+ * plane of the triangle where the (interpolated) orientation vanishes.
+ */
+static void
+PointPosition(CSGCtx *ctx, CSGPoint *pt)
+{
+	const CAD_Mesh *me = ctx->op[pt->key[3]].m;
+	const CAD_Mesh *mt = ctx->op[!pt->key[3]].m;
+	double P[3], Q[3], T[3][3], op, oq, lambda;
+	int k;
+
+	Pos(me, pt->key[0], P);
+	Pos(me, pt->key[1], Q);
+	TriPos(mt, pt->key[2], T);
+	op = OrientValue(T[0], T[1], T[2], P);
+	oq = OrientValue(T[0], T[1], T[2], Q);
+	lambda = (op != oq) ? op/(op - oq) : 0.5;
+	if (lambda < 0.0) { lambda = 0.0; }
+	if (lambda > 1.0) { lambda = 1.0; }
+	for (k = 0; k < 3; k++)
+		pt->x[k] = P[k] + lambda*(Q[k] - P[k]);
+}
+
+/*
+ * Assign unique intersection points to the segment endpoints, so that
+ * the triangles sharing an edge are split at the same points.
+ */
+static int
+BuildPoints(CSGCtx *ctx)
+{
+	Uint32 *table, mask, size = 64;
+	Uint i, e, maxPts = ctx->nSegs*2;
+
+	while (size < maxPts*2) {
+		size <<= 1;
+	}
+	if ((table = TryMalloc(size*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	if ((ctx->pts = TryMalloc((maxPts+1)*sizeof(CSGPoint))) == NULL) {
+		Free(table);
+		return (-1);
+	}
+	memset(table, 0xff, size*sizeof(Uint32));
+	mask = size-1;
+	ctx->nPts = 0;
+
+	for (i = 0; i < ctx->nSegs; i++) {
+		CSGSeg *s = &ctx->segs[i];
+
+		for (e = 0; e < 2; e++) {
+			Uint sd = s->ev[e] >> 2, k = s->ev[e] & 3;
+			CSGOperand *E = &ctx->op[sd];
+			const Uint32 *tri = &E->m->tri[s->t[sd]*3];
+			Uint32 key[4], h, ca, cb;
+
+			ca = E->canon[tri[k]];
+			cb = E->canon[tri[(k+1)%3]];
+			key[0] = MIN(ca, cb);
+			key[1] = MAX(ca, cb);
+			key[2] = s->t[!sd];
+			key[3] = sd;
+			for (h = HashKey(key) & mask; ; h = (h+1) & mask) {
+				CSGPoint *pt;
+
+				if (table[h] == 0xffffffff) {
+					table[h] = ctx->nPts;
+					pt = &ctx->pts[ctx->nPts++];
+					memcpy(pt->key, key, sizeof(key));
+					PointPosition(ctx, pt);
+					break;
+				}
+				pt = &ctx->pts[table[h]];
+				if (memcmp(pt->key, key, sizeof(key)) == 0)
+					break;
+			}
+			s->pt[e] = table[h];
+		}
+	}
+	Free(table);
+	return (0);
+}
+
+/* Group the segments by intersected triangle of X. */
+static int
+BuildSplits(CSGCtx *ctx, CSGOperand *X)
+{
+	Uint i, maxSplits = 0, *fill;
+
+	X->nSplits = 0;
+	for (i = 0; i < ctx->nSegs; i++) {
+		Uint32 t = ctx->segs[i].t[X->side];
+		CSGSplit *sp;
+
+		if (X->tag[t] == CSG_NEAR) {
+			if (X->nSplits+1 > maxSplits) {
+				maxSplits = (maxSplits > 0) ? maxSplits*2 : 64;
+				X->splits = Realloc(X->splits,
+				    maxSplits*sizeof(CSGSplit));
+			}
+			sp = &X->splits[X->nSplits];
+			sp->tri = t;
+			sp->nSegs = 0;
+			sp->sub = NULL;
+			sp->nSub = 0;
+			X->tag[t] = X->nSplits++;
+		}
+		X->splits[X->tag[t]].nSegs++;
+	}
+	if ((X->segList = TryMalloc((ctx->nSegs+1)*sizeof(Uint))) == NULL) {
+		return (-1);
+	}
+	fill = Malloc((X->nSplits+1)*sizeof(Uint));
+	for (i = 0; i < X->nSplits; i++) {
+		X->splits[i].segFirst = (i > 0) ?
+		    X->splits[i-1].segFirst + X->splits[i-1].nSegs : 0;
+		fill[i] = X->splits[i].segFirst;
+	}
+	for (i = 0; i < ctx->nSegs; i++) {
+		Uint32 t = ctx->segs[i].t[X->side];
+
+		X->segList[fill[X->tag[t]]++] = i;
+	}
+	Free(fill);
+	return (0);
+}
+
+/*
+ * Local constrained triangulation of an intersected triangle, in the
+ * plane of the triangle.
+ */
+static __inline__ double
+Orient2(const CSGLocal *L, int a, int b, int c)
+{
+	const double *pa = &L->xy[a*2], *pb = &L->xy[b*2], *pc = &L->xy[c*2];
+
+	return ((pb[0]-pa[0])*(pc[1]-pa[1]) - (pb[1]-pa[1])*(pc[0]-pa[0]));
+}
+
+static __inline__ double
+Dist2(const CSGLocal *L, int a, int b)
+{
+	double dx = L->xy[b*2] - L->xy[a*2];
+	double dy = L->xy[b*2+1] - L->xy[a*2+1];
+
+	return (dx*dx + dy*dy);
+}
+
+static int
+LocPoint(CSGLocal *L, double x, double y, Uint32 ref)
+{
+	if (L->nPts+1 > L->maxPts) {
+		L->maxPts = (L->maxPts > 0) ? L->maxPts*2 : 32;
+		L->xy = Realloc(L->xy, L->maxPts*2*sizeof(double));
+		L->ref = Realloc(L->ref, L->maxPts*sizeof(Uint32));
+	}
+	L->xy[L->nPts*2] = x;
+	L->xy[L->nPts*2+1] = y;
+	L->ref[L->nPts] = ref;
+	return (L->nPts++);
+}
+
+static int
+LocNewTri(CSGLocal *L)
+{
+	CSGLTri *T;
+
+	if (L->nTris+1 > L->maxTris) {
+		L->maxTris = (L->maxTris > 0) ? L->maxTris*2 : 32;
+		L->t = Realloc(L->t, L->maxTris*sizeof(CSGLTri));
+	}
+	T = &L->t[L->nTris];
+	T->con = 0;
+	T->vote = 0;
+	return (L->nTris++);
+}
+
+static __inline__ void
+LocSetTri(CSGLocal *L, int ti, int a, int b, int c, int na, int nb, int nc,
+    Uint con)
+{
+	CSGLTri *T = &L->t[ti];
+
+	T->v[0] = a;	T->v[1] = b;	T->v[2] = c;
+	T->nb[0] = na;	T->nb[1] = nb;	T->nb[2] = nc;
+	T->con = (Uint8)con;
+}
+
+/* In triangle ti, replace the neighbor old by new. */
+static __inline__ void
+LocSetNb(CSGLocal *L, int ti, int old, int new)
+{
+	int k;
+
+	if (ti < 0) {
+		return;
+	}
+	for (k = 0; k < 3; k++) {
+		if (L->t[ti].nb[k] == old) {
+			L->t[ti].nb[k] = new;
+			return;
+		}
+	}
+}
+
+/* Index of the edge of ti starting at point a. */
+static __inline__ int
+LocEdgeFrom(const CSGLocal *L, int ti, int a)
+{
+	const CSGLTri *T = &L->t[ti];
+
+	return (T->v[0] == a) ? 0 : (T->v[1] == a) ? 1 : 2;
+}
+
+/* Find the triangle containing the directed edge a-b. */
+static int
+LocFindEdge(const CSGLocal *L, int a, int b, int *kp)
+{
+	int ti, k;
+
+	for (ti = 0; ti < L->nTris; ti++) {
+		const CSGLTri *T = &L->t[ti];
+
+		for (k = 0; k < 3; k++) {
+			if (T->v[k] == a && T->v[(k+1)%3] == b) {
+				*kp = k;
+				return (ti);
+			}
+		}
+	}
+	return (-1);
+}
+
+static void
+LocSplitTri(CSGLocal *L, int ti, int p)
+{
+	CSGLTri T = L->t[ti];
+	int t1, t2;
+
+	t1 = LocNewTri(L);
+	t2 = LocNewTri(L);
+	LocSetTri(L, ti, T.v[0], T.v[1], p, T.nb[0], t1, t2, T.con & 1);
+	LocSetTri(L, t1, T.v[1], T.v[2], p, T.nb[1], t2, ti, (T.con>>1) & 1);
+	LocSetTri(L, t2, T.v[2], T.v[0], p, T.nb[2], ti, t1, (T.con>>2) & 1);
+	LocSetNb(L, T.nb[1], ti, t1);
+	LocSetNb(L, T.nb[2], ti, t2);
+}
+
+/* Split edge k of ti (and the neighboring triangle) at point p. */
+static void
+LocSplitEdge(CSGLocal *L, int ti, int k, int p)
+{
+	CSGLTri T = L->t[ti], U;
+	int a = T.v[k], b = T.v[(k+1)%3], c = T.v[(k+2)%3];
+	int nBC = T.nb[(k+1)%3], nCA = T.nb[(k+2)%3], tj = T.nb[k];
+	Uint cAB = (T.con>>k) & 1, cBC = (T.con>>((k+1)%3)) & 1;
+	Uint cCA = (T.con>>((k+2)%3)) & 1;
+	int t1, t3 = -1, m, d, nAD, nDB;
+	Uint cAD, cDB;
+
+	t1 = LocNewTri(L);
+	if (tj >= 0) {
+		t3 = LocNewTri(L);
+	}
+	LocSetTri(L, ti, a, p, c, t3, t1, nCA, cAB | (cCA<<2));
+	LocSetTri(L, t1, p, b, c, tj, nBC, ti, cAB | (cBC<<1));
+	LocSetNb(L, nBC, ti, t1);
+	if (tj >= 0) {
+		U = L->t[tj];
+		m = LocEdgeFrom(L, tj, b);
+		d = U.v[(m+2)%3];
+		nAD = U.nb[(m+1)%3];
+		nDB = U.nb[(m+2)%3];
+		cAD = (U.con>>((m+1)%3)) & 1;
+		cDB = (U.con>>((m+2)%3)) & 1;
+		LocSetTri(L, tj, b, p, d, t1, t3, nDB, cAB | (cDB<<2));
+		LocSetTri(L, t3, p, a, d, ti, nAD, tj, cAB | (cAD<<1));
+		LocSetNb(L, nAD, tj, t3);
+	}
+}
+
+/* Replace edge k of ti (a-b) by the other diagonal of the quad. */
+static void
+LocFlip(CSGLocal *L, int ti, int k)
+{
+	CSGLTri T = L->t[ti], U;
+	int a = T.v[k], b = T.v[(k+1)%3], c = T.v[(k+2)%3];
+	int tj = T.nb[k], m, d;
+	int nBC = T.nb[(k+1)%3], nCA = T.nb[(k+2)%3], nAD, nDB;
+	Uint cBC = (T.con>>((k+1)%3)) & 1, cCA = (T.con>>((k+2)%3)) & 1;
+	Uint cAD, cDB;
+
+	U = L->t[tj];
+	m = LocEdgeFrom(L, tj, b);
+	d = U.v[(m+2)%3];
+	nAD = U.nb[(m+1)%3];
+	nDB = U.nb[(m+2)%3];
+	cAD = (U.con>>((m+1)%3)) & 1;
+	cDB = (U.con>>((m+2)%3)) & 1;
+	LocSetTri(L, ti, c, a, d, nCA, nAD, tj, cCA | (cAD<<1));
+	LocSetTri(L, tj, d, b, c, nDB, nBC, ti, cDB | (cBC<<1));
+	LocSetNb(L, nAD, tj, ti);
+	LocSetNb(L, nBC, ti, tj);
+}
+
+/*
+ * Insert an interior point. Return the point it was merged with if it
+ * coincides with an existing point.
+ */
+static int
+LocInsert(CSGLocal *L, int p)
+{
+	double best = -DBL_MAX, tol2 = L->tol*L->tol;
+	int ti, k, bestTri = 0, bestK = 0;
+
+	for (ti = 0; ti < L->nTris; ti++) {
+		const CSGLTri *T = &L->t[ti];
+		double dMin = DBL_MAX;
+		int kMin = 0;
+
+		for (k = 0; k < 3; k++) {
+			int a = T->v[k], b = T->v[(k+1)%3];
+			double len = sqrt(Dist2(L, a, b)), d;
+
+			d = (len > 0.0) ? Orient2(L, a, b, p)/len : 0.0;
+			if (d < dMin) {
+				dMin = d;
+				kMin = k;
+			}
+		}
+		if (dMin > best) {
+			best = dMin;
+			bestTri = ti;
+			bestK = kMin;
+		}
+	}
+	for (k = 0; k < 3; k++) {
+		int v = L->t[bestTri].v[k];
+
+		if (Dist2(L, v, p) <= tol2)
+			return (v);
+	}
+	if (best > L->tol) {
+		LocSplitTri(L, bestTri, p);
+	} else {
+		LocSplitEdge(L, bestTri, bestK, p);
+	}
+	return (p);
+}
+
+/* Test whether segments a-b and c-d cross at an interior point. */
+static __inline__ int
+LocCrosses(const CSGLocal *L, int a, int b, int c, int d)
+{
+	double o1, o2, o3, o4;
+
+	if (c == a || c == b || d == a || d == b) {
+		return (0);
+	}
+	o1 = Orient2(L, a, b, c);
+	o2 = Orient2(L, a, b, d);
+	if (!((o1 > 0.0 && o2 < 0.0) || (o1 < 0.0 && o2 > 0.0))) {
+		return (0);
+	}
+	o3 = Orient2(L, c, d, a);
+	o4 = Orient2(L, c, d, b);
+	return ((o3 > 0.0 && o4 < 0.0) || (o3 < 0.0 && o4 > 0.0));
+}
+
+static void
+LocMarkEdge(CSGLocal *L, int a, int b)
+{
+	int ti, k;
+
+	if ((ti = LocFindEdge(L, a, b, &k)) != -1) {
+		L->t[ti].con |= (1 << k);
+	}
+	if ((ti = LocFindEdge(L, b, a, &k)) != -1)
+		L->t[ti].con |= (1 << k);
+}
+
+static void
+LocQueue(CSGLocal *L, int *n, int a, int b)
+{
+	if ((*n+1)*2 > L->maxQueue) {
+		L->maxQueue = (L->maxQueue > 0) ? L->maxQueue*2 : 64;
+		L->queue = Realloc(L->queue, L->maxQueue*sizeof(int));
+	}
+	L->queue[(*n)*2] = a;
+	L->queue[(*n)*2+1] = b;
+	(*n)++;
+}
+
+/*
+ * Make a-b an edge of the triangulation by flipping the edges which
+ * cross it (S.W. Sloan, "A fast algorithm for generating constrained
+ * Delaunay triangulations"), and mark it as constrained.
+ */
+static void
+LocConstrain(CSGLocal *L, int a, int b)
+{
+	int ti, tj, k, m, c, d, u, w, head = 0, n = 0, iter = 0;
+
+	if (a == b) {
+		return;
+	}
+	for (ti = 0; ti < L->nTris; ti++) {
+		const CSGLTri *T = &L->t[ti];
+
+		for (k = 0; k < 3; k++) {
+			if (T->nb[k] > ti &&
+			    LocCrosses(L, a, b, T->v[k], T->v[(k+1)%3]))
+				LocQueue(L, &n, T->v[k], T->v[(k+1)%3]);
+		}
+	}
+	while (head < n && iter++ < CSG_FLIPS_MAX) {
+		u = L->queue[head*2];
+		w = L->queue[head*2+1];
+		head++;
+		if ((ti = LocFindEdge(L, u, w, &k)) == -1 ||
+		    (tj = L->t[ti].nb[k]) == -1) {
+			continue;
+		}
+		c = L->t[ti].v[(k+2)%3];
+		m = LocEdgeFrom(L, tj, w);
+		d = L->t[tj].v[(m+2)%3];
+		if (Orient2(L, c, u, d) > 0.0 && Orient2(L, d, w, c) > 0.0) {
+			LocFlip(L, ti, k);
+			if (LocCrosses(L, a, b, c, d))
+				LocQueue(L, &n, c, d);
+		} else {
+			LocQueue(L, &n, u, w);
+		}
+		if (head > 1024 && head*2 > n) {	/* Compact the queue */
+			memmove(L->queue, &L->queue[head*2],
+			    (n-head)*2*sizeof(int));
+			n -= head;
+			head = 0;
+		}
+	}
+	LocMarkEdge(L, a, b);
+}
+
+static __inline__ double
+InCircle(const CSGLocal *L, int a, int b, int c, int d)
+{
+	const double *pa = &L->xy[a*2], *pb = &L->xy[b*2];
+	const double *pc = &L->xy[c*2], *pd = &L->xy[d*2];
+	double adx = pa[0]-pd[0], ady = pa[1]-pd[1];
+	double bdx = pb[0]-pd[0], bdy = pb[1]-pd[1];
+	double cdx = pc[0]-pd[0], cdy = pc[1]-pd[1];
+
+	return ((adx*adx + ady*ady)*(bdx*cdy - bdy*cdx) +
+	        (bdx*bdx + bdy*bdy)*(cdx*ady - cdy*adx) +
+	        (cdx*cdx + cdy*cdy)*(adx*bdy - ady*bdx));
+}
+
+/* Improve the shape of the triangles by flipping unconstrained edges. */
+static void
+LocDelaunay(CSGLocal *L)
+{
+	int ti, tj, k, m, a, b, c, d, pass, nFlips;
+
+	for (pass = 0; pass < 64; pass++) {
+		nFlips = 0;
+		for (ti = 0; ti < L->nTris; ti++) {
+			for (k = 0; k < 3; k++) {
+				CSGLTri *T = &L->t[ti];
+
+				if ((tj = T->nb[k]) < ti || (T->con & (1<<k))) {
+					continue;
+				}
+				a = T->v[k];
+				b = T->v[(k+1)%3];
+				c = T->v[(k+2)%3];
+				m = LocEdgeFrom(L, tj, b);
+				d = L->t[tj].v[(m+2)%3];
+				if (InCircle(L, a, b, c, d) > L->tolCirc &&
+				    Orient2(L, c, a, d) > 0.0 &&
+				    Orient2(L, d, b, c) > 0.0) {
+					LocFlip(L, ti, k);
+					nFlips++;
+					k = -1;
+				}
+			}
+		}
+		if (nFlips == 0)
+			break;
+	}
+}
+
+static int
+ComparePid(const void *p1, const void *p2)
+{
+	Uint32 a = *(const Uint32 *)p1, b = *(const Uint32 *)p2;
+
+	return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+static int
+CompareLambda(const void *p1, const void *p2)
+{
+	const CSGLSort *a = p1, *b = p2;
+
+	return (a->lambda < b->lambda) ? -1 : (a->lambda > b->lambda) ? 1 : 0;
+}
+
+static int
+LocFindPid(const CSGLocal *L, Uint32 pid)
+{
+	Uint32 *p;
+
+	p = bsearch(&pid, L->pids, L->nPids, sizeof(Uint32), ComparePid);
+	return (int)(p - L->pids);
+}
+
+/*
+ * Retriangulate a triangle of X along its intersection segments, and
+ * determine on which side of the other operand the triangles adjacent
+ * to each segment lie.
+ */
+static void
+Retriangulate(CSGJob *job, CSGSplit *sp)
+{
+	CSGCtx *ctx = job->ctx;
+	CSGOperand *X = job->X, *Y = &ctx->op[!X->side];
+	CSGLocal *L = &job->loc;
+	double C[3][3], O[3][3], n[3], e[3], scale;
+	Uint side = X->side, i, j;
+	int ax0, ax1, k, nPids;
+
+	TriPos(X->m, sp->tri, C);
+
+	/* Project along the dominant axis, keeping the orientation. */
+	for (k = 0; k < 3; k++) {
+		int k1 = (k+1)%3, k2 = (k+2)%3;
+
+		n[k] = (C[1][k1]-C[0][k1])*(C[2][k2]-C[0][k2]) -
+		       (C[1][k2]-C[0][k2])*(C[2][k1]-C[0][k1]);
+	}
+	k = (fabs(n[0]) > fabs(n[1])) ?
+	    (fabs(n[0]) > fabs(n[2]) ? 0 : 2) :
+	    (fabs(n[1]) > fabs(n[2]) ? 1 : 2);
+	ax0 = (n[k] >= 0.0) ? (k+1)%3 : (k+2)%3;
+	ax1 = (n[k] >= 0.0) ? (k+2)%3 : (k+1)%3;
+
+	L->nPts = 0;
+	L->nTris = 0;
+	for (k = 0; k < 3; k++) {
+		LocPoint(L, C[k][ax0], C[k][ax1], (Uint32)k);
+	}
+	LocNewTri(L);
+	LocSetTri(L, 0, 0, 1, 2, -1, -1, -1, 0);
+	scale = MAX(MAX(sqrt(Dist2(L, 0, 1)), sqrt(Dist2(L, 1, 2))),
+	    sqrt(Dist2(L, 2, 0)));
+	L->tol = scale*CSG_TOL;
+	L->tolCirc = scale*scale*scale*scale*CSG_TOL;
+
+	/* Gather the distinct intersection points. */
+	if ((int)sp->nSegs*2 > L->maxPids) {
+		L->maxPids = sp->nSegs*2;
+		L->pids = Realloc(L->pids, L->maxPids*sizeof(Uint32));
+		L->edge = Realloc(L->edge, L->maxPids*sizeof(int));
+		L->local = Realloc(L->local, L->maxPids*sizeof(int));
+		L->order = Realloc(L->order, L->maxPids*sizeof(CSGLSort));
+	}
+	for (i = 0, L->nPids = 0; i < sp->nSegs; i++) {
+		const CSGSeg *s = &ctx->segs[X->segList[sp->segFirst+i]];
+
+		L->pids[L->nPids++] = s->pt[0];
+		L->pids[L->nPids++] = s->pt[1];
+	}
+	qsort(L->pids, L->nPids, sizeof(Uint32), ComparePid);
+	for (k = 1, nPids = 1; k < L->nPids; k++) {
+		if (L->pids[k] != L->pids[nPids-1])
+			L->pids[nPids++] = L->pids[k];
+	}
+	L->nPids = nPids;
+	for (k = 0; k < nPids; k++) {
+		const double *x = ctx->pts[L->pids[k]].x;
+
+		L->edge[k] = -1;
+		L->local[k] = LocPoint(L, x[ax0], x[ax1], 3+L->pids[k]);
+	}
+	for (i = 0; i < sp->nSegs; i++) {
+		const CSGSeg *s = &ctx->segs[X->segList[sp->segFirst+i]];
+
+		for (j = 0; j < 2; j++) {
+			if ((Uint)(s->ev[j] >> 2) == side)
+				L->edge[LocFindPid(L, s->pt[j])] = s->ev[j] & 3;
+		}
+	}
+
+	/* Split the edges at their intersection points, in order. */
+	for (k = 0; k < 3; k++) {
+		int k1 = (k+1)%3, nOrd = 0, prev = k, ti, ke, p;
+		double len2;
+
+		for (j = 0; j < 3; j++) {
+			e[j] = C[k1][j] - C[k][j];
+		}
+		len2 = e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+		for (i = 0; i < (Uint)nPids; i++) {
+			const double *x = ctx->pts[L->pids[i]].x;
+
+			if (L->edge[i] != k) {
+				continue;
+			}
+			L->order[nOrd].lambda = ((x[0]-C[k][0])*e[0] +
+			                         (x[1]-C[k][1])*e[1] +
+			                         (x[2]-C[k][2])*e[2])/len2;
+			L->order[nOrd].i = (int)i;
+			nOrd++;
+		}
+		qsort(L->order, nOrd, sizeof(CSGLSort), CompareLambda);
+		for (i = 0; i < (Uint)nOrd; i++) {
+			int *loc = &L->local[L->order[i].i];
+
+			p = *loc;
+			if (Dist2(L, p, prev) <= L->tol*L->tol) {
+				*loc = prev;
+				continue;
+			}
+			if (Dist2(L, p, k1) <= L->tol*L->tol) {
+				*loc = k1;
+				continue;
+			}
+			if ((ti = LocFindEdge(L, prev, k1, &ke)) != -1) {
+				LocSplitEdge(L, ti, ke, p);
+			}
+			prev = p;
+		}
+	}
+	for (k = 0; k < nPids; k++) {
+		if (L->edge[k] == -1)
+			L->local[k] = LocInsert(L, L->local[k]);
+	}
+
+	/* Recover the intersection segments. */
+	for (i = 0; i < sp->nSegs; i++) {
+		const CSGSeg *s = &ctx->segs[X->segList[sp->segFirst+i]];
+
+		LocConstrain(L, L->local[LocFindPid(L, s->pt[0])],
+		                L->local[LocFindPid(L, s->pt[1])]);
+	}
+	LocDelaunay(L);
+
+	/*
+	 * The plane of the other triangle cuts this one along the segment,
+	 * so everything on one side of the segment lies on the same side of
+	 * that plane as the corners on that side. Use the corner farthest
+	 * from the segment, whose side is known exactly.
+	 */
+	for (i = 0; i < sp->nSegs; i++) {
+		const CSGSeg *s = &ctx->segs[X->segList[sp->segFirst+i]];
+		int a = L->local[LocFindPid(L, s->pt[0])];
+		int b = L->local[LocFindPid(L, s->pt[1])];
+		int tl, tr, kl, kr, c = 0, sc, vote;
+		double o, oMax = -1.0;
+
+		if (a == b) {
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			if ((o = fabs(Orient2(L, a, b, k))) > oMax) {
+				oMax = o;
+				c = k;
+			}
+		}
+		TriPos(Y->m, s->t[!side], O);
+		if ((sc = OrientP(&ctx->P, O[0], O[1], O[2], C[c],
+		    side ? 0x8 : 0x7)) == 0) {
+			continue;
+		}
+		vote = (Orient2(L, a, b, c) > 0.0) ? sc : -sc;
+		if ((tl = LocFindEdge(L, a, b, &kl)) != -1) {
+			L->t[tl].vote += vote;
+		}
+		if ((tr = LocFindEdge(L, b, a, &kr)) != -1)
+			L->t[tr].vote -= vote;
+	}
+
+	sp->sub = Malloc(L->nTris*sizeof(CSGSub));
+	sp->nSub = L->nTris;
+	for (k = 0; k < L->nTris; k++) {
+		const CSGLTri *T = &L->t[k];
+		CSGSub *sub = &sp->sub[k];
+
+		sub->v[0] = L->ref[T->v[0]];
+		sub->v[1] = L->ref[T->v[1]];
+		sub->v[2] = L->ref[T->v[2]];
+		sub->con = T->con;
+		sub->vote = (T->vote > 0) ? 1 : (T->vote < 0) ? -1 : 0;
+	}
+}
+
+static void
+SplitJob(void *p)
+{
+	CSGJob *job = p;
+	CSGLocal *L = &job->loc;
+	Uint i;
+
+	memset(L, 0, sizeof(CSGLocal));
+	for (i = job->i1; i < job->i2; i++) {
+		Retriangulate(job, &job->X->splits[i]);
+	}
+	Free(L->xy);
+	Free(L->ref);
+	Free(L->t);
+	Free(L->pids);
+	Free(L->edge);
+	Free(L->local);
+	Free(L->order);
+	Free(L->queue);
+}
+
+static void
+SplitAll(CSGCtx *ctx, CSGOperand *X)
+{
+	CSGJob *jobs;
+	Uint nJobs;
+
+	jobs = RunJobs(ctx, X, X->nSplits, CSG_SPLIT_CHUNK, SplitJob, &nJobs);
+	Free(jobs);
+}
+
+/* Position of a corner or intersection point of a split triangle. */
+static __inline__ void
+RefPos(const CSGCtx *ctx, const CSGOperand *X, Uint32 tri, Uint32 ref,
+    double *p)
+{
+	if (ref < 3) {
+		Pos(X->m, X->m->tri[tri*3 + ref], p);
+	} else {
+		memcpy(p, ctx->pts[ref-3].x, 3*sizeof(double));
+	}
+}
+
+typedef struct csg_ray {
+	const CSGCtx *ctx;
+	const CSGOperand *Y;
+	double p[3], q[3];
+	int segIsB;
+	Uint n;
+} CSGRay;
+
+static int
+RayTest(void *arg, Uint32 t)
+{
+	CSGRay *r = arg;
+	double T[3][3];
+
+	TriPos(r->Y->m, t, T);
+	if (SegThruTri(&r->ctx->P, r->p, r->q, T, r->segIsB)) {
+		r->n++;
+	}
+	return (0);
+}
+
+/*
+ * Test whether a point on the surface of X lies inside the other operand
+ * from the parity of the crossings of a segment towards +x.
+ */
+static int
+PointInside(const CSGCtx *ctx, const CSGOperand *X, const double *p)
+{
+	const CSGOperand *Y = &ctx->op[!X->side];
+	const CAD_Mesh *m = Y->m;
+	float min[3], max[3];
+	CSGRay r;
+	Uint i;
+
+	r.ctx = ctx;
+	r.Y = Y;
+	r.segIsB = (X->side == 1);
+	r.n = 0;
+	memcpy(r.p, p, 3*sizeof(double));
+	r.q[0] = (double)Y->max[0] + 1.0 + fabs((double)Y->max[0]);
+	r.q[1] = p[1];
+	r.q[2] = p[2];
+	if (r.q[0] <= p[0]) {
+		return (0);
+	}
+	for (i = 0; i < 3; i++) {
+		double slack = 1e-6*(fabs(p[i]) + 1.0);
+
+		min[i] = (float)(p[i] - slack);
+		max[i] = (float)(((i == 0) ? r.q[0] : p[i]) + slack);
+	}
+	if (Y->side == 1) {
+		CAD_BVHQueryBox(&ctx->bvh, min, max, RayTest, &r);
+	} else {
+		for (i = 0; i < m->nt; i++) {
+			float tmin[3], tmax[3];
+
+			TriBounds(m, i, tmin, tmax);
+			if (BoxOverlap(tmin, tmax, min, max))
+				RayTest(&r, i);
+		}
+	}
+	return (r.n & 1);
+}
+
+static __inline__ Uint32
+HashPos(const double *x)
+{
+	Uint32 h = 2166136261U, w[2];
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		double d = x[k] + 0.0;			/* Fold -0 into 0 */
+
+		memcpy(w, &d, sizeof(w));
+		h = (h ^ w[0])*16777619U;
+		h = (h ^ w[1])*16777619U;
+		h ^= h >> 15;
+	}
+	return (h);
+}
+
+/*
+ * Identify the intersection points and the near vertices of X which lie
+ * at the same position (the intersections in degenerate configurations
+ * fall exactly on vertices or on each other). Faces refer to vertex v of
+ * X as canon[v], and to intersection point i as nv+pmap[i].
+ */
+static Uint32 *
+MapPoints(const CSGCtx *ctx, const CSGOperand *X)
+{
+	const CAD_Mesh *m = X->m;
+	Uint32 *pmap, *table, *ids, mask, size = 64;
+	double (*pos)[3];
+	Uint i, k, n = 0;
+
+	while (size < (X->nNear*3 + ctx->nPts)*2) {
+		size <<= 1;
+	}
+	mask = size-1;
+	pmap = Malloc((ctx->nPts+1)*sizeof(Uint32));
+	table = Malloc(size*sizeof(Uint32));
+	ids = Malloc((X->nNear*3 + ctx->nPts + 1)*sizeof(Uint32));
+	pos = Malloc((X->nNear*3 + ctx->nPts + 1)*sizeof(double)*3);
+	memset(table, 0xff, size*sizeof(Uint32));
+
+	for (i = 0; i < X->nNear*3 + ctx->nPts; i++) {
+		Uint32 h, id;
+		double *x = pos[n];
+
+		if (i < X->nNear*3) {
+			Uint32 v = m->tri[X->near[i/3]*3 + i%3];
+
+			if (X->canon[v] != v) {
+				continue;
+			}
+			Pos(m, v, x);
+			id = v;
+		} else {
+			memcpy(x, ctx->pts[i - X->nNear*3].x, 3*sizeof(double));
+			id = m->nv + (i - X->nNear*3);
+		}
+		for (h = HashPos(x) & mask; ; h = (h+1) & mask) {
+			const double *y;
+
+			if (table[h] == 0xffffffff) {
+				table[h] = n;
+				ids[n++] = id;
+				break;
+			}
+			y = pos[table[h]];
+			if (x[0] == y[0] && x[1] == y[1] && x[2] == y[2]) {
+				id = ids[table[h]];
+				break;
+			}
+		}
+		if (i >= X->nNear*3) {
+			k = i - X->nNear*3;
+			pmap[k] = id - m->nv;	/* Wraps for vertices */
+		}
+	}
+	Free(pos);
+	Free(ids);
+	Free(table);
+	return (pmap);
+}
+
+/* Face with coincident vertices (such faces are discarded). */
+static __inline__ int
+FaceDegenerate(const CSGFace *f)
+{
+	return (f->v[0] == f->v[1] || f->v[1] == f->v[2] || f->v[2] == f->v[0]);
+}
+
+static Uint32
+FindRoot(Uint32 *parent, Uint32 i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return (i);
+}
+
+/*
+ * Group the near triangles of X (after splitting) into patches which
+ * are not separated by intersection curves, and determine whether each
+ * patch lies inside the other operand. Returns the faces in *pFaces and
+ * the inside flag of each face in *pInside.
+ */
+static int
+Classify(CSGCtx *ctx, CSGOperand *X, CSGFace **pFaces, Uint *pnFaces,
+    Uint8 **pInside)
+{
+	const CAD_Mesh *m = X->m;
+	CSGFace *faces;
+	CSGEdge *edges;
+	Uint32 *parent, mask, size = 64;
+	Sint32 *votes;
+	Uint8 *inside, *known;
+	Uint nFaces = 0, i, j, k;
+	Uint32 *pmap;
+
+	for (i = 0; i < X->nNear; i++) {
+		Uint32 tag = X->tag[X->near[i]];
+
+		nFaces += (tag == CSG_NEAR) ? 1 : X->splits[tag].nSub;
+	}
+	if ((faces = TryMalloc((nFaces+1)*sizeof(CSGFace))) == NULL) {
+		return (-1);
+	}
+	pmap = MapPoints(ctx, X);
+	for (i = 0, nFaces = 0; i < X->nNear; i++) {
+		Uint32 t = X->near[i], tag = X->tag[t];
+		const Uint32 *tri = &m->tri[t*3];
+		CSGSplit *sp;
+
+		if (tag == CSG_NEAR) {
+			CSGFace *f = &faces[nFaces++];
+
+			for (k = 0; k < 3; k++) {
+				f->v[k] = X->canon[tri[k]];
+			}
+			f->tri = t;
+			f->sub = CSG_NEAR;
+			f->con = 0;
+			f->vote = 0;
+			continue;
+		}
+		sp = &X->splits[tag];
+		for (j = 0; j < sp->nSub; j++) {
+			const CSGSub *sub = &sp->sub[j];
+			CSGFace *f = &faces[nFaces++];
+
+			for (k = 0; k < 3; k++) {
+				f->v[k] = (sub->v[k] < 3) ?
+				    X->canon[tri[sub->v[k]]] :
+				    m->nv + pmap[sub->v[k] - 3];
+			}
+			f->tri = t;
+			f->sub = j;
+			f->con = sub->con;
+			f->vote = sub->vote;
+		}
+	}
+
+	Free(pmap);
+
+	/* Join the faces across unconstrained edges. */
+	while (size < nFaces*6) {
+		size <<= 1;
+	}
+	mask = size-1;
+	if ((edges = TryMalloc(size*sizeof(CSGEdge))) == NULL) {
+		Free(faces);
+		return (-1);
+	}
+	parent = Malloc((nFaces+1)*sizeof(Uint32));
+	memset(edges, 0xff, size*sizeof(CSGEdge));
+	for (i = 0; i < nFaces; i++) {
+		parent[i] = i;
+	}
+	for (i = 0; i < nFaces; i++) {
+		const CSGFace *f = &faces[i];
+
+		if (FaceDegenerate(f)) {
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			Uint32 a = MIN(f->v[k], f->v[(k+1)%3]);
+			Uint32 b = MAX(f->v[k], f->v[(k+1)%3]);
+			Uint32 key[4], h, con = (f->con >> k) & 1;
+
+			if (a == b) {
+				continue;
+			}
+			key[0] = a;
+			key[1] = b;
+			key[2] = key[3] = 0;
+			for (h = HashKey(key) & mask; ; h = (h+1) & mask) {
+				CSGEdge *e = &edges[h];
+
+				if (e->face == 0xffffffff) {
+					e->a = a;
+					e->b = b;
+					e->face = i;
+					e->con = con;
+					break;
+				}
+				if (e->a == a && e->b == b) {
+					if (!con && !e->con) {
+						Uint32 r1 = FindRoot(parent, i);
+						Uint32 r2 = FindRoot(parent, e->face);
+
+						if (r1 != r2)
+							parent[MAX(r1,r2)] = MIN(r1,r2);
+					}
+					break;
+				}
+			}
+		}
+	}
+	Free(edges);
+
+	/* Classify the patches from their votes, or by casting a ray. */
+	votes = Malloc((nFaces+1)*sizeof(Sint32));
+	inside = Malloc(nFaces+1);
+	known = Malloc(nFaces+1);
+	memset(votes, 0, nFaces*sizeof(Sint32));
+	memset(known, 0, nFaces);
+	for (i = 0; i < nFaces; i++) {
+		votes[FindRoot(parent, i)] += faces[i].vote;
+	}
+	for (i = 0; i < nFaces; i++) {
+		Uint32 r = FindRoot(parent, i);
+
+		if (!known[r]) {
+			if (votes[r] != 0) {
+				inside[r] = (votes[r] < 0);
+			} else if (FaceDegenerate(&faces[i])) {
+				inside[r] = 0;
+			} else {
+				const CSGFace *f = &faces[i];
+				double p[3], q[3], c[3] = { 0.0, 0.0, 0.0 };
+				Uint32 refs[3];
+
+				for (k = 0; k < 3; k++) {
+					refs[k] = (f->sub == CSG_NEAR) ? k :
+					    X->splits[X->tag[f->tri]].sub[f->sub].v[k];
+				}
+				for (k = 0; k < 3; k++) {
+					RefPos(ctx, X, f->tri, refs[k], p);
+					c[0] += p[0];
+					c[1] += p[1];
+					c[2] += p[2];
+				}
+				q[0] = c[0]/3.0;
+				q[1] = c[1]/3.0;
+				q[2] = c[2]/3.0;
+				inside[r] = (Uint8)PointInside(ctx, X, q);
+			}
+			known[r] = 1;
+		}
+		inside[i] = inside[r];
+	}
+	Free(known);
+	Free(votes);
+	Free(parent);
+	*pFaces = faces;
+	*pnFaces = nFaces;
+	*pInside = inside;
+	return (0);
+}
+
+/* Compute the (area-weighted) normal of a triangle. */
+static void
+FaceNormal(const CAD_Mesh *m, Uint32 t, float *n)
+{
+	double P[3][3], u[3], v[3], nx, ny, nz, len;
+	int k;
+
+	TriPos(m, t, P);
+	for (k = 0; k < 3; k++) {
+		u[k] = P[1][k] - P[0][k];
+		v[k] = P[2][k] - P[0][k];
+	}
+	nx = u[1]*v[2] - u[2]*v[1];
+	ny = u[2]*v[0] - u[0]*v[2];
+	nz = u[0]*v[1] - u[1]*v[0];
+	len = sqrt(nx*nx + ny*ny + nz*nz);
+	if (len == 0.0) { len = 1.0; }
+	n[0] = (float)(nx/len);
+	n[1] = (float)(ny/len);
+	n[2] = (float)(nz/len);
+}
+
+/* Copy the vertices of X into out starting at index offs. */
+static void
+CopyVertices(CAD_Mesh *out, Uint offs, const CAD_Mesh *m, int flip)
+{
+	Uint i, k;
+
+	memcpy(&out->v[offs*3], m->v, m->nv*3*sizeof(float));
+	if (out->flags & CAD_MESH_NORMALS) {
+		float *n = &out->n[offs*3];
+
+		if (m->flags & CAD_MESH_NORMALS) {
+			memcpy(n, m->n, m->nv*3*sizeof(float));
+		} else {
+			memset(n, 0, m->nv*3*sizeof(float));
+			for (i = 0; i < m->nt; i++) {
+				float fn[3];
+
+				FaceNormal(m, i, fn);
+				for (k = 0; k < 3; k++) {
+					float *vn = &n[m->tri[i*3+k]*3];
+
+					vn[0] += fn[0];
+					vn[1] += fn[1];
+					vn[2] += fn[2];
+				}
+			}
+			for (i = 0; i < m->nv; i++) {
+				float *vn = &n[i*3];
+				float len = sqrtf(vn[0]*vn[0] + vn[1]*vn[1] +
+				                  vn[2]*vn[2]);
+
+				if (len > 0.0f) {
+					vn[0] /= len;
+					vn[1] /= len;
+					vn[2] /= len;
+				}
+			}
+		}
+		if (flip) {
+			for (i = 0; i < m->nv*3; i++)
+				n[i] = -n[i];
+		}
+	}
+	if (out->flags & CAD_MESH_COLORS) {
+		if (m->flags & CAD_MESH_COLORS) {
+			memcpy(&out->c[offs*4], m->c, m->nv*4);
+		} else {
+			memset(&out->c[offs*4], 0xff, m->nv*4);
+		}
+	}
+	if (out->flags & CAD_MESH_TEXCOORDS) {
+		if (m->flags & CAD_MESH_TEXCOORDS) {
+			memcpy(&out->st[offs*2], m->st, m->nv*2*sizeof(float));
+		} else {
+			memset(&out->st[offs*2], 0, m->nv*2*sizeof(float));
+		}
+	}
+}
+
+/*
+ * Create an output vertex at an intersection point on triangle t of X,
+ * interpolating the vertex attributes of the triangle.
+ */
+static Uint32
+PointVertex(CAD_Mesh *out, const CAD_Mesh *m, Uint32 t, const double *x,
+    int flip)
+{
+	const Uint32 *tri = &m->tri[t*3];
+	double P[3][3], v0[3], v1[3], v2[3], d00, d01, d11, d20, d21, den;
+	double w[3];
+	Uint32 i = out->nv++;
+	int k, j;
+
+	TriPos(m, t, P);
+	for (k = 0; k < 3; k++) {
+		v0[k] = P[1][k] - P[0][k];
+		v1[k] = P[2][k] - P[0][k];
+		v2[k] = x[k] - P[0][k];
+		out->v[i*3+k] = (float)x[k];
+	}
+	d00 = v0[0]*v0[0] + v0[1]*v0[1] + v0[2]*v0[2];
+	d01 = v0[0]*v1[0] + v0[1]*v1[1] + v0[2]*v1[2];
+	d11 = v1[0]*v1[0] + v1[1]*v1[1] + v1[2]*v1[2];
+	d20 = v2[0]*v0[0] + v2[1]*v0[1] + v2[2]*v0[2];
+	d21 = v2[0]*v1[0] + v2[1]*v1[1] + v2[2]*v1[2];
+	den = d00*d11 - d01*d01;
+	if (den != 0.0) {
+		w[1] = (d11*d20 - d01*d21)/den;
+		w[2] = (d00*d21 - d01*d20)/den;
+	} else {
+		w[1] = w[2] = 1.0/3.0;
+	}
+	w[0] = 1.0 - w[1] - w[2];
+
+	if (out->flags & CAD_MESH_NORMALS) {
+		float *n = &out->n[i*3], len;
+
+		if (m->flags & CAD_MESH_NORMALS) {
+			for (k = 0; k < 3; k++) {
+				n[k] = 0.0f;
+				for (j = 0; j < 3; j++)
+					n[k] += (float)w[j]*m->n[tri[j]*3+k];
+			}
+			len = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			if (len > 0.0f) {
+				n[0] /= len;
+				n[1] /= len;
+				n[2] /= len;
+			}
+		} else {
+			FaceNormal(m, t, n);
+		}
+		if (flip) {
+			n[0] = -n[0];
+			n[1] = -n[1];
+			n[2] = -n[2];
+		}
+	}
+	if (out->flags & CAD_MESH_COLORS) {
+		for (k = 0; k < 4; k++) {
+			double c = 255.0;
+
+			if (m->flags & CAD_MESH_COLORS) {
+				c = w[0]*m->c[tri[0]*4+k] +
+				    w[1]*m->c[tri[1]*4+k] +
+				    w[2]*m->c[tri[2]*4+k];
+			}
+			out->c[i*4+k] = (Uint8)MAX(0.0, MIN(255.0, c + 0.5));
+		}
+	}
+	if (out->flags & CAD_MESH_TEXCOORDS) {
+		for (k = 0; k < 2; k++) {
+			out->st[i*2+k] = 0.0f;
+			if (m->flags & CAD_MESH_TEXCOORDS) {
+				for (j = 0; j < 3; j++)
+					out->st[i*2+k] +=
+					    (float)w[j]*m->st[tri[j]*2+k];
+			}
+		}
+	}
+	return (i);
+}
+
+static __inline__ void
+EmitTri(CAD_Mesh *out, Uint32 a, Uint32 b, Uint32 c, int flip)
+{
+	Uint32 *t = &out->tri[out->nt*3];
+
+	t[0] = a;
+	t[1] = flip ? c : b;
+	t[2] = flip ? b : c;
+	out->nt++;
+}
+
+/*
+ * Which parts of X the operation retains (inside or outside of the other
+ * operand), and whether they are reversed.
+ */
+static __inline__ void
+KeepRule(const CSGOperand *X, int op, int *keepIn, int *flip)
+{
+	if (X->side == 0) {
+		*keepIn = (op == CAD_CSG_INTERSECTION);
+		*flip = 0;
+	} else {
+		*keepIn = (op != CAD_CSG_UNION);
+		*flip = (op == CAD_CSG_DIFFERENCE);
+	}
+}
+
+/* Emit the triangles of X away from the other operand, if retained. */
+static void
+EmitFar(CSGOperand *X, CAD_Mesh *out, Uint vOffs, int op)
+{
+	const CAD_Mesh *m = X->m;
+	int keepIn, flip;
+	Uint i;
+
+	KeepRule(X, op, &keepIn, &flip);
+	if (keepIn) {
+		return;
+	}
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *tri = &m->tri[i*3];
+
+		if (X->tag[i] == CSG_FAR)
+			EmitTri(out, vOffs+tri[0], vOffs+tri[1], vOffs+tri[2],
+			    flip);
+	}
+}
+
+/*
+ * Emit the retained near triangles of X into out. Intersection points get
+ * a vertex per split triangle (so that the attributes of the triangle can
+ * be interpolated), which pidStamp tracks by split number + stampBase.
+ */
+static void
+EmitNear(CSGCtx *ctx, CSGOperand *X, const CSGFace *faces, Uint nFaces,
+    const Uint8 *inside, CAD_Mesh *out, Uint vOffs, int op,
+    Uint32 *pidVtx, Uint32 *pidStamp, Uint32 stampBase)
+{
+	const CAD_Mesh *m = X->m;
+	int keepIn, keepOut, flip;
+	Uint32 stamp;
+	Uint i, k;
+
+	KeepRule(X, op, &keepIn, &flip);
+	keepOut = !keepIn;
+	for (i = 0; i < nFaces; i++) {
+		const CSGFace *f = &faces[i];
+		const Uint32 *tri = &m->tri[f->tri*3];
+		const CSGSub *sub;
+		Uint32 v[3];
+
+		if ((inside[i] ? keepIn : keepOut) == 0 ||
+		    FaceDegenerate(f)) {
+			continue;
+		}
+		if (f->sub == CSG_NEAR) {
+			EmitTri(out, vOffs+tri[0], vOffs+tri[1], vOffs+tri[2],
+			    flip);
+			continue;
+		}
+		sub = &X->splits[X->tag[f->tri]].sub[f->sub];
+		stamp = stampBase + X->tag[f->tri] + 1;
+		for (k = 0; k < 3; k++) {
+			Uint32 ref = sub->v[k], pid;
+
+			if (ref < 3) {
+				v[k] = vOffs + tri[ref];
+				continue;
+			}
+			pid = ref-3;
+			if (pidStamp[pid] != stamp) {
+				pidStamp[pid] = stamp;
+				pidVtx[pid] = PointVertex(out, m, f->tri,
+				    ctx->pts[pid].x, flip);
+			}
+			v[k] = pidVtx[pid];
+		}
+		EmitTri(out, v[0], v[1], v[2], flip);
+	}
+}
+
+/* Edge of the output, counted in both directions. */
+typedef struct csg_dedge {
+	Uint32 lo, hi;			/* Welded vertices */
+	Sint32 bal;			/* lo->hi minus hi->lo occurrences */
+	Uint32 t[2];			/* Triangle*3+edge in each direction */
+} CSGDEdge;
+
+/* Vertex found on an edge of a triangle. */
+typedef struct csg_tjunc {
+	Uint32 tri;
+	Uint32 k;
+	double t;			/* Position along the edge */
+	Uint32 v;
+} CSGTJunc;
+
+typedef struct csg_cellvtx {
+	Uint32 cell;
+	Uint32 v;
+} CSGCellVtx;
+
+static int
+CompareTJunc(const void *p1, const void *p2)
+{
+	const CSGTJunc *a = p1, *b = p2;
+
+	if (a->tri != b->tri) { return (a->tri < b->tri) ? -1 : 1; }
+	if (a->k != b->k) { return (a->k < b->k) ? -1 : 1; }
+	return (a->t < b->t) ? -1 : (a->t > b->t) ? 1 : 0;
+}
+
+static int
+CompareCellVtx(const void *p1, const void *p2)
+{
+	const CSGCellVtx *a = p1, *b = p2;
+
+	return (a->cell < b->cell) ? -1 : (a->cell > b->cell) ? 1 : 0;
+}
+
+static __inline__ Uint32
+HashCell(int x, int y, int z)
+{
+	return ((Uint32)x*73856093U) ^ ((Uint32)y*19349663U) ^
+	       ((Uint32)z*83492791U);
+}
+
+/*
+ * Test whether vertex v lies on the edge a-b (within tol), and return its
+ * position along the edge in *t.
+ */
+static int
+OnEdge(const CAD_Mesh *m, Uint32 a, Uint32 b, Uint32 v, double tol,
+    double *t)
+{
+	double A[3], B[3], V[3], d[3], w[3], len2, dist2 = 0.0;
+	int k;
+
+	Pos(m, a, A);
+	Pos(m, b, B);
+	Pos(m, v, V);
+	for (k = 0; k < 3; k++) {
+		d[k] = B[k] - A[k];
+		w[k] = V[k] - A[k];
+	}
+	len2 = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	if (len2 == 0.0) {
+		return (0);
+	}
+	*t = (w[0]*d[0] + w[1]*d[1] + w[2]*d[2])/len2;
+	if (*t*(*t)*len2 <= tol*tol || (1.0-*t)*(1.0-*t)*len2 <= tol*tol ||
+	    *t <= 0.0 || *t >= 1.0) {
+		return (0);
+	}
+	for (k = 0; k < 3; k++) {
+		double e = w[k] - (*t)*d[k];
+
+		dist2 += e*e;
+	}
+	return (dist2 <= tol*tol);
+}
+
+/*
+ * Split the triangle t along its edges at the given vertices (sorted by
+ * edge, then by position along the edge). Each vertex is connected to the
+ * corner opposite to its edge, in the piece which holds that edge.
+ */
+static void
+SplitAtJunctions(CAD_Mesh *m, Uint32 t, const CSGTJunc *tj, Uint n)
+{
+	Uint32 orig[3], (*pc)[3];
+	Uint nPc = 1, i, j, r, k;
+
+	memcpy(orig, &m->tri[t*3], sizeof(orig));
+	pc = Malloc((n+1)*sizeof(*pc));
+	memcpy(pc[0], orig, sizeof(orig));
+	for (i = 0; i < n; i = j) {
+		Uint32 a = orig[tj[i].k], b = orig[(tj[i].k+1)%3], o, prev;
+
+		for (j = i; j < n && tj[j].k == tj[i].k; j++)
+			;;
+		for (k = 0; k < nPc; k++) {
+			for (r = 0; r < 3; r++) {
+				if (pc[k][r] == a && pc[k][(r+1)%3] == b)
+					break;
+			}
+			if (r < 3)
+				break;
+		}
+		if (k == nPc) {
+			continue;
+		}
+		o = pc[k][(r+2)%3];
+		pc[k][0] = a;
+		pc[k][1] = tj[i].v;
+		pc[k][2] = o;
+		for (prev = tj[i].v, r = i+1; r <= j; r++) {
+			Uint32 next = (r < j) ? tj[r].v : b;
+
+			pc[nPc][0] = prev;
+			pc[nPc][1] = next;
+			pc[nPc][2] = o;
+			nPc++;
+			prev = next;
+		}
+	}
+	memcpy(&m->tri[t*3], pc[0], sizeof(orig));
+	for (k = 1; k < nPc; k++) {
+		CAD_MeshAddTri(m, pc[k][0], pc[k][1], pc[k][2]);
+	}
+	Free(pc);
+}
+
+/*
+ * Merge the vertices of the triangles from index first (and of the near
+ * triangles of the operands) which are closer than tol. The coordinates
+ * of the intersection points are rounded to single precision, and the
+ * retriangulation of each intersected triangle merges points which nearly
+ * coincide. Vertices are replaced by the lowest-numbered vertex of their
+ * cluster in all triangles, so that the vertices of the operands are
+ * retained. Triangles which collapse are removed; the new index of the
+ * first triangle is returned in *first.
+ */
+static int
+WeldNear(const CSGCtx *ctx, CAD_Mesh *m, Uint *first, double tol)
+{
+	CSGCellVtx *cv;
+	Uint32 *wid;
+	Uint i, j, k, n = 0, nCv = 0, nFar = 0, maxCv;
+	double h = tol*2.0;
+
+	if ((wid = TryMalloc((m->nv+1)*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	for (i = 0; i < m->nv; i++) {
+		wid[i] = i;
+	}
+	maxCv = (m->nt - *first + ctx->op[0].nNear + ctx->op[1].nNear)*3;
+	if ((cv = TryMalloc((maxCv+1)*sizeof(CSGCellVtx))) == NULL) {
+		Free(wid);
+		return (-1);
+	}
+	for (i = (*first)*3; i < m->nt*3; i++) {
+		cv[nCv++].v = m->tri[i];
+	}
+	for (j = 0; j < 2; j++) {
+		const CSGOperand *X = &ctx->op[j];
+		Uint32 vOffs = (j == 1) ? ctx->op[0].m->nv : 0;
+
+		for (i = 0; i < X->nNear*3; i++)
+			cv[nCv++].v = vOffs + X->m->tri[X->near[i/3]*3 + i%3];
+	}
+	for (i = 0; i < nCv; i++) {
+		const float *p = &m->v[cv[i].v*3];
+
+		cv[i].cell = HashCell((int)floor(p[0]/h), (int)floor(p[1]/h),
+		    (int)floor(p[2]/h));
+	}
+	qsort(cv, nCv, sizeof(CSGCellVtx), CompareCellVtx);
+
+	/* Join the vertices with those in the neighboring cells. */
+	for (i = 0; i < nCv; i++) {
+		const float *p = &m->v[cv[i].v*3];
+		int c[3], x, y, z;
+
+		for (k = 0; k < 3; k++) {
+			c[k] = (int)floor(p[k]/h);
+		}
+		for (x = c[0]-1; x <= c[0]+1; x++) {
+			for (y = c[1]-1; y <= c[1]+1; y++) {
+				for (z = c[2]-1; z <= c[2]+1; z++) {
+					CSGCellVtx key, *e;
+
+					key.cell = HashCell(x, y, z);
+					if ((e = bsearch(&key, cv, nCv,
+					    sizeof(CSGCellVtx),
+					    CompareCellVtx)) == NULL) {
+						continue;
+					}
+					while (e > cv && e[-1].cell == key.cell) {
+						e--;
+					}
+					for (; e < &cv[nCv] && e->cell == key.cell;
+					     e++) {
+						const float *q = &m->v[e->v*3];
+						Uint32 r1, r2;
+
+						if (fabs(p[0]-q[0]) > tol ||
+						    fabs(p[1]-q[1]) > tol ||
+						    fabs(p[2]-q[2]) > tol) {
+							continue;
+						}
+						r1 = FindRoot(wid, cv[i].v);
+						r2 = FindRoot(wid, e->v);
+						wid[MAX(r1,r2)] = MIN(r1,r2);
+					}
+				}
+			}
+		}
+	}
+	for (i = 0; i < m->nv; i++) {
+		wid[i] = FindRoot(wid, i);
+	}
+	for (i = 0; i < m->nt; i++) {
+		Uint32 *t = &m->tri[i*3];
+		Uint32 a = wid[t[0]], b = wid[t[1]], c = wid[t[2]];
+
+		if (a == b || b == c || c == a) {
+			continue;
+		}
+		m->tri[n*3] = a;
+		m->tri[n*3+1] = b;
+		m->tri[n*3+2] = c;
+		if (i < *first) {
+			nFar++;
+		}
+		n++;
+	}
+	m->nt = n;
+	*first = nFar;
+	Free(cv);
+	Free(wid);
+	return (0);
+}
+
+/*
+ * Close the seams left along degenerate contacts. Where the operands
+ * touch, the perturbation produces triangles of zero area which the
+ * planar retriangulation cannot represent, so that a vertex may lie on
+ * an edge of a triangle on the other side of the seam. Find such vertices
+ * among the unmatched edges of the triangles emitted from index first,
+ * and split the triangles at them.
+ */
+static int
+FixSeams(const CSGCtx *ctx, CAD_Mesh *m, Uint first)
+{
+	CSGDEdge *edges;
+	CSGCellVtx *cv = NULL;
+	CSGTJunc *tj = NULL;
+	Uint32 *open = NULL, mask, size = 64;
+	Uint nOpen = 0, nCv = 0, nTj = 0, maxTj = 0, i, j, k;
+	double h = 0.0, tol = 0.0;
+
+	if (m->nt == first) {
+		return (0);
+	}
+	for (i = first*3; i < m->nt*3; i++) {
+		const float *p = &m->v[m->tri[i]*3];
+
+		tol = MAX(tol, MAX(fabs(p[0]), MAX(fabs(p[1]), fabs(p[2]))));
+	}
+	tol *= CSG_SEAM_TOL;
+	if (WeldNear(ctx, m, &first, tol) == -1) {
+		return (-1);
+	}
+	while (size < (m->nt - first)*6) {
+		size <<= 1;
+	}
+	mask = size-1;
+	if ((edges = TryMalloc(size*sizeof(CSGDEdge))) == NULL) {
+		return (-1);
+	}
+
+	/* Find the unmatched edges. */
+	memset(edges, 0xff, size*sizeof(CSGDEdge));
+	for (i = first; i < m->nt; i++) {
+		for (k = 0; k < 3; k++) {
+			Uint32 a = m->tri[i*3+k], b = m->tri[i*3+(k+1)%3];
+			Uint32 key[4], hv;
+			int dir = (a < b) ? 0 : 1;
+
+			key[0] = MIN(a,b);
+			key[1] = MAX(a,b);
+			key[2] = key[3] = 0;
+			for (hv = HashKey(key) & mask; ; hv = (hv+1) & mask) {
+				CSGDEdge *e = &edges[hv];
+
+				if (e->lo == 0xffffffff) {
+					e->lo = key[0];
+					e->hi = key[1];
+					e->bal = 0;
+				}
+				if (e->lo == key[0] && e->hi == key[1]) {
+					e->bal += dir ? -1 : 1;
+					e->t[dir] = i*3 + k;
+					break;
+				}
+			}
+		}
+	}
+	for (i = 0; i < size; i++) {
+		if (edges[i].lo != 0xffffffff && edges[i].bal != 0)
+			nOpen++;
+	}
+	if (nOpen == 0) {
+		goto out;
+	}
+	open = Malloc(nOpen*sizeof(Uint32));
+	cv = Malloc(nOpen*2*sizeof(CSGCellVtx));
+	for (i = 0, nOpen = 0; i < size; i++) {
+		const CSGDEdge *e = &edges[i];
+		double A[3], B[3];
+
+		if (e->lo == 0xffffffff || e->bal == 0) {
+			continue;
+		}
+		open[nOpen++] = e->t[(e->bal > 0) ? 0 : 1];
+		cv[nCv++].v = e->lo;
+		cv[nCv++].v = e->hi;
+		Pos(m, e->lo, A);
+		Pos(m, e->hi, B);
+		h += sqrt((B[0]-A[0])*(B[0]-A[0]) + (B[1]-A[1])*(B[1]-A[1]) +
+		          (B[2]-A[2])*(B[2]-A[2]));
+	}
+	h = MAX(h/nOpen, FLT_MIN);
+
+	/* Bin the vertices of the unmatched edges. */
+	for (i = 0; i < nCv; i++) {
+		const float *p = &m->v[cv[i].v*3];
+
+		cv[i].cell = HashCell((int)floor(p[0]/h), (int)floor(p[1]/h),
+		    (int)floor(p[2]/h));
+	}
+	qsort(cv, nCv, sizeof(CSGCellVtx), CompareCellVtx);
+
+	/* Find the vertices lying on the unmatched edges. */
+	for (i = 0; i < nOpen; i++) {
+		Uint32 t = open[i]/3, ke = open[i]%3;
+		Uint32 a = m->tri[t*3+ke], b = m->tri[t*3+(ke+1)%3];
+		const float *pa = &m->v[a*3], *pb = &m->v[b*3];
+		int lo[3], hi[3], x, y, z;
+		Uint32 prev = 0xffffffff;
+		double pt;
+
+		for (k = 0; k < 3; k++) {
+			lo[k] = (int)floor((MIN(pa[k],pb[k]) - tol)/h);
+			hi[k] = (int)floor((MAX(pa[k],pb[k]) + tol)/h);
+		}
+		for (x = lo[0]; x <= hi[0]; x++) {
+			for (y = lo[1]; y <= hi[1]; y++) {
+				for (z = lo[2]; z <= hi[2]; z++) {
+					CSGCellVtx key, *c;
+
+					key.cell = HashCell(x, y, z);
+					if ((c = bsearch(&key, cv, nCv,
+					    sizeof(CSGCellVtx),
+					    CompareCellVtx)) == NULL) {
+						continue;
+					}
+					while (c > cv && c[-1].cell == key.cell) {
+						c--;
+					}
+					for (; c < &cv[nCv] && c->cell == key.cell;
+					     c++) {
+						if (c->v == prev ||
+						    c->v == a || c->v == b ||
+						    !OnEdge(m, a, b, c->v, tol,
+						    &pt)) {
+							continue;
+						}
+						if (nTj+1 > maxTj) {
+							maxTj = (maxTj > 0) ?
+							    maxTj*2 : 64;
+							tj = Realloc(tj,
+							    maxTj*sizeof(CSGTJunc));
+						}
+						tj[nTj].tri = t;
+						tj[nTj].k = ke;
+						tj[nTj].t = pt;
+						tj[nTj].v = c->v;
+						nTj++;
+						prev = c->v;
+					}
+				}
+			}
+		}
+	}
+
+	/* Split the triangles at those vertices. */
+	if (nTj == 0) {
+		goto out;
+	}
+	qsort(tj, nTj, sizeof(CSGTJunc), CompareTJunc);
+	for (i = 0, j = 0; i < nTj; i++) {
+		if (j > 0 && tj[i].tri == tj[j-1].tri && tj[i].k == tj[j-1].k &&
+		    tj[i].v == tj[j-1].v) {
+			continue;
+		}
+		tj[j++] = tj[i];
+	}
+	nTj = j;
+	for (i = 0; i < nTj; i = j) {
+		for (j = i; j < nTj && tj[j].tri == tj[i].tri; j++)
+			;;
+		SplitAtJunctions(m, tj[i].tri, &tj[i], j-i);
+	}
+out:
+	Free(tj);
+	Free(cv);
+	Free(open);
+	Free(edges);
+	return (0);
+}
+
+/* Remove the vertices which are not referenced by any triangle. */
+static void
+Compact(CAD_Mesh *m)
+{
+	Uint32 *map;
+	Uint i, n = 0;
+
+	map = Malloc((m->nv+1)*sizeof(Uint32));
+	memset(map, 0xff, m->nv*sizeof(Uint32));
+	for (i = 0; i < m->nt*3; i++) {
+		map[m->tri[i]] = 0;
+	}
+	for (i = 0; i < m->nv; i++) {
+		if (map[i] == 0xffffffff) {
+			continue;
+		}
+		map[i] = n;
+		if (i != n) {
+			memcpy(&m->v[n*3], &m->v[i*3], 3*sizeof(float));
+			if (m->flags & CAD_MESH_NORMALS)
+				memcpy(&m->n[n*3], &m->n[i*3], 3*sizeof(float));
+			if (m->flags & CAD_MESH_COLORS)
+				memcpy(&m->c[n*4], &m->c[i*4], 4);
+			if (m->flags & CAD_MESH_TEXCOORDS)
+				memcpy(&m->st[n*2], &m->st[i*2],
+				    2*sizeof(float));
+		}
+		n++;
+	}
+	for (i = 0; i < m->nt*3; i++) {
+		m->tri[i] = map[m->tri[i]];
+	}
+	m->nv = n;
+	Free(map);
+}
+
+static void
+FreeOperand(CSGOperand *X)
+{
+	Uint i;
+
+	for (i = 0; i < X->nSplits; i++) {
+		Free(X->splits[i].sub);
+	}
+	Free(X->splits);
+	Free(X->segList);
+	Free(X->canon);
+	Free(X->near);
+	Free(X->tag);
+}
+
+/* Handle the cases where the operands cannot intersect. */
+static int
+BooleanDisjoint(CAD_Mesh *out, const CAD_Mesh *a, const CAD_Mesh *b, int op)
+{
+	switch (op) {
+	case CAD_CSG_UNION:
+		if (CAD_MeshAppend(out, a) == -1 ||
+		    CAD_MeshAppend(out, b) == -1) {
+			return (-1);
+		}
+		break;
+	case CAD_CSG_DIFFERENCE:
+		if (CAD_MeshAppend(out, a) == -1)
+			return (-1);
+		break;
+	}
+	return (0);
+}
+
+/*
+ * Compute the union, difference or intersection (see csg.h) of two closed
+ * meshes a and b into out, which must be distinct from both. The result
+ * has the vertex attributes of a; attributes missing from b are derived
+ * (normals) or set to defaults. Returns -1 on failure.
+ */
+int
+CAD_MeshBoolean(CAD_Mesh *out, const CAD_Mesh *a, const CAD_Mesh *b, int op)
+{
+	CSGCtx ctx;
+	CSGFace *faces[2] = { NULL, NULL };
+	Uint8 *inside[2] = { NULL, NULL };
+	Uint nFaces[2] = { 0, 0 }, maxPtVtx = 0, maxTris, ntFar, i, j;
+	Uint32 *pidVtx = NULL, *pidStamp = NULL;
+	int rv = -1;
+
+	if (op != CAD_CSG_UNION && op != CAD_CSG_DIFFERENCE &&
+	    op != CAD_CSG_INTERSECTION) {
+		AG_SetError("Bad boolean operation: %d", op);
+		return (-1);
+	}
+	CAD_MeshReset(out, (a->nt > 0) ? a->flags : b->flags);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.op[0].m = a;
+	ctx.op[0].side = 0;
+	ctx.op[1].m = b;
+	ctx.op[1].side = 1;
+	CAD_MeshBounds(a, ctx.op[0].min, ctx.op[0].max);
+	CAD_MeshBounds(b, ctx.op[1].min, ctx.op[1].max);
+	if (a->nt == 0 || b->nt == 0 ||
+	    !BoxOverlap(ctx.op[0].min, ctx.op[0].max,
+	                ctx.op[1].min, ctx.op[1].max)) {
+		return BooleanDisjoint(out, a, b, op);
+	}
+	for (i = 0; i < 3; i++) {
+		ctx.P.ctr[i] = ((double)ctx.op[1].min[i] +
+		                (double)ctx.op[1].max[i])/2.0;
+	}
+	ctx.P.grow = (op == CAD_CSG_INTERSECTION) ? -1 : 1;
+	CAD_BVHInit(&ctx.bvh);
+
+	if (FindNear(&ctx, &ctx.op[0]) == -1 ||
+	    FindNear(&ctx, &ctx.op[1]) == -1 ||
+	    MergeVertices(&ctx.op[0]) == -1 ||
+	    MergeVertices(&ctx.op[1]) == -1 ||
+	    CAD_BVHBuild(&ctx.bvh, b) == -1 ||
+	    Intersect(&ctx) == -1 ||
+	    BuildPoints(&ctx) == -1 ||
+	    BuildSplits(&ctx, &ctx.op[0]) == -1 ||
+	    BuildSplits(&ctx, &ctx.op[1]) == -1) {
+		goto out;
+	}
+	SplitAll(&ctx, &ctx.op[0]);
+	SplitAll(&ctx, &ctx.op[1]);
+	for (i = 0; i < 2; i++) {
+		if (Classify(&ctx, &ctx.op[i], &faces[i], &nFaces[i],
+		    &inside[i]) == -1)
+			goto out;
+	}
+
+	/* Reserve for all vertices of a and b and every split vertex. */
+	maxTris = a->nt + b->nt;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < ctx.op[i].nSplits; j++) {
+			maxPtVtx += ctx.op[i].splits[j].nSegs*2;
+			maxTris += ctx.op[i].splits[j].nSub;
+		}
+	}
+	if (CAD_MeshReserve(out, a->nv + b->nv + maxPtVtx, maxTris) == -1) {
+		goto out;
+	}
+	pidVtx = Malloc((ctx.nPts+1)*sizeof(Uint32));
+	pidStamp = Malloc((ctx.nPts+1)*sizeof(Uint32));
+	memset(pidStamp, 0, ctx.nPts*sizeof(Uint32));
+	CopyVertices(out, 0, a, 0);
+	CopyVertices(out, a->nv, b, (op == CAD_CSG_DIFFERENCE));
+	out->nv = a->nv + b->nv;
+	out->nt = 0;
+	EmitFar(&ctx.op[0], out, 0, op);
+	EmitFar(&ctx.op[1], out, a->nv, op);
+	ntFar = out->nt;
+	EmitNear(&ctx, &ctx.op[0], faces[0], nFaces[0], inside[0], out, 0, op,
+	    pidVtx, pidStamp, 0);
+	EmitNear(&ctx, &ctx.op[1], faces[1], nFaces[1], inside[1], out, a->nv,
+	    op, pidVtx, pidStamp, ctx.op[0].nSplits);
+	if (FixSeams(&ctx, out, ntFar) == -1) {
+		goto out;
+	}
+	Compact(out);
+	rv = 0;
+out:
+	Free(pidStamp);
+	Free(pidVtx);
+	for (i = 0; i < 2; i++) {
+		Free(faces[i]);
+		Free(inside[i]);
+		FreeOperand(&ctx.op[i]);
+	}
+	Free(ctx.pts);
+	Free(ctx.segs);
+	CAD_BVHFree(&ctx.bvh);
+	return (rv);
+}
@@ -0,0 +1,18 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_CSG_H_
+#define _CADTOOLS_CSG_H_
+
+#include "begin_code.h"
+
+/* Boolean operations for CAD_MeshBoolean(). */
+#define CAD_CSG_UNION		0		/* A + B */
+#define CAD_CSG_DIFFERENCE	1		/* A - B */
+#define CAD_CSG_INTERSECTION	2		/* A & B */
+
+__BEGIN_DECLS
+int	CAD_MeshBoolean(CAD_Mesh *, const CAD_Mesh *, const CAD_Mesh *, int);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_CSG_H_ */
@@ -0,0 +1,820 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Mesh simplification by iterative edge collapse using quadric error
+ * metrics (Garland & Heckbert). Candidate edges are kept in a 4-ary heap
+ * ordered by collapse cost; entries made stale by earlier collapses are
+ * detected by per-vertex generation counters and discarded when popped,
+ * or purged in bulk when they accumulate.
+ *
+ * Connectivity is kept in a compact corner table: the triangle index array
+ * of the mesh itself, plus for each vertex a contiguous run of incident
+ * triangle references. A collapse appends the merged run of the surviving
+ * vertex to the reference array, which is compacted when it fills up.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <math.h>
+
+#include "cadtools.h"
+
+#define DEC_BORDER_WEIGHT 10.0		/* Weight of border constraint planes */
+#define DEC_FLIP_LIMIT	0.2		/* Min. cosine between old/new normal */
+#define DEC_LENGTH_WEIGHT 1e-3		/* Edge length term of collapse cost */
+#define DEC_HEAP_ARITY	4		/* Children per heap node */
+#define DEC_HEAP_SLACK	3		/* Max. heap entries per live triangle */
+#define DEC_CHECK_IVAL	4096		/* Collapses between cancel checks */
+
+/* Collapse candidate. */
+typedef struct dec_edge {
+	float cost;
+	Uint32 v1, v2;
+	Uint32 gen1, gen2;		/* Vertex generations at insertion */
+} DecEdge;
+
+typedef struct dec_vertex {
+	Uint32 tStart, tCount;		/* Run of incident triangles in refs */
+	Uint32 gen;			/* Incremented when modified */
+	Uint32 mark;			/* For neighborhood queries */
+	Uint flags;
+#define DEC_VTX_DEAD	0x01
+#define DEC_VTX_BORDER	0x02
+} DecVertex;
+
+typedef struct decimator {
+	CAD_Mesh *m;
+	double *q;			/* Vertex quadrics (10 per vertex) */
+	DecVertex *vtx;
+	Uint32 *refs;			/* Incident triangle runs */
+	Uint nRefs, maxRefs;
+	Uint8 *tDead;			/* Collapsed triangles */
+	Uint nLive;			/* Triangles remaining */
+	DecEdge *heap;
+	Uint nHeap, maxHeap;
+	Uint32 curMark;
+} Decimator;
+
+/*
+ * Quadrics.
+ */
+
+/* Add the quadric of plane ax+by+cz+d=0 (scaled by w) to q. */
+static void
+QuadricAddPlane(double *q, double a, double b, double c, double d, double w)
+{
+	q[0] += w*a*a; q[1] += w*a*b; q[2] += w*a*c; q[3] += w*a*d;
+	               q[4] += w*b*b; q[5] += w*b*c; q[6] += w*b*d;
+	                              q[7] += w*c*c; q[8] += w*c*d;
+	                                             q[9] += w*d*d;
+}
+
+static __inline__ double
+QuadricEval(const double *q, double x, double y, double z)
+{
+	return (q[0]*x*x + 2.0*q[1]*x*y + 2.0*q[2]*x*z + 2.0*q[3]*x +
+	                       q[4]*y*y + 2.0*q[5]*y*z + 2.0*q[6]*y +
+	                                      q[7]*z*z + 2.0*q[8]*z +
+	                                                     q[9]);
+}
+
+static __inline__ double *
+Quadric(Decimator *d, Uint v)
+{
+	return (&d->q[(size_t)v*10]);
+}
+
+/*
+ * Compute the position minimizing the combined quadric of an edge. Falls
+ * back to the best of the endpoints and the midpoint if the system is
+ * singular. Returns the error at that position.
+ */
+static double
+OptimalPosition(Decimator *d, Uint v1, Uint v2, float *p)
+{
+	const float *a = &d->m->v[v1*3], *b = &d->m->v[v2*3];
+	double q[10], det, best, err;
+	Uint i;
+
+	for (i = 0; i < 10; i++) {
+		q[i] = Quadric(d,v1)[i] + Quadric(d,v2)[i];
+	}
+	det = q[0]*(q[4]*q[7] - q[5]*q[5]) -
+	      q[1]*(q[1]*q[7] - q[5]*q[2]) +
+	      q[2]*(q[1]*q[5] - q[4]*q[2]);
+	if (fabs(det) > 1e-12) {
+		double x, y, z;
+
+		x = -(q[3]*(q[4]*q[7] - q[5]*q[5]) -
+		      q[1]*(q[6]*q[7] - q[5]*q[8]) +
+		      q[2]*(q[6]*q[5] - q[4]*q[8])) / det;
+		y = -(q[0]*(q[6]*q[7] - q[8]*q[5]) -
+		      q[3]*(q[1]*q[7] - q[5]*q[2]) +
+		      q[2]*(q[1]*q[8] - q[6]*q[2])) / det;
+		z = -(q[0]*(q[4]*q[8] - q[5]*q[6]) -
+		      q[1]*(q[1]*q[8] - q[6]*q[2]) +
+		      q[3]*(q[1]*q[5] - q[4]*q[2])) / det;
+		p[0] = (float)x;
+		p[1] = (float)y;
+		p[2] = (float)z;
+		return QuadricEval(q, x, y, z);
+	}
+	best = QuadricEval(q, a[0], a[1], a[2]);
+	memcpy(p, a, 3*sizeof(float));
+	if ((err = QuadricEval(q, b[0], b[1], b[2])) < best) {
+		best = err;
+		memcpy(p, b, 3*sizeof(float));
+	}
+	err = QuadricEval(q, (a[0]+b[0])*0.5, (a[1]+b[1])*0.5,
+	    (a[2]+b[2])*0.5);
+	if (err < best) {
+		best = err;
+		for (i = 0; i < 3; i++)
+			p[i] = (a[i]+b[i])*0.5f;
+	}
+	return (best);
+}
+
+/*
+ * Connectivity.
+ */
+
+static __inline__ int
+TriHas(const Uint32 *t, Uint32 v)
+{
+	return (t[0] == v || t[1] == v || t[2] == v);
+}
+
+/* Count the live triangles incident to both v1 and v2. */
+static Uint
+SharedTris(Decimator *d, Uint v1, Uint v2)
+{
+	const DecVertex *dv = &d->vtx[v1];
+	Uint i, n = 0;
+
+	for (i = 0; i < dv->tCount; i++) {
+		Uint32 t = d->refs[dv->tStart + i];
+
+		if (!d->tDead[t] && TriHas(&d->m->tri[t*3], v2))
+			n++;
+	}
+	return (n);
+}
+
+/* Build the incident triangle runs. */
+static int
+BuildRefs(Decimator *d)
+{
+	CAD_Mesh *m = d->m;
+	Uint i, k, sum = 0;
+
+	for (i = 0; i < m->nt*3; i++) {
+		d->vtx[m->tri[i]].tCount++;
+	}
+	for (i = 0; i < m->nv; i++) {
+		d->vtx[i].tStart = sum;
+		sum += d->vtx[i].tCount;
+		d->vtx[i].tCount = 0;
+	}
+	d->maxRefs = sum*2 + 1024;
+	if ((d->refs = TryMalloc(d->maxRefs*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	for (i = 0; i < m->nt; i++) {
+		for (k = 0; k < 3; k++) {
+			DecVertex *dv = &d->vtx[m->tri[i*3+k]];
+
+			d->refs[dv->tStart + dv->tCount++] = i;
+		}
+	}
+	d->nRefs = sum;
+	return (0);
+}
+
+/* Rewrite the reference array, dropping stale runs and dead triangles. */
+static int
+CompactRefs(Decimator *d, Uint extra)
+{
+	Uint32 *refs;
+	Uint i, j, n = 0, max;
+
+	for (i = 0; i < d->m->nv; i++) {
+		if (!(d->vtx[i].flags & DEC_VTX_DEAD))
+			n += d->vtx[i].tCount;
+	}
+	max = n*2 + extra + 1024;
+	if ((refs = TryMalloc(max*sizeof(Uint32))) == NULL) {
+		return (-1);
+	}
+	for (i = 0, n = 0; i < d->m->nv; i++) {
+		DecVertex *dv = &d->vtx[i];
+		Uint start = n;
+
+		if (dv->flags & DEC_VTX_DEAD) {
+			continue;
+		}
+		for (j = 0; j < dv->tCount; j++) {
+			Uint32 t = d->refs[dv->tStart + j];
+
+			if (!d->tDead[t])
+				refs[n++] = t;
+		}
+		dv->tStart = start;
+		dv->tCount = n - start;
+	}
+	Free(d->refs);
+	d->refs = refs;
+	d->nRefs = n;
+	d->maxRefs = max;
+	return (0);
+}
+
+/*
+ * Initial quadrics: the planes of the incident faces, plus planes
+ * perpendicular to the faces along border edges so that open boundaries
+ * are preserved.
+ */
+static void
+InitQuadrics(Decimator *d)
+{
+	CAD_Mesh *m = d->m;
+	Uint i, k;
+
+	memset(d->q, 0, (size_t)m->nv*10*sizeof(double));
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+		const float *p0 = &m->v[t[0]*3];
+		const float *p1 = &m->v[t[1]*3];
+		const float *p2 = &m->v[t[2]*3];
+		double e1[3], e2[3], n[3], len, dist;
+
+		for (k = 0; k < 3; k++) {
+			e1[k] = p1[k] - p0[k];
+			e2[k] = p2[k] - p0[k];
+		}
+		n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+		n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+		n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+		if ((len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2])) == 0.0) {
+			continue;
+		}
+		n[0] /= len; n[1] /= len; n[2] /= len;
+		dist = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+		for (k = 0; k < 3; k++) {
+			QuadricAddPlane(Quadric(d,t[k]), n[0], n[1], n[2],
+			    dist, 1.0);
+		}
+		for (k = 0; k < 3; k++) {
+			Uint32 a = t[k], b = t[(k+1)%3];
+			const float *pa = &m->v[a*3], *pb = &m->v[b*3];
+			double e[3], bn[3];
+
+			if (SharedTris(d, a, b) != 1) {
+				continue;
+			}
+			d->vtx[a].flags |= DEC_VTX_BORDER;
+			d->vtx[b].flags |= DEC_VTX_BORDER;
+
+			e[0] = pb[0]-pa[0]; e[1] = pb[1]-pa[1]; e[2] = pb[2]-pa[2];
+			bn[0] = e[1]*n[2] - e[2]*n[1];
+			bn[1] = e[2]*n[0] - e[0]*n[2];
+			bn[2] = e[0]*n[1] - e[1]*n[0];
+			if ((len = sqrt(bn[0]*bn[0] + bn[1]*bn[1] +
+			    bn[2]*bn[2])) == 0.0) {
+				continue;
+			}
+			bn[0] /= len; bn[1] /= len; bn[2] /= len;
+			dist = -(bn[0]*pa[0] + bn[1]*pa[1] + bn[2]*pa[2]);
+			QuadricAddPlane(Quadric(d,a), bn[0], bn[1], bn[2], dist,
+			    DEC_BORDER_WEIGHT);
+			QuadricAddPlane(Quadric(d,b), bn[0], bn[1], bn[2], dist,
+			    DEC_BORDER_WEIGHT);
+		}
+	}
+}
+
+/*
+ * Heap of collapse candidates.
+ */
+
+static int
+HeapPush(Decimator *d, Uint v1, Uint v2)
+{
+	DecEdge *e;
+	const float *a, *b;
+	float p[3], len2;
+	Uint i;
+
+	if (d->nHeap == d->maxHeap) {
+		Uint maxNew = d->maxHeap*2 + 1024;
+		DecEdge *heapNew;
+
+		if ((heapNew = TryRealloc(d->heap, maxNew*sizeof(DecEdge)))
+		    == NULL) {
+			return (-1);
+		}
+		d->heap = heapNew;
+		d->maxHeap = maxNew;
+	}
+	i = d->nHeap++;
+	e = &d->heap[i];
+
+	/*
+	 * The length term orders collapses within flat regions (where the
+	 * quadric error is zero) so that they do not all pile up on the same
+	 * vertex.
+	 */
+	a = &d->m->v[v1*3];
+	b = &d->m->v[v2*3];
+	len2 = (b[0]-a[0])*(b[0]-a[0]) + (b[1]-a[1])*(b[1]-a[1]) +
+	       (b[2]-a[2])*(b[2]-a[2]);
+	e->cost = (float)(OptimalPosition(d, v1, v2, p) +
+	    DEC_LENGTH_WEIGHT*len2);
+	e->v1 = v1;
+	e->v2 = v2;
+	e->gen1 = d->vtx[v1].gen;
+	e->gen2 = d->vtx[v2].gen;
+
+	while (i > 0) {				/* Sift up */
+		Uint parent = (i-1)/DEC_HEAP_ARITY;
+		DecEdge tmp;
+
+		if (d->heap[parent].cost <= d->heap[i].cost) {
+			break;
+		}
+		tmp = d->heap[parent];
+		d->heap[parent] = d->heap[i];
+		d->heap[i] = tmp;
+		i = parent;
+	}
+	return (0);
+}
+
+static void
+SiftDown(Decimator *d, Uint i)
+{
+	DecEdge *h = d->heap;
+	Uint n = d->nHeap;
+
+	for (;;) {
+		Uint c = i*DEC_HEAP_ARITY + 1, cEnd, min = i;
+		DecEdge tmp;
+
+		cEnd = (c + DEC_HEAP_ARITY < n) ? c + DEC_HEAP_ARITY : n;
+		for (; c < cEnd; c++) {
+			if (h[c].cost < h[min].cost)
+				min = c;
+		}
+		if (min == i) {
+			break;
+		}
+		tmp = h[min];
+		h[min] = h[i];
+		h[i] = tmp;
+		i = min;
+	}
+}
+
+static void
+HeapPop(Decimator *d, DecEdge *out)
+{
+	*out = d->heap[0];
+	d->heap[0] = d->heap[--d->nHeap];
+	SiftDown(d, 0);
+}
+
+static __inline__ int
+EdgeStale(const Decimator *d, const DecEdge *e)
+{
+	const DecVertex *dv1 = &d->vtx[e->v1], *dv2 = &d->vtx[e->v2];
+
+	return ((dv1->flags & DEC_VTX_DEAD) || (dv2->flags & DEC_VTX_DEAD) ||
+	        dv1->gen != e->gen1 || dv2->gen != e->gen2);
+}
+
+/*
+ * Drop the stale entries and rebuild the heap. Stale entries would
+ * otherwise outnumber the live ones and make every pop more expensive.
+ */
+static void
+HeapPurge(Decimator *d)
+{
+	Uint i, n = 0;
+
+	for (i = 0; i < d->nHeap; i++) {
+		if (!EdgeStale(d, &d->heap[i]))
+			d->heap[n++] = d->heap[i];
+	}
+	d->nHeap = n;
+	for (i = n/DEC_HEAP_ARITY + 1; i > 0; i--)
+		SiftDown(d, i-1);
+}
+
+/*
+ * Collapse.
+ */
+
+/*
+ * Check that moving vertex v (collapsing into the edge with vo) to p does
+ * not flip or degenerate any triangle which survives the collapse.
+ */
+static int
+CheckFlips(Decimator *d, Uint v, Uint vo, const float *p)
+{
+	const CAD_Mesh *m = d->m;
+	const DecVertex *dv = &d->vtx[v];
+	Uint i, k;
+
+	for (i = 0; i < dv->tCount; i++) {
+		Uint32 t = d->refs[dv->tStart + i];
+		const Uint32 *tri = &m->tri[t*3];
+		double e1[3], e2[3], f1[3], f2[3], n0[3], n1[3];
+		double l0, l1;
+		const float *a, *b, *c;
+
+		if (d->tDead[t] || TriHas(tri, vo)) {
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			if (tri[k] == v)
+				break;
+		}
+		a = &m->v[tri[k]*3];
+		b = &m->v[tri[(k+1)%3]*3];
+		c = &m->v[tri[(k+2)%3]*3];
+		for (k = 0; k < 3; k++) {
+			e1[k] = b[k] - a[k];
+			e2[k] = c[k] - a[k];
+			f1[k] = b[k] - p[k];
+			f2[k] = c[k] - p[k];
+		}
+		n0[0] = e1[1]*e2[2] - e1[2]*e2[1];
+		n0[1] = e1[2]*e2[0] - e1[0]*e2[2];
+		n0[2] = e1[0]*e2[1] - e1[1]*e2[0];
+		n1[0] = f1[1]*f2[2] - f1[2]*f2[1];
+		n1[1] = f1[2]*f2[0] - f1[0]*f2[2];
+		n1[2] = f1[0]*f2[1] - f1[1]*f2[0];
+		l0 = sqrt(n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2]);
+		l1 = sqrt(n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]);
+		if (l1 == 0.0 || l0 == 0.0 ||
+		    (n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2]) <
+		    DEC_FLIP_LIMIT*l0*l1)
+			return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Check the link condition: the vertices adjacent to both v1 and v2 must
+ * be exactly those of the triangles sharing the edge. This prevents
+ * collapses which would create non-manifold geometry.
+ */
+static int
+CheckLink(Decimator *d, Uint v1, Uint v2, Uint nShared)
+{
+	const CAD_Mesh *m = d->m;
+	const DecVertex *dv;
+	Uint32 mark = ++d->curMark;
+	Uint i, k, nCommon = 0;
+
+	dv = &d->vtx[v1];
+	for (i = 0; i < dv->tCount; i++) {
+		Uint32 t = d->refs[dv->tStart + i];
+
+		if (d->tDead[t]) {
+			continue;
+		}
+		for (k = 0; k < 3; k++)
+			d->vtx[m->tri[t*3+k]].mark = mark;
+	}
+	mark = ++d->curMark;
+	dv = &d->vtx[v2];
+	for (i = 0; i < dv->tCount; i++) {
+		Uint32 t = d->refs[dv->tStart + i];
+
+		if (d->tDead[t]) {
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			DecVertex *dw = &d->vtx[m->tri[t*3+k]];
+			Uint32 w = m->tri[t*3+k];
+
+			if (w == v1 || w == v2) {
+				continue;
+			}
+			if (dw->mark == mark-1) {
+				dw->mark = mark;
+				nCommon++;
+			}
+		}
+	}
+	return (nCommon == nShared ? 0 : -1);
+}
+
+/* Interpolate the vertex attributes of v1 and v2 into v1. */
+static void
+MergeAttributes(CAD_Mesh *m, Uint v1, Uint v2, const float *p)
+{
+	const float *a = &m->v[v1*3], *b = &m->v[v2*3];
+	float e[3], len2, s, t;
+	Uint k;
+
+	for (k = 0, len2 = 0.0f, t = 0.0f; k < 3; k++) {
+		e[k] = b[k] - a[k];
+		len2 += e[k]*e[k];
+		t += (p[k] - a[k])*e[k];
+	}
+	t = (len2 > 0.0f) ? t/len2 : 0.5f;
+	t = (t < 0.0f) ? 0.0f : (t > 1.0f) ? 1.0f : t;
+	s = 1.0f - t;
+
+	if (m->flags & CAD_MESH_NORMALS) {
+		float *n1 = &m->n[v1*3], *n2 = &m->n[v2*3], len;
+
+		for (k = 0; k < 3; k++) {
+			n1[k] = n1[k]*s + n2[k]*t;
+		}
+		len = sqrtf(n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]);
+		if (len > 0.0f) {
+			n1[0] /= len; n1[1] /= len; n1[2] /= len;
+		}
+	}
+	if (m->flags & CAD_MESH_COLORS) {
+		for (k = 0; k < 4; k++)
+			m->c[v1*4+k] = (Uint8)(m->c[v1*4+k]*s +
+			                       m->c[v2*4+k]*t + 0.5f);
+	}
+	if (m->flags & CAD_MESH_TEXCOORDS) {
+		for (k = 0; k < 2; k++)
+			m->st[v1*2+k] = m->st[v1*2+k]*s + m->st[v2*2+k]*t;
+	}
+}
+
+/* Collapse v2 into v1 at position p and queue the new edges of v1. */
+static int
+Collapse(Decimator *d, Uint v1, Uint v2, const float *p)
+{
+	CAD_Mesh *m = d->m;
+	DecVertex *dv1 = &d->vtx[v1], *dv2 = &d->vtx[v2];
+	Uint32 mark;
+	Uint i, k, start;
+
+	if (d->nRefs + dv1->tCount + dv2->tCount > d->maxRefs &&
+	    CompactRefs(d, dv1->tCount + dv2->tCount) == -1) {
+		return (-1);
+	}
+	for (i = 0; i < dv2->tCount; i++) {
+		Uint32 t = d->refs[dv2->tStart + i];
+		Uint32 *tri = &m->tri[t*3];
+
+		if (d->tDead[t]) {
+			continue;
+		}
+		if (TriHas(tri, v1)) {
+			d->tDead[t] = 1;
+			d->nLive--;
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			if (tri[k] == v2)
+				tri[k] = v1;
+		}
+	}
+
+	/* Append the merged triangle run of v1. */
+	start = d->nRefs;
+	for (i = 0; i < dv1->tCount; i++) {
+		Uint32 t = d->refs[dv1->tStart + i];
+
+		if (!d->tDead[t])
+			d->refs[d->nRefs++] = t;
+	}
+	for (i = 0; i < dv2->tCount; i++) {
+		Uint32 t = d->refs[dv2->tStart + i];
+
+		if (!d->tDead[t])
+			d->refs[d->nRefs++] = t;
+	}
+	dv1->tStart = start;
+	dv1->tCount = d->nRefs - start;
+	dv2->tCount = 0;
+	dv2->flags |= DEC_VTX_DEAD;
+	if (dv2->flags & DEC_VTX_BORDER) {
+		dv1->flags |= DEC_VTX_BORDER;
+	}
+	MergeAttributes(m, v1, v2, p);
+	memcpy(&m->v[v1*3], p, 3*sizeof(float));
+	for (k = 0; k < 10; k++) {
+		Quadric(d,v1)[k] += Quadric(d,v2)[k];
+	}
+	dv1->gen++;
+
+	mark = ++d->curMark;
+	for (i = 0; i < dv1->tCount; i++) {
+		const Uint32 *tri = &m->tri[d->refs[dv1->tStart + i]*3];
+
+		for (k = 0; k < 3; k++) {
+			Uint32 w = tri[k];
+
+			if (w == v1 || d->vtx[w].mark == mark) {
+				continue;
+			}
+			d->vtx[w].mark = mark;
+			if (HeapPush(d, v1, w) == -1)
+				return (-1);
+		}
+	}
+	return (0);
+}
+
+/* Remove dead triangles and unreferenced vertices from the mesh. */
+static void
+CompactMesh(Decimator *d)
+{
+	CAD_Mesh *m = d->m;
+	Uint32 *remap = d->refs;	/* Reused; at least nv entries */
+	Uint i, k, nv = 0, nt = 0;
+
+	for (i = 0; i < m->nv; i++) {
+		remap[i] = 0xffffffff;
+	}
+	for (i = 0; i < m->nt; i++) {
+		if (d->tDead[i]) {
+			continue;
+		}
+		for (k = 0; k < 3; k++) {
+			Uint32 v = m->tri[i*3+k];
+
+			if (remap[v] == 0xffffffff) {
+				remap[v] = 0;
+			}
+			m->tri[nt*3+k] = v;
+		}
+		nt++;
+	}
+	for (i = 0; i < m->nv; i++) {
+		if (remap[i] == 0xffffffff) {
+			continue;
+		}
+		remap[i] = nv;
+		if (i != nv) {
+			memcpy(&m->v[nv*3], &m->v[i*3], 3*sizeof(float));
+			if (m->flags & CAD_MESH_NORMALS)
+				memcpy(&m->n[nv*3], &m->n[i*3],
+				    3*sizeof(float));
+			if (m->flags & CAD_MESH_COLORS)
+				memcpy(&m->c[nv*4], &m->c[i*4], 4);
+			if (m->flags & CAD_MESH_TEXCOORDS)
+				memcpy(&m->st[nv*2], &m->st[i*2],
+				    2*sizeof(float));
+		}
+		nv++;
+	}
+	for (i = 0; i < nt*3; i++) {
+		m->tri[i] = remap[m->tri[i]];
+	}
+	m->nv = nv;
+	m->nt = nt;
+}
+
+/*
+ * Simplify a mesh until it has at most nTarget triangles, or until the
+ * next collapse would exceed maxError (measured as the sum of squared
+ * distances to the original planes; 0 means unbounded). The optional
+ * nRemoved returns the number of triangles removed. If prog is not NULL,
+ * the operation fails with "Cancelled" once cancellation is requested; the
+ * contents of m are then undefined, as with other failures.
+ */
+int
+CAD_MeshDecimate(CAD_Mesh *m, Uint nTarget, M_Real maxError, Uint *nRemoved,
+    CAD_Progress *prog)
+{
+	Decimator d;
+	DecEdge e;
+	double errLimit = (maxError > 0.0) ? maxError*maxError : HUGE_VAL;
+	Uint i, k, nt0 = m->nt, nPopped = 0;
+	int rv = -1;
+
+	if (nRemoved != NULL) {
+		*nRemoved = 0;
+	}
+	if (m->nt <= nTarget || m->nv < 4) {
+		return (0);
+	}
+	if (CAD_MeshUnshare(m) == -1) {
+		return (-1);
+	}
+	memset(&d, 0, sizeof(d));
+	d.m = m;
+	d.nLive = m->nt;
+	if ((d.q = TryMalloc((size_t)m->nv*10*sizeof(double))) == NULL ||
+	    (d.vtx = TryMalloc(m->nv*sizeof(DecVertex))) == NULL ||
+	    (d.tDead = TryMalloc(m->nt)) == NULL) {
+		goto out;
+	}
+	memset(d.vtx, 0, m->nv*sizeof(DecVertex));
+	memset(d.tDead, 0, m->nt);
+	if (BuildRefs(&d) == -1) {
+		goto out;
+	}
+	InitQuadrics(&d);
+
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+
+		for (k = 0; k < 3; k++) {
+			Uint32 a = t[k], b = t[(k+1)%3];
+
+			/* Interior edges are seen twice; queue them once. */
+			if ((a < b || SharedTris(&d, a, b) == 1) &&
+			    HeapPush(&d, a, b) == -1)
+				goto out;
+		}
+	}
+
+	while (d.nLive > nTarget && d.nHeap > 0) {
+		DecVertex *dv1, *dv2;
+		float p[3];
+		Uint nShared;
+
+		if (d.nHeap > d.nLive*DEC_HEAP_SLACK) {
+			HeapPurge(&d);
+			continue;
+		}
+		if (prog != NULL && ++nPopped % DEC_CHECK_IVAL == 0 &&
+		    CAD_ProgressCancelled(prog)) {
+			AG_SetErrorS(_("Cancelled"));
+			goto out;
+		}
+		HeapPop(&d, &e);
+		if (EdgeStale(&d, &e)) {
+			continue;
+		}
+		dv1 = &d.vtx[e.v1];
+		dv2 = &d.vtx[e.v2];
+		if (e.cost > errLimit) {
+			break;
+		}
+		if ((nShared = SharedTris(&d, e.v1, e.v2)) == 0) {
+			continue;
+		}
+		/* Don't pinch together two separate parts of a border. */
+		if ((dv1->flags & DEC_VTX_BORDER) &&
+		    (dv2->flags & DEC_VTX_BORDER) && nShared != 1) {
+			continue;
+		}
+		OptimalPosition(&d, e.v1, e.v2, p);
+		if (CheckLink(&d, e.v1, e.v2, nShared) == -1 ||
+		    CheckFlips(&d, e.v1, e.v2, p) == -1 ||
+		    CheckFlips(&d, e.v2, e.v1, p) == -1) {
+			continue;
+		}
+		if (Collapse(&d, e.v1, e.v2, p) == -1)
+			goto out;
+	}
+	if (d.maxRefs < m->nv) {
+		Uint32 *refsNew;
+
+		if ((refsNew = TryRealloc(d.refs, m->nv*sizeof(Uint32)))
+		    == NULL) {
+			goto out;
+		}
+		d.refs = refsNew;
+	}
+	CompactMesh(&d);
+	if (nRemoved != NULL) {
+		*nRemoved = nt0 - m->nt;
+	}
+	rv = 0;
+out:
+	Free(d.heap);
+	Free(d.refs);
+	Free(d.tDead);
+	Free(d.vtx);
+	Free(d.q);
+	return (rv);
+}
@@ -0,0 +1,13 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_DECIMATE_H_
+#define _CADTOOLS_DECIMATE_H_
+
+#include "begin_code.h"
+
+__BEGIN_DECLS
+int	CAD_MeshDecimate(CAD_Mesh *, Uint, M_Real, Uint *, CAD_Progress *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_DECIMATE_H_ */
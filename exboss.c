@@ -24,15 +24,44 @@
  */
 
 #include <agar/core.h>
+#include <agar/gui.h>
+
+#include <string.h>
+#include <math.h>
 
 #include "cadtools.h"
 #include "exboss.h"
 
+#define CIRCLE_SEGS	64			/* Circle discretization */
+
+/* Closed profile loop extracted from the sketch. */
+typedef struct exboss_loop {
+	double *xy;				/* Vertices (x,y) */
+	Uint n;
+	double area;				/* Signed area (>0 is CCW) */
+	double min[2], max[2];			/* Bounding box */
+	int depth;				/* Nesting depth (odd = hole) */
+	int parent;				/* Enclosing loop or -1 */
+} ExLoop;
+
+/*
+ * Working data of a regeneration pass. Temporary buffers are allocated
+ * from the scratch arena of the part and are not freed individually.
+ */
+typedef struct exboss_profile {
+	CAD_Arena *ar;				/* Scratch arena */
+	ExLoop *loops;
+	Uint nLoops, maxLoops;
+} ExProfile;
+
 static void
 Init(void *obj)
 {
 	CAD_ExtrudedBoss *exboss = obj;
 
+	exboss->skName[0] = '\0';
+	exboss->fromName[0] = '\0';
+	exboss->depth = 10.0;
 	exboss->flags = 0;
 }
 
@@ -42,6 +71,10 @@ Load(void *obj, AG_DataSource *buf, const AG_Version *ver)
 	CAD_ExtrudedBoss *exboss = obj;
 
 	exboss->flags = (Uint)AG_ReadUint32(buf);
+	if (ver->minor >= 2) {
+		AG_CopyString(exboss->skName, buf, sizeof(exboss->skName));
+		exboss->depth = M_ReadReal(buf);
+	}
 	return (0);
 }
 
@@ -51,17 +84,625 @@ Save(void *obj, AG_DataSource *buf)
 	CAD_ExtrudedBoss *exboss = obj;
 
 	AG_WriteUint32(buf, (Uint32)exboss->flags);
+	AG_WriteString(buf, exboss->skName);
+	M_WriteReal(buf, exboss->depth);
+	return (0);
+}
+
+/*
+ * Look up the source sketch by name. The sketch is not remembered across
+ * regenerations, since it may be renamed, closed or reloaded at any time;
+ * changes to it are detected through HashInputs().
+ */
+static SK *
+ResolveSketch(CAD_ExtrudedBoss *exboss)
+{
+	AG_Object *sk;
+
+	if (exboss->skName[0] == '\0' ||
+	    (sk = AG_ObjectFindChild(&vfsRoot, exboss->skName)) == NULL ||
+	    !AG_OfClass(sk, "SK:*")) {
+		return (NULL);
+	}
+	return (SK *)sk;
+}
+
+static int
+HashInputs(void *obj, AG_DataSource *ds)
+{
+	CAD_ExtrudedBoss *exboss = obj;
+	SK *sk;
+
+	if ((sk = ResolveSketch(exboss)) == NULL) {
+		AG_WriteUint8(ds, 0);
+		return (0);
+	}
+	AG_WriteUint8(ds, 1);
+	return AG_ObjectSerialize(sk, ds);
+}
+
+static ExLoop *
+NewLoop(ExProfile *pr, Uint n)
+{
+	ExLoop *L;
+
+	if (pr->nLoops+1 > pr->maxLoops) {
+		Uint maxNew = (pr->maxLoops > 0) ? pr->maxLoops*2 : 8;
+
+		pr->loops = CAD_ArenaRealloc(pr->ar, pr->loops,
+		    pr->maxLoops*sizeof(ExLoop), maxNew*sizeof(ExLoop));
+		pr->maxLoops = maxNew;
+	}
+	L = &pr->loops[pr->nLoops++];
+	L->xy = CAD_ArenaAlloc(pr->ar, n*2*sizeof(double));
+	L->n = 0;
+	L->depth = 0;
+	L->parent = -1;
+	return (L);
+}
+
+static int
+ComparePtr(const void *p1, const void *p2)
+{
+	const char *a = *(const char *const *)p1;
+	const char *b = *(const char *const *)p2;
+
+	return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+static Uint
+FindPoint(SK_Point **pts, Uint nPts, SK_Point *p)
+{
+	SK_Point **q;
+
+	q = bsearch(&p, pts, nPts, sizeof(SK_Point *), ComparePtr);
+	return (Uint)(q - pts);
+}
+
+/*
+ * Chain the sketch lines into closed loops. Lines are connected through
+ * shared SK_Point endpoints; only chains where every point joins exactly
+ * two lines form a loop, open chains and branches are ignored.
+ */
+static void
+ExtractLineLoops(SK *sk, ExProfile *pr)
+{
+	SK_Line *line;
+	SK_Point **pts;
+	Uint *segA, *segB, *adj, *deg, *visited;
+	Uint nLines = 0, nPts, i, j, n, s, e, p, p0, q;
+	ExLoop *L;
+
+	SK_FOREACH_NODE_CLASS(line, sk, sk_line, "Line:*") {
+		if (line->p1 != line->p2)
+			nLines++;
+	}
+	if (nLines < 3) {
+		return;
+	}
+	pts = CAD_ArenaAlloc(pr->ar, nLines*2*sizeof(SK_Point *));
+	segA = CAD_ArenaAlloc(pr->ar, nLines*sizeof(Uint));
+	segB = CAD_ArenaAlloc(pr->ar, nLines*sizeof(Uint));
+	visited = CAD_ArenaAlloc(pr->ar, nLines*sizeof(Uint));
+
+	i = 0;
+	SK_FOREACH_NODE_CLASS(line, sk, sk_line, "Line:*") {
+		if (line->p1 == line->p2) {
+			continue;
+		}
+		pts[i++] = line->p1;
+		pts[i++] = line->p2;
+	}
+	qsort(pts, nLines*2, sizeof(SK_Point *), ComparePtr);
+	for (i = 1, nPts = 1; i < nLines*2; i++) {
+		if (pts[i] != pts[nPts-1])
+			pts[nPts++] = pts[i];
+	}
+	adj = CAD_ArenaAlloc(pr->ar, nPts*2*sizeof(Uint));
+	deg = CAD_ArenaAlloc(pr->ar, nPts*sizeof(Uint));
+	memset(deg, 0, nPts*sizeof(Uint));
+
+	s = 0;
+	SK_FOREACH_NODE_CLASS(line, sk, sk_line, "Line:*") {
+		if (line->p1 == line->p2) {
+			continue;
+		}
+		segA[s] = FindPoint(pts, nPts, line->p1);
+		segB[s] = FindPoint(pts, nPts, line->p2);
+		visited[s] = 0;
+		for (j = 0; j < 2; j++) {
+			p = (j == 0) ? segA[s] : segB[s];
+			if (deg[p] < 2) {
+				adj[p*2 + deg[p]] = s;
+			}
+			deg[p]++;
+		}
+		s++;
+	}
+
+	for (s = 0; s < nLines; s++) {
+		if (visited[s] || deg[segA[s]] != 2) {
+			continue;
+		}
+		/* Walk the chain once to count its points. */
+		p0 = p = segA[s];
+		e = s;
+		n = 0;
+		do {
+			visited[e] = 1;
+			n++;
+			q = (segA[e] == p) ? segB[e] : segA[e];
+			if (deg[q] != 2) {
+				n = 0;				/* Open chain */
+				break;
+			}
+			e = (adj[q*2] == e) ? adj[q*2+1] : adj[q*2];
+			p = q;
+		} while (p != p0);
+		if (n < 3) {
+			continue;
+		}
+		L = NewLoop(pr, n);
+		p = p0;
+		e = s;
+		for (i = 0; i < n; i++) {
+			M_Vector3 v = SK_Pos(pts[p]);
+
+			L->xy[i*2] = (double)v.x;
+			L->xy[i*2+1] = (double)v.y;
+			q = (segA[e] == p) ? segB[e] : segA[e];
+			e = (adj[q*2] == e) ? adj[q*2+1] : adj[q*2];
+			p = q;
+		}
+		L->n = n;
+	}
+}
+
+static void
+ExtractCircleLoops(SK *sk, ExProfile *pr)
+{
+	SK_Circle *circle;
+	ExLoop *L;
+	Uint i;
+
+	SK_FOREACH_NODE_CLASS(circle, sk, sk_circle, "Circle:*") {
+		M_Vector3 c = SK_Pos(circle->p);
+		double r = (double)circle->r;
+
+		if (r <= 0.0) {
+			continue;
+		}
+		L = NewLoop(pr, CIRCLE_SEGS);
+		for (i = 0; i < CIRCLE_SEGS; i++) {
+			double a = (2.0*M_PI*(double)i)/(double)CIRCLE_SEGS;
+
+			L->xy[i*2] = (double)c.x + r*cos(a);
+			L->xy[i*2+1] = (double)c.y + r*sin(a);
+		}
+		L->n = CIRCLE_SEGS;
+	}
+}
+
+static int
+PointInLoop(const ExLoop *L, double px, double py)
+{
+	Uint i, j;
+	int inside = 0;
+
+	for (i = 0, j = L->n-1; i < L->n; j = i++) {
+		const double *a = &L->xy[i*2], *b = &L->xy[j*2];
+
+		if (((a[1] > py) != (b[1] > py)) &&
+		    (px < (b[0] - a[0])*(py - a[1])/(b[1] - a[1]) + a[0]))
+			inside = !inside;
+	}
+	return (inside);
+}
+
+/*
+ * Compute loop areas and nesting. Loops at even depth are outer
+ * boundaries and are made counterclockwise; loops at odd depth are holes
+ * in their parent and are made clockwise.
+ */
+static void
+ClassifyLoops(ExProfile *pr)
+{
+	Uint i, j, k;
+
+	for (i = 0; i < pr->nLoops; i++) {
+		ExLoop *L = &pr->loops[i];
+
+		L->area = 0.0;
+		L->min[0] = L->max[0] = L->xy[0];
+		L->min[1] = L->max[1] = L->xy[1];
+		for (k = 0, j = L->n-1; k < L->n; j = k++) {
+			const double *a = &L->xy[j*2], *b = &L->xy[k*2];
+
+			L->area += a[0]*b[1] - b[0]*a[1];
+			if (b[0] < L->min[0]) { L->min[0] = b[0]; }
+			if (b[1] < L->min[1]) { L->min[1] = b[1]; }
+			if (b[0] > L->max[0]) { L->max[0] = b[0]; }
+			if (b[1] > L->max[1]) { L->max[1] = b[1]; }
+		}
+		L->area *= 0.5;
+	}
+	for (i = 0; i < pr->nLoops; i++) {
+		ExLoop *L = &pr->loops[i];
+
+		for (j = 0; j < pr->nLoops; j++) {
+			ExLoop *O = &pr->loops[j];
+
+			if (i == j ||
+			    L->min[0] < O->min[0] || L->max[0] > O->max[0] ||
+			    L->min[1] < O->min[1] || L->max[1] > O->max[1] ||
+			    !PointInLoop(O, L->xy[0], L->xy[1])) {
+				continue;
+			}
+			L->depth++;
+			if (L->parent == -1 ||
+			    fabs(O->area) < fabs(pr->loops[L->parent].area))
+				L->parent = (int)j;
+		}
+	}
+	for (i = 0; i < pr->nLoops; i++) {
+		ExLoop *L = &pr->loops[i];
+		int ccw = (L->depth % 2) == 0;
+
+		if (ccw != (L->area > 0.0)) {
+			for (j = 0, k = L->n-1; j < k; j++, k--) {
+				double x = L->xy[j*2], y = L->xy[j*2+1];
+
+				L->xy[j*2] = L->xy[k*2];
+				L->xy[j*2+1] = L->xy[k*2+1];
+				L->xy[k*2] = x;
+				L->xy[k*2+1] = y;
+			}
+			L->area = -L->area;
+		}
+	}
+}
+
+/* Emit the side walls of a loop as flat-shaded quads. */
+static void
+EmitWalls(CAD_Mesh *m, CAD_Arena *ar, const ExLoop *L, float zBot, float zTop)
+{
+	Uint n = L->n, vb = m->nv, i;
+	float *X, *Y, *NX, *NY;
+	float *v = &m->v[vb*3], *nrm = &m->n[vb*3];
+	Uint32 *t = &m->tri[m->nt*3];
+
+	/* Structure-of-arrays copy with the first point repeated at the end. */
+	X = CAD_ArenaAlloc(ar, (n+1)*sizeof(float));
+	Y = CAD_ArenaAlloc(ar, (n+1)*sizeof(float));
+	NX = CAD_ArenaAlloc(ar, n*sizeof(float));
+	NY = CAD_ArenaAlloc(ar, n*sizeof(float));
+	for (i = 0; i < n; i++) {
+		X[i] = (float)L->xy[i*2];
+		Y[i] = (float)L->xy[i*2+1];
+	}
+	X[n] = X[0];
+	Y[n] = Y[0];
+
+	/* Outward edge normals (right-hand side of a CCW boundary). */
+	for (i = 0; i < n; i++) {
+		float dx = X[i+1] - X[i];
+		float dy = Y[i+1] - Y[i];
+		float len = sqrtf(dx*dx + dy*dy);
+		float inv = 1.0f/(len + (float)(len == 0.0f));
+
+		NX[i] = dy*inv;
+		NY[i] = -dx*inv;
+	}
+
+	/* Four vertices per edge: bottom i, bottom i+1, top i+1, top i. */
+	for (i = 0; i < n; i++) {
+		float *q = &v[i*12], *r = &nrm[i*12];
+
+		q[0] = X[i];	q[1] = Y[i];	q[2] = zBot;
+		q[3] = X[i+1];	q[4] = Y[i+1];	q[5] = zBot;
+		q[6] = X[i+1];	q[7] = Y[i+1];	q[8] = zTop;
+		q[9] = X[i];	q[10] = Y[i];	q[11] = zTop;
+
+		r[0] = NX[i];	r[1] = NY[i];	r[2] = 0.0f;
+		r[3] = NX[i];	r[4] = NY[i];	r[5] = 0.0f;
+		r[6] = NX[i];	r[7] = NY[i];	r[8] = 0.0f;
+		r[9] = NX[i];	r[10] = NY[i];	r[11] = 0.0f;
+	}
+	for (i = 0; i < n; i++) {
+		Uint32 a = (Uint32)(vb + i*4);
+
+		t[i*6] = a;
+		t[i*6+1] = a+1;
+		t[i*6+2] = a+2;
+		t[i*6+3] = a;
+		t[i*6+4] = a+2;
+		t[i*6+5] = a+3;
+	}
+	m->nv += n*4;
+	m->nt += n*2;
+}
+
+/* Emit the top and bottom caps of an outer loop and its holes. */
+static void
+EmitCaps(CAD_Mesh *m, const double *xy, Uint nPts, const Uint32 *tris,
+    Uint nTris, float zBot, float zTop)
+{
+	Uint vTop = m->nv, vBot = m->nv + nPts, i;
+	float *v = &m->v[vTop*3], *nrm = &m->n[vTop*3];
+	Uint32 *t = &m->tri[m->nt*3];
+
+	for (i = 0; i < nPts; i++) {
+		float *qt = &v[i*3], *qb = &v[(nPts+i)*3];
+		float *rt = &nrm[i*3], *rb = &nrm[(nPts+i)*3];
+
+		qt[0] = qb[0] = (float)xy[i*2];
+		qt[1] = qb[1] = (float)xy[i*2+1];
+		qt[2] = zTop;
+		qb[2] = zBot;
+		rt[0] = rb[0] = 0.0f;
+		rt[1] = rb[1] = 0.0f;
+		rt[2] = 1.0f;
+		rb[2] = -1.0f;
+	}
+	for (i = 0; i < nTris; i++) {
+		const Uint32 *s = &tris[i*3];
+		Uint32 *tt = &t[i*3], *tb = &t[(nTris+i)*3];
+
+		tt[0] = vTop + s[0];
+		tt[1] = vTop + s[1];
+		tt[2] = vTop + s[2];
+		tb[0] = vBot + s[0];
+		tb[1] = vBot + s[2];
+		tb[2] = vBot + s[1];
+	}
+	m->nv += nPts*2;
+	m->nt += nTris*2;
+}
+
+/*
+ * The extrusion may start on top of the geometry of an upstream feature
+ * rather than on the sketch plane. That feature is the (only) dependency
+ * of the boss, so it is saved, renamed and scheduled as such.
+ */
+static CAD_Feature *
+StartFeature(CAD_ExtrudedBoss *exboss)
+{
+	CAD_Feature *ft = CADFEATURE(exboss);
+
+	return (ft->ndeps > 0) ? ft->deps[0] : NULL;
+}
+
+/* Make the start feature named in the editor the dependency of the boss. */
+static int
+SetStartFeature(CAD_ExtrudedBoss *exboss, CAD_Part *part)
+{
+	CAD_Feature *ft = CADFEATURE(exboss), *dep;
+	AG_Object *obj = NULL;
+
+	if (ft->ndepNames > 0) {
+		CAD_FeatureResolveDeps(ft, part);
+	}
+	if (exboss->fromName[0] != '\0') {
+		if ((obj = AG_ObjectFindChild(part, exboss->fromName)) == NULL ||
+		    !AG_OfClass(obj, "CAD_Feature:*")) {
+			AG_SetError(_("No such feature: %s"), exboss->fromName);
+			return (-1);
+		}
+		if (CAD_FeatureAddDep(ft, obj) == -1)
+			return (-1);
+	}
+	while (ft->ndeps > 0 && (dep = ft->deps[0]) != (CAD_Feature *)obj) {
+		CAD_FeatureDelDep(ft, dep);
+	}
+	while (ft->ndeps > 1) {
+		CAD_FeatureDelDep(ft, ft->deps[1]);
+	}
 	return (0);
 }
 
-AG_ObjectClass cadExtrudedBossClass = {
-	"CAD_Feature:CAD_ExtrudedBoss",
-	sizeof(CAD_ExtrudedBoss),
-	{ 0,0 },
-	Init,
-	NULL,			/* reinit */
-	NULL,			/* destroy */
-	Load,
-	Save,
-	NULL			/* edit */
+typedef struct exboss_region {
+	double *xy;				/* Outer loop, then holes */
+	Uint nPts;
+	Uint32 *tris;
+	Uint nTris;
+} ExRegion;
+
+static int
+Regen(void *obj, CAD_Part *part, CAD_Mesh *m)
+{
+	CAD_ExtrudedBoss *exboss = obj;
+	ExProfile pr;
+	ExRegion *rgn = NULL;
+	Uint nRgn = 0, nv = 0, nt = 0, i, j;
+	Uint *holes = NULL;
+	float zBot, zTop, min[3], max[3];
+	CAD_Feature *from;
+	SK *sk;
+	int rv = -1;
+
+	if (exboss->skName[0] == '\0') {
+		return (0);
+	}
+	if ((sk = ResolveSketch(exboss)) == NULL) {
+		AG_SetError(_("No such sketch: %s"), exboss->skName);
+		return (-1);
+	}
+	if (exboss->depth <= 0.0) {
+		AG_SetError(_("Extrusion depth must be positive"));
+		return (-1);
+	}
+	if (exboss->flags & CAD_EXBOSS_MIDPLANE) {
+		zBot = (float)(-exboss->depth/2.0);
+		zTop = (float)(exboss->depth/2.0);
+	} else if (exboss->flags & CAD_EXBOSS_REVERSE) {
+		zBot = (float)(-exboss->depth);
+		zTop = 0.0f;
+	} else {
+		zBot = 0.0f;
+		zTop = (float)exboss->depth;
+	}
+	if ((from = StartFeature(exboss)) != NULL) {
+		CAD_MeshBounds(&from->mesh, min, max);
+		zBot += max[2];
+		zTop += max[2];
+	}
+	if (!(m->flags & CAD_MESH_NORMALS)) {
+		CAD_MeshReset(m, CAD_MESH_NORMALS);
+	}
+
+	pr.ar = &part->scratch;
+	pr.loops = NULL;
+	pr.nLoops = 0;
+	pr.maxLoops = 0;
+	ExtractLineLoops(sk, &pr);
+	ExtractCircleLoops(sk, &pr);
+	if (pr.nLoops == 0) {
+		AG_SetError(_("Sketch %s has no closed profile"),
+		    AGOBJECT(sk)->name);
+		goto out;
+	}
+	ClassifyLoops(&pr);
+
+	/* Triangulate each outer loop together with its holes. */
+	rgn = CAD_ArenaAlloc(pr.ar, pr.nLoops*sizeof(ExRegion));
+	holes = CAD_ArenaAlloc(pr.ar, pr.nLoops*sizeof(Uint));
+	for (i = 0; i < pr.nLoops; i++) {
+		ExLoop *L = &pr.loops[i];
+		ExRegion *R;
+		Uint nHoles = 0;
+
+		if (L->depth % 2) {
+			continue;
+		}
+		R = &rgn[nRgn++];
+		R->nPts = L->n;
+		for (j = 0; j < pr.nLoops; j++) {
+			if (pr.loops[j].parent == (int)i &&
+			    pr.loops[j].depth % 2)
+				R->nPts += pr.loops[j].n;
+		}
+		R->xy = CAD_ArenaAlloc(pr.ar, R->nPts*2*sizeof(double));
+		R->tris = NULL;
+		memcpy(R->xy, L->xy, L->n*2*sizeof(double));
+		R->nPts = L->n;
+		for (j = 0; j < pr.nLoops; j++) {
+			ExLoop *H = &pr.loops[j];
+
+			if (H->parent != (int)i || !(H->depth % 2)) {
+				continue;
+			}
+			holes[nHoles++] = R->nPts;
+			memcpy(&R->xy[R->nPts*2], H->xy,
+			    H->n*2*sizeof(double));
+			R->nPts += H->n;
+		}
+		if (CAD_TriangulatePolygon(R->xy, R->nPts, holes, nHoles,
+		    &R->tris, &R->nTris) == -1) {
+			nRgn--;
+			goto out;
+		}
+		nv += R->nPts*2;
+		nt += R->nTris*2;
+	}
+	for (i = 0; i < pr.nLoops; i++) {
+		nv += pr.loops[i].n*4;
+		nt += pr.loops[i].n*2;
+	}
+
+	if (CAD_MeshReserve(m, m->nv+nv, m->nt+nt) == -1) {
+		goto out;
+	}
+	for (i = 0; i < nRgn; i++) {
+		EmitCaps(m, rgn[i].xy, rgn[i].nPts, rgn[i].tris, rgn[i].nTris,
+		    zBot, zTop);
+	}
+	for (i = 0; i < pr.nLoops; i++) {
+		EmitWalls(m, pr.ar, &pr.loops[i], zBot, zTop);
+	}
+	rv = 0;
+out:
+	for (i = 0; i < nRgn; i++) {
+		Free(rgn[i].tris);		/* From CAD_TriangulatePolygon() */
+	}
+	return (rv);
+}
+
+static void
+ApplyChanges(AG_Event *event)
+{
+	CAD_ExtrudedBoss *exboss = AG_PTR(1);
+	CAD_Part *part = (CAD_Part *)AGOBJECT(exboss)->parent;
+
+	if (part != NULL && SetStartFeature(exboss, part) == -1) {
+		AG_TextMsgFromError();
+		return;
+	}
+	if (CAD_UndoCommit(exboss, _("Edit extrusion")) == -1) {
+		Verbose("%s\n", AG_GetError());
+	}
+	CAD_FeatureChanged(exboss);
+	CAD_ObjectModified(exboss);
+	if (part != NULL && CAD_PartRegen(part) == -1)
+		AG_TextMsgFromError();
+}
+
+static void *
+Edit(void *obj)
+{
+	const AG_FlagDescr exbossFlags[] = {
+	{ CAD_EXBOSS_REVERSE,	N_("Reverse direction"),		1 },
+	{ CAD_EXBOSS_MIDPLANE,	N_("Mid-plane (symmetric)"),		1 },
+	{ 0, NULL, 0 }
+	};
+	CAD_ExtrudedBoss *exboss = obj;
+	AG_Window *win;
+	AG_Textbox *tb;
+	AG_Numerical *num;
+	CAD_Feature *from;
+
+	if (CAD_UndoTrack(exboss) == -1) {
+		Verbose("%s\n", AG_GetError());
+	}
+	win = AG_WindowNew(0);
+	AG_WindowSetCaption(win, _("Extrusion: %s"), AGOBJECT(exboss)->name);
+
+	tb = AG_TextboxNewS(win, AG_TEXTBOX_HFILL, _("Sketch: "));
+	AG_TextboxBindUTF8(tb, exboss->skName, sizeof(exboss->skName));
+
+	if ((from = StartFeature(exboss)) != NULL) {
+		Strlcpy(exboss->fromName, AGOBJECT(from)->name,
+		    sizeof(exboss->fromName));
+	} else if (CADFEATURE(exboss)->ndepNames > 0) {
+		Strlcpy(exboss->fromName, CADFEATURE(exboss)->depNames[0],
+		    sizeof(exboss->fromName));
+	} else {
+		exboss->fromName[0] = '\0';
+	}
+	tb = AG_TextboxNewS(win, AG_TEXTBOX_HFILL, _("Start from: "));
+	AG_TextboxBindUTF8(tb, exboss->fromName, sizeof(exboss->fromName));
+	num = AG_NumericalNew(win, AG_NUMERICAL_HFILL, "mm", _("Depth: "));
+	M_BindReal(num, "value", &exboss->depth);
+	AG_CheckboxSetFromFlags(win, 0, &exboss->flags, exbossFlags);
+	AG_LabelNewS(win, 0, _("Operation: "));
+	AG_RadioNewUint(win, 0, cadFeatureOpNames, &CADFEATURE(exboss)->op);
+
+	AG_ButtonNewFn(win, AG_BUTTON_HFILL, _("Apply"),
+	    ApplyChanges, "%p", exboss);
+	return (win);
+}
+
+CAD_FeatureClass cadExtrudedBossClass = {
+	{
+		"CAD_Feature:CAD_ExtrudedBoss",
+		sizeof(CAD_ExtrudedBoss),
+		{ 0,2 },
+		Init,
+		NULL,			/* reinit */
+		NULL,			/* destroy */
+		Load,
+		Save,
+		Edit
+	},
+	Regen,
+	HashInputs
 };
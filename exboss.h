@@ -4,13 +4,16 @@
 
 typedef struct cad_extruded_boss {
 	struct cad_feature feat;
-	SK *sk;					/* Source sketch */
-	
+	char skName[AG_OBJECT_NAME_MAX];	/* Source sketch name */
+	char fromName[AG_OBJECT_NAME_MAX];	/* Start feature (in editor) */
+	M_Real depth;				/* Extrusion depth */
 	Uint flags;
+#define CAD_EXBOSS_REVERSE	0x01		/* Extrude along -Z */
+#define CAD_EXBOSS_MIDPLANE	0x02		/* Symmetric about sketch */
 } CAD_ExtrudedBoss;
 
 __BEGIN_DECLS
-extern AG_ObjectClass cadExtrudedBossClass;
+extern CAD_FeatureClass cadExtrudedBossClass;
 __END_DECLS
 
 #include "close_code.h"
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Export of meshes to Stanford PLY (binary) and Wavefront OBJ. Records
+ * are formatted directly from the mesh arrays into a fixed-size output
+ * buffer which is flushed with large writes, so that exporting does not
+ * require an intermediate copy of the geometry.
+ */
+
+#include <agar/core.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cadtools.h"
+
+#define EXPORT_BUFSIZE	(1024*1024)	/* Output buffer size */
+#define EXPORT_LINE_MAX	256		/* Longest formatted OBJ line */
+
+typedef struct export_buf {
+	FILE *f;
+	Uint8 *buf;
+	size_t len;
+	int err;			/* Write error occurred */
+} ExportBuf;
+
+static int
+OpenBuf(ExportBuf *eb, const char *path)
+{
+	if ((eb->f = fopen(path, "wb")) == NULL) {
+		AG_SetError("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+	setvbuf(eb->f, NULL, _IONBF, 0);
+	eb->buf = Malloc(EXPORT_BUFSIZE);
+	eb->len = 0;
+	eb->err = 0;
+	return (0);
+}
+
+static void
+FlushBuf(ExportBuf *eb)
+{
+	if (eb->len > 0 && !eb->err &&
+	    fwrite(eb->buf, eb->len, 1, eb->f) != 1) {
+		eb->err = errno;
+	}
+	eb->len = 0;
+}
+
+/* Return space for at least size bytes at the end of the buffer. */
+static __inline__ Uint8 *
+Reserve(ExportBuf *eb, size_t size)
+{
+	if (eb->len + size > EXPORT_BUFSIZE) {
+		FlushBuf(eb);
+	}
+	return (&eb->buf[eb->len]);
+}
+
+static void
+Puts(ExportBuf *eb, const char *s)
+{
+	size_t len = strlen(s);
+
+	if (len > EXPORT_BUFSIZE) {
+		len = EXPORT_BUFSIZE;
+	}
+	memcpy(Reserve(eb, len), s, len);
+	eb->len += len;
+}
+
+static int
+CloseBuf(ExportBuf *eb, const char *path)
+{
+	FlushBuf(eb);
+	Free(eb->buf);
+	if (fclose(eb->f) != 0 && eb->err == 0) {
+		eb->err = errno;
+	}
+	if (eb->err != 0) {
+		AG_SetError("%s: %s", path, strerror(eb->err));
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Write a mesh to a binary PLY file in host byte order. The flags select
+ * the optional vertex attributes to save (attributes missing from the
+ * mesh are left out). The comment may be NULL.
+ */
+int
+CAD_MeshSavePLY(const CAD_Mesh *m, const char *path, Uint flags,
+    const char *comment)
+{
+	ExportBuf eb;
+	char hdr[EXPORT_LINE_MAX];
+	size_t vSize;
+	Uint i;
+
+	flags &= m->flags;
+	if (OpenBuf(&eb, path) == -1) {
+		return (-1);
+	}
+	Puts(&eb, "ply\n");
+#if AG_BYTEORDER == AG_BIG_ENDIAN
+	Puts(&eb, "format binary_big_endian 1.0\n");
+#else
+	Puts(&eb, "format binary_little_endian 1.0\n");
+#endif
+	if (comment != NULL && comment[0] != '\0') {
+		snprintf(hdr, sizeof(hdr), "comment %s\n", comment);
+		Puts(&eb, hdr);
+	}
+	snprintf(hdr, sizeof(hdr), "element vertex %u\n", m->nv);
+	Puts(&eb, hdr);
+	Puts(&eb, "property float x\nproperty float y\nproperty float z\n");
+	vSize = 3*sizeof(float);
+	if (flags & CAD_MESH_NORMALS) {
+		Puts(&eb, "property float nx\nproperty float ny\n"
+		          "property float nz\n");
+		vSize += 3*sizeof(float);
+	}
+	if (flags & CAD_MESH_COLORS) {
+		Puts(&eb, "property uchar red\nproperty uchar green\n"
+		          "property uchar blue\nproperty uchar alpha\n");
+		vSize += 4;
+	}
+	if (flags & CAD_MESH_TEXCOORDS) {
+		Puts(&eb, "property float s\nproperty float t\n");
+		vSize += 2*sizeof(float);
+	}
+	snprintf(hdr, sizeof(hdr), "element face %u\n", m->nt);
+	Puts(&eb, hdr);
+	Puts(&eb, "property list uchar uint vertex_indices\nend_header\n");
+
+	for (i = 0; i < m->nv; i++) {
+		Uint8 *p = Reserve(&eb, vSize);
+
+		memcpy(p, &m->v[i*3], 3*sizeof(float));
+		p += 3*sizeof(float);
+		if (flags & CAD_MESH_NORMALS) {
+			memcpy(p, &m->n[i*3], 3*sizeof(float));
+			p += 3*sizeof(float);
+		}
+		if (flags & CAD_MESH_COLORS) {
+			memcpy(p, &m->c[i*4], 4);
+			p += 4;
+		}
+		if (flags & CAD_MESH_TEXCOORDS) {
+			memcpy(p, &m->st[i*2], 2*sizeof(float));
+		}
+		eb.len += vSize;
+	}
+	for (i = 0; i < m->nt; i++) {
+		Uint8 *p = Reserve(&eb, 1 + 3*sizeof(Uint32));
+
+		p[0] = 3;
+		memcpy(&p[1], &m->tri[i*3], 3*sizeof(Uint32));
+		eb.len += 1 + 3*sizeof(Uint32);
+	}
+	return CloseBuf(&eb, path);
+}
+
+/* Format an unsigned integer; returns the number of characters written. */
+static __inline__ int
+PutUint(char *s, Uint32 n)
+{
+	char tmp[10];
+	int len = 0, i;
+
+	do {
+		tmp[len++] = '0' + (n % 10);
+		n /= 10;
+	} while (n > 0);
+	for (i = 0; i < len; i++) {
+		s[i] = tmp[len-1-i];
+	}
+	return (len);
+}
+
+/*
+ * Write a mesh to a Wavefront OBJ file. The flags select the optional
+ * vertex attributes to save; colors are written as the common "v x y z
+ * r g b" extension. The comment may be NULL.
+ */
+int
+CAD_MeshSaveOBJ(const CAD_Mesh *m, const char *path, Uint flags,
+    const char *comment)
+{
+	ExportBuf eb;
+	char *s;
+	Uint i, k;
+
+	flags &= m->flags;
+	if (OpenBuf(&eb, path) == -1) {
+		return (-1);
+	}
+	if (comment != NULL && comment[0] != '\0') {
+		Puts(&eb, "# ");
+		Puts(&eb, comment);
+		Puts(&eb, "\n");
+	}
+	for (i = 0; i < m->nv; i++) {
+		const float *v = &m->v[i*3];
+
+		s = (char *)Reserve(&eb, EXPORT_LINE_MAX);
+		if (flags & CAD_MESH_COLORS) {
+			const Uint8 *c = &m->c[i*4];
+
+			eb.len += snprintf(s, EXPORT_LINE_MAX,
+			    "v %.9g %.9g %.9g %.4g %.4g %.4g\n", v[0], v[1], v[2],
+			    c[0]/255.0, c[1]/255.0, c[2]/255.0);
+		} else {
+			eb.len += snprintf(s, EXPORT_LINE_MAX,
+			    "v %.9g %.9g %.9g\n", v[0], v[1], v[2]);
+		}
+	}
+	if (flags & CAD_MESH_TEXCOORDS) {
+		for (i = 0; i < m->nv; i++) {
+			s = (char *)Reserve(&eb, EXPORT_LINE_MAX);
+			eb.len += snprintf(s, EXPORT_LINE_MAX, "vt %.9g %.9g\n",
+			    m->st[i*2], m->st[i*2+1]);
+		}
+	}
+	if (flags & CAD_MESH_NORMALS) {
+		for (i = 0; i < m->nv; i++) {
+			const float *n = &m->n[i*3];
+
+			s = (char *)Reserve(&eb, EXPORT_LINE_MAX);
+			eb.len += snprintf(s, EXPORT_LINE_MAX,
+			    "vn %.9g %.9g %.9g\n", n[0], n[1], n[2]);
+		}
+	}
+
+	/* Attributes share the vertex indices (which are 1-based). */
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+
+		s = (char *)Reserve(&eb, EXPORT_LINE_MAX);
+		*s++ = 'f';
+		for (k = 0; k < 3; k++) {
+			Uint32 idx = t[k]+1;
+
+			*s++ = ' ';
+			s += PutUint(s, idx);
+			if (flags & (CAD_MESH_TEXCOORDS|CAD_MESH_NORMALS)) {
+				*s++ = '/';
+				if (flags & CAD_MESH_TEXCOORDS) {
+					s += PutUint(s, idx);
+				}
+				if (flags & CAD_MESH_NORMALS) {
+					*s++ = '/';
+					s += PutUint(s, idx);
+				}
+			}
+		}
+		*s++ = '\n';
+		eb.len = s - (char *)eb.buf;
+	}
+	return CloseBuf(&eb, path);
+}
@@ -0,0 +1,14 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_EXPORT_H_
+#define _CADTOOLS_EXPORT_H_
+
+#include "begin_code.h"
+
+__BEGIN_DECLS
+int	CAD_MeshSavePLY(const CAD_Mesh *, const char *, Uint, const char *);
+int	CAD_MeshSaveOBJ(const CAD_Mesh *, const char *, Uint, const char *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_EXPORT_H_ */
@@ -25,44 +25,347 @@
 
 #include <agar/core.h>
 
+#include <string.h>
+
 #include "cadtools.h"
 #include "part.h"
 #include "feature.h"
 
+const char *cadFeatureOpNames[] = {
+	N_("Append"),
+	N_("Union"),
+	N_("Cut"),
+	N_("Intersect"),
+	NULL
+};
+
+static void
+Renamed(AG_Event *event)
+{
+	CAD_Feature *ft = AG_SELF();
+	AG_Object *part = AGOBJECT(ft)->parent;
+
+	if (part != NULL && AG_OfClass(part, "CAD_Part:*"))
+		CAD_PartRenamed((CAD_Part *)part, ft);
+}
+
 static void
 Init(void *obj)
 {
-	CAD_Feature *feature = obj;
+	CAD_Feature *ft = obj;
+
+	ft->flags = CAD_FEATURE_DIRTY;
+	ft->body = NULL;
+	ft->deps = NULL;
+	ft->ndeps = 0;
+	ft->depNames = NULL;
+	ft->ndepNames = 0;
+	CAD_MeshInit(&ft->mesh, 0);
+	CAD_MeshInit(&ft->result, 0);
+	ft->resultKey = 0;
+	ft->failKey = 0;
+	ft->op = CAD_FEATURE_UNION;
+	ft->seq = 0;
+	ft->hash = 0;
+	ft->inputs = 0;
+	ft->arena = NULL;
+
+	AG_SetEvent(ft, "renamed", Renamed, NULL);
+}
+
+static void
+FreeDepNames(CAD_Feature *ft)
+{
+	Uint i;
+
+	for (i = 0; i < ft->ndepNames; i++) {
+		Free(ft->depNames[i]);
+	}
+	Free(ft->depNames);
+	ft->depNames = NULL;
+	ft->ndepNames = 0;
+}
+
+static void
+Destroy(void *obj)
+{
+	CAD_Feature *ft = obj;
+
+	Free(ft->deps);
+	FreeDepNames(ft);
+	CAD_MeshFree(&ft->mesh);
+	CAD_MeshFree(&ft->result);
 
-	feature->flags = 0;
+	/* Features from a part's arena are not freed by AG_ObjectDestroy(). */
+	if (ft->arena != NULL)
+		CAD_ArenaFreeObj(ft->arena, ft, AGOBJECT(ft)->cls->size);
 }
 
 static int
 Load(void *obj, AG_DataSource *buf, const AG_Version *ver)
 {
-	CAD_Feature *feature = obj;
+	CAD_Feature *ft = obj;
+	Uint i;
 
-	feature->flags = (Uint)AG_ReadUint32(buf);
+	ft->flags = (Uint)AG_ReadUint32(buf) & CAD_FEATURE_SAVED;
+	ft->flags |= CAD_FEATURE_DIRTY;
+
+	/*
+	 * Dependencies are saved by name; they are resolved against the
+	 * parent part on the next regeneration.
+	 */
+	Free(ft->deps);
+	ft->deps = NULL;
+	ft->ndeps = 0;
+	FreeDepNames(ft);
+	if (ver->minor >= 1) {
+		ft->ndepNames = (Uint)AG_ReadUint32(buf);
+		if (ft->ndepNames > 0) {
+			ft->depNames = Malloc(ft->ndepNames*sizeof(char *));
+			for (i = 0; i < ft->ndepNames; i++)
+				ft->depNames[i] = AG_ReadString(buf);
+		}
+	}
+
+	/* Features predating boolean merging were simply appended. */
+	if (ver->minor >= 2) {
+		ft->op = (Uint)AG_ReadUint32(buf);
+		if (ft->op >= CAD_FEATURE_OP_LAST) {
+			AG_SetError(_("Bad feature operation: %u"), ft->op);
+			return (-1);
+		}
+	} else {
+		ft->op = CAD_FEATURE_APPEND;
+	}
 	return (0);
 }
 
 static int
 Save(void *obj, AG_DataSource *buf)
 {
-	CAD_Feature *feature = obj;
+	CAD_Feature *ft = obj;
+	Uint i;
+
+	AG_WriteUint32(buf, (Uint32)(ft->flags & CAD_FEATURE_SAVED));
+	AG_WriteUint32(buf, (Uint32)ft->ndeps);
+	for (i = 0; i < ft->ndeps; i++) {
+		AG_WriteString(buf, AGOBJECT(ft->deps[i])->name);
+	}
+	AG_WriteUint32(buf, (Uint32)ft->op);
+	return (0);
+}
+
+/* Return 1 if feature ft depends (directly or indirectly) on dep. */
+int
+CAD_FeatureDependsOn(void *pFt, void *pDep)
+{
+	CAD_Feature *ft = pFt;
+	Uint i;
 
-	AG_WriteUint32(buf, (Uint32)feature->flags);
+	for (i = 0; i < ft->ndeps; i++) {
+		if (ft->deps[i] == pDep ||
+		    CAD_FeatureDependsOn(ft->deps[i], pDep))
+			return (1);
+	}
 	return (0);
 }
 
-AG_ObjectClass cadFeatureClass = {
-	"CAD_Feature",
-	sizeof(CAD_Feature),
-	{ 0,0 },
-	Init,
-	NULL,			/* reinit */
-	NULL,			/* destroy */
-	Load,
-	Save,
-	NULL,			/* edit */
+/*
+ * Return 1 if feature dep is merged into the part body ahead of feature ft
+ * (i.e., if dep comes before ft in the body chain of the part).
+ */
+int
+CAD_FeatureUpstream(void *pFt, void *pDep)
+{
+	CAD_Feature *ft;
+
+	for (ft = CADFEATURE(pFt)->body; ft != NULL; ft = ft->body) {
+		if (ft == pDep)
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Record that feature ft uses the output of feature dep. The dependency
+ * must be upstream of ft in the part, so that the feature list remains in
+ * dependency order (and the graph acyclic).
+ */
+int
+CAD_FeatureAddDep(void *pFt, void *pDep)
+{
+	CAD_Feature *ft = pFt;
+	Uint i;
+
+	if (!CAD_FeatureUpstream(ft, pDep)) {
+		AG_SetError(_("%s: Dependency %s must come before it"),
+		    AGOBJECT(ft)->name, AGOBJECT(pDep)->name);
+		return (-1);
+	}
+	for (i = 0; i < ft->ndeps; i++) {
+		if (ft->deps[i] == pDep)
+			return (0);
+	}
+	ft->deps = Realloc(ft->deps, (ft->ndeps+1)*sizeof(CAD_Feature *));
+	ft->deps[ft->ndeps++] = pDep;
+	ft->flags |= CAD_FEATURE_DIRTY;
+	return (0);
+}
+
+void
+CAD_FeatureDelDep(void *pFt, void *pDep)
+{
+	CAD_Feature *ft = pFt;
+	Uint i;
+
+	for (i = 0; i < ft->ndeps; i++) {
+		if (ft->deps[i] == pDep)
+			break;
+	}
+	if (i == ft->ndeps) {
+		return;
+	}
+	if (i < ft->ndeps-1) {
+		memmove(&ft->deps[i], &ft->deps[i+1],
+		    (ft->ndeps-i-1)*sizeof(CAD_Feature *));
+	}
+	ft->ndeps--;
+	ft->flags |= CAD_FEATURE_DIRTY;
+}
+
+/*
+ * Resolve the dependencies named in the saved feature data against
+ * the children of the given part.
+ */
+void
+CAD_FeatureResolveDeps(void *pFt, void *part)
+{
+	CAD_Feature *ft = pFt;
+	AG_Object *dep;
+	Uint i;
+
+	for (i = 0; i < ft->ndepNames; i++) {
+		if ((dep = AG_ObjectFindChild(part, ft->depNames[i])) == NULL ||
+		    !AG_OfClass(dep, "CAD_Feature:*")) {
+			Verbose("%s: No such feature: %s\n",
+			    AGOBJECT(ft)->name, ft->depNames[i]);
+			continue;
+		}
+		if (CAD_FeatureAddDep(ft, dep) == -1)
+			Verbose("%s\n", AG_GetError());
+	}
+	FreeDepNames(ft);
+}
+
+/*
+ * Mark a feature as modified. The feature and everything downstream of it
+ * will be rebuilt by the next CAD_PartRegen().
+ */
+void
+CAD_FeatureChanged(void *p)
+{
+	CAD_Feature *ft = p;
+
+	ft->flags |= CAD_FEATURE_DIRTY;
+}
+
+/*
+ * Hash the external inputs of a feature (e.g., its source sketch) as
+ * reported by its class. The hash is 0 if the class reports none.
+ */
+static int
+HashInputs(CAD_Feature *ft, Uint64 *h)
+{
+	CAD_FeatureClass *cls = CADFEATURE_CLASS(ft);
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+	int rv;
+
+	*h = 0;
+	if (cls->hashInputs == NULL) {
+		return (0);
+	}
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	if ((rv = cls->hashInputs(ft, ds)) == 0) {
+		cs = AG_CORE_SOURCE(ds);
+		*h = CAD_HashBytes(CAD_HASH_INIT, cs->data, cs->size);
+	}
+	AG_CloseAutoCore(ds);
+	return (rv);
+}
+
+/*
+ * Compute a hash of everything which determines the geometry of the
+ * feature: its class, its saved parameters, the hashes of its upstream
+ * features and any external inputs reported by the class. Returns 0 if
+ * the feature cannot be hashed (i.e., its geometry must not be cached).
+ */
+Uint64
+CAD_FeatureHash(void *p)
+{
+	CAD_Feature *ft = p;
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+	Uint64 h;
+	Uint i;
+
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (0);
+	}
+	AG_WriteString(ds, AGOBJECT(ft)->cls->hier);
+	AG_WriteUint32(ds, (Uint32)(ft->flags & CAD_FEATURE_SAVED));
+	if (AGOBJECT(ft)->cls->save(ft, ds) == -1) {
+		goto fail;
+	}
+	for (i = 0; i < ft->ndeps; i++) {
+		AG_WriteUint64(ds, ft->deps[i]->hash);
+	}
+	if (HashInputs(ft, &ft->inputs) == -1) {
+		goto fail;
+	}
+	AG_WriteUint64(ds, ft->inputs);
+	cs = AG_CORE_SOURCE(ds);
+	h = CAD_HashBytes(CAD_HASH_INIT, cs->data, cs->size);
+	AG_CloseAutoCore(ds);
+	return (h != 0 ? h : 1);
+fail:
+	AG_CloseAutoCore(ds);
+	return (0);
+}
+
+/*
+ * Return 1 if the external inputs of a feature have changed since its hash
+ * was last computed (e.g., its source sketch was edited, renamed or closed).
+ */
+int
+CAD_FeatureInputsChanged(void *p)
+{
+	CAD_Feature *ft = p;
+	Uint64 h;
+
+	if (CADFEATURE_CLASS(ft)->hashInputs == NULL) {
+		return (0);
+	}
+	if (HashInputs(ft, &h) == -1) {
+		return (1);
+	}
+	return (h != ft->inputs);
+}
+
+CAD_FeatureClass cadFeatureClass = {
+	{
+		"CAD_Feature",
+		sizeof(CAD_Feature),
+		{ 0,2 },
+		Init,
+		NULL,			/* reinit */
+		Destroy,
+		Load,
+		Save,
+		NULL,			/* edit */
+	},
+	NULL,				/* regen */
+	NULL				/* hashInputs */
 };
@@ -5,16 +5,65 @@
 
 #include "begin_code.h"
 
+struct cad_part;
+
+typedef struct cad_feature_class {
+	struct ag_object_class _inherit;
+
+	/* Generate the feature geometry into the given mesh. */
+	int (*regen)(void *, struct cad_part *, CAD_Mesh *);
+
+	/* Write external inputs (e.g., source sketch) for hashing. */
+	int (*hashInputs)(void *, AG_DataSource *);
+} CAD_FeatureClass;
+
 typedef struct cad_feature {
 	struct ag_object obj;
 	Uint flags;
 #define CAD_FEATURE_SUPPRESS	0x01			/* Inactive */
+#define CAD_FEATURE_DIRTY	0x02			/* Needs regeneration */
+#define CAD_FEATURE_REGENERATED	0x04			/* Rebuilt in last pass */
+#define CAD_FEATURE_FAILED	0x08			/* Could not be merged */
+#define CAD_FEATURE_SAVED	(CAD_FEATURE_SUPPRESS)
+
+	struct cad_feature *body;			/* Previous in body chain */
+	struct cad_feature **deps;			/* Upstream features */
+	Uint ndeps;
+	char **depNames;				/* Unresolved (from load) */
+	Uint ndepNames;
+	CAD_Mesh mesh;					/* Generated geometry */
+	CAD_Mesh result;				/* Part body after merge */
+	Uint64 resultKey;				/* Merge chain of result */
+	Uint64 failKey;					/* Merge chain that failed */
+	Uint op;					/* Merge with part body */
+#define CAD_FEATURE_APPEND	0			/* Add triangles as-is */
+#define CAD_FEATURE_UNION	1			/* Boolean union */
+#define CAD_FEATURE_CUT		2			/* Boolean difference */
+#define CAD_FEATURE_INTERSECT	3			/* Boolean intersection */
+#define CAD_FEATURE_OP_LAST	4
+	Uint seq;					/* Index in regen pass */
+	Uint64 hash;					/* Hash of inputs */
+	Uint64 inputs;					/* Hash of external inputs */
+	CAD_Arena *arena;				/* Storage (or NULL) */
 
 	AG_TAILQ_ENTRY(cad_feature) features;
 } CAD_Feature;
 
+#define CADFEATURE(p) ((CAD_Feature *)(p))
+#define CADFEATURE_CLASS(p) ((CAD_FeatureClass *)AGOBJECT(p)->cls)
+
 __BEGIN_DECLS
-extern AG_ObjectClass cadFeatureClass;
+extern CAD_FeatureClass cadFeatureClass;
+extern const char *cadFeatureOpNames[];
+
+int	CAD_FeatureAddDep(void *, void *);
+void	CAD_FeatureDelDep(void *, void *);
+int	CAD_FeatureDependsOn(void *, void *);
+int	CAD_FeatureUpstream(void *, void *);
+void	CAD_FeatureResolveDeps(void *, void *);
+void	CAD_FeatureChanged(void *);
+Uint64	CAD_FeatureHash(void *);
+int	CAD_FeatureInputsChanged(void *);
 __END_DECLS
 
 #include "close_code.h"
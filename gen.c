@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Change tracking for documents. Parts, programs and machines carry a
+ * generation counter which is bumped by every operation that modifies
+ * their saved state, so checking for unsaved changes does not require
+ * serializing the object and comparing it against its archive as
+ * AG_ObjectChanged() does.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include "cadtools.h"
+
+void
+CAD_GenerationInit(CAD_Generation *g)
+{
+	g->gen = 0;
+	g->genSaved = 0;
+}
+
+/*
+ * Return the counter tracking changes to an object. Features are tracked
+ * by their part. Returns NULL if the object is not tracked.
+ */
+CAD_Generation *
+CAD_ObjectGeneration(void *p)
+{
+	AG_Object *obj = p;
+
+	if (AG_OfClass(obj, "CAD_Feature:*")) {
+		obj = obj->parent;
+		if (obj == NULL)
+			return (NULL);
+	}
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		return &((CAD_Part *)obj)->gen;
+	} else if (AG_OfClass(obj, "CAM_Program:*")) {
+		return &((CAM_Program *)obj)->gen;
+	} else if (AG_OfClass(obj, "CAM_Machine:*")) {
+		return &((CAM_Machine *)obj)->gen;
+	}
+	return (NULL);
+}
+
+/* Record that the saved state of an object has changed. */
+void
+CAD_ObjectModified(void *obj)
+{
+	CAD_Generation *g;
+
+	if ((g = CAD_ObjectGeneration(obj)) != NULL)
+		g->gen++;
+}
+
+/* Record that an object was saved to (or loaded from) its archive. */
+void
+CAD_ObjectSaved(void *obj)
+{
+	CAD_Generation *g;
+
+	if ((g = CAD_ObjectGeneration(obj)) != NULL)
+		g->genSaved = g->gen;
+}
+
+/*
+ * Return 1 if the object has unsaved changes. Objects which are not
+ * tracked fall back to AG_ObjectChanged().
+ */
+int
+CAD_ObjectChanged(void *obj)
+{
+	CAD_Generation *g;
+
+	if ((g = CAD_ObjectGeneration(obj)) == NULL) {
+		return AG_ObjectChanged(obj);
+	}
+	return (g->gen != g->genSaved);
+}
+
+static void
+EditedValue(AG_Event *event)
+{
+	void *obj = AG_PTR(1);
+
+	CAD_ObjectModified(obj);
+}
+
+/*
+ * Bump the generation of an object whenever one of the value widgets
+ * (bound to its fields) under the given widget is edited.
+ */
+void
+CAD_TrackEdits(void *parent, void *obj)
+{
+	AG_Object *chld;
+
+	AGOBJECT_FOREACH_CHILD(chld, parent, ag_object) {
+		if (AG_OfClass(chld, "AG_Widget:AG_Numerical:*")) {
+			AG_AddEvent(chld, "numerical-changed", EditedValue,
+			    "%p", obj);
+		} else if (AG_OfClass(chld, "AG_Widget:AG_Textbox:*")) {
+			AG_AddEvent(chld, "textbox-postchg", EditedValue,
+			    "%p", obj);
+		} else if (AG_OfClass(chld, "AG_Widget:AG_Checkbox:*")) {
+			AG_AddEvent(chld, "checkbox-changed", EditedValue,
+			    "%p", obj);
+		} else if (AG_OfClass(chld, "AG_Widget:AG_Radio:*")) {
+			AG_AddEvent(chld, "radio-changed", EditedValue,
+			    "%p", obj);
+		} else if (AG_OfClass(chld, "AG_Widget:*")) {
+			CAD_TrackEdits(chld, obj);
+		}
+	}
+}
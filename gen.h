@@ -0,0 +1,24 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_GEN_H_
+#define _CADTOOLS_GEN_H_
+
+#include "begin_code.h"
+
+/* Modification counter of a document object. */
+typedef struct cad_generation {
+	Uint32 gen;				/* Bumped by each change */
+	Uint32 genSaved;			/* Value when last saved */
+} CAD_Generation;
+
+__BEGIN_DECLS
+void	CAD_GenerationInit(CAD_Generation *);
+CAD_Generation *CAD_ObjectGeneration(void *);
+void	CAD_ObjectModified(void *);
+void	CAD_ObjectSaved(void *);
+int	CAD_ObjectChanged(void *);
+void	CAD_TrackEdits(void *, void *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_GEN_H_ */
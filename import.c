@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Background loading of documents. The loader runs as a job on the pool
+ * while a progress window polls its status from the GUI thread. The
+ * loaded object is only attached to the VFS (and opened) once the loader
+ * has completed successfully, so that the rest of the application never
+ * sees a partially loaded object.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+void
+CAD_ProgressInit(CAD_Progress *prog)
+{
+	AG_MutexInit(&prog->lock);
+	prog->bytesDone = 0;
+	prog->bytesTotal = 0;
+	prog->nVtx = 0;
+	prog->nFaces = 0;
+	prog->cancel = 0;
+}
+
+void
+CAD_ProgressDestroy(CAD_Progress *prog)
+{
+	AG_MutexDestroy(&prog->lock);
+}
+
+void
+CAD_ProgressSetTotal(CAD_Progress *prog, Uint64 bytesTotal)
+{
+	AG_MutexLock(&prog->lock);
+	prog->bytesTotal = bytesTotal;
+	AG_MutexUnlock(&prog->lock);
+}
+
+/* Account for processed input; may be called from multiple threads. */
+void
+CAD_ProgressUpdate(CAD_Progress *prog, Uint64 bytes, Uint nVtx, Uint nFaces)
+{
+	AG_MutexLock(&prog->lock);
+	prog->bytesDone += bytes;
+	prog->nVtx += nVtx;
+	prog->nFaces += nFaces;
+	AG_MutexUnlock(&prog->lock);
+}
+
+int
+CAD_ProgressCancelled(CAD_Progress *prog)
+{
+	int rv;
+
+	AG_MutexLock(&prog->lock);
+	rv = prog->cancel;
+	AG_MutexUnlock(&prog->lock);
+	return (rv);
+}
+
+static void
+ImportJob(void *p)
+{
+	CAD_Import *imp = p;
+	int rv;
+
+	rv = imp->load(imp);
+
+	AG_MutexLock(&imp->prog.lock);
+	if (rv == -1) {
+		Strlcpy(imp->errMsg, AG_GetError(), sizeof(imp->errMsg));
+		imp->status = CAD_IMPORT_FAILED;
+	} else {
+		imp->status = CAD_IMPORT_DONE;
+	}
+	AG_MutexUnlock(&imp->prog.lock);
+}
+
+static void
+InitImport(CAD_Import *imp, const char *path, int (*load)(CAD_Import *),
+    void *arg)
+{
+	CAD_ProgressInit(&imp->prog);
+	Strlcpy(imp->path, path, sizeof(imp->path));
+	imp->load = load;
+	imp->finish = NULL;
+	imp->arg = arg;
+	imp->obj = NULL;
+	imp->status = CAD_IMPORT_RUNNING;
+	imp->errMsg[0] = '\0';
+	imp->info[0] = '\0';
+	imp->pct = 0;
+	imp->win = NULL;
+	imp->lbl = NULL;
+}
+
+static void
+CancelImport(AG_Event *event)
+{
+	CAD_Import *imp = AG_PTR(1);
+
+	AG_MutexLock(&imp->prog.lock);
+	imp->prog.cancel = 1;
+	AG_MutexUnlock(&imp->prog.lock);
+}
+
+/*
+ * Attach and open a document once its loader has completed, or report
+ * the error.
+ */
+static void
+FinishImport(CAD_Import *imp, int status, int cancel)
+{
+	CAD_ProgressDestroy(&imp->prog);
+
+	if (imp->finish != NULL) {
+		imp->finish(imp, status, cancel);
+		return;
+	}
+	if (status == CAD_IMPORT_DONE) {
+		AG_ObjectAttach(&vfsRoot, imp->obj);
+		if (AG_OfClass(imp->obj, "SK:*")) {
+			CAD_PartsCheckInputs();		/* Now resolvable */
+		}
+		CAD_OpenObject(imp->obj);
+		if (imp->info[0] != '\0')
+			AG_TextTmsg(AG_MSG_INFO, 4000, "%s", imp->info);
+	} else {
+		if (imp->obj != NULL) {
+			AG_ObjectDestroy(imp->obj);
+		}
+		if (!cancel)
+			AG_TextMsg(AG_MSG_ERROR, "%s: %s",
+			    AG_ShortFilename(imp->path), imp->errMsg);
+	}
+}
+
+/* Update the progress window and finish up once the loader is done. */
+static Uint32
+PollImport(AG_Timer *to, AG_Event *event)
+{
+	CAD_Import *imp = AG_PTR(1);
+	CAD_Progress *prog = &imp->prog;
+	int status, cancel;
+
+	AG_MutexLock(&prog->lock);
+	status = imp->status;
+	cancel = prog->cancel;
+	if (prog->bytesTotal > 0) {
+		imp->pct = (int)((prog->bytesDone*100)/prog->bytesTotal);
+	}
+	if (prog->nVtx > 0 || prog->nFaces > 0) {
+		AG_LabelText(imp->lbl, _("%lu KB read, %u vertices, %u faces"),
+		    (unsigned long)(prog->bytesDone/1024), prog->nVtx,
+		    prog->nFaces);
+	} else if (prog->bytesTotal > 0) {
+		AG_LabelText(imp->lbl, _("%lu KB read"),
+		    (unsigned long)(prog->bytesDone/1024));
+	}
+	AG_MutexUnlock(&prog->lock);
+
+	if (status == CAD_IMPORT_RUNNING) {
+		return (to->ival);
+	}
+
+	/* The job has completed; wait for the pool to release it. */
+	CAD_JobGroupWait(&imp->group);
+	CAD_JobGroupDestroy(&imp->group);
+	AG_ObjectDetach(imp->win);
+	FinishImport(imp, status, cancel);
+	Free(imp);
+	return (0);
+}
+
+static void
+StartImport(CAD_Import *imp, const char *caption)
+{
+	AG_Window *win;
+
+	win = imp->win = AG_WindowNew(AG_WINDOW_NOCLOSE|AG_WINDOW_NORESIZE);
+	AG_WindowSetCaptionS(win, caption);
+	imp->lbl = AG_LabelNewS(win, 0, _("Starting..."));
+	{
+		AG_ProgressBar *pb;
+
+		pb = AG_ProgressBarNew(win, AG_PROGRESS_BAR_HORIZ,
+		    AG_PROGRESS_BAR_SHOW_PCT|AG_PROGRESS_BAR_HFILL);
+		AG_BindInt(pb, "value", &imp->pct);
+	}
+	AG_ButtonNewFn(win, AG_BUTTON_HFILL, _("Cancel"),
+	    CancelImport, "%p", imp);
+	AG_WindowShow(win);
+
+	AG_InitTimer(&imp->timer, "import", 0);
+	AG_AddTimer(win, &imp->timer, 100, PollImport, "%p", imp);
+
+	CAD_JobGroupInit(&imp->group);
+	CAD_JobSubmit(&imp->group, ImportJob, imp);
+}
+
+/*
+ * Load a document in the background. The load function is executed by
+ * the job pool; it must leave the resulting object (not attached to any
+ * parent) in imp->obj, or return -1 and set the error message.
+ */
+void
+CAD_ImportStart(const char *path, int (*load)(CAD_Import *), void *arg)
+{
+	char caption[128];
+	CAD_Import *imp;
+
+	imp = Malloc(sizeof(CAD_Import));
+	InitImport(imp, path, load, arg);
+	snprintf(caption, sizeof(caption), _("Loading %s"),
+	    AG_ShortFilename(path));
+	StartImport(imp, caption);
+}
+
+/*
+ * Run a long operation on an open document in the background, with the
+ * same progress window as CAD_ImportStart(). The operation function is
+ * executed by the job pool; once it has completed, finish is invoked from
+ * the GUI thread with the resulting status and whether cancellation was
+ * requested. The finish function is responsible for reporting errors and
+ * releasing the argument. The returned handle remains valid until finish
+ * has been invoked.
+ */
+CAD_Import *
+CAD_OperationStart(const char *name, const char *caption,
+    int (*fn)(CAD_Import *), void (*finish)(CAD_Import *, int, int),
+    void *arg)
+{
+	CAD_Import *imp;
+
+	imp = Malloc(sizeof(CAD_Import));
+	InitImport(imp, name, fn, arg);
+	imp->finish = finish;
+	StartImport(imp, caption);
+	AG_LabelTextS(imp->lbl, _("Working..."));
+	return (imp);
+}
+
+/*
+ * Request the cancellation of an operation started with
+ * CAD_OperationStart() and wait for its function to return. The finish
+ * function is still invoked afterwards, from the GUI thread.
+ */
+void
+CAD_OperationCancel(CAD_Import *imp)
+{
+	AG_MutexLock(&imp->prog.lock);
+	imp->prog.cancel = 1;
+	AG_MutexUnlock(&imp->prog.lock);
+	CAD_JobGroupWait(&imp->group);
+}
+
+static void
+CancelImportSet(AG_Event *event)
+{
+	CAD_ImportSet *set = AG_PTR(1);
+	Uint i;
+
+	for (i = 0; i < set->n; i++) {
+		CAD_Import *imp = &set->imps[i];
+
+		AG_MutexLock(&imp->prog.lock);
+		imp->prog.cancel = 1;
+		AG_MutexUnlock(&imp->prog.lock);
+	}
+}
+
+/*
+ * Open the documents whose loaders have completed, in order of
+ * completion, and update the progress window.
+ */
+static Uint32
+PollImportSet(AG_Timer *to, AG_Event *event)
+{
+	CAD_ImportSet *set = AG_PTR(1);
+	CAD_Progress *prog;
+	float frac = 0.0f;
+	int status, cancel;
+	Uint i;
+
+	for (i = 0; i < set->n; i++) {
+		CAD_Import *imp = &set->imps[i];
+
+		if (set->finished[i]) {
+			continue;
+		}
+		prog = &imp->prog;
+		AG_MutexLock(&prog->lock);
+		status = imp->status;
+		cancel = prog->cancel;
+		if (prog->bytesTotal > 0) {
+			frac += (float)prog->bytesDone /
+			        (float)prog->bytesTotal;
+		}
+		AG_MutexUnlock(&prog->lock);
+
+		if (status != CAD_IMPORT_RUNNING) {
+			FinishImport(imp, status, cancel);
+			set->finished[i] = 1;
+			set->nDone++;
+		}
+	}
+	set->pct = (int)(((float)set->nDone + frac)*100.0f/(float)set->n);
+	if (set->pct > 100) {
+		set->pct = 100;
+	}
+	AG_LabelText(set->lbl, _("Loaded %u of %u documents"), set->nDone,
+	    set->n);
+
+	if (set->nDone < set->n) {
+		return (to->ival);
+	}
+	CAD_JobGroupWait(&set->group);
+	CAD_JobGroupDestroy(&set->group);
+	AG_ObjectDetach(set->win);
+	if (set->fnDone != NULL) {
+		set->fnDone();
+	}
+	Free(set->finished);
+	Free(set->imps);
+	Free(set);
+	return (0);
+}
+
+/*
+ * Load several documents in native format concurrently. Each document is
+ * attached and opened as soon as its own loader has completed. If fnDone
+ * is not NULL, it is invoked once all documents have been handled.
+ */
+void
+CAD_ImportDocuments(char **paths, Uint nPaths, void (*fnDone)(void))
+{
+	CAD_ImportSet *set;
+	AG_ObjectClass *cls;
+	AG_Window *win;
+	Uint i;
+
+	if (nPaths == 0) {
+		goto done;
+	}
+	set = Malloc(sizeof(CAD_ImportSet));
+	set->imps = Malloc(nPaths*sizeof(CAD_Import));
+	set->finished = Malloc(nPaths);
+	memset(set->finished, 0, nPaths);
+	set->n = 0;
+	set->nDone = 0;
+	set->pct = 0;
+	set->fnDone = fnDone;
+	for (i = 0; i < nPaths; i++) {
+		if ((cls = CAD_DocumentClass(paths[i])) == NULL) {
+			Verbose("Ignoring argument: %s\n", paths[i]);
+			continue;
+		}
+		InitImport(&set->imps[set->n++], paths[i], CAD_ImportObject,
+		    cls);
+	}
+	if (set->n == 0) {
+		Free(set->finished);
+		Free(set->imps);
+		Free(set);
+		goto done;
+	}
+
+	win = set->win = AG_WindowNew(AG_WINDOW_NOCLOSE|AG_WINDOW_NORESIZE);
+	AG_WindowSetCaption(win, _("Loading %u documents"), set->n);
+	set->lbl = AG_LabelNewS(win, 0, _("Starting..."));
+	{
+		AG_ProgressBar *pb;
+
+		pb = AG_ProgressBarNew(win, AG_PROGRESS_BAR_HORIZ,
+		    AG_PROGRESS_BAR_SHOW_PCT|AG_PROGRESS_BAR_HFILL);
+		AG_BindInt(pb, "value", &set->pct);
+	}
+	AG_ButtonNewFn(win, AG_BUTTON_HFILL, _("Cancel"),
+	    CancelImportSet, "%p", set);
+	AG_WindowShow(win);
+
+	/* Submit all loaders before the first poll can run. */
+	CAD_JobGroupInit(&set->group);
+	for (i = 0; i < set->n; i++) {
+		CAD_JobSubmit(&set->group, ImportJob, &set->imps[i]);
+	}
+	AG_InitTimer(&set->timer, "import-set", 0);
+	AG_AddTimer(win, &set->timer, 50, PollImportSet, "%p", set);
+	return;
+done:
+	if (fnDone != NULL)
+		fnDone();
+}
+
+/*
+ * Return the class of document stored in a file, based on its extension,
+ * or NULL if the file is not a cadtools document. Must be called from the
+ * main thread (the class's subsystem is initialized if needed).
+ */
+AG_ObjectClass *
+CAD_DocumentClass(const char *path)
+{
+	const char *ext;
+
+	if ((ext = strrchr(path, '.')) == NULL) {
+		return (NULL);
+	}
+	if (strcasecmp(ext, ".sk") == 0) {
+		CAD_InitSketches();
+		return (&skClass);
+	} else if (strcasecmp(ext, ".part") == 0) {
+		return (&cadPartClass);
+	} else if (strcasecmp(ext, ".prog") == 0) {
+		return (&camProgramClass);
+	}
+	return (NULL);
+}
+
+/*
+ * Load a document in native format into a new object of the given class
+ * (not attached to any parent). May be called from any thread.
+ */
+void *
+CAD_LoadDocument(AG_ObjectClass *cls, const char *path)
+{
+	AG_Object *obj;
+
+	if ((obj = AG_ObjectNew(NULL, NULL, cls)) == NULL) {
+		return (NULL);
+	}
+	if (AG_OfClass(obj, "CAD_Part:*") && CAD_PartFileProbe(path)) {
+		if (CAD_PartLoad((CAD_Part *)obj, path,
+		    CAD_PART_LOAD_ALL) == -1) {
+			AG_ObjectDestroy(obj);
+			return (NULL);
+		}
+	} else {
+		if (AG_ObjectLoadFromFile(obj, path) == -1) {
+			AG_ObjectDestroy(obj);
+			return (NULL);
+		}
+	}
+	CAD_ObjectSaved(obj);
+	AG_SetString(obj, "archive-path", path);
+	AG_ObjectSetNameS(obj, AG_ShortFilename(path));
+	return (obj);
+}
+
+/*
+ * Loader for documents in native format. The argument is the object
+ * class to instantiate.
+ */
+int
+CAD_ImportObject(CAD_Import *imp)
+{
+	if ((imp->obj = CAD_LoadDocument(imp->arg, imp->path)) == NULL) {
+		return (-1);
+	}
+	return (0);
+}
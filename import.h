@@ -0,0 +1,69 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_IMPORT_H_
+#define _CADTOOLS_IMPORT_H_
+
+#include "begin_code.h"
+
+/* Progress of a long-running operation, shared with the GUI. */
+typedef struct cad_progress {
+	AG_Mutex lock;
+	Uint64 bytesDone, bytesTotal;		/* Input processed */
+	Uint nVtx, nFaces;			/* Elements parsed */
+	int cancel;				/* Cancellation requested */
+} CAD_Progress;
+
+/* Background loading of a document. */
+typedef struct cad_import {
+	CAD_Progress prog;
+	char path[AG_PATHNAME_MAX];
+	int (*load)(struct cad_import *);	/* Loader (runs in background) */
+	void (*finish)(struct cad_import *, int, int); /* Operation done */
+	void *arg;				/* Loader argument */
+	void *obj;				/* Loaded object (unattached) */
+	int status;
+#define CAD_IMPORT_RUNNING	0
+#define CAD_IMPORT_DONE		1
+#define CAD_IMPORT_FAILED	2
+	char errMsg[256];			/* Error message if failed */
+	char info[128];				/* Message on completion */
+	CAD_JobGroup group;
+	AG_Window *win;				/* Progress window */
+	AG_Label *lbl;
+	int pct;				/* Progress bar value */
+	AG_Timer timer;
+} CAD_Import;
+
+/* Concurrent loading of several documents. */
+typedef struct cad_import_set {
+	CAD_Import *imps;			/* Loaders (without windows) */
+	Uint8 *finished;			/* Opened or reported */
+	Uint n, nDone;
+	CAD_JobGroup group;
+	AG_Window *win;				/* Progress window */
+	AG_Label *lbl;
+	int pct;				/* Progress bar value */
+	AG_Timer timer;
+	void (*fnDone)(void);			/* All documents handled */
+} CAD_ImportSet;
+
+__BEGIN_DECLS
+void	CAD_ProgressInit(CAD_Progress *);
+void	CAD_ProgressDestroy(CAD_Progress *);
+void	CAD_ProgressSetTotal(CAD_Progress *, Uint64);
+void	CAD_ProgressUpdate(CAD_Progress *, Uint64, Uint, Uint);
+int	CAD_ProgressCancelled(CAD_Progress *);
+
+void	CAD_ImportStart(const char *, int (*)(CAD_Import *), void *);
+CAD_Import *CAD_OperationStart(const char *, const char *,
+	                          int (*)(CAD_Import *),
+	                          void (*)(CAD_Import *, int, int), void *);
+void	CAD_OperationCancel(CAD_Import *);
+void	CAD_ImportDocuments(char **, Uint, void (*)(void));
+AG_ObjectClass *CAD_DocumentClass(const char *);
+void	*CAD_LoadDocument(AG_ObjectClass *, const char *);
+int	CAD_ImportObject(CAD_Import *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_IMPORT_H_ */
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Work-stealing thread pool. Each worker owns a deque of jobs; it pops
+ * work from the bottom of its own deque and steals from the top of the
+ * others' when it runs dry. Jobs submitted from a worker go to that
+ * worker's deque, so recursively spawned work stays local.
+ *
+ * Without thread support, jobs are executed immediately by the caller.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "cadtools.h"
+
+typedef struct cad_job {
+	CAD_JobFn fn;
+	void *arg;
+	CAD_JobGroup *group;
+} CAD_Job;
+
+#ifdef AG_THREADS
+
+typedef struct cad_job_worker {
+	AG_Thread th;
+	AG_Mutex lock;				/* Lock on deque */
+	CAD_Job *jobs;				/* Deque (top is jobs[head]) */
+	Uint head, tail, maxJobs;
+} CAD_JobWorker;
+
+static struct {
+	AG_Mutex lock;
+	AG_Cond work;				/* Jobs are available */
+	Uint nQueued;				/* Jobs sitting in deques */
+	int exiting;
+	CAD_JobWorker *workers;
+	Uint nWorkers;
+	Uint nextWorker;			/* For external submits */
+	AG_ThreadKey selfKey;			/* CAD_JobWorker of thread */
+} pool;
+
+static int poolInited = 0;
+
+static void
+RunJob(CAD_Job *job)
+{
+	CAD_JobGroup *g = job->group;
+
+	job->fn(job->arg);
+
+	AG_MutexLock(&g->lock);
+	if (--g->pending == 0) {
+		AG_CondBroadcast(&g->done);
+	}
+	AG_MutexUnlock(&g->lock);
+}
+
+static void
+PushJob(CAD_JobWorker *w, const CAD_Job *job)
+{
+	AG_MutexLock(&w->lock);
+	if (w->head > 0 && w->head == w->tail) {
+		w->head = 0;
+		w->tail = 0;
+	}
+	if (w->tail+1 > w->maxJobs) {
+		if (w->head > 0) {
+			memmove(w->jobs, &w->jobs[w->head],
+			    (w->tail - w->head)*sizeof(CAD_Job));
+			w->tail -= w->head;
+			w->head = 0;
+		}
+		if (w->tail+1 > w->maxJobs) {
+			w->maxJobs = (w->maxJobs > 0) ? w->maxJobs*2 : 64;
+			w->jobs = Realloc(w->jobs, w->maxJobs*sizeof(CAD_Job));
+		}
+	}
+	w->jobs[w->tail++] = *job;
+
+	/*
+	 * Count the job before it can be seen by other workers, so that a
+	 * thief can never decrement nQueued ahead of us.
+	 */
+	AG_MutexLock(&pool.lock);
+	pool.nQueued++;
+	AG_MutexUnlock(&w->lock);
+	AG_CondSignal(&pool.work);
+	AG_MutexUnlock(&pool.lock);
+}
+
+/* Pop the most recently pushed job from our own deque. */
+static int
+PopJob(CAD_JobWorker *w, CAD_Job *job)
+{
+	int rv = 0;
+
+	AG_MutexLock(&w->lock);
+	if (w->tail > w->head) {
+		*job = w->jobs[--w->tail];
+		rv = 1;
+	}
+	AG_MutexUnlock(&w->lock);
+	return (rv);
+}
+
+/*
+ * Steal the oldest job from another deque. If group is non-NULL, take
+ * the oldest job belonging to that group, wherever it sits in the deque.
+ */
+static int
+StealJob(CAD_JobWorker *w, CAD_Job *job, CAD_JobGroup *group)
+{
+	Uint i;
+	int rv = 0;
+
+	AG_MutexLock(&w->lock);
+	for (i = w->head; i < w->tail; i++) {
+		if (group != NULL && w->jobs[i].group != group) {
+			continue;
+		}
+		*job = w->jobs[i];
+		if (i > w->head) {
+			memmove(&w->jobs[w->head+1], &w->jobs[w->head],
+			    (i - w->head)*sizeof(CAD_Job));
+		}
+		w->head++;
+		rv = 1;
+		break;
+	}
+	AG_MutexUnlock(&w->lock);
+	return (rv);
+}
+
+static int
+FindJob(CAD_JobWorker *self, CAD_Job *job, CAD_JobGroup *group)
+{
+	Uint i, start;
+
+	if (self != NULL && group == NULL && PopJob(self, job)) {
+		goto found;
+	}
+	start = (self != NULL) ? (Uint)(self - pool.workers) + 1 : 0;
+	for (i = 0; i < pool.nWorkers; i++) {
+		CAD_JobWorker *w = &pool.workers[(start+i) % pool.nWorkers];
+
+		if (StealJob(w, job, group))
+			goto found;
+	}
+	return (0);
+found:
+	AG_MutexLock(&pool.lock);
+	pool.nQueued--;
+	AG_MutexUnlock(&pool.lock);
+	return (1);
+}
+
+static void *
+WorkerThread(void *p)
+{
+	CAD_JobWorker *self = p;
+	CAD_Job job;
+
+	AG_ThreadKeySet(pool.selfKey, self);
+	for (;;) {
+		AG_MutexLock(&pool.lock);
+		while (pool.nQueued == 0 && !pool.exiting) {
+			AG_CondWait(&pool.work, &pool.lock);
+		}
+		if (pool.exiting) {
+			AG_MutexUnlock(&pool.lock);
+			break;
+		}
+		AG_MutexUnlock(&pool.lock);
+
+		while (FindJob(self, &job, NULL))
+			RunJob(&job);
+	}
+	return (NULL);
+}
+
+static Uint
+CountCPUs(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n;
+
+	if ((n = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+		return ((Uint)n);
+#endif
+	return (1);
+}
+
+/*
+ * Start the worker threads. If nThreads is 0, use one worker per online
+ * processor.
+ */
+int
+CAD_JobPoolInit(Uint nThreads)
+{
+	Uint i;
+
+	if (poolInited) {
+		return (0);
+	}
+	if (nThreads == 0) {
+		nThreads = CountCPUs();
+	}
+	AG_MutexInit(&pool.lock);
+	AG_CondInit(&pool.work);
+	AG_ThreadKeyCreate(&pool.selfKey, NULL);
+	pool.nQueued = 0;
+	pool.exiting = 0;
+	pool.nextWorker = 0;
+	pool.nWorkers = nThreads;
+	pool.workers = Malloc(nThreads*sizeof(CAD_JobWorker));
+	for (i = 0; i < nThreads; i++) {
+		CAD_JobWorker *w = &pool.workers[i];
+
+		AG_MutexInit(&w->lock);
+		w->jobs = NULL;
+		w->head = 0;
+		w->tail = 0;
+		w->maxJobs = 0;
+	}
+	poolInited = 1;
+	for (i = 0; i < nThreads; i++) {
+		CAD_JobWorker *w = &pool.workers[i];
+
+		if (AG_ThreadTryCreate(&w->th, WorkerThread, w) == -1) {
+			pool.nWorkers = i;
+			break;
+		}
+	}
+	if (pool.nWorkers == 0) {
+		CAD_JobPoolDestroy();
+		return (-1);
+	}
+	return (0);
+}
+
+void
+CAD_JobPoolDestroy(void)
+{
+	Uint i;
+
+	if (!poolInited) {
+		return;
+	}
+	AG_MutexLock(&pool.lock);
+	pool.exiting = 1;
+	AG_CondBroadcast(&pool.work);
+	AG_MutexUnlock(&pool.lock);
+
+	for (i = 0; i < pool.nWorkers; i++) {
+		AG_ThreadJoin(pool.workers[i].th, NULL);
+	}
+	for (i = 0; i < pool.nWorkers; i++) {
+		AG_MutexDestroy(&pool.workers[i].lock);
+		Free(pool.workers[i].jobs);
+	}
+	Free(pool.workers);
+	AG_CondDestroy(&pool.work);
+	AG_MutexDestroy(&pool.lock);
+	poolInited = 0;
+}
+
+Uint
+CAD_JobPoolThreads(void)
+{
+	return (poolInited ? pool.nWorkers : 1);
+}
+
+#else /* !AG_THREADS */
+
+int
+CAD_JobPoolInit(Uint nThreads)
+{
+	return (0);
+}
+
+void
+CAD_JobPoolDestroy(void)
+{
+}
+
+Uint
+CAD_JobPoolThreads(void)
+{
+	return (1);
+}
+
+#endif /* AG_THREADS */
+
+void
+CAD_JobGroupInit(CAD_JobGroup *g)
+{
+	AG_MutexInit(&g->lock);
+	AG_CondInit(&g->done);
+	g->pending = 0;
+}
+
+void
+CAD_JobGroupDestroy(CAD_JobGroup *g)
+{
+	AG_CondDestroy(&g->done);
+	AG_MutexDestroy(&g->lock);
+}
+
+/* Queue a job for execution by the pool. */
+void
+CAD_JobSubmit(CAD_JobGroup *g, CAD_JobFn fn, void *arg)
+{
+	CAD_Job job;
+#ifdef AG_THREADS
+	CAD_JobWorker *self;
+#endif
+
+	job.fn = fn;
+	job.arg = arg;
+	job.group = g;
+
+	AG_MutexLock(&g->lock);
+	g->pending++;
+	AG_MutexUnlock(&g->lock);
+
+#ifdef AG_THREADS
+	if (poolInited) {
+		if ((self = AG_ThreadKeyGet(pool.selfKey)) == NULL) {
+			AG_MutexLock(&pool.lock);
+			self = &pool.workers[pool.nextWorker++ %
+			                     pool.nWorkers];
+			AG_MutexUnlock(&pool.lock);
+		}
+		PushJob(self, &job);
+		return;
+	}
+	RunJob(&job);
+#else
+	fn(arg);
+	g->pending--;
+#endif
+}
+
+/*
+ * Wait for all jobs in the group to complete. The calling thread runs
+ * queued jobs of the group itself rather than sitting idle.
+ */
+void
+CAD_JobGroupWait(CAD_JobGroup *g)
+{
+#ifdef AG_THREADS
+	CAD_JobWorker *self = NULL;
+	CAD_Job job;
+
+	if (poolInited) {
+		self = AG_ThreadKeyGet(pool.selfKey);
+	}
+	for (;;) {
+		AG_MutexLock(&g->lock);
+		if (g->pending == 0) {
+			AG_MutexUnlock(&g->lock);
+			break;
+		}
+		AG_MutexUnlock(&g->lock);
+
+		if (poolInited && FindJob(self, &job, g)) {
+			RunJob(&job);
+			continue;
+		}
+		AG_MutexLock(&g->lock);
+		if (g->pending > 0) {
+			AG_CondWait(&g->done, &g->lock);
+		}
+		AG_MutexUnlock(&g->lock);
+	}
+#endif
+}
@@ -0,0 +1,29 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_JOBS_H_
+#define _CADTOOLS_JOBS_H_
+
+#include "begin_code.h"
+
+typedef void (*CAD_JobFn)(void *);
+
+/* Set of jobs which can be waited on collectively. */
+typedef struct cad_job_group {
+	AG_Mutex lock;
+	AG_Cond done;
+	Uint pending;				/* Jobs submitted, not completed */
+} CAD_JobGroup;
+
+__BEGIN_DECLS
+int	CAD_JobPoolInit(Uint);
+void	CAD_JobPoolDestroy(void);
+Uint	CAD_JobPoolThreads(void);
+
+void	CAD_JobGroupInit(CAD_JobGroup *);
+void	CAD_JobGroupDestroy(CAD_JobGroup *);
+void	CAD_JobSubmit(CAD_JobGroup *, CAD_JobFn, void *);
+void	CAD_JobGroupWait(CAD_JobGroup *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_JOBS_H_ */
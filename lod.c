@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Level-of-detail rendering for large parts. When a part is displayed, a
+ * job on the pool builds a chain of meshes, each decimated to a fraction
+ * of the triangles of the previous one. The part geometry is not copied:
+ * the job holds its arrays (see CAD_MeshAcquire()) and clusters them into
+ * the first level, which is then refined and decimated further. The
+ * levels are converted to hidden SG_Objects as they become available.
+ * A timer on each SG_View selects the level to display from the projected
+ * size of the part, and drops to a coarser level while the camera is
+ * moving. Full detail is restored once the camera has been still for a
+ * short while.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cadtools.h"
+
+#define LOD_RATIO		4	/* Triangle reduction between levels */
+#define LOD_MIN_TRIS		20000	/* Don't build levels below this */
+#define LOD_POLL_IVAL		50	/* View poll interval (ms) */
+#define LOD_SETTLE_TICKS	5	/* Still polls before full detail */
+#define LOD_MOVING_DENSITY	1.0	/* Triangles per pixel (moving) */
+#define LOD_MOVING_MAX		1000000	/* Max. triangles while moving */
+#define LOD_GRID_MAX		1024	/* Clustering grid resolution limit */
+#define LOD_CHECK_IVAL		65536	/* Elements between cancel checks */
+
+/* Per-view camera state. */
+typedef struct cad_lod_view {
+	CAD_Part *part;
+	SG_View *sgv;
+	M_Matrix44 camT;		/* Camera transform at last poll */
+	Uint still;			/* Polls without camera motion */
+} CAD_LODView;
+
+void
+CAD_LODInit(CAD_LOD *lod)
+{
+	Uint i;
+
+	AG_MutexInit(&lod->lock);
+	lod->flags = CAD_LOD_STALE;
+	lod->gen = 0;
+	for (i = 0; i < CAD_LOD_MAX; i++) {
+		lod->so[i] = NULL;
+		lod->nt[i] = 0;
+		CAD_MeshInit(&lod->pending[i], 0);
+	}
+	lod->nBuilt = 0;
+	lod->nReady = 0;
+	lod->cur = 0;
+	CAD_MeshInit(&lod->src, 0);
+	lod->srcPin = NULL;
+	lod->srcGen = 0;
+	CAD_JobGroupInit(&lod->group);
+	lod->center[0] = lod->center[1] = lod->center[2] = 0.0f;
+	lod->radius = 0.0f;
+}
+
+void
+CAD_LODDestroy(CAD_LOD *lod)
+{
+	Uint i;
+
+	AG_MutexLock(&lod->lock);
+	lod->gen++;
+	AG_MutexUnlock(&lod->lock);
+	CAD_JobGroupWait(&lod->group);
+	CAD_JobGroupDestroy(&lod->group);
+
+	for (i = 0; i < CAD_LOD_MAX; i++) {
+		CAD_MeshFree(&lod->pending[i]);
+	}
+	AG_MutexDestroy(&lod->lock);
+}
+
+/* Show only the given level. */
+static void
+ShowLevel(CAD_LOD *lod, Uint level)
+{
+	Uint i;
+
+	for (i = 0; i < lod->nReady; i++) {
+		if (lod->so[i] == NULL) {
+			continue;
+		}
+		if (i == level) {
+			SGNODE(lod->so[i])->flags &= ~(SG_NODE_HIDE);
+		} else {
+			SGNODE(lod->so[i])->flags |= SG_NODE_HIDE;
+		}
+	}
+	lod->cur = level;
+}
+
+/*
+ * Discard the simplified levels after the part geometry has changed. A
+ * builder job still running finishes its current level and then exits.
+ */
+void
+CAD_LODInvalidate(CAD_LOD *lod)
+{
+	Uint i;
+
+	ShowLevel(lod, 0);
+
+	AG_MutexLock(&lod->lock);
+	lod->gen++;
+	lod->flags |= CAD_LOD_STALE;
+	for (i = 1; i < CAD_LOD_MAX; i++) {
+		CAD_MeshFree(&lod->pending[i]);
+		lod->nt[i] = 0;
+	}
+	lod->nBuilt = 0;
+	AG_MutexUnlock(&lod->lock);
+
+	for (i = 1; i < lod->nReady; i++) {
+		if (lod->so[i] != NULL)
+			SG_ObjectFreeGeometry(lod->so[i]);
+	}
+	lod->nReady = 0;
+}
+
+/* Return 1 if the levels being built have been invalidated. */
+static int
+Cancelled(CAD_LOD *lod, Uint gen)
+{
+	int rv;
+
+	AG_MutexLock(&lod->lock);
+	rv = (lod->gen != gen);
+	AG_MutexUnlock(&lod->lock);
+	return (rv);
+}
+
+static int
+CompareKeys(const void *p1, const void *p2)
+{
+	Uint64 k1 = *(const Uint64 *)p1, k2 = *(const Uint64 *)p2;
+
+	return (k1 < k2) ? -1 : (k1 > k2) ? 1 : 0;
+}
+
+/*
+ * Approximate the source mesh by merging the vertices within each cell of
+ * a uniform grid over its bounding cube. The grid is sized for at least
+ * nTarget triangles, assuming that the surface occupies a few cells per
+ * grid row. Aside from the output, only the sort keys and a vertex map
+ * are allocated. Return -1 on failure or if the build was cancelled.
+ */
+static int
+Cluster(CAD_LOD *lod, Uint gen, CAD_Mesh *out, Uint nTarget)
+{
+	const CAD_Mesh *m = &lod->src;
+	Uint64 *key = NULL;
+	Uint32 *map = NULL;
+	float min[3], invCell;
+	Uint i, j, nOut = 0, nt = 0, res;
+	int rv = -1;
+
+	for (res = 16; res < LOD_GRID_MAX && res*res < nTarget/2; res <<= 1)
+		;;
+	for (j = 0; j < 3; j++) {
+		min[j] = lod->center[j] - lod->radius;
+	}
+	invCell = (lod->radius > 0.0f) ? res/(2.0f*lod->radius) : 0.0f;
+
+	if ((key = TryMalloc(m->nv*sizeof(Uint64))) == NULL ||
+	    (map = TryMalloc(m->nv*sizeof(Uint32))) == NULL) {
+		goto out;
+	}
+	for (i = 0; i < m->nv; i++) {
+		const float *v = &m->v[i*3];
+		Uint32 cell = 0;
+
+		for (j = 0; j < 3; j++) {
+			Sint32 c = (Sint32)((v[j] - min[j])*invCell);
+
+			if (c < 0) { c = 0; }
+			if (c >= (Sint32)res) { c = (Sint32)res-1; }
+			cell = cell*res + (Uint32)c;
+		}
+		key[i] = ((Uint64)cell << 32) | i;
+	}
+	if (Cancelled(lod, gen)) {
+		goto out;
+	}
+	qsort(key, m->nv, sizeof(Uint64), CompareKeys);
+	for (i = 0; i < m->nv; i++) {
+		if (i == 0 || (key[i] >> 32) != (key[i-1] >> 32))
+			nOut++;
+	}
+	if (CAD_MeshReserve(out, nOut, 0) == -1) {
+		goto out;
+	}
+
+	/* Average the positions and normals of the vertices in each cell. */
+	for (i = 0; i < m->nv; ) {
+		Uint32 first = (Uint32)key[i];
+		double sv[3] = { 0.0, 0.0, 0.0 }, sn[3] = { 0.0, 0.0, 0.0 };
+		Uint k, n;
+		float *v;
+
+		for (n = 0; i+n < m->nv &&
+		    (key[i+n] >> 32) == (key[i] >> 32); n++) {
+			Uint32 iv = (Uint32)key[i+n];
+
+			for (j = 0; j < 3; j++) {
+				sv[j] += m->v[iv*3+j];
+				if (m->flags & CAD_MESH_NORMALS)
+					sn[j] += m->n[iv*3+j];
+			}
+			map[iv] = out->nv;
+		}
+		k = out->nv++;
+		v = &out->v[k*3];
+		for (j = 0; j < 3; j++) {
+			v[j] = (float)(sv[j]/n);
+		}
+		if (m->flags & CAD_MESH_NORMALS) {
+			double len = sqrt(sn[0]*sn[0] + sn[1]*sn[1] +
+			                  sn[2]*sn[2]);
+
+			for (j = 0; j < 3; j++)
+				out->n[k*3+j] = (len > 0.0) ?
+				    (float)(sn[j]/len) : 0.0f;
+		}
+		if (m->flags & CAD_MESH_COLORS) {
+			memcpy(&out->c[k*4], &m->c[first*4], 4);
+		}
+		if (m->flags & CAD_MESH_TEXCOORDS) {
+			memcpy(&out->st[k*2], &m->st[first*2], 2*sizeof(float));
+		}
+		i += n;
+		if ((i / LOD_CHECK_IVAL) != ((i-n) / LOD_CHECK_IVAL) &&
+		    Cancelled(lod, gen))
+			goto out;
+	}
+	Free(key);
+	key = NULL;
+
+	/* Keep the triangles whose corners fall in three different cells. */
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+		Uint32 a = map[t[0]], b = map[t[1]], c = map[t[2]];
+
+		if (a != b && b != c && a != c)
+			nt++;
+	}
+	if (Cancelled(lod, gen) || CAD_MeshReserve(out, 0, nt) == -1) {
+		goto out;
+	}
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+		Uint32 a = map[t[0]], b = map[t[1]], c = map[t[2]];
+
+		if (a != b && b != c && a != c)
+			CAD_MeshAddTri(out, a, b, c);
+	}
+	rv = Cancelled(lod, gen) ? -1 : 0;
+out:
+	Free(key);
+	Free(map);
+	return (rv);
+}
+
+/*
+ * Build the levels from the held source geometry. The first level is
+ * clustered from the source, which is released as soon as it is done,
+ * and every level is decimated from the previous one.
+ */
+static void
+BuildJob(void *arg)
+{
+	CAD_LOD *lod = arg;
+	CAD_Mesh work;
+	Uint gen, k, nTarget;
+	int rv;
+
+	AG_MutexLock(&lod->lock);
+	gen = lod->srcGen;
+	AG_MutexUnlock(&lod->lock);
+
+	nTarget = lod->src.nt/LOD_RATIO;
+	CAD_MeshInit(&work, lod->src.flags);
+	rv = Cluster(lod, gen, &work, nTarget);
+	CAD_MeshRelease(lod->srcPin);
+	lod->srcPin = NULL;
+	CAD_MeshInit(&lod->src, 0);
+	if (rv == -1) {
+		goto out;
+	}
+	for (k = 1; k < CAD_LOD_MAX; k++) {
+		if (nTarget < LOD_MIN_TRIS ||
+		    CAD_MeshDecimate(&work, nTarget, 0.0, NULL, NULL) == -1) {
+			break;
+		}
+		AG_MutexLock(&lod->lock);
+		if (lod->gen != gen) {
+			AG_MutexUnlock(&lod->lock);
+			break;
+		}
+		CAD_MeshFree(&lod->pending[k]);
+		CAD_MeshInit(&lod->pending[k], work.flags);
+		if (CAD_MeshAppend(&lod->pending[k], &work) == -1) {
+			AG_MutexUnlock(&lod->lock);
+			break;
+		}
+		lod->nBuilt = k+1;
+		AG_MutexUnlock(&lod->lock);
+		nTarget = work.nt/LOD_RATIO;
+	}
+out:
+	CAD_MeshFree(&work);
+
+	AG_MutexLock(&lod->lock);
+	lod->flags &= ~(CAD_LOD_BUILDING);
+	AG_MutexUnlock(&lod->lock);
+}
+
+/*
+ * Start building the levels for the current part geometry. The builder
+ * holds the part geometry (which is never modified in place) instead of
+ * working on a copy of it.
+ */
+static void
+StartBuild(CAD_LOD *lod, CAD_Part *part)
+{
+	const CAD_Mesh *m = CAD_PartMesh(part);
+	float min[3], max[3], d[3];
+	int build;
+
+	CAD_MeshBounds(m, min, max);
+	d[0] = max[0]-min[0];
+	d[1] = max[1]-min[1];
+	d[2] = max[2]-min[2];
+	lod->center[0] = (min[0]+max[0])*0.5f;
+	lod->center[1] = (min[1]+max[1])*0.5f;
+	lod->center[2] = (min[2]+max[2])*0.5f;
+	lod->radius = 0.5f*sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+	build = (m->nt >= LOD_MIN_TRIS*LOD_RATIO);
+	if (build) {
+		lod->srcPin = CAD_MeshAcquire((CAD_Mesh *)m, &lod->src);
+	}
+	AG_MutexLock(&lod->lock);
+	lod->flags &= ~(CAD_LOD_STALE);
+	lod->so[0] = part->so;
+	lod->nt[0] = m->nt;
+	lod->nBuilt = 1;
+	lod->nReady = 1;
+	lod->cur = 0;
+	if (build) {
+		lod->flags |= CAD_LOD_BUILDING;
+		lod->srcGen = lod->gen;
+	}
+	AG_MutexUnlock(&lod->lock);
+
+	if (build)
+		CAD_JobSubmit(&lod->group, BuildJob, lod);
+}
+
+/* Convert newly built levels to hidden SG objects. */
+static void
+UploadLevels(CAD_LOD *lod, CAD_Part *part)
+{
+	for (;;) {
+		CAD_Mesh m;
+		Uint k;
+
+		AG_MutexLock(&lod->lock);
+		if (lod->nReady >= lod->nBuilt) {
+			AG_MutexUnlock(&lod->lock);
+			break;
+		}
+		k = lod->nReady;
+		m = lod->pending[k];
+		CAD_MeshInit(&lod->pending[k], 0);
+		AG_MutexUnlock(&lod->lock);
+
+		if (lod->so[k] == NULL) {
+			char name[AG_OBJECT_NAME_MAX];
+
+			snprintf(name, sizeof(name), "Part Object LOD%u", k);
+			lod->so[k] = SG_ObjectNew(part->sg->root, name);
+		}
+		SGNODE(lod->so[k])->flags |= SG_NODE_HIDE;
+		if (CAD_MeshToObject(&m, lod->so[k]) == -1) {
+			Verbose("LOD: %s\n", AG_GetError());
+		}
+		lod->nt[k] = m.nt;
+		CAD_MeshFree(&m);
+		lod->nReady = k+1;
+	}
+}
+
+/*
+ * Select the level to display for a view. Full detail is shown once the
+ * camera has settled.
+ */
+static Uint
+SelectLevel(const CAD_LOD *lod, CAD_LODView *view, int settled)
+{
+	SG_View *sgv = view->sgv;
+	M_Matrix44 T;
+	double dx, dy, dz, dist, px, budget;
+	Uint k;
+
+	if (settled) {
+		return (0);
+	}
+	SG_GetNodeTransform(sgv->cam, &T);
+	dx = T.m[0][3] - lod->center[0];
+	dy = T.m[1][3] - lod->center[1];
+	dz = T.m[2][3] - lod->center[2];
+	dist = sqrt(dx*dx + dy*dy + dz*dz);
+
+	/* Approximate projected diameter of the bounding sphere (pixels). */
+	if (dist <= lod->radius) {
+		return (0);
+	}
+	px = AGWIDGET(sgv)->h * lod->radius /
+	     (dist*tan(sgv->cam->fovY*M_PI/360.0));
+	budget = px*px*LOD_MOVING_DENSITY;
+	if (budget > LOD_MOVING_MAX) {
+		budget = LOD_MOVING_MAX;
+	}
+	for (k = 0; k < lod->nReady-1; k++) {
+		if (lod->nt[k] <= budget)
+			break;
+	}
+	return (k);
+}
+
+static Uint32
+PollView(AG_Timer *to, AG_Event *event)
+{
+	CAD_LODView *view = AG_PTR(1);
+	CAD_Part *part = view->part;
+	CAD_LOD *lod = &part->lod;
+	M_Matrix44 T;
+	Uint level, flags;
+
+	AG_MutexLock(&lod->lock);
+	flags = lod->flags;
+	AG_MutexUnlock(&lod->lock);
+	if ((flags & CAD_LOD_STALE) && !(flags & CAD_LOD_BUILDING)) {
+		StartBuild(lod, part);
+	}
+	UploadLevels(lod, part);
+
+	SG_GetNodeTransform(view->sgv->cam, &T);
+	if (memcmp(&T, &view->camT, sizeof(M_Matrix44)) != 0) {
+		view->camT = T;
+		view->still = 0;
+	} else if (view->still < LOD_SETTLE_TICKS) {
+		view->still++;
+	}
+	if (lod->nReady > 1) {
+		level = SelectLevel(lod, view,
+		    (view->still >= LOD_SETTLE_TICKS));
+		if (level != lod->cur) {
+			ShowLevel(lod, level);
+			AG_Redraw(view->sgv);
+		}
+	}
+	return (to->ival);
+}
+
+static void
+ViewDetached(AG_Event *event)
+{
+	CAD_LODView *view = AG_PTR(1);
+
+	Free(view);
+}
+
+/* Select levels of detail for the part shown by an SG_View. */
+void
+CAD_LODAttachView(CAD_Part *part, SG_View *sgv)
+{
+	CAD_LODView *view;
+
+	view = Malloc(sizeof(CAD_LODView));
+	view->part = part;
+	view->sgv = sgv;
+	memset(&view->camT, 0, sizeof(M_Matrix44));
+	view->still = 0;
+
+	AG_AddTimerAuto(sgv, LOD_POLL_IVAL, PollView, "%p", view);
+	AG_AddEvent(sgv, "detached", ViewDetached, "%p", view);
+}
@@ -0,0 +1,43 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_LOD_H_
+#define _CADTOOLS_LOD_H_
+
+#include "begin_code.h"
+
+#define CAD_LOD_MAX 6				/* Levels (incl. full detail) */
+
+struct cad_part;
+
+/*
+ * Chain of progressively simplified versions of the part geometry, used
+ * to render large parts interactively. Level 0 is the part object itself.
+ */
+typedef struct cad_lod {
+	AG_Mutex lock;
+	Uint flags;
+#define CAD_LOD_STALE	 0x01			/* Levels must be rebuilt */
+#define CAD_LOD_BUILDING 0x02			/* Builder job is running */
+	Uint gen;				/* Incremented on invalidation */
+	SG_Object *so[CAD_LOD_MAX];		/* Level objects */
+	Uint nt[CAD_LOD_MAX];			/* Triangles per level */
+	CAD_Mesh pending[CAD_LOD_MAX];		/* Built, not yet converted */
+	Uint nBuilt;				/* Levels built */
+	Uint nReady;				/* Levels converted to objects */
+	Uint cur;				/* Level being displayed */
+	CAD_Mesh src;				/* Source (held for builder) */
+	CAD_MeshPin *srcPin;
+	Uint srcGen;				/* Generation of source */
+	CAD_JobGroup group;
+	float center[3], radius;		/* Bounding sphere */
+} CAD_LOD;
+
+__BEGIN_DECLS
+void	CAD_LODInit(CAD_LOD *);
+void	CAD_LODDestroy(CAD_LOD *);
+void	CAD_LODInvalidate(CAD_LOD *);
+void	CAD_LODAttachView(struct cad_part *, SG_View *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_LOD_H_ */
@@ -130,6 +130,7 @@ Init(void *obj)
 	ma->cons = NULL;
 	ma->model = NULL;
 	TAILQ_INIT(&ma->upload);
+	CAD_GenerationInit(&ma->gen);
 #ifdef NETWORK
 	NC_Init(&ma->sess, _PROTO_MACHCTL_NAME, _PROTO_MACHCTL_VER);
 #endif
@@ -321,6 +322,7 @@ EnableMachine(AG_Event *event)
 {
 	CAM_Machine *ma = AG_PTR(1);
 
+	CAD_ObjectModified(ma);
 	AG_MutexLock(&ma->lock);
 	if (ma->host[0] == '\0' || ma->port[0] == '\0') {
 		AG_TextMsg(AG_MSG_ERROR, _("Hostname/port not specified"));
@@ -419,6 +421,7 @@ CAM_MachineUploadProgram(CAM_Machine *ma, CAM_Program *prog)
 	if (AG_ObjectSave(prog) == -1) {
 		return (-1);
 	}
+	CAD_ObjectSaved(prog);
 	if (AG_ObjectCopyName(prog, prog_name, sizeof(prog_name)) == -1 ||
 	    AG_ObjectCopyDigest(prog, &len, digest) == -1 ||
 	    AG_ObjectCopyFilename(prog, path, sizeof(path)) == -1)
@@ -36,6 +36,7 @@ typedef struct cam_machine {
 	Uint32 tPong;			 /* Time of last ping */
 	AG_Console *cons;		 /* Status console (or NULL) */
 	AG_TAILQ_HEAD(,cam_program) upload; /* Program upload queue */
+	CAD_Generation gen;		 /* Change tracking */
 } CAM_Machine;
 
 __BEGIN_DECLS
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Flat indexed triangle meshes.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+void
+CAD_MeshInit(CAD_Mesh *m, Uint flags)
+{
+	m->flags = flags;
+	m->v = NULL;
+	m->n = NULL;
+	m->c = NULL;
+	m->st = NULL;
+	m->nv = 0;
+	m->maxv = 0;
+	m->tri = NULL;
+	m->nt = 0;
+	m->maxt = 0;
+	m->pin = NULL;
+}
+
+/*
+ * Give the arrays of a mesh up to the readers holding them. If keep is
+ * set, the mesh continues with a private copy of its contents, otherwise
+ * it is left empty. Return -1 if the copy could not be allocated.
+ */
+static int
+Unshare(CAD_Mesh *m, int keep)
+{
+	CAD_MeshPin *pin = m->pin;
+	CAD_Mesh old;
+
+	if (pin == NULL) {
+		return (0);
+	}
+	m->pin = NULL;
+
+	AG_MutexLock(&pin->lock);
+	if (pin->nRefs == 0) {
+		AG_MutexUnlock(&pin->lock);
+		AG_MutexDestroy(&pin->lock);
+		Free(pin);
+		return (0);
+	}
+	pin->owned = 0;
+	pin->v = m->v;
+	pin->n = m->n;
+	pin->c = m->c;
+	pin->st = m->st;
+	pin->tri = m->tri;
+	AG_MutexUnlock(&pin->lock);
+
+	old = *m;
+	CAD_MeshInit(m, old.flags);
+	return (keep ? CAD_MeshAppend(m, &old) : 0);
+}
+
+/*
+ * Hold the arrays of a mesh for reading by another thread, and return a
+ * shallow copy of the mesh in view. The owner may go on modifying or
+ * freeing the mesh; the arrays seen through view remain unchanged until
+ * CAD_MeshRelease() is called. View must not be modified or freed.
+ */
+CAD_MeshPin *
+CAD_MeshAcquire(CAD_Mesh *m, CAD_Mesh *view)
+{
+	CAD_MeshPin *pin;
+
+	if ((pin = m->pin) == NULL) {
+		pin = Malloc(sizeof(CAD_MeshPin));
+		AG_MutexInit(&pin->lock);
+		pin->nRefs = 0;
+		pin->owned = 1;
+		pin->v = pin->n = pin->st = NULL;
+		pin->c = NULL;
+		pin->tri = NULL;
+		m->pin = pin;
+	}
+	AG_MutexLock(&pin->lock);
+	pin->nRefs++;
+	AG_MutexUnlock(&pin->lock);
+
+	*view = *m;
+	view->pin = NULL;
+	return (pin);
+}
+
+/* Release arrays held with CAD_MeshAcquire(). */
+void
+CAD_MeshRelease(CAD_MeshPin *pin)
+{
+	AG_MutexLock(&pin->lock);
+	if (--pin->nRefs > 0 || pin->owned) {
+		AG_MutexUnlock(&pin->lock);
+		return;
+	}
+	AG_MutexUnlock(&pin->lock);
+
+	Free(pin->v);
+	Free(pin->n);
+	Free(pin->c);
+	Free(pin->st);
+	Free(pin->tri);
+	AG_MutexDestroy(&pin->lock);
+	Free(pin);
+}
+
+/*
+ * Ensure that the arrays of a mesh are not held by readers, before they
+ * are modified in place. Return -1 if a copy could not be allocated.
+ */
+int
+CAD_MeshUnshare(CAD_Mesh *m)
+{
+	return Unshare(m, 1);
+}
+
+void
+CAD_MeshFree(CAD_Mesh *m)
+{
+	Unshare(m, 0);
+	Free(m->v);
+	Free(m->n);
+	Free(m->c);
+	Free(m->st);
+	Free(m->tri);
+	CAD_MeshInit(m, m->flags);
+}
+
+/* Remove all geometry, but retain the allocated storage for reuse. */
+void
+CAD_MeshClear(CAD_Mesh *m)
+{
+	Unshare(m, 0);
+	m->nv = 0;
+	m->nt = 0;
+}
+
+/*
+ * Remove all geometry and change the vertex attributes to flags. The
+ * storage is retained if the attributes are unchanged.
+ */
+void
+CAD_MeshReset(CAD_Mesh *m, Uint flags)
+{
+	if (m->flags == flags) {
+		CAD_MeshClear(m);
+	} else {
+		CAD_MeshFree(m);
+		CAD_MeshInit(m, flags);
+	}
+}
+
+/*
+ * Ensure storage for at least nv vertices and nt triangles.
+ * Return -1 if memory could not be allocated.
+ */
+int
+CAD_MeshReserve(CAD_Mesh *m, Uint nv, Uint nt)
+{
+	void *p;
+
+	if ((nv > m->maxv || nt > m->maxt) && Unshare(m, 1) == -1) {
+		return (-1);
+	}
+	if (nv > m->maxv) {
+		if ((p = TryRealloc(m->v, nv*3*sizeof(float))) == NULL) {
+			return (-1);
+		}
+		m->v = p;
+		if (m->flags & CAD_MESH_NORMALS) {
+			if ((p = TryRealloc(m->n, nv*3*sizeof(float))) == NULL)
+				return (-1);
+			m->n = p;
+		}
+		if (m->flags & CAD_MESH_COLORS) {
+			if ((p = TryRealloc(m->c, nv*4)) == NULL)
+				return (-1);
+			m->c = p;
+		}
+		if (m->flags & CAD_MESH_TEXCOORDS) {
+			if ((p = TryRealloc(m->st, nv*2*sizeof(float))) == NULL)
+				return (-1);
+			m->st = p;
+		}
+		m->maxv = nv;
+	}
+	if (nt > m->maxt) {
+		if ((p = TryRealloc(m->tri, nt*3*sizeof(Uint32))) == NULL) {
+			return (-1);
+		}
+		m->tri = p;
+		m->maxt = nt;
+	}
+	return (0);
+}
+
+/* Append a vertex and return its index. */
+Uint
+CAD_MeshAddVertex(CAD_Mesh *m, float x, float y, float z)
+{
+	float *v;
+
+	if (m->nv+1 > m->maxv) {
+		if (CAD_MeshReserve(m, (m->maxv > 0) ? m->maxv*2 : 64, 0)
+		    == -1)
+			AG_FatalError(NULL);
+	}
+	v = &m->v[m->nv*3];
+	v[0] = x;
+	v[1] = y;
+	v[2] = z;
+	if (m->flags & CAD_MESH_NORMALS) {
+		memset(&m->n[m->nv*3], 0, 3*sizeof(float));
+	}
+	if (m->flags & CAD_MESH_COLORS) {
+		memset(&m->c[m->nv*4], 0xff, 4);
+	}
+	if (m->flags & CAD_MESH_TEXCOORDS) {
+		memset(&m->st[m->nv*2], 0, 2*sizeof(float));
+	}
+	return (m->nv++);
+}
+
+void
+CAD_MeshAddTri(CAD_Mesh *m, Uint32 a, Uint32 b, Uint32 c)
+{
+	Uint32 *t;
+
+	if (m->nt+1 > m->maxt) {
+		if (CAD_MeshReserve(m, 0, (m->maxt > 0) ? m->maxt*2 : 64)
+		    == -1)
+			AG_FatalError(NULL);
+	}
+	t = &m->tri[m->nt*3];
+	t[0] = a;
+	t[1] = b;
+	t[2] = c;
+	m->nt++;
+}
+
+/* Append the geometry of src to dst. */
+int
+CAD_MeshAppend(CAD_Mesh *dst, const CAD_Mesh *src)
+{
+	Uint32 *t;
+	Uint i, vOffs = dst->nv;
+
+	if (CAD_MeshReserve(dst, dst->nv+src->nv, dst->nt+src->nt) == -1) {
+		return (-1);
+	}
+	memcpy(&dst->v[dst->nv*3], src->v, src->nv*3*sizeof(float));
+	if (dst->flags & CAD_MESH_NORMALS) {
+		if (src->flags & CAD_MESH_NORMALS) {
+			memcpy(&dst->n[dst->nv*3], src->n,
+			    src->nv*3*sizeof(float));
+		} else {
+			memset(&dst->n[dst->nv*3], 0, src->nv*3*sizeof(float));
+		}
+	}
+	if (dst->flags & CAD_MESH_COLORS) {
+		if (src->flags & CAD_MESH_COLORS) {
+			memcpy(&dst->c[dst->nv*4], src->c, src->nv*4);
+		} else {
+			memset(&dst->c[dst->nv*4], 0xff, src->nv*4);
+		}
+	}
+	if (dst->flags & CAD_MESH_TEXCOORDS) {
+		if (src->flags & CAD_MESH_TEXCOORDS) {
+			memcpy(&dst->st[dst->nv*2], src->st,
+			    src->nv*2*sizeof(float));
+		} else {
+			memset(&dst->st[dst->nv*2], 0, src->nv*2*sizeof(float));
+		}
+	}
+	t = &dst->tri[dst->nt*3];
+	for (i = 0; i < src->nt*3; i++) {
+		t[i] = src->tri[i] + vOffs;
+	}
+	dst->nv += src->nv;
+	dst->nt += src->nt;
+	return (0);
+}
+
+/* Compute the axis-aligned bounding box of the mesh. */
+void
+CAD_MeshBounds(const CAD_Mesh *m, float *min, float *max)
+{
+	Uint i, j;
+
+	if (m->nv == 0) {
+		min[0] = min[1] = min[2] = 0.0f;
+		max[0] = max[1] = max[2] = 0.0f;
+		return;
+	}
+	for (j = 0; j < 3; j++) {
+		min[j] = max[j] = m->v[j];
+	}
+	for (i = 1; i < m->nv; i++) {
+		const float *v = &m->v[i*3];
+
+		for (j = 0; j < 3; j++) {
+			if (v[j] < min[j]) { min[j] = v[j]; }
+			if (v[j] > max[j]) { max[j] = v[j]; }
+		}
+	}
+}
+
+/* Range of vertices converted by a job. */
+typedef struct cad_mesh_conv {
+	const CAD_Mesh *m;
+	SG_Vertex *vtx;
+	Uint i1, i2;
+} CAD_MeshConv;
+
+static void
+ConvertVertices(void *arg)
+{
+	CAD_MeshConv *cv = arg;
+	const CAD_Mesh *m = cv->m;
+	Uint i;
+
+	for (i = cv->i1; i < cv->i2; i++) {
+		SG_Vertex *vtx = &cv->vtx[i];
+
+		memset(vtx, 0, sizeof(SG_Vertex));
+		vtx->v.x = (M_Real)m->v[i*3];
+		vtx->v.y = (M_Real)m->v[i*3+1];
+		vtx->v.z = (M_Real)m->v[i*3+2];
+		if (m->flags & CAD_MESH_NORMALS) {
+			vtx->n.x = (M_Real)m->n[i*3];
+			vtx->n.y = (M_Real)m->n[i*3+1];
+			vtx->n.z = (M_Real)m->n[i*3+2];
+		}
+		if (m->flags & CAD_MESH_COLORS) {
+			vtx->c.r = (M_Real)m->c[i*4]/255.0;
+			vtx->c.g = (M_Real)m->c[i*4+1]/255.0;
+			vtx->c.b = (M_Real)m->c[i*4+2]/255.0;
+			vtx->c.a = (M_Real)m->c[i*4+3]/255.0;
+		} else {
+			vtx->c.r = 1.0;
+			vtx->c.g = 1.0;
+			vtx->c.b = 1.0;
+			vtx->c.a = 1.0;
+		}
+		if (m->flags & CAD_MESH_TEXCOORDS) {
+			vtx->st.x = (M_Real)m->st[i*2];
+			vtx->st.y = (M_Real)m->st[i*2+1];
+		}
+	}
+}
+
+/*
+ * Replace the geometry of an SG_Object with the contents of a mesh. The
+ * vertex array is allocated once and filled in parallel.
+ */
+int
+CAD_MeshToObject(const CAD_Mesh *m, SG_Object *so)
+{
+	CAD_MeshConv *cv;
+	CAD_JobGroup g;
+	SG_Vertex *vtx;
+	Uint i, n;
+
+	SG_ObjectFreeGeometry(so);
+	if (m->nv == 0) {
+		return (0);
+	}
+	if ((vtx = TryRealloc(so->vtx, m->nv*sizeof(SG_Vertex))) == NULL) {
+		return (-1);
+	}
+	so->vtx = vtx;
+
+	n = CAD_JobPoolThreads()*4;
+	if (m->nv/n < 4096) {
+		n = m->nv/4096 + 1;
+	}
+	cv = Malloc(n*sizeof(CAD_MeshConv));
+	CAD_JobGroupInit(&g);
+	for (i = 0; i < n; i++) {
+		cv[i].m = m;
+		cv[i].vtx = vtx;
+		cv[i].i1 = (Uint)(((Uint64)m->nv*i)/n);
+		cv[i].i2 = (Uint)(((Uint64)m->nv*(i+1))/n);
+		CAD_JobSubmit(&g, ConvertVertices, &cv[i]);
+	}
+	CAD_JobGroupWait(&g);
+	CAD_JobGroupDestroy(&g);
+	Free(cv);
+	so->nvtx = m->nv;
+
+	for (i = 0; i < m->nt; i++) {
+		const Uint32 *t = &m->tri[i*3];
+
+		if (SG_FacetFromTri3(so, (int)t[0], (int)t[1], (int)t[2])
+		    == NULL)
+			return (-1);
+	}
+	return (0);
+}
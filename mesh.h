@@ -0,0 +1,58 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_MESH_H_
+#define _CADTOOLS_MESH_H_
+
+#include "begin_code.h"
+
+/*
+ * Arrays of a mesh held by readers in other threads (see CAD_MeshAcquire).
+ * While the mesh owns them, the arrays are only freed by the mesh itself.
+ */
+typedef struct cad_mesh_pin {
+	AG_Mutex lock;
+	Uint nRefs;				/* Readers holding the arrays */
+	int owned;				/* Arrays still owned by mesh */
+	float *v, *n, *st;			/* Arrays given up by mesh */
+	Uint8 *c;
+	Uint32 *tri;
+} CAD_MeshPin;
+
+/*
+ * Flat indexed triangle mesh. This is the working representation used by
+ * feature generation; it is converted to an SG_Object for display.
+ */
+typedef struct cad_mesh {
+	Uint flags;
+#define CAD_MESH_NORMALS	0x01		/* Per-vertex normals */
+#define CAD_MESH_COLORS		0x02		/* Per-vertex colors */
+#define CAD_MESH_TEXCOORDS	0x04		/* Per-vertex texture coords */
+
+	float *v;				/* Vertex positions (xyz) */
+	float *n;				/* Vertex normals (xyz) */
+	Uint8 *c;				/* Vertex colors (rgba) */
+	float *st;				/* Texture coordinates (st) */
+	Uint nv, maxv;
+	Uint32 *tri;				/* Triangle vertex indices */
+	Uint nt, maxt;
+	CAD_MeshPin *pin;			/* Held by readers (or NULL) */
+} CAD_Mesh;
+
+__BEGIN_DECLS
+void	CAD_MeshInit(CAD_Mesh *, Uint);
+void	CAD_MeshFree(CAD_Mesh *);
+void	CAD_MeshClear(CAD_Mesh *);
+void	CAD_MeshReset(CAD_Mesh *, Uint);
+int	CAD_MeshReserve(CAD_Mesh *, Uint, Uint);
+Uint	CAD_MeshAddVertex(CAD_Mesh *, float, float, float);
+void	CAD_MeshAddTri(CAD_Mesh *, Uint32, Uint32, Uint32);
+int	CAD_MeshAppend(CAD_Mesh *, const CAD_Mesh *);
+CAD_MeshPin *CAD_MeshAcquire(CAD_Mesh *, CAD_Mesh *);
+void	CAD_MeshRelease(CAD_MeshPin *);
+int	CAD_MeshUnshare(CAD_Mesh *);
+void	CAD_MeshBounds(const CAD_Mesh *, float *, float *);
+int	CAD_MeshToObject(const CAD_Mesh *, SG_Object *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_MESH_H_ */
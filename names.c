@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Name index for the children of an object. It replaces probing with
+ * AG_ObjectFindChild() when generating unique names: a hash table of the
+ * names in use is kept up to date as children are attached, detached or
+ * renamed, and a counter per base name remembers the next free number, so
+ * that generating a name does not depend on how many are already taken.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+#define NAMES_INIT_BUCKETS	64
+
+void
+CAD_NameIndexInit(CAD_NameIndex *ni)
+{
+	ni->nBuckets = NAMES_INIT_BUCKETS;
+	ni->buckets = Malloc(ni->nBuckets*sizeof(CAD_NameEnt *));
+	memset(ni->buckets, 0, ni->nBuckets*sizeof(CAD_NameEnt *));
+	ni->nEnts = 0;
+	ni->ctrs = NULL;
+}
+
+void
+CAD_NameIndexDestroy(CAD_NameIndex *ni)
+{
+	CAD_NameEnt *ent, *entNext;
+	CAD_NameCtr *ctr, *ctrNext;
+	Uint i;
+
+	for (i = 0; i < ni->nBuckets; i++) {
+		for (ent = ni->buckets[i]; ent != NULL; ent = entNext) {
+			entNext = ent->next;
+			Free(ent->name);
+			Free(ent);
+		}
+	}
+	Free(ni->buckets);
+	for (ctr = ni->ctrs; ctr != NULL; ctr = ctrNext) {
+		ctrNext = ctr->next;
+		Free(ctr->base);
+		Free(ctr);
+	}
+}
+
+static __inline__ Uint
+NameBucket(const CAD_NameIndex *ni, const char *name)
+{
+	return (Uint)(CAD_HashBytes(CAD_HASH_INIT, name, strlen(name)) %
+	              ni->nBuckets);
+}
+
+static void
+Grow(CAD_NameIndex *ni)
+{
+	CAD_NameEnt **buckets, *ent, *entNext;
+	Uint nBuckets = ni->nBuckets*2, nOld = ni->nBuckets, i, b;
+
+	buckets = Malloc(nBuckets*sizeof(CAD_NameEnt *));
+	memset(buckets, 0, nBuckets*sizeof(CAD_NameEnt *));
+	ni->nBuckets = nBuckets;
+	for (i = 0; i < nOld; i++) {
+		for (ent = ni->buckets[i]; ent != NULL; ent = entNext) {
+			entNext = ent->next;
+			b = NameBucket(ni, ent->name);
+			ent->next = buckets[b];
+			buckets[b] = ent;
+		}
+	}
+	Free(ni->buckets);
+	ni->buckets = buckets;
+}
+
+static CAD_NameCtr *
+GetCounter(CAD_NameIndex *ni, const char *base, size_t len)
+{
+	CAD_NameCtr *ctr;
+
+	for (ctr = ni->ctrs; ctr != NULL; ctr = ctr->next) {
+		if (strncmp(ctr->base, base, len) == 0 &&
+		    ctr->base[len] == '\0')
+			return (ctr);
+	}
+	ctr = Malloc(sizeof(CAD_NameCtr));
+	ctr->base = Malloc(len+1);
+	memcpy(ctr->base, base, len);
+	ctr->base[len] = '\0';
+	ctr->n = 0;
+	ctr->next = ni->ctrs;
+	ni->ctrs = ctr;
+	return (ctr);
+}
+
+/*
+ * If the name has the form "<base> #<n>", make sure the counter of the
+ * base name is past n, so that loaded names are not probed again.
+ */
+static void
+SeedCounter(CAD_NameIndex *ni, const char *name)
+{
+	const char *s = strrchr(name, '#'), *c;
+	CAD_NameCtr *ctr;
+	Uint n = 0;
+
+	if (s == NULL || s == name || s[-1] != ' ' || s[1] == '\0') {
+		return;
+	}
+	for (c = &s[1]; *c != '\0'; c++) {
+		if (*c < '0' || *c > '9' || n > 100000000)
+			return;
+		n = n*10 + (Uint)(*c - '0');
+	}
+	ctr = GetCounter(ni, name, (size_t)(s-1 - name));
+	if (ctr->n <= n)
+		ctr->n = n+1;
+}
+
+void
+CAD_NameIndexAdd(CAD_NameIndex *ni, void *obj)
+{
+	const char *name = AGOBJECT(obj)->name;
+	CAD_NameEnt *ent;
+	Uint b;
+
+	if (ni->nEnts+1 > ni->nBuckets) {
+		Grow(ni);
+	}
+	b = NameBucket(ni, name);
+	ent = Malloc(sizeof(CAD_NameEnt));
+	ent->name = Strdup(name);
+	ent->obj = obj;
+	ent->next = ni->buckets[b];
+	ni->buckets[b] = ent;
+	ni->nEnts++;
+	SeedCounter(ni, name);
+}
+
+static void
+DelEnt(CAD_NameIndex *ni, CAD_NameEnt **pEnt)
+{
+	CAD_NameEnt *ent = *pEnt;
+
+	*pEnt = ent->next;
+	Free(ent->name);
+	Free(ent);
+	ni->nEnts--;
+}
+
+void
+CAD_NameIndexDel(CAD_NameIndex *ni, void *obj)
+{
+	CAD_NameEnt **pEnt;
+
+	for (pEnt = &ni->buckets[NameBucket(ni, AGOBJECT(obj)->name)];
+	     *pEnt != NULL;
+	     pEnt = &(*pEnt)->next) {
+		if ((*pEnt)->obj == obj) {
+			DelEnt(ni, pEnt);
+			return;
+		}
+	}
+}
+
+/*
+ * Update the index after an object was renamed. The previous name is
+ * not known, so this scans the whole index; renames are rare compared
+ * to insertions.
+ */
+void
+CAD_NameIndexRenamed(CAD_NameIndex *ni, void *obj)
+{
+	CAD_NameEnt **pEnt;
+	Uint i;
+
+	for (i = 0; i < ni->nBuckets; i++) {
+		for (pEnt = &ni->buckets[i]; *pEnt != NULL;
+		     pEnt = &(*pEnt)->next) {
+			if ((*pEnt)->obj == obj) {
+				DelEnt(ni, pEnt);
+				CAD_NameIndexAdd(ni, obj);
+				return;
+			}
+		}
+	}
+}
+
+int
+CAD_NameIndexExists(const CAD_NameIndex *ni, const char *name)
+{
+	const CAD_NameEnt *ent;
+
+	for (ent = ni->buckets[NameBucket(ni, name)]; ent != NULL;
+	     ent = ent->next) {
+		if (strcmp(ent->name, name) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+/* Generate an unused name of the form "<base> #<n>". */
+void
+CAD_NameIndexGenerate(CAD_NameIndex *ni, const char *base, char *name,
+    size_t len)
+{
+	CAD_NameCtr *ctr = GetCounter(ni, base, strlen(base));
+
+	do {
+		snprintf(name, len, "%s #%u", base, ctr->n++);
+	} while (CAD_NameIndexExists(ni, name));
+}
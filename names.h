@@ -0,0 +1,40 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_NAMES_H_
+#define _CADTOOLS_NAMES_H_
+
+#include "begin_code.h"
+
+typedef struct cad_name_ent {
+	char *name;
+	void *obj;				/* Object using the name */
+	struct cad_name_ent *next;		/* In bucket */
+} CAD_NameEnt;
+
+/* Next number to use for generated names of the form "<base> #<n>". */
+typedef struct cad_name_ctr {
+	char *base;
+	Uint n;
+	struct cad_name_ctr *next;
+} CAD_NameCtr;
+
+/* Index of the names of the children of an object. */
+typedef struct cad_name_index {
+	CAD_NameEnt **buckets;
+	Uint nBuckets;
+	Uint nEnts;
+	CAD_NameCtr *ctrs;
+} CAD_NameIndex;
+
+__BEGIN_DECLS
+void	CAD_NameIndexInit(CAD_NameIndex *);
+void	CAD_NameIndexDestroy(CAD_NameIndex *);
+void	CAD_NameIndexAdd(CAD_NameIndex *, void *);
+void	CAD_NameIndexDel(CAD_NameIndex *, void *);
+void	CAD_NameIndexRenamed(CAD_NameIndex *, void *);
+int	CAD_NameIndexExists(const CAD_NameIndex *, const char *);
+void	CAD_NameIndexGenerate(CAD_NameIndex *, const char *, char *, size_t);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_NAMES_H_ */
@@ -27,6 +27,7 @@
 #include <agar/gui.h>
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cadtools.h"
@@ -34,6 +35,193 @@
 
 #include <agar/sg/sg_load_ply.h>
 
+#define PART_FEATURE_BLOCK	(16*1024)	/* Feature storage block size */
+#define PART_SCRATCH_BLOCK	(256*1024)	/* Regen buffer block size */
+#define PART_PREVIEW_TRIS	1024		/* Triangles in preview mesh */
+#define PART_COMPACT_MIN	(4*1024*1024)	/* Garbage before compaction */
+#define PART_BODY_CACHE	(128*1024*1024)	/* Merged bodies kept per part */
+
+/*
+ * The feature lists of open part windows are updated incrementally as
+ * features are attached, detached or renamed.
+ */
+static void
+AddFeatureItem(AG_Tlist *tl, CAD_Feature *ft)
+{
+	AG_TlistItem *it;
+
+	it = AG_TlistAddPtr(tl, NULL, AGOBJECT(ft)->name, ft);
+	it->depth = 1;
+}
+
+static void
+UpdateRootItem(AG_Tlist *tl, CAD_Part *part)
+{
+	AG_TlistItem *it;
+
+	if ((it = AG_TlistFindPtr(tl, part)) == NULL) {
+		return;
+	}
+	if (TAILQ_EMPTY(&part->features)) {
+		it->flags &= ~(AG_TLIST_HAS_CHILDREN);
+	} else {
+		it->flags |= AG_TLIST_HAS_CHILDREN|AG_TLIST_VISIBLE_CHILDREN;
+	}
+}
+
+static void
+InitFeatureList(AG_Tlist *tl, CAD_Part *part)
+{
+	AG_TlistItem *it;
+	CAD_Feature *ft;
+
+	it = AG_TlistAddPtr(tl, NULL, AGOBJECT(part)->name, part);
+	it->depth = 0;
+	it->flags |= AG_TLIST_NO_SELECT;
+	TAILQ_FOREACH(ft, &part->features, features) {
+		AddFeatureItem(tl, ft);
+	}
+	UpdateRootItem(tl, part);
+
+	part->ftViews = Realloc(part->ftViews,
+	    (part->nFtViews+1)*sizeof(AG_Tlist *));
+	part->ftViews[part->nFtViews++] = tl;
+}
+
+/* The window containing a feature list was closed. */
+static void
+CloseFeatureList(AG_Event *event)
+{
+	CAD_Part *part = AG_PTR(1);
+	AG_Tlist *tl = AG_PTR(2);
+	Uint i;
+
+	for (i = 0; i < part->nFtViews; i++) {
+		if (part->ftViews[i] == tl)
+			break;
+	}
+	if (i == part->nFtViews) {
+		return;
+	}
+	if (i < part->nFtViews-1) {
+		memmove(&part->ftViews[i], &part->ftViews[i+1],
+		    (part->nFtViews-i-1)*sizeof(AG_Tlist *));
+	}
+	part->nFtViews--;
+}
+
+static void
+FeatureAttached(CAD_Part *part, CAD_Feature *ft)
+{
+	Uint i;
+
+	for (i = 0; i < part->nFtViews; i++) {
+		AddFeatureItem(part->ftViews[i], ft);
+		UpdateRootItem(part->ftViews[i], part);
+	}
+}
+
+static void
+FeatureDetached(CAD_Part *part, CAD_Feature *ft)
+{
+	AG_TlistItem *it;
+	Uint i;
+
+	for (i = 0; i < part->nFtViews; i++) {
+		if ((it = AG_TlistFindPtr(part->ftViews[i], ft)) != NULL) {
+			AG_TlistDel(part->ftViews[i], it);
+		}
+		UpdateRootItem(part->ftViews[i], part);
+	}
+}
+
+/*
+ * Update the name index and the feature lists after the part or a feature
+ * was renamed.
+ */
+void
+CAD_PartRenamed(CAD_Part *part, void *obj)
+{
+	AG_TlistItem *it;
+	Uint i;
+
+	if (obj != part) {
+		CAD_NameIndexRenamed(&part->names, obj);
+	}
+	for (i = 0; i < part->nFtViews; i++) {
+		AG_Tlist *tl = part->ftViews[i];
+
+		if ((it = AG_TlistFindPtr(tl, obj)) == NULL) {
+			continue;
+		}
+		Strlcpy(it->text, AGOBJECT(obj)->name, sizeof(it->text));
+		if (it->label != -1) {
+			AG_WidgetUnmapSurface(tl, it->label);
+			it->label = -1;
+		}
+		AG_Redraw(tl);
+	}
+}
+
+/* Keep the feature list in sync with the object's children. */
+static void
+ChildAttached(AG_Event *event)
+{
+	CAD_Part *part = AG_SELF();
+	AG_Object *chld = AG_PTR(1);
+
+	CAD_NameIndexAdd(&part->names, chld);
+	if (!AG_OfClass(chld, "CAD_Feature:*")) {
+		return;
+	}
+	/* The new feature is merged into the body built by its predecessors. */
+	CADFEATURE(chld)->body = TAILQ_LAST(&part->features, cad_featureq);
+	TAILQ_INSERT_TAIL(&part->features, CADFEATURE(chld), features);
+	CADFEATURE(chld)->flags |= CAD_FEATURE_DIRTY;
+	CADFEATURE(chld)->flags &= ~(CAD_FEATURE_FAILED);
+	CADFEATURE(chld)->resultKey = 0;
+	CADFEATURE(chld)->failKey = 0;
+	CAD_ObjectModified(part);
+	FeatureAttached(part, CADFEATURE(chld));
+}
+
+static void
+ChildDetached(AG_Event *event)
+{
+	CAD_Part *part = AG_SELF();
+	AG_Object *chld = AG_PTR(1);
+	CAD_Feature *ft;
+
+	CAD_NameIndexDel(&part->names, chld);
+	if (!AG_OfClass(chld, "CAD_Feature:*")) {
+		return;
+	}
+	TAILQ_REMOVE(&part->features, CADFEATURE(chld), features);
+	TAILQ_FOREACH(ft, &part->features, features) {
+		if (ft->body == CADFEATURE(chld))
+			ft->body = CADFEATURE(chld)->body;
+		CAD_FeatureDelDep(ft, chld);
+	}
+	CADFEATURE(chld)->body = NULL;
+
+	/* Keep displaying its merged body until the next regeneration. */
+	ft = CADFEATURE(chld);
+	if (part->body == &ft->result) {
+		CAD_MeshFree(&part->kept);
+		part->kept = ft->result;
+		part->keptKey = ft->resultKey;
+		CAD_MeshInit(&ft->result, 0);
+		part->body = &part->kept;
+	}
+	ft->resultKey = 0;
+	part->flags |= CAD_PART_REMERGE;
+	CAD_ObjectModified(part);
+	FeatureDetached(part, CADFEATURE(chld));
+}
+
+static void InstallCompacted(CAD_Part *);
+static void CancelDecimate(CAD_Part *);
+
 static void
 Init(void *obj)
 {
@@ -43,8 +231,34 @@ Init(void *obj)
 
 	part->descr[0] = '\0';
 	part->flags = 0;
+	CAD_NameIndexInit(&part->names);
+	part->file = NULL;
+	part->compact = NULL;
+	AG_InitTimer(&part->compactTimer, "compact", 0);
 	part->sg = SG_New(part, "Rendering", 0);
 	part->so = SG_ObjectNew(part->sg->root, "Part Object");
+	CAD_MeshInit(&part->base, 0);
+	part->body = &part->base;
+	part->baseKey = 1;
+	CAD_MeshInit(&part->kept, 0);
+	part->keptKey = 0;
+	CAD_MeshCacheInit(&part->cache);
+	CAD_LODInit(&part->lod);
+	CAD_BVHInit(&part->bvh);
+	part->decimRatio = 10.0;
+	part->decimError = 0.0;
+	part->decim = NULL;
+	TAILQ_INIT(&part->features);
+	CAD_JournalInit(&part->journal, part);
+	CAD_GenerationInit(&part->gen);
+	CAD_ArenaInit(&part->ftArena, PART_FEATURE_BLOCK);
+	CAD_ArenaInit(&part->scratch, PART_SCRATCH_BLOCK);
+	part->ftViews = NULL;
+	part->nFtViews = 0;
+
+	AG_SetEvent(part, "child-attached", ChildAttached, NULL);
+	AG_SetEvent(part, "child-detached", ChildDetached, NULL);
+	CAD_NameIndexAdd(&part->names, part->sg);
 
 	cam = SG_CameraNew(part->sg->root, "CameraFront");
 	SG_Translate(cam, 0.0, 0.0, 5.0);
@@ -69,140 +283,1101 @@ Init(void *obj)
 #endif
 }
 
-static void
-Destroy(void *obj)
+static void
+Destroy(void *obj)
+{
+	CAD_Part *part = obj;
+
+	if (part->decim != NULL) {
+		CancelDecimate(part);
+	}
+	CAD_LODDestroy(&part->lod);
+	CAD_BVHFree(&part->bvh);
+	CAD_MeshFree(&part->base);
+	CAD_MeshFree(&part->kept);
+	CAD_MeshCacheDestroy(&part->cache);
+	CAD_JournalDestroy(&part->journal);
+	CAD_NameIndexDestroy(&part->names);
+	if (part->compact != NULL) {
+		AG_DelTimer(part, &part->compactTimer);
+		InstallCompacted(part);
+	}
+	if (part->file != NULL) {
+		CAD_PartFileClose(part->file);
+	}
+	CAD_ArenaDestroy(&part->scratch);
+	CAD_ArenaDestroy(&part->ftArena);	/* Features already destroyed */
+	Free(part->ftViews);
+}
+
+static int
+Load(void *obj, AG_DataSource *buf, const AG_Version *ver)
+{
+	CAD_Part *part = obj;
+
+	AG_CopyString(part->descr, buf, sizeof(part->descr));
+	part->flags &= ~(CAD_PART_SAVED);
+	part->flags |= AG_ReadUint32(buf) & CAD_PART_SAVED;
+	if (ver->minor >= 1) {
+		(void)AG_ReadUint32(buf);		/* Triangle count */
+	}
+	return (0);
+}
+
+static int
+Save(void *obj, AG_DataSource *buf)
+{
+	CAD_Part *part = obj;
+
+	AG_WriteString(buf, part->descr);
+	AG_WriteUint32(buf, part->flags & CAD_PART_SAVED);
+	AG_WriteUint32(buf, (Uint32)CAD_PartMesh(part)->nt);
+	return (0);
+}
+
+/* Open the parameter editor of a feature. */
+static void
+EditFeature(AG_Event *event)
+{
+	AG_Tlist *tl = AG_SELF();
+	AG_Object *obj;
+	AG_Window *win;
+
+	if ((obj = AG_TlistSelectedItemPtr(tl)) == NULL ||
+	    !AG_OfClass(obj, "CAD_Feature:*") || obj->cls->edit == NULL) {
+		return;
+	}
+	if ((win = obj->cls->edit(obj)) != NULL)
+		AG_WindowShow(win);
+}
+
+static void
+SetViewCamera(AG_Event *event)
+{
+	SG_View *sgv = AG_PTR(1);
+	char *which = AG_STRING(2);
+	SG_Camera *cam;
+
+	if ((cam = SG_FindNode(sgv->sg, which)) == NULL) {
+		AG_TextMsg(AG_MSG_ERROR, _("Cannot find Camera: %s"), which);
+		return;
+	}
+	SG_ViewSetCamera(sgv, cam);
+}
+
+static void
+ShowCameraSettings(AG_Event *event)
+{
+	SG_View *sgv = AG_PTR(1);
+	AG_Window *win;
+
+	win = AG_WindowNew(0);
+	AG_WindowSetCaption(win, _("Camera settings (%s)"),
+	    AGOBJECT(sgv->cam)->name);
+	AG_ObjectAttach(win, SGNODE_OPS(sgv->cam)->edit(sgv->cam, sgv));
+	AG_WindowShow(win);
+}
+
+static void
+ShowLightSettings(AG_Event *event)
+{
+	SG_View *sgv = AG_PTR(1);
+	char *ltname = AG_STRING(2);
+	SG_Light *lt;
+	AG_Window *win;
+
+	if ((lt = SG_FindNode(sgv->sg, ltname)) == NULL) {
+		AG_TextMsg(AG_MSG_ERROR, _("Cannot find Light: %s"), ltname);
+		return;
+	}
+
+	win = AG_WindowNew(0);
+	AG_WindowSetCaptionS(win, _("Light settings"));
+	AG_ObjectAttach(win, SGNODE_OPS(lt)->edit(lt, sgv));
+	AG_WindowShow(win);
+}
+
+/*
+ * Read a cached tessellation from the part file. Cache entries are only
+ * loaded from the file when they are needed.
+ */
+static int
+FetchTessellation(CAD_Part *part, Uint64 hash, CAD_Mesh *m)
+{
+	char key[AG_OBJECT_NAME_MAX];
+	const CAD_PartChunk *c;
+
+	if (part->file == NULL) {
+		return (0);
+	}
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+	if ((c = CAD_PartFileFind(part->file, CAD_CHUNK_TESS, key)) == NULL) {
+		return (0);
+	}
+	if (CAD_PartFileReadMesh(part->file, c, m) == -1 ||
+	    CAD_MeshCacheInsert(&part->cache, hash, m) == -1) {
+		Verbose("%s\n", AG_GetError());
+		CAD_MeshClear(m);
+		return (0);
+	}
+	return (1);
+}
+
+static int
+RegenFeature(CAD_Part *part, CAD_Feature *ft)
+{
+	CAD_FeatureClass *cls = CADFEATURE_CLASS(ft);
+
+	CAD_MeshClear(&ft->mesh);
+	if ((ft->flags & CAD_FEATURE_SUPPRESS) || cls->regen == NULL) {
+		goto out;
+	}
+	if (ft->hash != 0 &&
+	    (CAD_MeshCacheLookup(&part->cache, ft->hash, &ft->mesh) == 1 ||
+	     FetchTessellation(part, ft->hash, &ft->mesh) == 1)) {
+		goto out;
+	}
+	if (cls->regen(ft, part, &ft->mesh) == -1) {
+		AG_SetError("%s: %s", AGOBJECT(ft)->name, AG_GetError());
+		return (-1);
+	}
+	if (ft->hash != 0 &&
+	    CAD_MeshCacheInsert(&part->cache, ft->hash, &ft->mesh) == -1) {
+		Verbose("%s: Not cached: %s\n", AGOBJECT(ft)->name,
+		    AG_GetError());
+	}
+out:
+	ft->flags &= ~(CAD_FEATURE_DIRTY);
+	ft->flags |= CAD_FEATURE_REGENERATED;
+	return (0);
+}
+
+/* State of a parallel regeneration pass. */
+typedef struct cad_regen_task {
+	struct cad_regen_sched *rs;
+	Uint idx;
+} CAD_RegenTask;
+
+typedef struct cad_regen_sched {
+	CAD_Part *part;
+	CAD_JobGroup group;
+	AG_Mutex lock;
+	CAD_Feature **fts;			/* Features to rebuild */
+	CAD_RegenTask *tasks;
+	Uint n;
+	Uint *nWait;				/* Upstream rebuilds pending */
+	Uint *downOffs;				/* Downstream lists (CSR) */
+	Uint *down;
+	int failed;
+	char errMsg[AG_BUFFER_MAX];
+} CAD_RegenSched;
+
+static void
+RegenJob(void *p)
+{
+	CAD_RegenTask *task = p;
+	CAD_RegenSched *rs = task->rs;
+	CAD_Feature *ft = rs->fts[task->idx];
+	Uint i;
+	int failed;
+
+	AG_MutexLock(&rs->lock);
+	failed = rs->failed;
+	AG_MutexUnlock(&rs->lock);
+
+	if (!failed && RegenFeature(rs->part, ft) == -1) {
+		AG_MutexLock(&rs->lock);
+		if (!rs->failed) {
+			rs->failed = 1;
+			Strlcpy(rs->errMsg, AG_GetError(), sizeof(rs->errMsg));
+		}
+		AG_MutexUnlock(&rs->lock);
+	}
+
+	/* Release the downstream features which were waiting on us. */
+	AG_MutexLock(&rs->lock);
+	for (i = rs->downOffs[task->idx]; i < rs->downOffs[task->idx+1]; i++) {
+		Uint j = rs->down[i];
+
+		if (--rs->nWait[j] == 0)
+			CAD_JobSubmit(&rs->group, RegenJob, &rs->tasks[j]);
+	}
+	AG_MutexUnlock(&rs->lock);
+}
+
+/*
+ * Rebuild the given features on the job pool. Features which do not
+ * depend on each other (e.g., bosses on different sketches) run
+ * concurrently; each feature is started as soon as all of its scheduled
+ * upstream features have completed. Only the dependencies on the output
+ * of other features are considered here: feature geometry is generated
+ * independently of the part body, which is merged in body chain order
+ * once all features are built.
+ */
+static int
+RegenParallel(CAD_Part *part, CAD_Feature **fts, Uint n)
+{
+	CAD_RegenSched rs;
+	Uint i, j, *fill;
+
+	rs.part = part;
+	rs.fts = fts;
+	rs.n = n;
+	rs.failed = 0;
+	rs.errMsg[0] = '\0';
+	rs.tasks = CAD_ArenaAlloc(&part->scratch, n*sizeof(CAD_RegenTask));
+	rs.nWait = CAD_ArenaAlloc(&part->scratch, n*sizeof(Uint));
+	rs.downOffs = CAD_ArenaAlloc(&part->scratch, (n+1)*sizeof(Uint));
+	memset(rs.downOffs, 0, (n+1)*sizeof(Uint));
+
+	for (i = 0; i < n; i++) {
+		rs.tasks[i].rs = &rs;
+		rs.tasks[i].idx = i;
+		rs.nWait[i] = 0;
+		for (j = 0; j < fts[i]->ndeps; j++) {
+			CAD_Feature *dep = fts[i]->deps[j];
+
+			if (dep->flags & CAD_FEATURE_REGENERATED) {
+				rs.nWait[i]++;
+				rs.downOffs[dep->seq+1]++;
+			}
+		}
+	}
+	for (i = 0; i < n; i++) {
+		rs.downOffs[i+1] += rs.downOffs[i];
+	}
+	rs.down = CAD_ArenaAlloc(&part->scratch,
+	    (rs.downOffs[n]+1)*sizeof(Uint));
+	fill = CAD_ArenaAlloc(&part->scratch, n*sizeof(Uint));
+	memcpy(fill, rs.downOffs, n*sizeof(Uint));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < fts[i]->ndeps; j++) {
+			CAD_Feature *dep = fts[i]->deps[j];
+
+			if (!(dep->flags & CAD_FEATURE_REGENERATED)) {
+				continue;
+			}
+			rs.down[fill[dep->seq]++] = i;
+		}
+	}
+
+	AG_MutexInit(&rs.lock);
+	CAD_JobGroupInit(&rs.group);
+	AG_MutexLock(&rs.lock);
+	for (i = 0; i < n; i++) {
+		if (rs.nWait[i] == 0)
+			CAD_JobSubmit(&rs.group, RegenJob, &rs.tasks[i]);
+	}
+	AG_MutexUnlock(&rs.lock);
+	CAD_JobGroupWait(&rs.group);
+	CAD_JobGroupDestroy(&rs.group);
+	AG_MutexDestroy(&rs.lock);
+
+	if (rs.failed) {
+		AG_SetErrorS(rs.errMsg);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * The body resulting from the merge of each feature is kept in ft->result,
+ * identified by a key which chains the key of the body it was merged into
+ * with the hash and operation of the feature (the hash covers only the
+ * parameters of the feature class). Regeneration resumes from the last body
+ * whose key is still current, so only the features downstream of a change
+ * are merged again. Bodies are dropped from the start of the feature list
+ * when they exceed PART_BODY_CACHE bytes; the key is 0 if not cacheable.
+ */
+static Uint64
+BodyKey(Uint64 key, const CAD_Feature *ft)
+{
+	Uint32 op = (Uint32)ft->op;
+	Uint64 h;
+
+	if (key == 0 || ft->hash == 0) {
+		return (0);
+	}
+	h = CAD_HashBytes(key, &ft->hash, sizeof(Uint64));
+	h = CAD_HashBytes(h, &op, sizeof(Uint32));
+	return (h != 0 ? h : 1);
+}
+
+/* Return 1 if merging the feature leaves the body unchanged. */
+static int
+BodyUnchanged(const CAD_Feature *ft, Uint64 key)
+{
+	if ((ft->flags & CAD_FEATURE_SUPPRESS) ||
+	    (ft->mesh.nt == 0 && ft->op != CAD_FEATURE_INTERSECT)) {
+		return (1);
+	}
+	return (key != 0 && key == ft->failKey);	/* Failed before */
+}
+
+static size_t
+BodySize(const CAD_Mesh *m)
+{
+	size_t size = m->maxv*3*sizeof(float) + m->maxt*3*sizeof(Uint32);
+
+	if (m->flags & CAD_MESH_NORMALS) { size += m->maxv*3*sizeof(float); }
+	if (m->flags & CAD_MESH_COLORS) { size += m->maxv*4; }
+	if (m->flags & CAD_MESH_TEXCOORDS) { size += m->maxv*2*sizeof(float); }
+	return (size);
+}
+
+/* Drop merged bodies beyond the cache size, except for cur. */
+static void
+TrimBodies(CAD_Part *part, const CAD_Mesh *cur)
+{
+	CAD_Feature *ft;
+	size_t size = 0;
+
+	TAILQ_FOREACH_REVERSE(ft, &part->features, cad_featureq, features) {
+		if (&ft->result == cur) {
+			size += BodySize(&ft->result);
+			continue;
+		}
+		if (ft->resultKey != 0) {
+			size += BodySize(&ft->result);
+			if (size <= PART_BODY_CACHE)
+				continue;
+		}
+		CAD_MeshFree(&ft->result);
+		ft->resultKey = 0;
+	}
+}
+
+/*
+ * Combine the geometry of a feature with the given body into ft->result.
+ * A body merged by the previous feature in the same pass (prev) is not
+ * kept, and is taken over when the feature is simply appended.
+ */
+static int
+MergeFeature(CAD_Feature *ft, const CAD_Mesh *body, CAD_Feature *prev)
+{
+	CAD_Mesh tmp;
+	int op;
+
+	switch (ft->op) {
+	case CAD_FEATURE_UNION:
+		op = CAD_CSG_UNION;
+		break;
+	case CAD_FEATURE_CUT:
+		op = CAD_CSG_DIFFERENCE;
+		break;
+	case CAD_FEATURE_INTERSECT:
+		op = CAD_CSG_INTERSECTION;
+		break;
+	default:
+		if (prev == NULL) {
+			CAD_MeshReset(&ft->result, body->flags|ft->mesh.flags);
+			if (CAD_MeshAppend(&ft->result, body) == -1) {
+				return (-1);
+			}
+			return CAD_MeshAppend(&ft->result, &ft->mesh);
+		}
+		tmp = ft->result;
+		ft->result = prev->result;
+		prev->result = tmp;
+		if (CAD_MeshAppend(&ft->result, &ft->mesh) == -1) {
+			tmp = ft->result;
+			ft->result = prev->result;
+			prev->result = tmp;
+			return (-1);
+		}
+		prev->resultKey = 0;
+		return (0);
+	}
+	return CAD_MeshBoolean(&ft->result, body, &ft->mesh, op);
+}
+
+/*
+ * Merge the features into the part body, starting from the last body
+ * which is still current. A feature which cannot be merged (e.g., its
+ * boolean operation fails because the meshes are not closed) is marked
+ * as failed and leaves the body unchanged; it is not retried until it
+ * or the body upstream of it changes. Returns 1 if the body has changed.
+ */
+static int
+MergeFeatures(CAD_Part *part)
+{
+	CAD_Feature *ft, *from = NULL, *start, *prev = NULL;
+	const CAD_Mesh *body = part->body, *cur = &part->base;
+	Uint64 key = part->baseKey, curKey = key;
+	int merged = 0;
+
+	TAILQ_FOREACH(ft, &part->features, features) {
+		Uint64 k = BodyKey(key, ft);
+
+		if (BodyUnchanged(ft, k)) {
+			continue;
+		}
+		if ((key = k) == 0) {
+			break;
+		}
+		if (ft->resultKey == key) {
+			from = ft;
+			cur = &ft->result;
+			curKey = key;
+		} else if (part->keptKey == key) {
+			from = ft;
+			cur = &part->kept;
+			curKey = key;
+		}
+	}
+	start = (from != NULL) ? TAILQ_NEXT(from, features) :
+	                         TAILQ_FIRST(&part->features);
+	for (ft = start; ft != NULL; ft = TAILQ_NEXT(ft, features)) {
+		ft->resultKey = 0;			/* Merged again below */
+	}
+	key = curKey;
+	for (ft = start; ft != NULL; ft = TAILQ_NEXT(ft, features)) {
+		Uint64 k = BodyKey(key, ft);
+
+		if (BodyUnchanged(ft, k)) {
+			if (k == 0 || k != ft->failKey) {
+				ft->flags &= ~(CAD_FEATURE_FAILED);
+			}
+			ft->resultKey = 0;
+			continue;
+		}
+		if (MergeFeature(ft, cur, prev) == -1) {
+			Verbose("%s: %s\n", AGOBJECT(ft)->name, AG_GetError());
+			ft->flags |= CAD_FEATURE_FAILED;
+			ft->failKey = k;
+			ft->resultKey = 0;
+			continue;
+		}
+		ft->flags &= ~(CAD_FEATURE_FAILED);
+		ft->failKey = 0;
+		ft->resultKey = k;
+		cur = &ft->result;
+		prev = ft;
+		key = k;
+		merged = 1;
+		TrimBodies(part, cur);
+	}
+	part->body = cur;
+	if (cur != &part->kept) {
+		CAD_MeshFree(&part->kept);
+		part->keptKey = 0;
+	}
+	TrimBodies(part, cur);
+	return (merged || cur != body);
+}
+
+/*
+ * Regenerate the part geometry. Each feature is merged into the body
+ * built by the features before it (its body chain), and may only depend
+ * on features upstream of it (see CAD_FeatureAddDep()), so the feature
+ * list is always in dependency order. A feature is rebuilt if it was
+ * marked dirty, if its external inputs have changed (see
+ * CAD_PartCheckInputs()) or if any of its upstream dependencies is being
+ * rebuilt; clean features keep their previously generated mesh.
+ * Independent features are rebuilt in parallel, and features whose inputs
+ * hash to a known value are fetched from the tessellation cache instead.
+ * Only the features downstream of the first change are merged again (see
+ * MergeFeatures()).
+ */
+static int
+RegenPart(CAD_Part *part)
+{
+	CAD_Feature *ft, **fts = NULL;
+	Uint i, n = 0, maxFts = 0;
+	int rv = 0;
+
+	(void)CAD_PartCheckInputs(part);
+	TAILQ_FOREACH(ft, &part->features, features) {
+		if (ft->ndepNames > 0) {
+			CAD_FeatureResolveDeps(ft, part);
+		}
+		ft->flags &= ~(CAD_FEATURE_REGENERATED);
+
+		if (!(ft->flags & CAD_FEATURE_DIRTY)) {
+			for (i = 0; i < ft->ndeps; i++) {
+				if (ft->deps[i]->flags &
+				    (CAD_FEATURE_DIRTY|CAD_FEATURE_REGENERATED))
+					break;
+			}
+			if (i == ft->ndeps)
+				continue;
+		}
+		ft->flags |= CAD_FEATURE_REGENERATED;	/* Scheduled */
+		ft->hash = CAD_FeatureHash(ft);
+		if (n+1 > maxFts) {
+			fts = CAD_ArenaRealloc(&part->scratch, fts,
+			    maxFts*sizeof(CAD_Feature *),
+			    ((maxFts > 0) ? maxFts*2 : 32)*sizeof(CAD_Feature *));
+			maxFts = (maxFts > 0) ? maxFts*2 : 32;
+		}
+		ft->seq = n;
+		fts[n++] = ft;
+	}
+	if (n == 0 && !(part->flags & (CAD_PART_REBUILD|CAD_PART_REMERGE))) {
+		return (0);
+	}
+	if (n > 1 && CAD_JobPoolThreads() > 1) {
+		rv = RegenParallel(part, fts, n);
+	} else {
+		for (i = 0; i < n; i++) {
+			if ((rv = RegenFeature(part, fts[i])) == -1)
+				break;
+		}
+	}
+	if (rv == -1) {
+		return (-1);
+	}
+
+	/*
+	 * Merge the feature meshes into the imported geometry, combining each
+	 * feature with the body built so far according to its operation. If
+	 * no feature contributes geometry, the imported mesh is used as-is
+	 * rather than copied. A new imported mesh invalidates every body.
+	 */
+	if (part->flags & CAD_PART_REBUILD) {
+		if (++part->baseKey == 0)
+			part->baseKey = 1;
+	}
+	if (!MergeFeatures(part) && !(part->flags & CAD_PART_REBUILD)) {
+		part->flags &= ~(CAD_PART_REMERGE);
+		return (0);
+	}
+	part->flags &= ~(CAD_PART_REBUILD|CAD_PART_REMERGE);
+	CAD_LODInvalidate(&part->lod);
+	part->bvh.flags |= CAD_BVH_STALE;
+	return CAD_MeshToObject(CAD_PartMesh(part), part->so);
+}
+
+/*
+ * Mark the features whose external inputs (e.g., source sketches) have
+ * changed since they were generated. Returns the number of features
+ * marked.
+ */
+Uint
+CAD_PartCheckInputs(CAD_Part *part)
+{
+	CAD_Feature *ft;
+	Uint n = 0;
+
+	TAILQ_FOREACH(ft, &part->features, features) {
+		if (!(ft->flags & CAD_FEATURE_DIRTY) &&
+		    CAD_FeatureInputsChanged(ft)) {
+			ft->flags |= CAD_FEATURE_DIRTY;
+			n++;
+		}
+	}
+	return (n);
+}
+
+/*
+ * Regenerate the parts whose external inputs have changed. This is called
+ * when a sketch is loaded, or when its editor loses focus or is closed
+ * (see CAD_OpenObject()), rather than polling the inputs of open parts.
+ */
+void
+CAD_PartsCheckInputs(void)
+{
+	AG_Object *obj;
+
+	AGOBJECT_FOREACH_CHILD(obj, &vfsRoot, ag_object) {
+		if (!AG_OfClass(obj, "CAD_Part:*")) {
+			continue;
+		}
+		if (CAD_PartCheckInputs((CAD_Part *)obj) > 0 &&
+		    CAD_PartRegen((CAD_Part *)obj) == -1)
+			AG_TextMsgFromError();
+	}
+}
+
+/*
+ * Temporary buffers used during regeneration are taken from the scratch
+ * arena of the part, which is recycled once the pass is complete.
+ */
+int
+CAD_PartRegen(CAD_Part *part)
+{
+	int rv;
+
+	rv = RegenPart(part);
+	CAD_ArenaReset(&part->scratch);
+	return (rv);
+}
+
+/*
+ * Return the merged geometry of the part. This is the imported mesh if no
+ * feature has been merged into it (the merged body may also be empty).
+ */
+const CAD_Mesh *
+CAD_PartMesh(const CAD_Part *part)
+{
+	return (part->body);
+}
+
+/*
+ * Return the spatial index of the part geometry for ray, closest-point
+ * and box queries. The index is built on first use and rebuilt in full
+ * after the part has been regenerated: merging renumbers the triangles
+ * of the body, so the tree cannot be refit per feature (CAD_BVHRefit()
+ * only applies to vertices moved in place, which regeneration never
+ * does). Returns NULL on failure.
+ */
+const CAD_BVH *
+CAD_PartBVH(CAD_Part *part)
+{
+	const CAD_Mesh *m = CAD_PartMesh(part);
+	CAD_BVH *bvh = &part->bvh;
+
+	if (bvh->m != m || bvh->nTris != m->nt ||
+	    (bvh->flags & CAD_BVH_STALE)) {
+		if (CAD_BVHBuild(bvh, m) == -1)
+			return (NULL);
+	}
+	return (bvh);
+}
+
+/* Create a feature in the storage of the part, without attaching it. */
+static CAD_Feature *
+NewFeature(CAD_Part *part, AG_ObjectClass *cls, const char *name)
+{
+	CAD_Feature *ft;
+
+	ft = CAD_ArenaAllocObj(&part->ftArena, cls->size);
+	AG_ObjectInit(ft, cls);
+	AGOBJECT(ft)->flags |= AG_OBJECT_STATIC;
+	ft->arena = &part->ftArena;
+	AG_ObjectSetNameS(ft, name);
+	return (ft);
+}
+
+void
+CAD_PartInsertFeature(AG_Event *event)
+{
+	char name[AG_OBJECT_NAME_MAX];
+	CAD_Part *part = AG_PTR(1);
+	AG_ObjectClass *cls = AG_PTR(2);
+	char *basename = AG_STRING(3);
+	Uint op = AG_UINT(4);
+	CAD_Feature *ft;
+
+	CAD_NameIndexGenerate(&part->names, basename, name, sizeof(name));
+
+	ft = NewFeature(part, cls, name);
+	ft->op = op;
+	AG_ObjectAttach(part, ft);
+
+	if (CAD_PartRegen(part) == -1)
+		AG_TextMsgFromError();
+}
+
+static int
+LoadFeature(CAD_Part *part, CAD_PartFile *pf, const CAD_PartChunk *c)
+{
+	AG_ObjectClass *cls;
+	CAD_Feature *ft;
+
+	if ((cls = AG_LookupClass(c->cls)) == NULL ||
+	    strncmp(cls->hier, "CAD_Feature", 11) != 0) {
+		AG_SetError(_("%s: Bad feature class: %s"), c->name, c->cls);
+		return (-1);
+	}
+	ft = NewFeature(part, cls, c->name);
+	if (CAD_ObjectReadChunk(pf, c, ft) == -1) {
+		AG_ObjectDestroy(ft);
+		return (-1);
+	}
+	AG_ObjectAttach(part, ft);
+	return (0);
+}
+
+/*
+ * Load a part saved in the native format into a newly created part. Only
+ * the chunks selected by flags are read; if the imported geometry is not
+ * requested, it can be loaded later with CAD_PartLoadMesh(). Cached
+ * tessellations are read as regeneration needs them.
+ */
+int
+CAD_PartLoad(CAD_Part *part, const char *path, Uint flags)
+{
+	CAD_PartFile *pf;
+	const CAD_PartChunk *c;
+	Uint i;
+
+	if ((pf = CAD_PartFileOpen(path)) == NULL) {
+		return (-1);
+	}
+	if ((c = CAD_PartFileFind(pf, CAD_CHUNK_INFO, NULL)) == NULL) {
+		AG_SetError(_("%s: Missing part information"), path);
+		goto fail;
+	}
+	if (CAD_ObjectReadChunk(pf, c, part) == -1) {
+		goto fail;
+	}
+	if (flags & CAD_PART_LOAD_FEATURES) {
+		for (i = 0; i < pf->nChunks; i++) {
+			c = &pf->chunks[i];
+			if (c->type == CAD_CHUNK_FEAT &&
+			    LoadFeature(part, pf, c) == -1)
+				goto fail;
+		}
+	}
+	if ((c = CAD_PartFileFind(pf, CAD_CHUNK_MESH, NULL)) != NULL) {
+		if (flags & CAD_PART_LOAD_MESH) {
+			if (CAD_PartFileReadMesh(pf, c, &part->base) == -1)
+				goto fail;
+		} else {
+			part->flags |= CAD_PART_NOMESH;
+		}
+	}
+	if (part->file != NULL) {
+		CAD_PartFileClose(part->file);
+	}
+	part->file = pf;
+	part->flags |= CAD_PART_REBUILD;
+	return (0);
+fail:
+	CAD_PartFileClose(pf);
+	return (-1);
+}
+
+/* Load imported geometry which was skipped by CAD_PartLoad(). */
+int
+CAD_PartLoadMesh(CAD_Part *part)
 {
+	const CAD_PartChunk *c;
+
+	if (!(part->flags & CAD_PART_NOMESH)) {
+		return (0);
+	}
+	if (part->file == NULL ||
+	    (c = CAD_PartFileFind(part->file, CAD_CHUNK_MESH, NULL)) == NULL) {
+		AG_SetError(_("Imported geometry is not available"));
+		return (-1);
+	}
+	if (CAD_PartFileReadMesh(part->file, c, &part->base) == -1) {
+		return (-1);
+	}
+	part->flags &= ~(CAD_PART_NOMESH);
+	part->flags |= CAD_PART_REBUILD;
+	return (0);
 }
 
-static int
-Load(void *obj, AG_DataSource *buf, const AG_Version *ver)
+/*
+ * Restore a part from an autosave file (see autosave.c). If the imported
+ * geometry was unchanged when the snapshot was taken, it is read from the
+ * archive the part was saved to. Subsequent saves to the archive update
+ * it in place.
+ */
+int
+CAD_PartRecover(CAD_Part *part, const char *path, const char *archive)
 {
-	CAD_Part *part = obj;
+	CAD_PartFile *af;
+	const CAD_PartChunk *c;
+	int hasMesh;
 
-	AG_CopyString(part->descr, buf, sizeof(part->descr));
-	part->flags = AG_ReadUint32(buf);
+	if (CAD_PartLoad(part, path, CAD_PART_LOAD_ALL) == -1) {
+		return (-1);
+	}
+	hasMesh = (CAD_PartFileFind(part->file, CAD_CHUNK_MESH, NULL) != NULL);
+	CAD_PartFileClose(part->file);
+	part->file = NULL;
+
+	if (archive != NULL && (af = CAD_PartFileOpen(archive)) != NULL) {
+		if (!hasMesh &&
+		    (c = CAD_PartFileFind(af, CAD_CHUNK_MESH, NULL)) != NULL &&
+		    CAD_PartFileReadMesh(af, c, &part->base) == -1) {
+			CAD_PartFileClose(af);
+			return (-1);
+		}
+		part->file = af;
+	}
+	if (hasMesh) {
+		part->flags |= CAD_PART_MESH_DIRTY;
+	}
 	return (0);
 }
 
-static int
-Save(void *obj, AG_DataSource *buf)
+/*
+ * Read the description and triangle count of a part saved in the native
+ * format, without loading it. The triangle count is (Uint)-1 if the file
+ * predates its recording.
+ */
+int
+CAD_PartReadInfo(const CAD_PartFile *pf, char *descr, size_t len,
+    Uint *nTris)
 {
-	CAD_Part *part = obj;
+	const CAD_PartChunk *c;
+	AG_DataSource *ds;
+	AG_Version ver;
+	int i, nHier;
 
-	AG_WriteString(buf, part->descr);
-	AG_WriteUint32(buf, part->flags);
+	if ((c = CAD_PartFileFind(pf, CAD_CHUNK_INFO, NULL)) == NULL) {
+		AG_SetError(_("%s: Missing part information"), pf->path);
+		return (-1);
+	}
+	if ((ds = CAD_PartFileReadChunk(pf, c)) == NULL) {
+		return (-1);
+	}
+	/* Only CAD_Part (the last class) has a dataset; see Save(). */
+	if ((nHier = (int)AG_ReadUint8(ds)) < 1) {
+		AG_SetError(_("%s: Class mismatch"), c->name);
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	for (i = 0; i < nHier; i++) {
+		ver.major = (Uint)AG_ReadUint32(ds);
+		ver.minor = (Uint)AG_ReadUint32(ds);
+	}
+	AG_CopyString(descr, ds, len);
+	(void)AG_ReadUint32(ds);			/* Flags */
+	*nTris = (ver.minor >= 1) ? (Uint)AG_ReadUint32(ds) : (Uint)-1;
+	AG_CloseAutoCore(ds);
 	return (0);
 }
 
+/*
+ * Build a small mesh for thumbnails by sampling the triangles of m at a
+ * regular interval. Vertices are not shared.
+ */
 static void
-FindFeatures(AG_Tlist *tl, AG_Object *pob, int depth)
+MakePreview(const CAD_Mesh *m, CAD_Mesh *prev)
 {
-	AG_Object *cob;
-	AG_TlistItem *it;
-	int nosel = 0;
-	
-	if (!AG_OfClass(pob, "CAD_Feature:*")) {
-		if (!TAILQ_EMPTY(&pob->children)) {
-			nosel++;
-		} else {
-			return;
+	Uint step = (m->nt + PART_PREVIEW_TRIS-1)/PART_PREVIEW_TRIS;
+	Uint i, j, k;
+
+	CAD_MeshInit(prev, m->flags & CAD_MESH_NORMALS);
+	if (CAD_MeshReserve(prev, PART_PREVIEW_TRIS*3, PART_PREVIEW_TRIS) == -1)
+		return;
+
+	for (i = 0; i < m->nt; i += step) {
+		const Uint32 *t = &m->tri[i*3];
+		Uint32 *tp = &prev->tri[prev->nt*3];
+
+		for (j = 0; j < 3; j++) {
+			for (k = 0; k < 3; k++) {
+				prev->v[prev->nv*3+k] = m->v[t[j]*3+k];
+				if (prev->flags & CAD_MESH_NORMALS)
+					prev->n[prev->nv*3+k] = m->n[t[j]*3+k];
+			}
+			tp[j] = (Uint32)prev->nv++;
 		}
+		prev->nt++;
 	}
+}
 
-	it = AG_TlistAddS(tl, NULL, pob->name);
-	it->depth = depth;
-	it->p1 = pob;
-	if (nosel) {
-		it->flags |= AG_TLIST_NO_SELECT;
-	}
-	if (!TAILQ_EMPTY(&pob->children)) {
-		it->flags |= AG_TLIST_HAS_CHILDREN;
-		if (AG_ObjectRoot(pob) == pob)
-			it->flags |= AG_TLIST_VISIBLE_CHILDREN;
+typedef struct cad_part_save_tess {
+	CAD_PartWriter *w;
+	Uint64 *keys;				/* Entries written */
+	Uint nKeys, maxKeys;
+	size_t size;				/* Bytes written */
+} CAD_PartSaveTess;
+
+static int
+SaveTessellation(void *p, Uint64 hash, const CAD_Mesh *m)
+{
+	CAD_PartSaveTess *st = p;
+	const CAD_PartChunk *c;
+	char key[AG_OBJECT_NAME_MAX];
+
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+	if (st->w->prev != NULL &&
+	    (c = CAD_PartFileFind(st->w->prev, CAD_CHUNK_TESS, key)) != NULL) {
+		/* Same key, same contents; keep the existing chunk. */
+		if (CAD_PartWriterCopy(st->w, st->w->prev, c) == -1)
+			return (-1);
+	} else {
+		if (CAD_PartWriterMesh(st->w, CAD_CHUNK_TESS, key, m) == -1)
+			return (-1);
 	}
-	if ((it->flags & AG_TLIST_HAS_CHILDREN)) {
-		TAILQ_FOREACH(cob, &pob->children, cobjs)
-			FindFeatures(tl, cob, depth+1);
+	if (st->nKeys+1 > st->maxKeys) {
+		st->maxKeys = (st->maxKeys > 0) ? st->maxKeys*2 : 64;
+		st->keys = Realloc(st->keys, st->maxKeys*sizeof(Uint64));
 	}
+	st->keys[st->nKeys++] = hash;
+	st->size += (size_t)st->w->chunks[st->w->nChunks-1].size;
+	return (0);
 }
 
-static void
-PollFeatures(AG_Event *event)
+/*
+ * Write the tessellation cache. Entries of the previous file which have
+ * not been loaded into memory are carried over, as long as the total
+ * remains within the cache size limit.
+ */
+static int
+SaveTessellations(CAD_Part *part, CAD_PartWriter *w)
 {
-	AG_Tlist *tl = AG_PTR(0);
-	CAD_Part *part = AG_PTR(1);
+	CAD_PartSaveTess st;
+	Uint64 hash;
+	Uint i, j;
+	int rv = -1;
+
+	st.w = w;
+	st.keys = NULL;
+	st.nKeys = 0;
+	st.maxKeys = 0;
+	st.size = 0;
+	if (CAD_MeshCacheForeach(&part->cache, SaveTessellation, &st) == -1) {
+		goto out;
+	}
+	for (i = 0; part->file != NULL && i < part->file->nChunks; i++) {
+		const CAD_PartChunk *c = &part->file->chunks[i];
 
-	AG_TlistClear(tl);
-	AG_LockVFS(part);
-	FindFeatures(tl, AGOBJECT(part), 0);
-	AG_UnlockVFS(part);
-	AG_TlistRestore(tl);
+		if (c->type != CAD_CHUNK_TESS ||
+		    st.size + c->size > part->cache.maxSize) {
+			continue;
+		}
+		hash = (Uint64)strtoull(c->name, NULL, 16);
+		for (j = 0; j < st.nKeys; j++) {
+			if (st.keys[j] == hash)
+				break;
+		}
+		if (j < st.nKeys) {
+			continue;
+		}
+		if (CAD_PartWriterCopy(w, part->file, c) == -1) {
+			goto out;
+		}
+		st.size += (size_t)c->size;
+	}
+	rv = 0;
+out:
+	Free(st.keys);
+	return (rv);
 }
 
+/*
+ * Replace the file of the part by its compacted version, waiting for the
+ * compaction to complete if needed. On failure, the original file is
+ * kept.
+ */
 static void
-SetViewCamera(AG_Event *event)
+InstallCompacted(CAD_Part *part)
 {
-	SG_View *sgv = AG_PTR(1);
-	char *which = AG_STRING(2);
-	SG_Camera *cam;
+	CAD_PartFile *pf;
 
-	if ((cam = SG_FindNode(sgv->sg, which)) == NULL) {
-		AG_TextMsg(AG_MSG_ERROR, _("Cannot find Camera: %s"), which);
-		return;
+	if ((pf = CAD_PartCompactFinish(part->compact)) != NULL) {
+		CAD_PartFileClose(part->file);
+		part->file = pf;
+	} else {
+		Verbose("%s: compaction failed: %s\n", AGOBJECT(part)->name,
+		    AG_GetError());
 	}
-	SG_ViewSetCamera(sgv, cam);
+	part->compact = NULL;
 }
 
-static void
-ShowCameraSettings(AG_Event *event)
+static Uint32
+PollCompact(AG_Timer *to, AG_Event *event)
 {
-	SG_View *sgv = AG_PTR(1);
-	AG_Window *win;
+	CAD_Part *part = AG_PTR(1);
 
-	win = AG_WindowNew(0);
-	AG_WindowSetCaption(win, _("Camera settings (%s)"),
-	    AGOBJECT(sgv->cam)->name);
-	AG_ObjectAttach(win, SGNODE_OPS(sgv->cam)->edit(sgv->cam, sgv));
-	AG_WindowShow(win);
+	if (!CAD_PartCompactDone(part->compact)) {
+		return (to->ival);
+	}
+	InstallCompacted(part);
+	return (0);
 }
 
+/*
+ * Start compacting the file of the part in the background once enough of
+ * it is garbage from in-place updates.
+ */
 static void
-ShowLightSettings(AG_Event *event)
+CheckCompact(CAD_Part *part)
 {
-	SG_View *sgv = AG_PTR(1);
-	char *ltname = AG_STRING(2);
-	SG_Light *lt;
-	AG_Window *win;
+	Uint64 garbage = CAD_PartFileGarbage(part->file);
 
-	if ((lt = SG_FindNode(sgv->sg, ltname)) == NULL) {
-		AG_TextMsg(AG_MSG_ERROR, _("Cannot find Light: %s"), ltname);
+	if (garbage < PART_COMPACT_MIN ||
+	    garbage < part->file->size - garbage) {
 		return;
 	}
-
-	win = AG_WindowNew(0);
-	AG_WindowSetCaptionS(win, _("Light settings"));
-	AG_ObjectAttach(win, SGNODE_OPS(lt)->edit(lt, sgv));
-	AG_WindowShow(win);
+	part->compact = CAD_PartCompactStart(part->file);
+	AG_AddTimer(part, &part->compactTimer, 250, PollCompact, "%p", part);
 }
 
-void
-CAD_PartInsertFeature(AG_Event *event)
+/*
+ * Save a part in the native format: the part dataset, one chunk per
+ * feature, the imported geometry, a preview of the merged geometry and
+ * the tessellation cache.
+ *
+ * If the part was loaded from (or last saved to) the same file, the file
+ * is updated in place: only the chunks which have changed are appended,
+ * followed by a new table of contents. The file is compacted in the
+ * background once the space taken by stale chunks exceeds the live data.
+ */
+int
+CAD_PartSave(CAD_Part *part, const char *path)
 {
-	char name[AG_OBJECT_NAME_MAX];
-	CAD_Part *part = AG_PTR(1);
-	AG_ObjectClass *cls = AG_PTR(2);
-	char *basename = AG_STRING(3);
+	CAD_PartWriter w;
+	CAD_PartFile *pf;
 	CAD_Feature *ft;
-	Uint name_no = 0;
-tryname:
-	snprintf(name, sizeof(name), "%s #%d", basename, name_no++);
-	if (AG_ObjectFindChild(part, name) != NULL)
-		goto tryname;
-
-	ft = Malloc(cls->size);
-	AG_ObjectInit(ft, &cadFeatureClass);
-	AG_ObjectSetNameS(ft, name);
-	AG_ObjectAttach(part, ft);
+	const CAD_Mesh *m;
+	CAD_Mesh prev;
+	int rv, append;
+
+	if (part->compact != NULL) {
+		AG_DelTimer(part, &part->compactTimer);
+		InstallCompacted(part);
+	}
+	append = (part->file != NULL && strcmp(part->file->path, path) == 0);
+	if (append) {
+		rv = CAD_PartWriterAppend(&w, part->file);
+	} else {
+		rv = CAD_PartWriterOpen(&w, path);
+	}
+	if (rv == -1) {
+		return (-1);
+	}
+	if (CAD_ObjectWriteChunk(&w, CAD_CHUNK_INFO, part) == -1) {
+		goto fail;
+	}
+	TAILQ_FOREACH(ft, &part->features, features) {
+		if (ft->ndepNames > 0) {
+			CAD_FeatureResolveDeps(ft, part);
+		}
+		if (CAD_ObjectWriteChunk(&w, CAD_CHUNK_FEAT, ft) == -1)
+			goto fail;
+	}
+	if ((part->flags & CAD_PART_NOMESH) ||
+	    (append && !(part->flags & CAD_PART_MESH_DIRTY) &&
+	     CAD_PartFileFind(part->file, CAD_CHUNK_MESH, NULL) != NULL)) {
+		const CAD_PartChunk *c;
+
+		c = CAD_PartFileFind(part->file, CAD_CHUNK_MESH, NULL);
+		if (c != NULL && CAD_PartWriterCopy(&w, part->file, c) == -1)
+			goto fail;
+	} else if (part->base.nv > 0) {
+		if (CAD_PartWriterMesh(&w, CAD_CHUNK_MESH, "base",
+		    &part->base) == -1)
+			goto fail;
+	}
+	m = CAD_PartMesh(part);
+	if (m->nt > PART_PREVIEW_TRIS) {
+		MakePreview(m, &prev);
+		rv = CAD_PartWriterMesh(&w, CAD_CHUNK_PREV, "preview", &prev);
+		CAD_MeshFree(&prev);
+	} else if (m->nt > 0) {
+		rv = CAD_PartWriterMesh(&w, CAD_CHUNK_PREV, "preview", m);
+	} else {
+		rv = 0;
+	}
+	if (rv == -1 || SaveTessellations(part, &w) == -1) {
+		goto fail;
+	}
+	if ((pf = CAD_PartWriterCommit(&w)) == NULL) {
+		return (-1);
+	}
+	if (part->file != NULL) {
+		CAD_PartFileClose(part->file);
+	}
+	part->file = pf;
+	part->flags &= ~(CAD_PART_MESH_DIRTY);
+	part->cache.flags &= ~(CAD_MESH_CACHE_DIRTY);
+	if (append) {
+		CheckCompact(part);
+	}
+	return (0);
+fail:
+	CAD_PartWriterAbort(&w);
+	return (-1);
 }
 
 /* Save part to native cadtools format. */
@@ -212,22 +1387,66 @@ SavePartToNative(AG_Event *event)
 	CAD_Part *part = AG_PTR(1);
 	char *path = AG_STRING(2);
 
-	if (AG_ObjectSaveToFile(part, path) == -1) {
+	if (CAD_PartSave(part, path) == -1) {
 		AG_TextMsgFromError();
 		return;
 	}
+	CAD_ObjectSaved(part);
 	AG_SetString(part, "archive-path", path);
 	AG_ObjectSetNameS(part, AG_ShortFilename(path));
+	CAD_PartRenamed(part, part);
+}
+
+/* Read the attribute selection from the export options. */
+static Uint
+ExportFlags(AG_FileType *ft, const char *pfx)
+{
+	char key[32];
+	Uint flags = 0;
+
+	snprintf(key, sizeof(key), "%s.vtxnormals", pfx);
+	if (AG_FileOptionInt(ft, key)) { flags |= CAD_MESH_NORMALS; }
+	snprintf(key, sizeof(key), "%s.vtxcolors", pfx);
+	if (AG_FileOptionInt(ft, key)) { flags |= CAD_MESH_COLORS; }
+	snprintf(key, sizeof(key), "%s.texcoords", pfx);
+	if (AG_FileOptionInt(ft, key)) { flags |= CAD_MESH_TEXCOORDS; }
+	return (flags);
+}
+
+/* Export the part geometry to Stanford PLY format. */
+static void
+SavePartToPLY(AG_Event *event)
+{
+	CAD_Part *part = AG_PTR(1);
+	char *path = AG_STRING(2);
+	AG_FileType *ft = AG_PTR(3);
+
+	if (CAD_MeshSavePLY(CAD_PartMesh(part), path, ExportFlags(ft, "ply"),
+	    AG_FileOptionString(ft, "ply.comment")) == -1)
+		AG_TextMsgFromError();
+}
+
+/* Export the part geometry to Wavefront OBJ format. */
+static void
+SavePartToOBJ(AG_Event *event)
+{
+	CAD_Part *part = AG_PTR(1);
+	char *path = AG_STRING(2);
+	AG_FileType *ft = AG_PTR(3);
+
+	if (CAD_MeshSaveOBJ(CAD_PartMesh(part), path, ExportFlags(ft, "obj"),
+	    AG_FileOptionString(ft, "obj.comment")) == -1)
+		AG_TextMsgFromError();
 }
 
 void
 CAD_PartSaveMenu(AG_FileDlg *fd, CAD_Part *part)
 {
-/*	AG_FileType *ft; */
+	AG_FileType *ft;
 
 	AG_FileDlgAddType(fd, _("cadtools part"), "*.part",
 	    SavePartToNative, "%p", part);
-#if 0
+
 	ft = AG_FileDlgAddType(fd, _("Stanford PLY"), "*.ply",
 	    SavePartToPLY, "%p", part);
 	AG_FileOptionNewString(ft, _("Comment: "), "ply.comment", "");
@@ -235,9 +1454,12 @@ CAD_PartSaveMenu(AG_FileDlg *fd, CAD_Part *part)
 	AG_FileOptionNewBool(ft, _("Save vertex colors"), "ply.vtxcolors", 1);
 	AG_FileOptionNewBool(ft, _("Save texture coords"), "ply.texcoords", 1);
 
-	AG_FileDlgAddType(fd, _("Wavefront OBJ"), "*.obj",
+	ft = AG_FileDlgAddType(fd, _("Wavefront OBJ"), "*.obj",
 	    SavePartToOBJ, "%p", part);
-#endif
+	AG_FileOptionNewString(ft, _("Comment: "), "obj.comment", "");
+	AG_FileOptionNewBool(ft, _("Save vertex normals"), "obj.vtxnormals", 1);
+	AG_FileOptionNewBool(ft, _("Save vertex colors"), "obj.vtxcolors", 0);
+	AG_FileOptionNewBool(ft, _("Save texture coords"), "obj.texcoords", 1);
 }
 
 /* Open a part in native cadtools format. */
@@ -245,55 +1467,88 @@ static void
 OpenPartNative(AG_Event *event)
 {
 	char *path = AG_STRING(2);
-	AG_Object *obj;
 
-	obj = AG_ObjectNew(&vfsRoot, NULL, &cadPartClass);
-	if (AG_ObjectLoadFromFile(obj, path) == -1) {
-		AG_TextMsgFromError();
-		AG_ObjectDetach(obj);
-		AG_ObjectDestroy(obj);
-		return;
-	}
-	AG_SetString(obj, "archive-path", path);
-	AG_ObjectSetNameS(obj, AG_ShortFilename(path));
-	CAD_OpenObject(obj);
+	CAD_ImportStart(path, CAD_ImportObject, &cadPartClass);
 }
 
-/* Generate a new part from a mesh in PLY format. */
-static void
-OpenPartFromPLY(AG_Event *event)
+/* PLY import options (copied from the file dialog). */
+typedef struct cad_ply_options {
+	Uint flags;			/* Vertex attributes to load */
+	M_Real scale;			/* Scaling factor */
+	int weld;			/* Merge duplicate vertices */
+	float weldEps;			/* Duplicate vertex tolerance */
+	M_Real decimRatio;		/* Triangles to keep (%) */
+} CAD_PLYOptions;
+
+/* Generate a new part from a PLY mesh (runs in the background). */
+static int
+LoadPartFromPLY(CAD_Import *imp)
 {
-/*	AG_Object *fd = AG_SELF(); */
-	char *path = AG_STRING(1);
-	AG_FileType *ft = AG_PTR(2);
+	CAD_PLYOptions *opts = imp->arg;
 	CAD_Part *part;
-	Uint flags = 0;
 
 	part = Malloc(sizeof(CAD_Part));
 	AG_ObjectInit(part, &cadPartClass);
 	AG_ObjectSetName(part, "Imported object");
 	AGOBJECT(part)->flags |= AG_OBJECT_RESIDENT;
-	AG_ObjectAttach(&vfsRoot, part);
 
-	if (AG_FileOptionInt(ft, "ply.vtxnormals"))
-		flags |= SG_PLY_LOAD_VTX_NORMALS;
-	if (AG_FileOptionInt(ft, "ply.vtxcolors"))
-		flags |= SG_PLY_LOAD_VTX_COLORS;
-	if (AG_FileOptionInt(ft, "ply.texcoords"))
-		flags |= SG_PLY_LOAD_TEXCOORDS;
-	if (AG_FileOptionInt(ft, "ply.dups"))
-		flags |= SG_PLY_DUP_VERTICES;
+	if (CAD_MeshLoadPLY(&part->base, imp->path, opts->flags, opts->scale,
+	    &imp->prog) == -1) {
+		goto fail;
+	}
+	if (opts->weld) {
+		Uint nMerged;
+
+		if (CAD_MeshWeld(&part->base, opts->weldEps, &nMerged) == -1) {
+			goto fail;
+		}
+		snprintf(imp->info, sizeof(imp->info),
+		    _("%s: Merged %u duplicate vertices"),
+		    AG_ShortFilename(imp->path), nMerged);
+	}
+	if (opts->decimRatio < 100.0) {
+		Uint nTarget = (Uint)(part->base.nt*opts->decimRatio/100.0);
 
-	if (SG_ObjectLoadPLY(part->so, path, flags) == -1) {
+		if (CAD_MeshDecimate(&part->base, nTarget, 0.0, NULL,
+		    &imp->prog) == -1)
+			goto fail;
+	}
+	part->flags |= CAD_PART_REBUILD;
+	if (CAD_PartRegen(part) == -1) {
 		goto fail;
 	}
-	SG_Scale(part->so, AG_FileOptionFlt(ft,"ply.scale"));
-/*	SG_ObjectNormalize(part->so); */
-	CAD_OpenObject(part);
-	return;
+	CAD_ObjectModified(part);			/* Not saved yet */
+	imp->obj = part;
+	Free(opts);
+	return (0);
 fail:
-	AG_TextMsg(AG_MSG_ERROR, "%s: %s", path, AG_GetError());
-	AG_ObjectDestroy(part->so);
+	AG_ObjectDestroy(part);
+	Free(opts);
+	return (-1);
+}
+
+static void
+OpenPartFromPLY(AG_Event *event)
+{
+/*	AG_Object *fd = AG_SELF(); */
+	char *path = AG_STRING(1);
+	AG_FileType *ft = AG_PTR(2);
+	CAD_PLYOptions *opts;
+
+	opts = Malloc(sizeof(CAD_PLYOptions));
+	opts->flags = 0;
+	if (AG_FileOptionInt(ft, "ply.vtxnormals"))
+		opts->flags |= CAD_MESH_NORMALS;
+	if (AG_FileOptionInt(ft, "ply.vtxcolors"))
+		opts->flags |= CAD_MESH_COLORS;
+	if (AG_FileOptionInt(ft, "ply.texcoords"))
+		opts->flags |= CAD_MESH_TEXCOORDS;
+	opts->scale = AG_FileOptionFlt(ft, "ply.scale");
+	opts->weld = AG_FileOptionInt(ft, "ply.dups");
+	opts->weldEps = (float)AG_FileOptionFlt(ft, "ply.weld_eps");
+	opts->decimRatio = AG_FileOptionFlt(ft, "ply.decimate");
+
+	CAD_ImportStart(path, LoadPartFromPLY, opts);
 }
 
 void
@@ -311,6 +1566,179 @@ CAD_PartOpenMenu(AG_FileDlg *fd)
 	AG_FileOptionNewBool(ft, _("Load vertex colors"), "ply.vtxcolors", 1);
 	AG_FileOptionNewBool(ft, _("Load texture coords"), "ply.texcoords", 1);
 	AG_FileOptionNewBool(ft, _("Detect duplicate vertices"), "ply.dups", 1);
+	AG_FileOptionNewFlt(ft, _("Duplicate vertex tolerance"), "ply.weld_eps",
+	    0.0, 0.0, 1e3, NULL);
+	AG_FileOptionNewFlt(ft, _("Decimate to"), "ply.decimate",
+	    100.0, 0.01, 100.0, "%");
+}
+
+/* Decimation of the imported geometry in the background. */
+typedef struct cad_part_decim {
+	CAD_Part *part;				/* Part (NULL if destroyed) */
+	CAD_Import *op;
+	Uint nTarget;
+	M_Real maxError;
+	CAD_Mesh src;				/* View of base mesh */
+	CAD_MeshPin *srcPin;
+	CAD_Mesh m;				/* Simplified copy of base mesh */
+	Uint nRemoved;
+	size_t undoBudget;			/* Budget of undo journal */
+	CAD_UndoMesh undoBefore, undoAfter;	/* Payloads for undo */
+} CAD_PartDecim;
+
+/*
+ * Simplify a copy of the imported geometry (runs in the background). The
+ * source arrays are held with CAD_MeshAcquire(), and the part is flagged
+ * busy so the result is not installed over concurrent changes. The undo
+ * payloads of the previous and new mesh are prepared here as well.
+ */
+static int
+DecimateJob(CAD_Import *imp)
+{
+	CAD_PartDecim *dec = imp->arg;
+
+	CAD_UndoMeshPrepare(&dec->undoBefore, &dec->src, dec->undoBudget);
+	if (CAD_MeshAppend(&dec->m, &dec->src) == -1 ||
+	    CAD_MeshDecimate(&dec->m, dec->nTarget, dec->maxError,
+	    &dec->nRemoved, &imp->prog) == -1) {
+		return (-1);
+	}
+	if (dec->undoBefore.n > 0) {
+		CAD_UndoMeshPrepare(&dec->undoAfter, &dec->m,
+		    dec->undoBudget - dec->undoBefore.size);
+	}
+	return (0);
+}
+
+/*
+ * Replace the imported geometry of a part by the simplified mesh (which
+ * receives the previous geometry) and regenerate the part.
+ */
+static int
+InstallDecimated(CAD_Part *part, CAD_PartDecim *dec)
+{
+	CAD_Mesh tmp;
+
+	tmp = part->base;
+	part->base = dec->m;
+	dec->m = tmp;
+	if (CAD_UndoCommitMesh(part, _("Decimate"), &dec->undoBefore,
+	    &dec->undoAfter) == -1) {
+		Verbose("%s\n", AG_GetError());
+	}
+	CAD_ObjectModified(part);
+	part->flags |= CAD_PART_REBUILD|CAD_PART_MESH_DIRTY;
+	return CAD_PartRegen(part);
+}
+
+/*
+ * Stop the decimation of a part being destroyed. The operation finishes
+ * later on without the part.
+ */
+static void
+CancelDecimate(CAD_Part *part)
+{
+	CAD_PartDecim *dec = part->decim;
+
+	CAD_OperationCancel(dec->op);
+	dec->part = NULL;
+	part->decim = NULL;
+}
+
+static void
+FinishDecimate(CAD_Import *imp, int status, int cancel)
+{
+	CAD_PartDecim *dec = imp->arg;
+	CAD_Part *part = dec->part;
+
+	CAD_MeshRelease(dec->srcPin);
+	if (part == NULL) {
+		goto out;
+	}
+	part->flags &= ~(CAD_PART_BUSY);
+	part->decim = NULL;
+	if (cancel) {
+		goto out;
+	}
+	if (status != CAD_IMPORT_DONE) {
+		AG_TextMsg(AG_MSG_ERROR, "%s: %s", AGOBJECT(part)->name,
+		    imp->errMsg);
+		goto out;
+	}
+	if (InstallDecimated(part, dec) == -1) {
+		AG_TextMsgFromError();
+		goto out;
+	}
+	AG_TextTmsg(AG_MSG_INFO, 4000, _("Removed %u triangles (%u left)"),
+	    dec->nRemoved, part->base.nt);
+out:
+	CAD_UndoMeshFree(&dec->undoBefore);
+	CAD_UndoMeshFree(&dec->undoAfter);
+	CAD_MeshFree(&dec->m);
+	Free(dec);
+}
+
+static void
+DecimatePart(AG_Event *event)
+{
+	char caption[128];
+	CAD_Part *part = AG_PTR(1);
+	AG_Window *win = AG_PTR(2);
+	CAD_PartDecim *dec;
+
+	if (part->decimRatio <= 0.0 || part->decimRatio > 100.0) {
+		AG_TextMsgS(AG_MSG_ERROR, _("Ratio must be within 0-100%"));
+		return;
+	}
+	if (part->flags & CAD_PART_BUSY) {
+		AG_TextMsg(AG_MSG_ERROR, _("%s is being decimated"),
+		    AGOBJECT(part)->name);
+		return;
+	}
+	dec = Malloc(sizeof(CAD_PartDecim));
+	dec->part = part;
+	dec->nTarget = (Uint)(part->base.nt*part->decimRatio/100.0);
+	dec->maxError = part->decimError;
+	dec->srcPin = CAD_MeshAcquire(&part->base, &dec->src);
+	dec->nRemoved = 0;
+	CAD_MeshInit(&dec->m, part->base.flags);
+	dec->undoBudget = part->journal.maxSize;
+	CAD_UndoMeshInit(&dec->undoBefore);
+	CAD_UndoMeshInit(&dec->undoAfter);
+	part->flags |= CAD_PART_BUSY;
+	part->decim = dec;
+
+	snprintf(caption, sizeof(caption), _("Decimating %s"),
+	    AGOBJECT(part)->name);
+	dec->op = CAD_OperationStart(AGOBJECT(part)->name, caption,
+	    DecimateJob, FinishDecimate, dec);
+	AG_ObjectDetach(win);
+}
+
+static void
+ShowDecimateDlg(AG_Event *event)
+{
+	CAD_Part *part = AG_PTR(1);
+	AG_Window *win;
+	AG_Numerical *num;
+	AG_Box *hBox;
+
+	win = AG_WindowNew(0);
+	AG_WindowSetCaption(win, _("Decimate %s"), AGOBJECT(part)->name);
+
+	AG_LabelNew(win, 0, _("Imported triangles: %u"), part->base.nt);
+	num = AG_NumericalNew(win, AG_NUMERICAL_HFILL, "%",
+	    _("Triangles to keep: "));
+	M_BindReal(num, "value", &part->decimRatio);
+	num = AG_NumericalNew(win, AG_NUMERICAL_HFILL, "mm",
+	    _("Max. error (0=none): "));
+	M_BindReal(num, "value", &part->decimError);
+
+	hBox = AG_BoxNewHoriz(win, AG_BOX_HOMOGENOUS|AG_BOX_HFILL);
+	AG_ButtonNewFn(hBox, 0, _("Decimate"), DecimatePart, "%p,%p",
+	    part, win);
+	AG_ButtonNewFn(hBox, 0, _("Cancel"), AGWINDETACH(win));
+	AG_WindowShow(win);
 }
 
 static void *
@@ -324,6 +1752,10 @@ Edit(void *obj)
 	AG_Pane *hPane;
 	SG_View *sgv;
 
+	if (CAD_PartLoadMesh(part) == -1 || CAD_PartRegen(part) == -1) {
+		AG_TextMsgFromError();
+	}
+
 	win = AG_WindowNew(AG_WINDOW_MAIN);
 	AG_WindowSetCaptionS(win, AGOBJECT(part)->name);
 
@@ -343,8 +1775,16 @@ Edit(void *obj)
 	m = AG_MenuNode(menu->root, _("Features"), NULL);
 	{
 		AG_MenuAction(m, _("Extruded boss/base"), NULL,
-		    CAD_PartInsertFeature, "%p,%p,%s", part,
-		    &cadExtrudedBossClass, _("Extrusion"));
+		    CAD_PartInsertFeature, "%p,%p,%s,%u", part,
+		    &cadExtrudedBossClass, _("Extrusion"), CAD_FEATURE_UNION);
+		AG_MenuAction(m, _("Extruded cut"), NULL,
+		    CAD_PartInsertFeature, "%p,%p,%s,%u", part,
+		    &cadExtrudedBossClass, _("Cut"), CAD_FEATURE_CUT);
+	}
+	m = AG_MenuNode(menu->root, _("Mesh"), NULL);
+	{
+		AG_MenuAction(m, _("Decimate..."), NULL,
+		    ShowDecimateDlg, "%p", part);
 	}
 	m = AG_MenuNode(menu->root, _("View"), NULL);
 	{
@@ -377,16 +1817,19 @@ Edit(void *obj)
 
 		ntab = AG_NotebookAddTab(nb, _("Features"), AG_BOX_VERT);
 		{
-			tl = AG_TlistNew(ntab, AG_TLIST_POLL|AG_TLIST_TREE|
-			                       AG_TLIST_EXPAND);
-			AG_SetEvent(tl, "tlist-poll", PollFeatures, "%p", part);
+			tl = AG_TlistNew(ntab, AG_TLIST_TREE|AG_TLIST_EXPAND);
+			AG_SetEvent(tl, "tlist-dblclick", EditFeature, NULL);
 			AGWIDGET(tl)->flags &= ~(AG_WIDGET_FOCUSABLE);
+			InitFeatureList(tl, part);
+			AG_AddEvent(win, "detached", CloseFeatureList, "%p,%p",
+			    part, tl);
 		}
 
 		box = AG_BoxNew(hPane->div[1], AG_BOX_VERT, AG_BOX_EXPAND);
 		{
 			AG_ObjectAttach(box, sgv);
 			AG_WidgetFocus(sgv);
+			CAD_LODAttachView(part, sgv);
 		}
 		AG_ObjectAttach(hPane->div[1], toolbar);
 	}
@@ -399,7 +1842,7 @@ Edit(void *obj)
 AG_ObjectClass cadPartClass = {
 	"CAD_Part",
 	sizeof(CAD_Part),
-	{ 0,0 },
+	{ 0,1 },
 	Init,
 	NULL,			/* reinit */
 	Destroy,
@@ -12,15 +12,58 @@ typedef struct cad_part {
 
 	char descr[CAD_PART_DESCR_MAX];		/* Part description */
 	Uint32 flags;
+#define CAD_PART_REBUILD 0x80000000		/* Merged geometry is stale */
+#define CAD_PART_NOMESH	 0x40000000		/* Base mesh not loaded yet */
+#define CAD_PART_MESH_DIRTY 0x20000000		/* Base mesh changed since save */
+#define CAD_PART_BUSY	 0x10000000		/* Base mesh being decimated */
+#define CAD_PART_REMERGE 0x08000000		/* Feature list has changed */
+#define CAD_PART_SAVED	 0x0000ffff
 	SG *sg;					/* Rendering scene */
 	SG_Object *so;				/* Generated polygonal object */
-	AG_TAILQ_HEAD(,cad_feature) features;	/* Source features */
+	CAD_Mesh base;				/* Imported geometry */
+	const CAD_Mesh *body;			/* Merged geometry */
+	Uint64 baseKey;				/* Identifies base for merging */
+	CAD_Mesh kept;				/* Body of a detached feature */
+	Uint64 keptKey;
+	CAD_MeshCache cache;			/* Tessellation cache */
+	CAD_LOD lod;				/* Simplified levels for display */
+	CAD_BVH bvh;				/* Spatial index (see CAD_PartBVH) */
+	M_Real decimRatio;			/* Decimation settings */
+	M_Real decimError;
+	struct cad_part_decim *decim;		/* Running decimation (or NULL) */
+	CAD_Journal journal;			/* Undo history */
+	CAD_Generation gen;			/* Change tracking */
+	CAD_NameIndex names;			/* Names of child objects */
+	CAD_PartFile *file;			/* Contents of last saved file */
+	CAD_PartCompact *compact;		/* Compaction of file (or NULL) */
+	AG_Timer compactTimer;
+	CAD_Arena ftArena;			/* Storage for features */
+	CAD_Arena scratch;			/* Temporary regen buffers */
+	struct ag_tlist **ftViews;		/* Open feature lists */
+	Uint nFtViews;
+	AG_TAILQ_HEAD(cad_featureq,cad_feature) features; /* Source features */
 } CAD_Part;
 
+/* Flags for CAD_PartLoad(). */
+#define CAD_PART_LOAD_FEATURES	0x01		/* Load the feature tree */
+#define CAD_PART_LOAD_MESH	0x02		/* Load the imported geometry */
+#define CAD_PART_LOAD_ALL	(CAD_PART_LOAD_FEATURES|CAD_PART_LOAD_MESH)
+
 __BEGIN_DECLS
 extern AG_ObjectClass cadPartClass;
 
+int  CAD_PartRegen(CAD_Part *);
+Uint CAD_PartCheckInputs(CAD_Part *);
+void CAD_PartsCheckInputs(void);
+const CAD_Mesh *CAD_PartMesh(const CAD_Part *);
+const CAD_BVH *CAD_PartBVH(CAD_Part *);
+int  CAD_PartLoad(CAD_Part *, const char *, Uint);
+int  CAD_PartLoadMesh(CAD_Part *);
+int  CAD_PartSave(CAD_Part *, const char *);
+int  CAD_PartRecover(CAD_Part *, const char *, const char *);
+int  CAD_PartReadInfo(const CAD_PartFile *, char *, size_t, Uint *);
 void CAD_PartInsertFeature(AG_Event *);
+void CAD_PartRenamed(CAD_Part *, void *);
 void CAD_PartSaveMenu(AG_FileDlg *, CAD_Part *);
 void CAD_PartOpenMenu(AG_FileDlg *);
 __END_DECLS
@@ -0,0 +1,966 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Native .part container. The file starts with a fixed size header which
+ * gives the location of a table of contents, written at the end of the
+ * file. Every piece of the document (the part dataset, each feature, the
+ * imported geometry, a low resolution preview and each cached
+ * tessellation) is stored in a chunk of its own, so that a reader only
+ * has to fetch the header, the table of contents and the chunks it is
+ * interested in.
+ *
+ *	Header:	magic[8], major, minor (32-bit), TOC offset, TOC size (64-bit)
+ *	TOC:	count (32-bit), then type, name, class, offset, size, hash
+ *
+ * The header and the table of contents are in network byte order. Mesh
+ * chunks hold the arrays in host byte order (as in the cache sidecar),
+ * prefixed by a byte order mark.
+ *
+ * A file can also be updated in place: changed chunks and a new table of
+ * contents are appended, and the header is rewritten last to point to
+ * them. Until then, the previous header and table of contents remain
+ * valid. Chunks which are no longer referenced are reclaimed by
+ * compaction, which copies the live chunks to a new file in the
+ * background. The table of contents is synced to disk before the header
+ * is written, and the header before the file is closed or renamed.
+ *
+ * Chunks are read by reopening the file, so an open file records the
+ * identity of the file it was read from (device, inode, modification
+ * time and size). Chunks are not read from a file which has changed.
+ */
+
+#include <agar/core.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "cadtools.h"
+
+#define PARTFILE_BYTEORDER	0x01020304
+#define PARTFILE_TOC_MAX	(64*1024*1024)	/* Sanity limit on TOC size */
+#define PARTFILE_BUFSIZE	65536
+
+/* Return 1 if the file at path is in the native chunked format. */
+int
+CAD_PartFileProbe(const char *path)
+{
+	char magic[8];
+	AG_DataSource *ds;
+	int rv;
+
+	if ((ds = AG_OpenFile(path, "rb")) == NULL) {
+		return (0);
+	}
+	rv = (AG_Read(ds, magic, sizeof(magic)) == 0 &&
+	      memcmp(magic, CAD_PART_FILE_MAGIC, sizeof(magic)) == 0);
+	AG_CloseFile(ds);
+	return (rv);
+}
+
+/* Record the identity of the file at path in pf. */
+static int
+GetIdentity(CAD_PartFile *pf, const char *path)
+{
+	struct stat sb;
+
+	if (stat(path, &sb) == -1) {
+		AG_SetError("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+	pf->dev = (Uint64)sb.st_dev;
+	pf->ino = (Uint64)sb.st_ino;
+	pf->mtime = (Uint64)sb.st_mtime;
+	pf->fileSize = (Uint64)sb.st_size;
+	return (0);
+}
+
+/*
+ * Return -1 if the file has been replaced or modified since its table of
+ * contents was read (or written by us).
+ */
+static int
+CheckIdentity(const CAD_PartFile *pf)
+{
+	CAD_PartFile cur;
+
+	if (GetIdentity(&cur, pf->path) == -1) {
+		return (-1);
+	}
+	if (cur.dev != pf->dev || cur.ino != pf->ino ||
+	    cur.mtime != pf->mtime || cur.fileSize != pf->fileSize) {
+		AG_SetError(_("%s: File has changed on disk"), pf->path);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Read the header and table of contents of a .part file. Chunk contents
+ * are only read on request.
+ */
+CAD_PartFile *
+CAD_PartFileOpen(const char *path)
+{
+	char magic[8];
+	CAD_PartFile *pf;
+	AG_DataSource *ds, *toc = NULL;
+	Uint64 tocOffs, tocSize;
+	Uint8 *buf = NULL;
+	Uint i;
+
+	if ((ds = AG_OpenFile(path, "rb")) == NULL) {
+		return (NULL);
+	}
+	pf = Malloc(sizeof(CAD_PartFile));
+	Strlcpy(pf->path, path, sizeof(pf->path));
+	pf->chunks = NULL;
+	pf->nChunks = 0;
+
+	/* Stat after opening, so that a replaced file cannot pass for ds. */
+	if (GetIdentity(pf, path) == -1) {
+		goto fail;
+	}
+	if (AG_Read(ds, magic, sizeof(magic)) == -1 ||
+	    memcmp(magic, CAD_PART_FILE_MAGIC, sizeof(magic)) != 0) {
+		AG_SetError(_("%s: Not a cadtools part file"), path);
+		goto fail;
+	}
+	pf->ver.major = (Uint)AG_ReadUint32(ds);
+	pf->ver.minor = (Uint)AG_ReadUint32(ds);
+	if (pf->ver.major != CAD_PART_FILE_MAJOR) {
+		AG_SetError(_("%s: Unsupported file version %u.%u"), path,
+		    pf->ver.major, pf->ver.minor);
+		goto fail;
+	}
+	tocOffs = AG_ReadUint64(ds);
+	tocSize = AG_ReadUint64(ds);
+	if (tocOffs < CAD_PART_FILE_HDR || tocSize < 4 ||
+	    tocSize > PARTFILE_TOC_MAX) {
+		AG_SetError(_("%s: Bad table of contents"), path);
+		goto fail;
+	}
+	pf->tocOffs = tocOffs;
+	pf->size = tocOffs + tocSize;
+	buf = Malloc((size_t)tocSize);
+	if (AG_Seek(ds, (long)tocOffs, AG_SEEK_SET) == -1 ||
+	    AG_Read(ds, buf, (size_t)tocSize) == -1) {
+		AG_SetError(_("%s: Truncated file"), path);
+		goto fail;
+	}
+	if ((toc = AG_OpenConstCore(buf, (size_t)tocSize)) == NULL) {
+		goto fail;
+	}
+	pf->nChunks = (Uint)AG_ReadUint32(toc);
+	if (pf->nChunks > tocSize/32) {
+		AG_SetError(_("%s: Bad table of contents"), path);
+		goto fail;
+	}
+	pf->chunks = Malloc((pf->nChunks+1)*sizeof(CAD_PartChunk));
+	for (i = 0; i < pf->nChunks; i++) {
+		CAD_PartChunk *c = &pf->chunks[i];
+
+		c->type = AG_ReadUint32(toc);
+		AG_CopyString(c->name, toc, sizeof(c->name));
+		AG_CopyString(c->cls, toc, sizeof(c->cls));
+		c->offs = AG_ReadUint64(toc);
+		c->size = AG_ReadUint64(toc);
+		c->hash = AG_ReadUint64(toc);
+		if (c->offs < CAD_PART_FILE_HDR || c->offs > tocOffs ||
+		    c->size > tocOffs - c->offs) {
+			AG_SetError(_("%s: Bad chunk (%s)"), path, c->name);
+			goto fail;
+		}
+	}
+	AG_CloseCore(toc);
+	AG_CloseFile(ds);
+	Free(buf);
+	return (pf);
+fail:
+	if (toc != NULL) {
+		AG_CloseCore(toc);
+	}
+	AG_CloseFile(ds);
+	Free(buf);
+	CAD_PartFileClose(pf);
+	return (NULL);
+}
+
+void
+CAD_PartFileClose(CAD_PartFile *pf)
+{
+	Free(pf->chunks);
+	Free(pf);
+}
+
+/*
+ * Return the number of bytes in the file which are no longer referenced
+ * by the table of contents.
+ */
+Uint64
+CAD_PartFileGarbage(const CAD_PartFile *pf)
+{
+	Uint64 live = CAD_PART_FILE_HDR + (pf->size - pf->tocOffs);
+	Uint i;
+
+	for (i = 0; i < pf->nChunks; i++) {
+		live += pf->chunks[i].size;
+	}
+	return (pf->size > live) ? (pf->size - live) : 0;
+}
+
+/*
+ * Look up a chunk by type and name. If name is NULL, return the first
+ * chunk of the given type.
+ */
+const CAD_PartChunk *
+CAD_PartFileFind(const CAD_PartFile *pf, Uint32 type, const char *name)
+{
+	Uint i;
+
+	for (i = 0; i < pf->nChunks; i++) {
+		const CAD_PartChunk *c = &pf->chunks[i];
+
+		if (c->type == type &&
+		    (name == NULL || strcmp(c->name, name) == 0))
+			return (c);
+	}
+	return (NULL);
+}
+
+/*
+ * Open the file at the start of a chunk. The identity of the file is
+ * checked after it is opened, so a file replaced in between is detected.
+ */
+static AG_DataSource *
+OpenChunk(const CAD_PartFile *pf, const CAD_PartChunk *c)
+{
+	AG_DataSource *ds;
+
+	if ((ds = AG_OpenFile(pf->path, "rb")) == NULL) {
+		return (NULL);
+	}
+	if (CheckIdentity(pf) == -1) {
+		AG_CloseFile(ds);
+		return (NULL);
+	}
+	if (AG_Seek(ds, (long)c->offs, AG_SEEK_SET) == -1) {
+		AG_CloseFile(ds);
+		return (NULL);
+	}
+	return (ds);
+}
+
+/*
+ * Read the contents of a chunk into memory. The returned data source
+ * must be closed with AG_CloseAutoCore().
+ */
+AG_DataSource *
+CAD_PartFileReadChunk(const CAD_PartFile *pf, const CAD_PartChunk *c)
+{
+	Uint8 buf[PARTFILE_BUFSIZE];
+	AG_DataSource *ds, *mem;
+	Uint64 left = c->size;
+	size_t n;
+
+	if ((ds = OpenChunk(pf, c)) == NULL) {
+		return (NULL);
+	}
+	if ((mem = AG_OpenAutoCore()) == NULL) {
+		AG_CloseFile(ds);
+		return (NULL);
+	}
+	while (left > 0) {
+		n = (left > sizeof(buf)) ? sizeof(buf) : (size_t)left;
+		if (AG_Read(ds, buf, n) == -1 ||
+		    AG_Write(mem, buf, n) == -1) {
+			AG_SetError(_("%s: Cannot read chunk %s"), pf->path,
+			    c->name);
+			AG_CloseAutoCore(mem);
+			AG_CloseFile(ds);
+			return (NULL);
+		}
+		left -= n;
+	}
+	AG_CloseFile(ds);
+	AG_Seek(mem, 0, AG_SEEK_SET);
+	return (mem);
+}
+
+/*
+ * Read a mesh chunk directly into the arrays of m. Chunks referencing
+ * vertices beyond their vertex count are rejected.
+ */
+int
+CAD_PartFileReadMesh(const CAD_PartFile *pf, const CAD_PartChunk *c,
+    CAD_Mesh *m)
+{
+	AG_DataSource *ds;
+	Uint32 hdr[4];
+	Uint64 nv, size, i;
+
+	if ((ds = OpenChunk(pf, c)) == NULL) {
+		return (-1);
+	}
+	if (c->size < sizeof(hdr) || AG_Read(ds, hdr, sizeof(hdr)) == -1 ||
+	    hdr[0] != PARTFILE_BYTEORDER) {
+		AG_SetError(_("%s: Unusable mesh chunk (%s)"), pf->path,
+		    c->name);
+		goto fail;
+	}
+	nv = (Uint64)hdr[2];
+	size = nv*3*sizeof(float) + (Uint64)hdr[3]*3*sizeof(Uint32);
+	if (hdr[1] & CAD_MESH_NORMALS) { size += nv*3*sizeof(float); }
+	if (hdr[1] & CAD_MESH_COLORS) { size += nv*4; }
+	if (hdr[1] & CAD_MESH_TEXCOORDS) { size += nv*2*sizeof(float); }
+	if (size != c->size - sizeof(hdr)) {
+		AG_SetError(_("%s: Bad mesh chunk (%s)"), pf->path, c->name);
+		goto fail;
+	}
+	CAD_MeshReset(m, (Uint)hdr[1]);
+	if (CAD_MeshReserve(m, (Uint)hdr[2], (Uint)hdr[3]) == -1) {
+		goto fail;
+	}
+	if (AG_Read(ds, m->v, hdr[2]*3*sizeof(float)) == -1 ||
+	    ((m->flags & CAD_MESH_NORMALS) &&
+	     AG_Read(ds, m->n, hdr[2]*3*sizeof(float)) == -1) ||
+	    ((m->flags & CAD_MESH_COLORS) &&
+	     AG_Read(ds, m->c, hdr[2]*4) == -1) ||
+	    ((m->flags & CAD_MESH_TEXCOORDS) &&
+	     AG_Read(ds, m->st, hdr[2]*2*sizeof(float)) == -1) ||
+	    AG_Read(ds, m->tri, hdr[3]*3*sizeof(Uint32)) == -1) {
+		AG_SetError(_("%s: Truncated mesh chunk (%s)"), pf->path,
+		    c->name);
+		goto fail;
+	}
+	for (i = 0; i < (Uint64)hdr[3]*3; i++) {
+		if (m->tri[i] >= hdr[2]) {
+			AG_SetError(_("%s: Bad vertex index in mesh chunk (%s)"),
+			    pf->path, c->name);
+			goto fail;
+		}
+	}
+	m->nv = (Uint)hdr[2];
+	m->nt = (Uint)hdr[3];
+	AG_CloseFile(ds);
+	return (0);
+fail:
+	AG_CloseFile(ds);
+	return (-1);
+}
+
+static int
+OpenOutput(CAD_PartWriter *w, const char *path, const char *mode)
+{
+	if ((w->f = fopen(path, mode)) == NULL) {
+		AG_SetError("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+	if ((w->ds = AG_OpenFileHandle(w->f)) == NULL) {
+		fclose(w->f);
+		w->f = NULL;
+		return (-1);
+	}
+	return (0);
+}
+
+/* Flush the output file to disk. */
+static int
+SyncOutput(CAD_PartWriter *w)
+{
+	if (fflush(w->f) != 0 || fsync(fileno(w->f)) == -1) {
+		AG_SetError("%s: %s", w->tmpPath, strerror(errno));
+		return (-1);
+	}
+	return (0);
+}
+
+/* Close the output file, reporting any error from the close itself. */
+static int
+CloseOutput(CAD_PartWriter *w)
+{
+	int rv = 0;
+
+	if (w->ds == NULL) {
+		return (0);
+	}
+	AG_CloseFileHandle(w->ds);
+	w->ds = NULL;
+	if (fclose(w->f) != 0) {
+		AG_SetError("%s: %s", w->tmpPath, strerror(errno));
+		rv = -1;
+	}
+	w->f = NULL;
+	return (rv);
+}
+
+/*
+ * Start writing a .part file. The data is written to a temporary file
+ * which replaces the destination in CAD_PartWriterCommit().
+ */
+int
+CAD_PartWriterOpen(CAD_PartWriter *w, const char *path)
+{
+	Uint8 hdr[CAD_PART_FILE_HDR];
+
+	Strlcpy(w->path, path, sizeof(w->path));
+	Strlcpy(w->tmpPath, path, sizeof(w->tmpPath));
+	Strlcat(w->tmpPath, ".new", sizeof(w->tmpPath));
+	if (OpenOutput(w, w->tmpPath, "wb") == -1) {
+		return (-1);
+	}
+	w->prev = NULL;
+	w->chunks = NULL;
+	w->nChunks = 0;
+	w->maxChunks = 0;
+
+	/* Reserve space for the header, written on commit. */
+	memset(hdr, 0, sizeof(hdr));
+	if (AG_Write(w->ds, hdr, sizeof(hdr)) == -1) {
+		CAD_PartWriterAbort(w);
+		return (-1);
+	}
+	w->offs = sizeof(hdr);
+	return (0);
+}
+
+/*
+ * Start updating an existing file in place. New chunks are appended;
+ * chunks of the existing file which are written again unchanged, or are
+ * copied with CAD_PartWriterCopy(), are referenced where they are. This
+ * fails if the file has changed on disk since pf was read.
+ */
+int
+CAD_PartWriterAppend(CAD_PartWriter *w, const CAD_PartFile *pf)
+{
+	long end;
+
+	Strlcpy(w->path, pf->path, sizeof(w->path));
+	Strlcpy(w->tmpPath, pf->path, sizeof(w->tmpPath));
+	if (CheckIdentity(pf) == -1 ||
+	    OpenOutput(w, pf->path, "r+b") == -1) {
+		return (-1);
+	}
+	w->prev = pf;
+	w->chunks = NULL;
+	w->nChunks = 0;
+	w->maxChunks = 0;
+	if (AG_Seek(w->ds, 0, AG_SEEK_END) == -1 ||
+	    (end = AG_Tell(w->ds)) == -1) {
+		CAD_PartWriterAbort(w);
+		return (-1);
+	}
+	w->offs = (Uint64)end;
+	return (0);
+}
+
+static CAD_PartChunk *
+AddChunk(CAD_PartWriter *w)
+{
+	if (w->nChunks+1 > w->maxChunks) {
+		w->maxChunks = (w->maxChunks > 0) ? w->maxChunks*2 : 16;
+		w->chunks = Realloc(w->chunks,
+		    w->maxChunks*sizeof(CAD_PartChunk));
+	}
+	return (&w->chunks[w->nChunks++]);
+}
+
+static CAD_PartChunk *
+BeginChunk(CAD_PartWriter *w, Uint32 type, const char *name, const char *cls)
+{
+	CAD_PartChunk *c;
+
+	c = AddChunk(w);
+	c->type = type;
+	Strlcpy(c->name, (name != NULL) ? name : "", sizeof(c->name));
+	Strlcpy(c->cls, (cls != NULL) ? cls : "", sizeof(c->cls));
+	c->offs = w->offs;
+	c->size = 0;
+	c->hash = CAD_HASH_INIT;
+	return (c);
+}
+
+static int
+WriteData(CAD_PartWriter *w, CAD_PartChunk *c, const void *p, size_t len)
+{
+	if (len == 0) {
+		return (0);
+	}
+	if (AG_Write(w->ds, p, len) == -1) {
+		AG_SetError("%s: %s", w->tmpPath, AG_GetError());
+		return (-1);
+	}
+	c->hash = CAD_HashBytes(c->hash, p, len);
+	c->size += len;
+	w->offs += len;
+	return (0);
+}
+
+/*
+ * Write a chunk from a memory buffer. When updating a file in place, a
+ * chunk identical to the existing one is not written again.
+ */
+int
+CAD_PartWriterChunk(CAD_PartWriter *w, Uint32 type, const char *name,
+    const char *cls, const void *data, size_t len)
+{
+	const CAD_PartChunk *cPrev;
+	CAD_PartChunk *c;
+
+	if (w->prev != NULL &&
+	    (cPrev = CAD_PartFileFind(w->prev, type, name)) != NULL &&
+	    cPrev->size == len &&
+	    cPrev->hash == CAD_HashBytes(CAD_HASH_INIT, data, len) &&
+	    strcmp(cPrev->cls, (cls != NULL) ? cls : "") == 0) {
+		c = AddChunk(w);
+		*c = *cPrev;
+		return (0);
+	}
+	c = BeginChunk(w, type, name, cls);
+	return WriteData(w, c, data, len);
+}
+
+/* Return the size and hash of the mesh chunk that would be written. */
+static Uint64
+MeshChunkHash(const Uint32 *hdr, const CAD_Mesh *m, Uint64 *size)
+{
+	Uint64 h;
+
+	h = CAD_HashBytes(CAD_HASH_INIT, hdr, 4*sizeof(Uint32));
+	h = CAD_HashBytes(h, m->v, m->nv*3*sizeof(float));
+	*size = 4*sizeof(Uint32) + m->nv*3*sizeof(float) +
+	    m->nt*3*sizeof(Uint32);
+	if (m->flags & CAD_MESH_NORMALS) {
+		h = CAD_HashBytes(h, m->n, m->nv*3*sizeof(float));
+		*size += m->nv*3*sizeof(float);
+	}
+	if (m->flags & CAD_MESH_COLORS) {
+		h = CAD_HashBytes(h, m->c, m->nv*4);
+		*size += m->nv*4;
+	}
+	if (m->flags & CAD_MESH_TEXCOORDS) {
+		h = CAD_HashBytes(h, m->st, m->nv*2*sizeof(float));
+		*size += m->nv*2*sizeof(float);
+	}
+	return CAD_HashBytes(h, m->tri, m->nt*3*sizeof(Uint32));
+}
+
+/*
+ * Write a mesh chunk straight from the arrays of m. When updating a file
+ * in place, an identical mesh chunk is not written again.
+ */
+int
+CAD_PartWriterMesh(CAD_PartWriter *w, Uint32 type, const char *name,
+    const CAD_Mesh *m)
+{
+	const CAD_PartChunk *cPrev;
+	CAD_PartChunk *c;
+	Uint32 hdr[4];
+	Uint64 size;
+
+	hdr[0] = PARTFILE_BYTEORDER;
+	hdr[1] = (Uint32)m->flags;
+	hdr[2] = (Uint32)m->nv;
+	hdr[3] = (Uint32)m->nt;
+	if (w->prev != NULL &&
+	    (cPrev = CAD_PartFileFind(w->prev, type, name)) != NULL &&
+	    cPrev->hash == MeshChunkHash(hdr, m, &size) &&
+	    cPrev->size == size) {
+		c = AddChunk(w);
+		*c = *cPrev;
+		return (0);
+	}
+	c = BeginChunk(w, type, name, NULL);
+	if (WriteData(w, c, hdr, sizeof(hdr)) == -1 ||
+	    WriteData(w, c, m->v, m->nv*3*sizeof(float)) == -1 ||
+	    ((m->flags & CAD_MESH_NORMALS) &&
+	     WriteData(w, c, m->n, m->nv*3*sizeof(float)) == -1) ||
+	    ((m->flags & CAD_MESH_COLORS) &&
+	     WriteData(w, c, m->c, m->nv*4) == -1) ||
+	    ((m->flags & CAD_MESH_TEXCOORDS) &&
+	     WriteData(w, c, m->st, m->nv*2*sizeof(float)) == -1) ||
+	    WriteData(w, c, m->tri, m->nt*3*sizeof(Uint32)) == -1)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Copy a chunk unchanged from an existing file. If the file is the one
+ * being updated, the chunk is simply referenced again.
+ */
+int
+CAD_PartWriterCopy(CAD_PartWriter *w, const CAD_PartFile *pf,
+    const CAD_PartChunk *cSrc)
+{
+	Uint8 buf[PARTFILE_BUFSIZE];
+	CAD_PartChunk *c;
+	AG_DataSource *ds;
+	Uint64 left = cSrc->size;
+	size_t n;
+
+	if (pf == w->prev) {
+		c = AddChunk(w);
+		*c = *cSrc;
+		return (0);
+	}
+	if ((ds = OpenChunk(pf, cSrc)) == NULL) {
+		return (-1);
+	}
+	c = BeginChunk(w, cSrc->type, cSrc->name, cSrc->cls);
+	while (left > 0) {
+		n = (left > sizeof(buf)) ? sizeof(buf) : (size_t)left;
+		if (AG_Read(ds, buf, n) == -1 ||
+		    WriteData(w, c, buf, n) == -1) {
+			AG_CloseFile(ds);
+			return (-1);
+		}
+		left -= n;
+	}
+	AG_CloseFile(ds);
+	return (0);
+}
+
+/*
+ * Append the table of contents and write the header, which makes the
+ * new contents visible to readers. The chunks and the table of contents
+ * reach the disk before the header does.
+ */
+static int
+WriteTOC(CAD_PartWriter *w)
+{
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+	Uint64 tocOffs = w->offs;
+	Uint i;
+
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	AG_WriteUint32(ds, (Uint32)w->nChunks);
+	for (i = 0; i < w->nChunks; i++) {
+		CAD_PartChunk *c = &w->chunks[i];
+
+		AG_WriteUint32(ds, c->type);
+		AG_WriteString(ds, c->name);
+		AG_WriteString(ds, c->cls);
+		AG_WriteUint64(ds, c->offs);
+		AG_WriteUint64(ds, c->size);
+		AG_WriteUint64(ds, c->hash);
+	}
+	cs = AG_CORE_SOURCE(ds);
+	if (AG_Write(w->ds, cs->data, cs->size) == -1) {
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	w->tocOffs = tocOffs;
+	w->offs += cs->size;
+	if (SyncOutput(w) == -1) {
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	AG_Seek(ds, 0, AG_SEEK_SET);
+	AG_Write(ds, CAD_PART_FILE_MAGIC, 8);
+	AG_WriteUint32(ds, CAD_PART_FILE_MAJOR);
+	AG_WriteUint32(ds, CAD_PART_FILE_MINOR);
+	AG_WriteUint64(ds, tocOffs);
+	AG_WriteUint64(ds, (Uint64)(cs->size));
+	if (AG_Seek(w->ds, 0, AG_SEEK_SET) == -1 ||
+	    AG_Write(w->ds, cs->data, CAD_PART_FILE_HDR) == -1 ||
+	    SyncOutput(w) == -1) {
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	AG_CloseAutoCore(ds);
+	return CloseOutput(w);
+}
+
+/*
+ * Return the table of contents of a written file, once it is in place
+ * under its final name.
+ */
+static CAD_PartFile *
+WrittenFile(CAD_PartWriter *w)
+{
+	CAD_PartFile *pf;
+
+	pf = Malloc(sizeof(CAD_PartFile));
+	if (GetIdentity(pf, w->path) == -1) {
+		Free(pf);
+		Free(w->chunks);
+		w->chunks = NULL;
+		w->nChunks = 0;
+		return (NULL);
+	}
+	Strlcpy(pf->path, w->path, sizeof(pf->path));
+	pf->ver.major = CAD_PART_FILE_MAJOR;
+	pf->ver.minor = CAD_PART_FILE_MINOR;
+	pf->chunks = w->chunks;
+	pf->nChunks = w->nChunks;
+	pf->tocOffs = w->tocOffs;
+	pf->size = w->offs;
+	w->chunks = NULL;
+	w->nChunks = 0;
+	return (pf);
+}
+
+/*
+ * Write the table of contents and header, and move the file into place.
+ * On success, return the table of contents of the new file.
+ */
+CAD_PartFile *
+CAD_PartWriterCommit(CAD_PartWriter *w)
+{
+	if (WriteTOC(w) == -1) {
+		goto fail;
+	}
+	if (w->prev == NULL && rename(w->tmpPath, w->path) == -1) {
+		AG_SetError("%s: %s", w->path, strerror(errno));
+		goto fail;
+	}
+	return WrittenFile(w);
+fail:
+	CAD_PartWriterAbort(w);
+	return (NULL);
+}
+
+/*
+ * Discard a file being written. A file being updated in place is left
+ * with its previous contents.
+ */
+void
+CAD_PartWriterAbort(CAD_PartWriter *w)
+{
+	(void)CloseOutput(w);
+	if (w->prev == NULL) {
+		AG_FileDelete(w->tmpPath);
+	}
+	Free(w->chunks);
+	w->chunks = NULL;
+	w->nChunks = 0;
+}
+
+static void
+CompactJob(void *p)
+{
+	CAD_PartCompact *pc = p;
+	CAD_PartWriter *w = &pc->w;
+	Uint i;
+	int rv = -1;
+
+	if (CAD_PartWriterOpen(w, pc->src->path) == -1) {
+		goto out;
+	}
+	for (i = 0; i < pc->src->nChunks; i++) {
+		if (CAD_PartWriterCopy(w, pc->src, &pc->src->chunks[i]) == -1)
+			goto fail;
+	}
+	if (WriteTOC(w) == -1) {
+		goto fail;
+	}
+	rv = 0;
+	goto out;
+fail:
+	CAD_PartWriterAbort(w);
+out:
+	AG_MutexLock(&pc->lock);
+	if (rv == -1) {
+		Strlcpy(pc->errMsg, AG_GetError(), sizeof(pc->errMsg));
+	}
+	pc->status = (rv == 0) ? CAD_PART_COMPACT_DONE :
+	                         CAD_PART_COMPACT_FAILED;
+	AG_MutexUnlock(&pc->lock);
+}
+
+/*
+ * Start copying the live chunks of a file to a new file on the job pool.
+ * The existing file is only read. The new file is put in place by
+ * CAD_PartCompactFinish().
+ */
+CAD_PartCompact *
+CAD_PartCompactStart(const CAD_PartFile *pf)
+{
+	CAD_PartCompact *pc;
+
+	pc = Malloc(sizeof(CAD_PartCompact));
+	AG_MutexInit(&pc->lock);
+	pc->status = CAD_PART_COMPACT_RUNNING;
+	pc->errMsg[0] = '\0';
+
+	/* Work on a copy of the table of contents. */
+	pc->src = Malloc(sizeof(CAD_PartFile));
+	memcpy(pc->src, pf, sizeof(CAD_PartFile));
+	pc->src->chunks = Malloc((pf->nChunks+1)*sizeof(CAD_PartChunk));
+	memcpy(pc->src->chunks, pf->chunks, pf->nChunks*sizeof(CAD_PartChunk));
+
+	CAD_JobGroupInit(&pc->group);
+	CAD_JobSubmit(&pc->group, CompactJob, pc);
+	return (pc);
+}
+
+/* Return 1 if the compaction job has completed. */
+int
+CAD_PartCompactDone(CAD_PartCompact *pc)
+{
+	int rv;
+
+	AG_MutexLock(&pc->lock);
+	rv = (pc->status != CAD_PART_COMPACT_RUNNING);
+	AG_MutexUnlock(&pc->lock);
+	return (rv);
+}
+
+/*
+ * Wait for compaction to complete and replace the original file with the
+ * compacted one, unless the original has changed in the meantime. Return
+ * the table of contents of the new file, or NULL (with the original file
+ * left intact) on failure.
+ */
+CAD_PartFile *
+CAD_PartCompactFinish(CAD_PartCompact *pc)
+{
+	CAD_PartFile *pf = NULL;
+
+	CAD_JobGroupWait(&pc->group);
+	CAD_JobGroupDestroy(&pc->group);
+
+	if (pc->status == CAD_PART_COMPACT_DONE) {
+		if (CheckIdentity(pc->src) == -1) {
+			CAD_PartWriterAbort(&pc->w);
+		} else if (rename(pc->w.tmpPath, pc->w.path) == -1) {
+			AG_SetError("%s: %s", pc->w.path, strerror(errno));
+			CAD_PartWriterAbort(&pc->w);
+		} else {
+			pf = WrittenFile(&pc->w);
+		}
+	} else {
+		AG_SetError("%s", pc->errMsg);
+	}
+	AG_MutexDestroy(&pc->lock);
+	CAD_PartFileClose(pc->src);
+	Free(pc);
+	return (pf);
+}
+
+/*
+ * Write the dataset of an object, preceded by the version of each class
+ * in its inheritance hierarchy, in the form expected by
+ * CAD_ObjectReadChunk().
+ */
+int
+CAD_ObjectWriteDataset(AG_DataSource *ds, void *p)
+{
+	AG_Object *obj = p;
+	AG_ObjectClass **hier;
+	int i, nHier, rv = -1;
+
+	if (AG_ObjectGetInheritHier(obj, &hier, &nHier) == -1) {
+		return (-1);
+	}
+	AG_WriteUint8(ds, (Uint8)nHier);
+	for (i = 0; i < nHier; i++) {
+		AG_WriteUint32(ds, (Uint32)hier[i]->ver.major);
+		AG_WriteUint32(ds, (Uint32)hier[i]->ver.minor);
+	}
+	for (i = 0; i < nHier; i++) {
+		if (hier[i]->save != NULL && hier[i]->save(obj, ds) == -1)
+			goto out;
+	}
+	rv = 0;
+out:
+	Free(hier);
+	return (rv);
+}
+
+/* Write the dataset of an object to a chunk of its own. */
+int
+CAD_ObjectWriteChunk(CAD_PartWriter *w, Uint32 type, void *p)
+{
+	AG_Object *obj = p;
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+	int rv = -1;
+
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	if (CAD_ObjectWriteDataset(ds, obj) == 0) {
+		cs = AG_CORE_SOURCE(ds);
+		rv = CAD_PartWriterChunk(w, type, obj->name, obj->cls->hier,
+		    cs->data, cs->size);
+	}
+	AG_CloseAutoCore(ds);
+	return (rv);
+}
+
+/* Load the dataset of an object from a chunk. */
+int
+CAD_ObjectReadChunk(const CAD_PartFile *pf, const CAD_PartChunk *c, void *p)
+{
+	AG_Object *obj = p;
+	AG_ObjectClass **hier;
+	AG_Version *vers = NULL;
+	AG_DataSource *ds;
+	int i, nHier, rv = -1;
+
+	if (AG_ObjectGetInheritHier(obj, &hier, &nHier) == -1) {
+		return (-1);
+	}
+	if ((ds = CAD_PartFileReadChunk(pf, c)) == NULL) {
+		goto out;
+	}
+	if ((int)AG_ReadUint8(ds) != nHier) {
+		AG_SetError(_("%s: Class mismatch"), c->name);
+		goto out_close;
+	}
+	vers = Malloc(nHier*sizeof(AG_Version));
+	for (i = 0; i < nHier; i++) {
+		vers[i].major = (Uint)AG_ReadUint32(ds);
+		vers[i].minor = (Uint)AG_ReadUint32(ds);
+		if (vers[i].major != hier[i]->ver.major) {
+			AG_SetError(_("%s: Incompatible %s version (%u.%u)"),
+			    c->name, hier[i]->hier, vers[i].major,
+			    vers[i].minor);
+			goto out_close;
+		}
+	}
+	for (i = 0; i < nHier; i++) {
+		if (hier[i]->load != NULL &&
+		    hier[i]->load(obj, ds, &vers[i]) == -1)
+			goto out_close;
+	}
+	rv = 0;
+out_close:
+	AG_CloseAutoCore(ds);
+out:
+	Free(vers);
+	Free(hier);
+	return (rv);
+}
@@ -0,0 +1,102 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_PARTFILE_H_
+#define _CADTOOLS_PARTFILE_H_
+
+#include "begin_code.h"
+
+#define CAD_PART_FILE_MAGIC	"CADPART"	/* Including the NUL */
+#define CAD_PART_FILE_MAJOR	1
+#define CAD_PART_FILE_MINOR	0
+#define CAD_PART_FILE_HDR	32		/* Size of file header */
+
+/* Chunk types. */
+#define CAD_CHUNK_INFO	0x494e464f		/* "INFO" Part dataset */
+#define CAD_CHUNK_FEAT	0x46454154		/* "FEAT" Feature dataset */
+#define CAD_CHUNK_MESH	0x4d455348		/* "MESH" Imported geometry */
+#define CAD_CHUNK_PREV	0x50524556		/* "PREV" Preview geometry */
+#define CAD_CHUNK_TESS	0x54455353		/* "TESS" Cached tessellation */
+
+/* Table of contents entry. */
+typedef struct cad_part_chunk {
+	Uint32 type;				/* Chunk type */
+	char name[AG_OBJECT_NAME_MAX];		/* Object name or cache key */
+	char cls[AG_OBJECT_HIER_MAX];		/* Object class (or "") */
+	Uint64 offs;				/* Offset in file */
+	Uint64 size;				/* Length in bytes */
+	Uint64 hash;				/* Hash of contents */
+} CAD_PartChunk;
+
+/* Table of contents of an open .part file. */
+typedef struct cad_part_file {
+	char path[AG_PATHNAME_MAX];
+	AG_Version ver;				/* Container version */
+	CAD_PartChunk *chunks;
+	Uint nChunks;
+	Uint64 tocOffs;				/* Offset of TOC */
+	Uint64 size;				/* End of TOC */
+	Uint64 dev, ino;			/* Identity of file on disk */
+	Uint64 mtime, fileSize;
+} CAD_PartFile;
+
+/* State of a .part file being written. */
+typedef struct cad_part_writer {
+	AG_DataSource *ds;			/* Output file */
+	FILE *f;				/* Handle of ds */
+	char path[AG_PATHNAME_MAX];		/* Destination */
+	char tmpPath[AG_PATHNAME_MAX];		/* File being written */
+	const CAD_PartFile *prev;		/* File updated in place */
+	CAD_PartChunk *chunks;
+	Uint nChunks, maxChunks;
+	Uint64 offs;				/* Current offset */
+	Uint64 tocOffs;				/* Offset of TOC (written) */
+} CAD_PartWriter;
+
+/* Compaction of a .part file in the background. */
+typedef struct cad_part_compact {
+	AG_Mutex lock;
+	int status;
+#define CAD_PART_COMPACT_RUNNING 0
+#define CAD_PART_COMPACT_DONE	 1
+#define CAD_PART_COMPACT_FAILED	 2
+	char errMsg[AG_BUFFER_MAX];
+	CAD_PartFile *src;			/* Copy of source TOC */
+	CAD_PartWriter w;			/* Compacted file */
+	CAD_JobGroup group;
+} CAD_PartCompact;
+
+__BEGIN_DECLS
+int	CAD_PartFileProbe(const char *);
+CAD_PartFile *CAD_PartFileOpen(const char *);
+void	CAD_PartFileClose(CAD_PartFile *);
+Uint64	CAD_PartFileGarbage(const CAD_PartFile *);
+const CAD_PartChunk *CAD_PartFileFind(const CAD_PartFile *, Uint32,
+	                              const char *);
+AG_DataSource *CAD_PartFileReadChunk(const CAD_PartFile *,
+	                             const CAD_PartChunk *);
+int	CAD_PartFileReadMesh(const CAD_PartFile *, const CAD_PartChunk *,
+	                     CAD_Mesh *);
+
+int	CAD_PartWriterOpen(CAD_PartWriter *, const char *);
+int	CAD_PartWriterAppend(CAD_PartWriter *, const CAD_PartFile *);
+int	CAD_PartWriterChunk(CAD_PartWriter *, Uint32, const char *,
+	                    const char *, const void *, size_t);
+int	CAD_PartWriterMesh(CAD_PartWriter *, Uint32, const char *,
+	                   const CAD_Mesh *);
+int	CAD_PartWriterCopy(CAD_PartWriter *, const CAD_PartFile *,
+	                   const CAD_PartChunk *);
+CAD_PartFile *CAD_PartWriterCommit(CAD_PartWriter *);
+void	CAD_PartWriterAbort(CAD_PartWriter *);
+
+CAD_PartCompact *CAD_PartCompactStart(const CAD_PartFile *);
+int	CAD_PartCompactDone(CAD_PartCompact *);
+CAD_PartFile *CAD_PartCompactFinish(CAD_PartCompact *);
+
+int	CAD_ObjectWriteDataset(AG_DataSource *, void *);
+int	CAD_ObjectWriteChunk(CAD_PartWriter *, Uint32, void *);
+int	CAD_ObjectReadChunk(const CAD_PartFile *, const CAD_PartChunk *,
+	                    void *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_PARTFILE_H_ */
@@ -0,0 +1,1107 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Loader for Stanford PLY meshes. The file is mapped into memory and, for
+ * the binary formats, the vertex and face blocks are split into ranges
+ * which are decoded in parallel by the job pool directly into the arrays
+ * of a CAD_Mesh. ASCII files are parsed sequentially.
+ */
+
+#include <agar/core.h>
+
+#include <cadtools/config/have_mmap.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "cadtools.h"
+
+#define PLY_CHUNK_MIN	16384		/* Minimum records per job */
+#define PLY_PROGRESS	65536		/* Records between progress updates */
+#define PLY_NAME_MAX	32
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+
+enum ply_format {
+	PLY_ASCII,
+	PLY_BINARY_LE,
+	PLY_BINARY_BE
+};
+
+enum ply_type {
+	PLY_NONE,
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64
+};
+
+static const Uint plyTypeSize[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static const struct {
+	const char *name;
+	enum ply_type type;
+} plyTypeNames[] = {
+	{ "char",	PLY_INT8 },	{ "int8",	PLY_INT8 },
+	{ "uchar",	PLY_UINT8 },	{ "uint8",	PLY_UINT8 },
+	{ "short",	PLY_INT16 },	{ "int16",	PLY_INT16 },
+	{ "ushort",	PLY_UINT16 },	{ "uint16",	PLY_UINT16 },
+	{ "int",	PLY_INT32 },	{ "int32",	PLY_INT32 },
+	{ "uint",	PLY_UINT32 },	{ "uint32",	PLY_UINT32 },
+	{ "float",	PLY_FLOAT32 },	{ "float32",	PLY_FLOAT32 },
+	{ "double",	PLY_FLOAT64 },	{ "float64",	PLY_FLOAT64 },
+};
+
+typedef struct ply_prop {
+	char name[PLY_NAME_MAX];
+	enum ply_type type;		/* Scalar or list element type */
+	enum ply_type countType;	/* List count type (or PLY_NONE) */
+	Uint offs;			/* Offset in fixed-size record */
+} PlyProp;
+
+typedef struct ply_elem {
+	char name[PLY_NAME_MAX];
+	Uint count;
+	PlyProp *props;
+	Uint nProps;
+	Uint size;			/* Record size (0 = variable) */
+} PlyElem;
+
+/* Vertex properties we know how to import. */
+enum ply_field {
+	FLD_X, FLD_Y, FLD_Z,
+	FLD_NX, FLD_NY, FLD_NZ,
+	FLD_R, FLD_G, FLD_B, FLD_A,
+	FLD_S, FLD_T,
+	FLD_LAST
+};
+
+static const char *plyFieldNames[FLD_LAST][3] = {
+	{ "x", NULL, NULL },
+	{ "y", NULL, NULL },
+	{ "z", NULL, NULL },
+	{ "nx", NULL, NULL },
+	{ "ny", NULL, NULL },
+	{ "nz", NULL, NULL },
+	{ "red", "r", "diffuse_red" },
+	{ "green", "g", "diffuse_green" },
+	{ "blue", "b", "diffuse_blue" },
+	{ "alpha", "a", NULL },
+	{ "s", "u", "texture_u" },
+	{ "t", "v", "texture_v" },
+};
+
+typedef struct ply_file {
+	const Uint8 *data;		/* Mapped file contents */
+	size_t size;
+	int mapped;			/* Data is mmap'd (otherwise Malloc'd) */
+	enum ply_format format;
+	int swap;			/* Byte order differs from host */
+	PlyElem *elems;
+	Uint nElems;
+	size_t hdrSize;			/* Offset of element data */
+	PlyElem *vtxElem, *faceElem;
+	int fld[FLD_LAST];		/* Vertex field -> property (or -1) */
+	int idxProp;			/* Face index list property */
+	M_Real scale;
+	CAD_Mesh *m;
+	CAD_Progress *prog;		/* Progress report (or NULL) */
+} PlyFile;
+
+/* Range of records decoded by a job. */
+typedef struct ply_job {
+	PlyFile *pf;
+	const Uint8 *base;		/* First record of the element */
+	Uint i1, i2;
+	int bad;			/* Malformed record or cancelled */
+} PlyJob;
+
+/*
+ * Account for n decoded records of an element and check for cancellation.
+ * Returns -1 if the operation has been cancelled.
+ */
+static int
+Progress(const PlyFile *pf, const PlyElem *el, size_t bytes, Uint n)
+{
+	if (pf->prog == NULL) {
+		return (0);
+	}
+	CAD_ProgressUpdate(pf->prog, bytes,
+	    (el == pf->vtxElem) ? n : 0,
+	    (el == pf->faceElem) ? n : 0);
+	return (CAD_ProgressCancelled(pf->prog) ? -1 : 0);
+}
+
+static __inline__ const Uint8 *
+Swapped(const Uint8 *p, Uint size, Uint8 *buf)
+{
+	Uint i;
+
+	for (i = 0; i < size; i++) {
+		buf[i] = p[size-1-i];
+	}
+	return (buf);
+}
+
+static __inline__ double
+GetScalar(const Uint8 *p, enum ply_type type, int swap)
+{
+	Uint8 buf[8];
+
+	if (swap) {
+		p = Swapped(p, plyTypeSize[type], buf);
+	}
+	switch (type) {
+	case PLY_INT8:
+		return (double)(Sint8)p[0];
+	case PLY_UINT8:
+		return (double)p[0];
+	case PLY_INT16:
+		{ Sint16 v; memcpy(&v, p, 2); return (double)v; }
+	case PLY_UINT16:
+		{ Uint16 v; memcpy(&v, p, 2); return (double)v; }
+	case PLY_INT32:
+		{ Sint32 v; memcpy(&v, p, 4); return (double)v; }
+	case PLY_UINT32:
+		{ Uint32 v; memcpy(&v, p, 4); return (double)v; }
+	case PLY_FLOAT32:
+		{ float v; memcpy(&v, p, 4); return (double)v; }
+	case PLY_FLOAT64:
+		{ double v; memcpy(&v, p, 8); return v; }
+	default:
+		return (0.0);
+	}
+}
+
+/* Read an integer (count or index); negative values map to ~0. */
+static __inline__ Uint32
+GetIndex(const Uint8 *p, enum ply_type type, int swap)
+{
+	Uint8 buf[4];
+
+	if (swap) {
+		p = Swapped(p, plyTypeSize[type], buf);
+	}
+	switch (type) {
+	case PLY_INT8:
+		return ((Sint8)p[0] < 0) ? ~0U : (Uint32)p[0];
+	case PLY_UINT8:
+		return (Uint32)p[0];
+	case PLY_INT16:
+		{ Sint16 v; memcpy(&v, p, 2);
+		  return (v < 0) ? ~0U : (Uint32)v; }
+	case PLY_UINT16:
+		{ Uint16 v; memcpy(&v, p, 2); return (Uint32)v; }
+	case PLY_INT32:
+		{ Sint32 v; memcpy(&v, p, 4);
+		  return (v < 0) ? ~0U : (Uint32)v; }
+	case PLY_UINT32:
+		{ Uint32 v; memcpy(&v, p, 4); return v; }
+	default:
+		return (~0U);
+	}
+}
+
+static enum ply_type
+ParseType(const char *s)
+{
+	Uint i;
+
+	for (i = 0; i < sizeof(plyTypeNames)/sizeof(plyTypeNames[0]); i++) {
+		if (strcmp(plyTypeNames[i].name, s) == 0)
+			return (plyTypeNames[i].type);
+	}
+	return (PLY_NONE);
+}
+
+static int
+MapFile(PlyFile *pf, const char *path)
+{
+	struct stat sb;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		AG_SetErrorS(AG_Strerror(errno));
+		return (-1);
+	}
+	if (fstat(fd, &sb) == -1) {
+		AG_SetErrorS(AG_Strerror(errno));
+		goto fail;
+	}
+	pf->size = (size_t)sb.st_size;
+#ifdef HAVE_MMAP
+	pf->data = mmap(NULL, pf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pf->data != MAP_FAILED) {
+		pf->mapped = 1;
+		close(fd);
+		return (0);
+	}
+#endif
+	{
+		Uint8 *buf;
+		size_t pos = 0;
+		ssize_t rv;
+
+		if ((buf = TryMalloc(pf->size+1)) == NULL) {
+			goto fail;
+		}
+		while (pos < pf->size) {
+			if ((rv = read(fd, &buf[pos], pf->size - pos)) <= 0) {
+				AG_SetErrorS((rv == 0) ? _("Unexpected EOF") :
+				    AG_Strerror(errno));
+				Free(buf);
+				goto fail;
+			}
+			pos += (size_t)rv;
+		}
+		pf->data = buf;
+		pf->mapped = 0;
+	}
+	close(fd);
+	return (0);
+fail:
+	close(fd);
+	return (-1);
+}
+
+static void
+UnmapFile(PlyFile *pf)
+{
+	if (pf->data == NULL) {
+		return;
+	}
+#ifdef HAVE_MMAP
+	if (pf->mapped) {
+		munmap((void *)pf->data, pf->size);
+		return;
+	}
+#endif
+	Free((void *)pf->data);
+}
+
+static void
+FreeElems(PlyFile *pf)
+{
+	Uint i;
+
+	for (i = 0; i < pf->nElems; i++) {
+		Free(pf->elems[i].props);
+	}
+	Free(pf->elems);
+}
+
+/* Parse the PLY header. */
+static int
+ParseHeader(PlyFile *pf)
+{
+	const char *p = (const char *)pf->data;
+	const char *end = p + pf->size;
+	char line[256], a[PLY_NAME_MAX], b[PLY_NAME_MAX], c[PLY_NAME_MAX];
+	char d[PLY_NAME_MAX];
+	PlyElem *el = NULL;
+	int gotFormat = 0;
+	size_t len;
+
+	if (pf->size < 4 || strncmp(p, "ply", 3) != 0 ||
+	    (p[3] != '\n' && p[3] != '\r')) {
+		AG_SetError(_("Not a PLY file"));
+		return (-1);
+	}
+	for (;;) {
+		const char *eol;
+		unsigned long count;
+
+		if ((eol = memchr(p, '\n', end - p)) == NULL) {
+			AG_SetError(_("Truncated PLY header"));
+			return (-1);
+		}
+		len = MIN((size_t)(eol - p), sizeof(line)-1);
+		memcpy(line, p, len);
+		line[len] = '\0';
+		if (len > 0 && line[len-1] == '\r') {
+			line[len-1] = '\0';
+		}
+		p = eol+1;
+
+		if (strcmp(line, "end_header") == 0) {
+			break;
+		} else if (strncmp(line, "format ", 7) == 0) {
+			if (sscanf(line, "format %31s", a) != 1) {
+				goto syntax;
+			}
+			if (strcmp(a, "ascii") == 0) {
+				pf->format = PLY_ASCII;
+			} else if (strcmp(a, "binary_little_endian") == 0) {
+				pf->format = PLY_BINARY_LE;
+			} else if (strcmp(a, "binary_big_endian") == 0) {
+				pf->format = PLY_BINARY_BE;
+			} else {
+				AG_SetError(_("Unknown PLY format: %s"), a);
+				return (-1);
+			}
+			gotFormat = 1;
+		} else if (strncmp(line, "element ", 8) == 0) {
+			if (sscanf(line, "element %31s %lu", a, &count) != 2 ||
+			    count > 0xffffffffUL) {
+				goto syntax;
+			}
+			pf->elems = Realloc(pf->elems,
+			    (pf->nElems+1)*sizeof(PlyElem));
+			el = &pf->elems[pf->nElems++];
+			Strlcpy(el->name, a, sizeof(el->name));
+			el->count = (Uint)count;
+			el->props = NULL;
+			el->nProps = 0;
+			el->size = 0;
+		} else if (strncmp(line, "property ", 9) == 0) {
+			PlyProp *prop;
+
+			if (el == NULL) {
+				goto syntax;
+			}
+			el->props = Realloc(el->props,
+			    (el->nProps+1)*sizeof(PlyProp));
+			prop = &el->props[el->nProps++];
+			if (sscanf(line, "property list %31s %31s %31s",
+			    b, c, d) == 3) {
+				prop->countType = ParseType(b);
+				prop->type = ParseType(c);
+				Strlcpy(prop->name, d, sizeof(prop->name));
+				if (prop->countType == PLY_NONE ||
+				    prop->countType >= PLY_FLOAT32 ||
+				    prop->type == PLY_NONE)
+					goto syntax;
+			} else if (sscanf(line, "property %31s %31s", b, c) == 2) {
+				prop->countType = PLY_NONE;
+				prop->type = ParseType(b);
+				Strlcpy(prop->name, c, sizeof(prop->name));
+				if (prop->type == PLY_NONE)
+					goto syntax;
+			} else {
+				goto syntax;
+			}
+		}
+		/* Ignore comment, obj_info and unknown lines. */
+	}
+	if (!gotFormat) {
+		AG_SetError(_("Missing PLY format line"));
+		return (-1);
+	}
+	pf->hdrSize = (size_t)(p - (const char *)pf->data);
+	return (0);
+syntax:
+	AG_SetError(_("Bad PLY header line: `%s'"), line);
+	return (-1);
+}
+
+/* Compute record layouts and locate the vertex and face properties. */
+static void
+SetupElements(PlyFile *pf)
+{
+	Uint i, j, k, f;
+
+	for (i = 0; i < pf->nElems; i++) {
+		PlyElem *el = &pf->elems[i];
+		Uint offs = 0;
+
+		for (j = 0; j < el->nProps; j++) {
+			PlyProp *prop = &el->props[j];
+
+			prop->offs = offs;
+			if (prop->countType != PLY_NONE) {
+				offs = 0;
+				break;
+			}
+			offs += plyTypeSize[prop->type];
+		}
+		el->size = (j == el->nProps) ? offs : 0;
+
+		if (pf->vtxElem == NULL && strcmp(el->name, "vertex") == 0) {
+			pf->vtxElem = el;
+		} else if (pf->faceElem == NULL &&
+		    strcmp(el->name, "face") == 0) {
+			pf->faceElem = el;
+		}
+	}
+	for (f = 0; f < FLD_LAST; f++) {
+		pf->fld[f] = -1;
+		if (pf->vtxElem == NULL) {
+			continue;
+		}
+		for (j = 0; j < pf->vtxElem->nProps && pf->fld[f] == -1; j++) {
+			PlyProp *prop = &pf->vtxElem->props[j];
+
+			if (prop->countType != PLY_NONE) {
+				continue;
+			}
+			for (k = 0; k < 3; k++) {
+				if (plyFieldNames[f][k] != NULL &&
+				    strcmp(prop->name, plyFieldNames[f][k]) == 0) {
+					pf->fld[f] = (int)j;
+					break;
+				}
+			}
+		}
+	}
+	pf->idxProp = -1;
+	if (pf->faceElem != NULL) {
+		for (j = 0; j < pf->faceElem->nProps; j++) {
+			PlyProp *prop = &pf->faceElem->props[j];
+
+			if (prop->countType != PLY_NONE &&
+			    prop->type < PLY_FLOAT32 &&
+			    (strcmp(prop->name, "vertex_indices") == 0 ||
+			     strcmp(prop->name, "vertex_index") == 0)) {
+				pf->idxProp = (int)j;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Skip over a variable-size binary record, returning a pointer past it
+ * or NULL if the record extends past the end of the file.
+ */
+static const Uint8 *
+SkipRecord(const PlyFile *pf, const PlyElem *el, const Uint8 *p)
+{
+	const Uint8 *end = pf->data + pf->size;
+	Uint j, n;
+
+	for (j = 0; j < el->nProps; j++) {
+		const PlyProp *prop = &el->props[j];
+
+		if (prop->countType == PLY_NONE) {
+			p += plyTypeSize[prop->type];
+		} else {
+			if (p + plyTypeSize[prop->countType] > end) {
+				return (NULL);
+			}
+			n = GetIndex(p, prop->countType, pf->swap);
+			p += plyTypeSize[prop->countType] +
+			     (size_t)n*plyTypeSize[prop->type];
+		}
+		if (p > end)
+			return (NULL);
+	}
+	return (p);
+}
+
+/* Decode a range of binary vertex records. */
+static void
+VertexJob(void *arg)
+{
+	PlyJob *job = arg;
+	PlyFile *pf = job->pf;
+	CAD_Mesh *m = pf->m;
+	const PlyElem *el = pf->vtxElem;
+	const PlyProp *pr = el->props;
+	const int *fld = pf->fld;
+	float scale = (float)pf->scale;
+	int swap = pf->swap;
+	Uint i, f, n;
+
+	for (i = job->i1; i < job->i2; i++) {
+		const Uint8 *rec = job->base + (size_t)i*el->size;
+		float *v = &m->v[i*3];
+
+		if (i > job->i1 && ((i - job->i1) % PLY_PROGRESS) == 0 &&
+		    Progress(pf, el, (size_t)PLY_PROGRESS*el->size,
+		    PLY_PROGRESS) == -1) {
+			job->bad = 3;
+			return;
+		}
+
+		for (f = FLD_X; f <= FLD_Z; f++) {
+			const PlyProp *p = &pr[fld[f]];
+
+			v[f-FLD_X] = (float)GetScalar(rec + p->offs, p->type,
+			    swap)*scale;
+		}
+		if (m->flags & CAD_MESH_NORMALS) {
+			float *n = &m->n[i*3];
+
+			for (f = FLD_NX; f <= FLD_NZ; f++) {
+				const PlyProp *p = &pr[fld[f]];
+
+				n[f-FLD_NX] = (float)GetScalar(rec + p->offs,
+				    p->type, swap);
+			}
+		}
+		if (m->flags & CAD_MESH_COLORS) {
+			Uint8 *c = &m->c[i*4];
+
+			for (f = FLD_R; f <= FLD_A; f++) {
+				const PlyProp *p;
+				double val;
+
+				if (fld[f] == -1) {
+					c[f-FLD_R] = 255;
+					continue;
+				}
+				p = &pr[fld[f]];
+				val = GetScalar(rec + p->offs, p->type, swap);
+				if (p->type >= PLY_FLOAT32) {
+					val *= 255.0;
+				}
+				c[f-FLD_R] = (val <= 0.0) ? 0 :
+				             (val >= 255.0) ? 255 : (Uint8)val;
+			}
+		}
+		if (m->flags & CAD_MESH_TEXCOORDS) {
+			float *st = &m->st[i*2];
+
+			for (f = FLD_S; f <= FLD_T; f++) {
+				const PlyProp *p = &pr[fld[f]];
+
+				st[f-FLD_S] = (float)GetScalar(rec + p->offs,
+				    p->type, swap);
+			}
+		}
+	}
+	n = (job->i2 - job->i1) % PLY_PROGRESS;
+	if (n == 0 && job->i2 > job->i1) {
+		n = PLY_PROGRESS;
+	}
+	if (Progress(pf, el, (size_t)n*el->size, n) == -1)
+		job->bad = 3;
+}
+
+/*
+ * Decode a range of triangle records of the form "count i1 i2 i3". Sets
+ * job->bad to 1 if a face is not a triangle, 2 if an index is out of
+ * range and 3 if cancelled. The range is only assumed to start on a
+ * record boundary if all faces before it are triangles, so the face
+ * counts are still checked after an index is found out of range.
+ */
+static void
+TriangleJob(void *arg)
+{
+	PlyJob *job = arg;
+	PlyFile *pf = job->pf;
+	CAD_Mesh *m = pf->m;
+	const PlyProp *prop = &pf->faceElem->props[pf->idxProp];
+	Uint cSize = plyTypeSize[prop->countType];
+	Uint iSize = plyTypeSize[prop->type];
+	Uint stride = cSize + 3*iSize;
+	Uint nv = m->nv, i, k;
+	int swap = pf->swap;
+
+	for (i = job->i1; i < job->i2; i++) {
+		const Uint8 *rec = job->base + (size_t)i*stride;
+		Uint32 *t = &m->tri[i*3];
+
+		if (i > job->i1 && ((i - job->i1) % PLY_PROGRESS) == 0 &&
+		    Progress(pf, pf->faceElem, (size_t)PLY_PROGRESS*stride,
+		    PLY_PROGRESS) == -1) {
+			job->bad = 3;
+			return;
+		}
+		if (GetIndex(rec, prop->countType, swap) != 3) {
+			job->bad = 1;
+			return;
+		}
+		for (k = 0; k < 3; k++) {
+			t[k] = GetIndex(rec + cSize + k*iSize, prop->type,
+			    swap);
+			if (t[k] >= nv)
+				job->bad = 2;
+		}
+	}
+	k = (job->i2 - job->i1) % PLY_PROGRESS;
+	if (k == 0 && job->i2 > job->i1) {
+		k = PLY_PROGRESS;
+	}
+	if (Progress(pf, pf->faceElem, (size_t)k*stride, k) == -1)
+		job->bad = 3;
+}
+
+/* Split count records into jobs and submit them to the group. */
+static PlyJob *
+SubmitJobs(PlyFile *pf, CAD_JobGroup *g, CAD_JobFn fn, const Uint8 *base,
+    Uint count, Uint *nJobs)
+{
+	PlyJob *jobs;
+	Uint n, per, i;
+
+	n = CAD_JobPoolThreads()*4;
+	if (count/n < PLY_CHUNK_MIN) {
+		n = count/PLY_CHUNK_MIN;
+	}
+	if (n == 0) {
+		n = 1;
+	}
+	per = count/n;
+	jobs = Malloc(n*sizeof(PlyJob));
+	for (i = 0; i < n; i++) {
+		jobs[i].pf = pf;
+		jobs[i].base = base;
+		jobs[i].i1 = i*per;
+		jobs[i].i2 = (i == n-1) ? count : (i+1)*per;
+		jobs[i].bad = 0;
+		CAD_JobSubmit(g, fn, &jobs[i]);
+	}
+	*nJobs = n;
+	return (jobs);
+}
+
+/*
+ * Return a pointer to the vertex index list of a face record, which must
+ * have been checked with SkipRecord().
+ */
+static const Uint8 *
+FindIndexList(const PlyFile *pf, const Uint8 *p)
+{
+	const PlyElem *el = pf->faceElem;
+	Uint j;
+
+	for (j = 0; j < (Uint)pf->idxProp; j++) {
+		const PlyProp *prop = &el->props[j];
+
+		if (prop->countType == PLY_NONE) {
+			p += plyTypeSize[prop->type];
+		} else {
+			p += plyTypeSize[prop->countType] +
+			     (size_t)GetIndex(p, prop->countType, pf->swap)*
+			     plyTypeSize[prop->type];
+		}
+	}
+	return (p);
+}
+
+/* Decode polygonal faces sequentially, triangulating them as fans. */
+static int
+LoadPolygonsBinary(PlyFile *pf, const Uint8 *base)
+{
+	const PlyElem *el = pf->faceElem;
+	const PlyProp *idx = &el->props[pf->idxProp];
+	CAD_Mesh *m = pf->m;
+	const Uint8 *p, *r, *mark;
+	Uint cSize = plyTypeSize[idx->countType];
+	Uint iSize = plyTypeSize[idx->type];
+	Uint i, k, n, nt = 0;
+	Uint32 *t;
+
+	/* Count the triangles and check the block bounds. */
+	for (i = 0, p = base; i < el->count; i++) {
+		if ((mark = SkipRecord(pf, el, p)) == NULL) {
+			AG_SetError(_("Truncated PLY face data"));
+			return (-1);
+		}
+		r = FindIndexList(pf, p);
+		p = mark;
+		n = GetIndex(r, idx->countType, pf->swap);
+		nt += (n > 2) ? n-2 : 0;
+	}
+	if (CAD_MeshReserve(m, m->nv, nt) == -1) {
+		return (-1);
+	}
+	t = m->tri;
+	for (i = 0, p = mark = base; i < el->count; i++) {
+		if (i > 0 && (i % PLY_PROGRESS) == 0) {
+			if (Progress(pf, el, (size_t)(p - mark), PLY_PROGRESS)
+			    == -1) {
+				AG_SetErrorS(_("Cancelled"));
+				return (-1);
+			}
+			mark = p;
+		}
+		r = FindIndexList(pf, p);
+		n = GetIndex(r, idx->countType, pf->swap);
+		r += cSize;
+		for (k = 2; k < n; k++) {
+			t[0] = GetIndex(r, idx->type, pf->swap);
+			t[1] = GetIndex(r + (k-1)*iSize, idx->type, pf->swap);
+			t[2] = GetIndex(r + k*iSize, idx->type, pf->swap);
+			if (t[0] >= m->nv || t[1] >= m->nv || t[2] >= m->nv) {
+				AG_SetError(_("Vertex index out of range"));
+				return (-1);
+			}
+			t += 3;
+		}
+		p = SkipRecord(pf, el, p);
+	}
+	m->nt = nt;
+	Progress(pf, el, (size_t)(p - mark), i % PLY_PROGRESS);
+	return (0);
+}
+
+/* Locate the start of each element block in a binary file. */
+static int
+FindBlocks(PlyFile *pf, const Uint8 **vtxBase, const Uint8 **faceBase)
+{
+	const Uint8 *p = pf->data + pf->hdrSize;
+	const Uint8 *end = pf->data + pf->size;
+	Uint i, j;
+
+	*vtxBase = NULL;
+	*faceBase = NULL;
+	for (i = 0; i < pf->nElems; i++) {
+		PlyElem *el = &pf->elems[i];
+
+		if (el == pf->vtxElem) { *vtxBase = p; }
+		if (el == pf->faceElem) { *faceBase = p; }
+
+		if (el->size > 0) {
+			if ((size_t)(end - p) < (size_t)el->count*el->size) {
+				goto truncated;
+			}
+			p += (size_t)el->count*el->size;
+		} else if (i+1 < pf->nElems) {
+			for (j = 0; j < el->count; j++) {
+				if ((p = SkipRecord(pf, el, p)) == NULL)
+					goto truncated;
+			}
+		}
+	}
+	return (0);
+truncated:
+	AG_SetError(_("Truncated PLY data"));
+	return (-1);
+}
+
+static int
+LoadBinary(PlyFile *pf)
+{
+	CAD_Mesh *m = pf->m;
+	const Uint8 *vtxBase, *faceBase;
+	PlyJob *vJobs = NULL, *fJobs = NULL;
+	Uint nvJobs = 0, nfJobs = 0, i;
+	CAD_JobGroup g;
+	int fast = 0, cancel = 0, nonTri = 0, badIdx = 0;
+
+	if (FindBlocks(pf, &vtxBase, &faceBase) == -1) {
+		return (-1);
+	}
+	if (pf->vtxElem->size == 0) {
+		AG_SetError(_("Unsupported PLY vertex element"));
+		return (-1);
+	}
+	if (CAD_MeshReserve(m, pf->vtxElem->count, 0) == -1) {
+		return (-1);
+	}
+	m->nv = pf->vtxElem->count;
+
+	/*
+	 * Triangle meshes with only the index list in the face element
+	 * have fixed-size face records and are decoded in parallel with
+	 * the vertices.
+	 */
+	if (faceBase != NULL && pf->idxProp == 0 &&
+	    pf->faceElem->nProps == 1 && pf->faceElem->count > 0) {
+		const PlyProp *idx = &pf->faceElem->props[0];
+		size_t stride = plyTypeSize[idx->countType] +
+		                3*plyTypeSize[idx->type];
+
+		if (GetIndex(faceBase, idx->countType, pf->swap) == 3 &&
+		    (size_t)(pf->data + pf->size - faceBase) >=
+		    stride*pf->faceElem->count) {
+			if (CAD_MeshReserve(m, m->nv, pf->faceElem->count)
+			    == -1) {
+				return (-1);
+			}
+			fast = 1;
+		}
+	}
+
+	CAD_JobGroupInit(&g);
+	vJobs = SubmitJobs(pf, &g, VertexJob, vtxBase, pf->vtxElem->count,
+	    &nvJobs);
+	if (fast) {
+		fJobs = SubmitJobs(pf, &g, TriangleJob, faceBase,
+		    pf->faceElem->count, &nfJobs);
+	}
+	CAD_JobGroupWait(&g);
+	CAD_JobGroupDestroy(&g);
+
+	for (i = 0; i < nvJobs; i++) {
+		if (vJobs[i].bad == 3)
+			cancel = 1;
+	}
+	for (i = 0; i < nfJobs; i++) {
+		if (fJobs[i].bad == 1) {
+			nonTri = 1;
+		} else if (fJobs[i].bad == 2) {
+			badIdx = 1;
+		} else if (fJobs[i].bad == 3) {
+			cancel = 1;
+		}
+	}
+	Free(fJobs);
+	Free(vJobs);
+
+	if (cancel) {
+		AG_SetErrorS(_("Cancelled"));
+		return (-1);
+	}
+	/*
+	 * If any face is not a triangle, jobs past it started at arbitrary
+	 * offsets and their results are meaningless; the general loader
+	 * checks the indices again.
+	 */
+	if (fast && !nonTri) {
+		if (badIdx) {
+			AG_SetError(_("Vertex index out of range"));
+			return (-1);
+		}
+		m->nt = pf->faceElem->count;
+		return (0);
+	}
+	if (faceBase != NULL && pf->idxProp != -1) {
+		return LoadPolygonsBinary(pf, faceBase);
+	}
+	return (0);
+}
+
+/*
+ * ASCII format.
+ */
+
+static int
+NextToken(const char **pp, const char *end, char *tok, size_t size)
+{
+	const char *p = *pp;
+	size_t len = 0;
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+	    *p == '\n')) {
+		p++;
+	}
+	if (p == end) {
+		return (-1);
+	}
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' &&
+	    *p != '\n') {
+		if (len < size-1) {
+			tok[len++] = *p;
+		}
+		p++;
+	}
+	tok[len] = '\0';
+	*pp = p;
+	return (0);
+}
+
+static int
+LoadASCII(PlyFile *pf)
+{
+	const char *p = (const char *)pf->data + pf->hdrSize;
+	const char *end = (const char *)pf->data + pf->size;
+	const char *pLast;
+	CAD_Mesh *m = pf->m;
+	double vals[FLD_LAST];
+	Uint32 *poly = NULL;
+	Uint maxPoly = 0;
+	char tok[64];
+	Uint i, j, k, f, n;
+
+	for (i = 0; i < pf->nElems; i++) {
+		PlyElem *el = &pf->elems[i];
+
+		if (el == pf->vtxElem &&
+		    CAD_MeshReserve(m, el->count, 0) == -1) {
+			goto fail;
+		}
+		for (j = 0, pLast = p; j < el->count; j++) {
+			if (j > 0 && (j % PLY_PROGRESS) == 0) {
+				if (Progress(pf, el, (size_t)(p - pLast),
+				    PLY_PROGRESS) == -1) {
+					AG_SetErrorS(_("Cancelled"));
+					goto fail;
+				}
+				pLast = p;
+			}
+			for (f = 0; f < FLD_LAST; f++) {
+				vals[f] = (f == FLD_A) ? 255.0 : 0.0;
+			}
+			for (k = 0; k < el->nProps; k++) {
+				PlyProp *prop = &el->props[k];
+
+				if (NextToken(&p, end, tok, sizeof(tok)) == -1) {
+					goto truncated;
+				}
+				if (prop->countType == PLY_NONE) {
+					if (el != pf->vtxElem) {
+						continue;
+					}
+					for (f = 0; f < FLD_LAST; f++) {
+						if (pf->fld[f] == (int)k)
+							vals[f] = strtod(tok, NULL);
+					}
+					continue;
+				}
+				n = (Uint)strtoul(tok, NULL, 10);
+				if (el == pf->faceElem && (int)k == pf->idxProp &&
+				    n > maxPoly) {
+					maxPoly = n;
+					poly = Realloc(poly, n*sizeof(Uint32));
+				}
+				for (f = 0; f < n; f++) {
+					if (NextToken(&p, end, tok, sizeof(tok))
+					    == -1) {
+						goto truncated;
+					}
+					if (el == pf->faceElem &&
+					    (int)k == pf->idxProp)
+						poly[f] = (Uint32)strtoul(tok,
+						    NULL, 10);
+				}
+				if (el != pf->faceElem || (int)k != pf->idxProp) {
+					continue;
+				}
+				for (f = 0; f < n; f++) {
+					if (poly[f] >= m->nv) {
+						AG_SetError(_("Vertex index out "
+						              "of range"));
+						goto fail;
+					}
+				}
+				for (f = 2; f < n; f++)
+					CAD_MeshAddTri(m, poly[0], poly[f-1],
+					    poly[f]);
+			}
+			if (el == pf->vtxElem) {
+				Uint vi = m->nv++;
+
+				for (f = FLD_X; f <= FLD_Z; f++) {
+					m->v[vi*3+f-FLD_X] =
+					    (float)(vals[f]*pf->scale);
+				}
+				if (m->flags & CAD_MESH_NORMALS) {
+					for (f = FLD_NX; f <= FLD_NZ; f++)
+						m->n[vi*3+f-FLD_NX] =
+						    (float)vals[f];
+				}
+				if (m->flags & CAD_MESH_COLORS) {
+					for (f = FLD_R; f <= FLD_A; f++) {
+						double c = vals[f];
+
+						if (pf->fld[f] != -1 &&
+						    el->props[pf->fld[f]].type
+						    >= PLY_FLOAT32) {
+							c *= 255.0;
+						}
+						m->c[vi*4+f-FLD_R] =
+						    (c <= 0.0) ? 0 :
+						    (c >= 255.0) ? 255 :
+						    (Uint8)c;
+					}
+				}
+				if (m->flags & CAD_MESH_TEXCOORDS) {
+					for (f = FLD_S; f <= FLD_T; f++)
+						m->st[vi*2+f-FLD_S] =
+						    (float)vals[f];
+				}
+			}
+		}
+		Progress(pf, el, (size_t)(p - pLast), j % PLY_PROGRESS);
+	}
+	Free(poly);
+	return (0);
+truncated:
+	AG_SetError(_("Truncated PLY data"));
+fail:
+	Free(poly);
+	return (-1);
+}
+
+/*
+ * Load a PLY file into an empty mesh. The flags select which optional
+ * vertex attributes (CAD_MESH_NORMALS, CAD_MESH_COLORS and
+ * CAD_MESH_TEXCOORDS) to import; attributes missing from the file are
+ * left out. Vertex positions are multiplied by scale. Polygons are
+ * triangulated as fans. If prog is not NULL, progress is reported there
+ * and the load fails with "Cancelled" once cancellation is requested.
+ */
+int
+CAD_MeshLoadPLY(CAD_Mesh *m, const char *path, Uint flags, M_Real scale,
+    CAD_Progress *prog)
+{
+	PlyFile pf;
+	int rv = -1;
+
+	memset(&pf, 0, sizeof(pf));
+	pf.scale = scale;
+	pf.m = m;
+	pf.prog = prog;
+	if (MapFile(&pf, path) == -1) {
+		return (-1);
+	}
+	if (ParseHeader(&pf) == -1) {
+		goto out;
+	}
+	if (prog != NULL) {
+		CAD_ProgressSetTotal(prog, pf.size);
+		CAD_ProgressUpdate(prog, pf.hdrSize, 0, 0);
+	}
+	SetupElements(&pf);
+	if (pf.vtxElem == NULL ||
+	    pf.fld[FLD_X] == -1 || pf.fld[FLD_Y] == -1 || pf.fld[FLD_Z] == -1) {
+		AG_SetError(_("PLY file has no vertex positions"));
+		goto out;
+	}
+	if (pf.fld[FLD_NX] == -1 || pf.fld[FLD_NY] == -1 ||
+	    pf.fld[FLD_NZ] == -1) {
+		flags &= ~(CAD_MESH_NORMALS);
+	}
+	if (pf.fld[FLD_R] == -1 || pf.fld[FLD_G] == -1 ||
+	    pf.fld[FLD_B] == -1) {
+		flags &= ~(CAD_MESH_COLORS);
+	}
+	if (pf.fld[FLD_S] == -1 || pf.fld[FLD_T] == -1) {
+		flags &= ~(CAD_MESH_TEXCOORDS);
+	}
+	CAD_MeshFree(m);
+	CAD_MeshInit(m, flags);
+
+#if AG_BYTEORDER == AG_BIG_ENDIAN
+	pf.swap = (pf.format == PLY_BINARY_LE);
+#else
+	pf.swap = (pf.format == PLY_BINARY_BE);
+#endif
+	rv = (pf.format == PLY_ASCII) ? LoadASCII(&pf) : LoadBinary(&pf);
+	if (rv == -1)
+		CAD_MeshFree(m);
+out:
+	FreeElems(&pf);
+	UnmapFile(&pf);
+	return (rv);
+}
@@ -0,0 +1,14 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_PLY_H_
+#define _CADTOOLS_PLY_H_
+
+#include "begin_code.h"
+
+__BEGIN_DECLS
+int	CAD_MeshLoadPLY(CAD_Mesh *, const char *, Uint, M_Real,
+	                CAD_Progress *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_PLY_H_ */
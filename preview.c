@@ -0,0 +1,736 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Thumbnails and metadata of documents for the preview pane of the Open
+ * dialog. Previews are generated by a job on the pool, reading no more of
+ * a file than needed (for native parts, the part information and preview
+ * mesh chunks), and cached by path and modification time both in memory
+ * and under the "previews" directory of the user data directory.
+ *
+ * Only the file most recently asked for is queued, so that browsing a
+ * large directory never leaves a backlog of stale previews behind.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cadtools.h"
+
+#define PREVIEW_MAGIC	"CADPREV"		/* Including the NUL */
+#define PREVIEW_VERSION	1			/* Cache file version */
+#define PREVIEW_POLL	50			/* Polling interval (ms) */
+
+static CAD_PreviewCache cadPreviews;
+static int previewsInited = 0;
+
+static void
+InitCache(CAD_PreviewCache *pc)
+{
+	AG_MutexInit(&pc->lock);
+	AG_GetString(agConfig, "save-path", pc->dir, sizeof(pc->dir));
+	Strlcat(pc->dir, AG_PATHSEP, sizeof(pc->dir));
+	Strlcat(pc->dir, "previews", sizeof(pc->dir));
+	if (AG_MkPath(pc->dir) == -1) {
+		Verbose("%s; not caching previews\n", AG_GetError());
+		pc->dir[0] = '\0';
+	}
+	pc->ents = Malloc(CAD_PREVIEW_CACHE_MAX*sizeof(CAD_Preview *));
+	pc->nEnts = 0;
+	pc->useCounter = 0;
+	pc->want[0] = '\0';
+	pc->cur[0] = '\0';
+	pc->running = 0;
+	CAD_JobGroupInit(&pc->group);
+	previewsInited = 1;
+}
+
+/* Return the path of the cache file of a document. */
+static void
+CachePath(const CAD_PreviewCache *pc, const char *path, char *dst,
+    size_t len)
+{
+	Uint64 h;
+
+	h = CAD_HashBytes(CAD_HASH_INIT, path, strlen(path));
+	snprintf(dst, len, "%s%s%016llx.prev", pc->dir, AG_PATHSEP,
+	    (unsigned long long)h);
+}
+
+/* Load a preview from the cache directory, if it is up to date. */
+static int
+ReadCached(const CAD_PreviewCache *pc, CAD_Preview *pv)
+{
+	char cachePath[AG_PATHNAME_MAX], path[AG_PATHNAME_MAX];
+	char magic[8];
+	AG_DataSource *ds;
+
+	if (pc->dir[0] == '\0') {
+		return (-1);
+	}
+	CachePath(pc, pv->path, cachePath, sizeof(cachePath));
+	if ((ds = AG_OpenFile(cachePath, "rb")) == NULL) {
+		return (-1);
+	}
+	if (AG_Read(ds, magic, sizeof(magic)) == -1 ||
+	    memcmp(magic, PREVIEW_MAGIC, sizeof(magic)) != 0 ||
+	    AG_ReadUint32(ds) != PREVIEW_VERSION) {
+		goto fail;
+	}
+	AG_CopyString(path, ds, sizeof(path));
+	if (strcmp(path, pv->path) != 0 ||		/* Hash collision */
+	    AG_ReadUint64(ds) != pv->mtime ||
+	    (int)AG_ReadUint8(ds) != pv->kind) {
+		goto fail;
+	}
+	AG_CopyString(pv->descr, ds, sizeof(pv->descr));
+	pv->nFeatures = (Uint)AG_ReadUint32(ds);
+	pv->nTris = (Uint)AG_ReadUint32(ds);
+	pv->progType = (Uint)AG_ReadUint32(ds);
+	pv->progLines = (Uint)AG_ReadUint32(ds);
+	pv->progBytes = (Uint)AG_ReadUint32(ds);
+	pv->nEntities = (Uint)AG_ReadUint32(ds);
+	if (AG_Read(ds, pv->px, sizeof(pv->px)) == -1) {
+		goto fail;
+	}
+	AG_CloseFile(ds);
+	return (0);
+fail:
+	AG_CloseFile(ds);
+	return (-1);
+}
+
+/* Save a preview to the cache directory. */
+static int
+WriteCached(const CAD_PreviewCache *pc, const CAD_Preview *pv)
+{
+	char cachePath[AG_PATHNAME_MAX], tmpPath[AG_PATHNAME_MAX];
+	AG_DataSource *ds;
+
+	if (pc->dir[0] == '\0') {
+		return (0);
+	}
+	CachePath(pc, pv->path, cachePath, sizeof(cachePath));
+	Strlcpy(tmpPath, cachePath, sizeof(tmpPath));
+	Strlcat(tmpPath, ".new", sizeof(tmpPath));
+	if ((ds = AG_OpenFile(tmpPath, "wb")) == NULL) {
+		return (-1);
+	}
+	AG_Write(ds, PREVIEW_MAGIC, 8);
+	AG_WriteUint32(ds, PREVIEW_VERSION);
+	AG_WriteString(ds, pv->path);
+	AG_WriteUint64(ds, pv->mtime);
+	AG_WriteUint8(ds, (Uint8)pv->kind);
+	AG_WriteString(ds, pv->descr);
+	AG_WriteUint32(ds, (Uint32)pv->nFeatures);
+	AG_WriteUint32(ds, (Uint32)pv->nTris);
+	AG_WriteUint32(ds, (Uint32)pv->progType);
+	AG_WriteUint32(ds, (Uint32)pv->progLines);
+	AG_WriteUint32(ds, (Uint32)pv->progBytes);
+	AG_WriteUint32(ds, (Uint32)pv->nEntities);
+	if (AG_Write(ds, pv->px, sizeof(pv->px)) == -1) {
+		AG_CloseFile(ds);
+		AG_FileDelete(tmpPath);
+		return (-1);
+	}
+	AG_CloseFile(ds);
+	if (rename(tmpPath, cachePath) == -1) {
+		AG_SetError("%s: %s", cachePath, strerror(errno));
+		AG_FileDelete(tmpPath);
+		return (-1);
+	}
+	return (0);
+}
+
+static void
+ClearImage(CAD_Preview *pv)
+{
+	Uint i;
+
+	for (i = 0; i < CAD_PREVIEW_SIZE*CAD_PREVIEW_SIZE; i++) {
+		pv->px[i*4] = 245;
+		pv->px[i*4+1] = 245;
+		pv->px[i*4+2] = 245;
+		pv->px[i*4+3] = 255;
+	}
+}
+
+/* Render a mesh into the thumbnail, in an isometric view scaled to fit. */
+static void
+RenderMesh(CAD_Preview *pv, const CAD_Mesh *m)
+{
+	static const float R[3] = { 0.7071f, 0.7071f, 0.0f };	/* Right */
+	static const float U[3] = { -0.4082f, 0.4082f, 0.8165f }; /* Up */
+	static const float E[3] = { 0.5774f, -0.5774f, 0.5774f }; /* Eye */
+	CAD_RenderView view;
+	CAD_Image img;
+	int j;
+
+	CAD_RenderViewInit(&view);
+	for (j = 0; j < 3; j++) {
+		view.T[0][j] = R[j];
+		view.T[1][j] = U[j];
+		view.T[2][j] = E[j];
+	}
+	view.flags |= CAD_RENDER_FIT;
+	CAD_ImageInit(&img, CAD_PREVIEW_SIZE, CAD_PREVIEW_SIZE);
+	CAD_RenderMesh(&img, m, &view);
+	memcpy(pv->px, img.px, sizeof(pv->px));
+	CAD_ImageFree(&img);
+}
+
+/* Draw 2D line segments (x1,y1,x2,y2) into the thumbnail, scaled to fit. */
+static void
+DrawSegments(CAD_Preview *pv, const float *seg, Uint nSeg)
+{
+	const int size = CAD_PREVIEW_SIZE;
+	float xMin = FLT_MAX, xMax = -FLT_MAX, yMin = FLT_MAX, yMax = -FLT_MAX;
+	float scale, cx, cy;
+	Uint i, j;
+
+	if (nSeg == 0) {
+		return;
+	}
+	for (i = 0; i < nSeg*2; i++) {
+		const float *p = &seg[i*2];
+
+		if (p[0] < xMin) { xMin = p[0]; }
+		if (p[0] > xMax) { xMax = p[0]; }
+		if (p[1] < yMin) { yMin = p[1]; }
+		if (p[1] > yMax) { yMax = p[1]; }
+	}
+	scale = (xMax-xMin > yMax-yMin) ? xMax-xMin : yMax-yMin;
+	scale = (scale > 0.0f) ? (float)(size-5)/scale : 1.0f;
+	cx = (xMin+xMax)/2.0f;
+	cy = (yMin+yMax)/2.0f;
+
+	for (i = 0; i < nSeg; i++) {
+		int x[2], y[2], dx, dy, sx, sy, err, e2;
+
+		for (j = 0; j < 2; j++) {
+			x[j] = (int)((float)size/2.0f +
+			             (seg[i*4 + j*2] - cx)*scale);
+			y[j] = (int)((float)size/2.0f -
+			             (seg[i*4 + j*2+1] - cy)*scale);
+		}
+		dx = abs(x[1]-x[0]);
+		dy = -abs(y[1]-y[0]);
+		sx = (x[0] < x[1]) ? 1 : -1;
+		sy = (y[0] < y[1]) ? 1 : -1;
+		err = dx + dy;
+		for (;;) {
+			if (x[0] >= 0 && x[0] < size &&
+			    y[0] >= 0 && y[0] < size) {
+				Uint8 *p = &pv->px[(y[0]*size + x[0])*4];
+
+				p[0] = 40;
+				p[1] = 60;
+				p[2] = 120;
+				p[3] = 255;
+			}
+			if (x[0] == x[1] && y[0] == y[1]) {
+				break;
+			}
+			if ((e2 = 2*err) >= dy) { err += dy; x[0] += sx; }
+			if (e2 <= dx) { err += dx; y[0] += sy; }
+		}
+	}
+}
+
+/* Append a segment to a growable array of segments. */
+static void
+AddSegment(float **seg, Uint *nSeg, Uint *maxSeg, float x1, float y1,
+    float x2, float y2)
+{
+	float *s;
+
+	if (*nSeg+1 > *maxSeg) {
+		*maxSeg = (*maxSeg > 0) ? *maxSeg*2 : 256;
+		*seg = Realloc(*seg, (*maxSeg)*4*sizeof(float));
+	}
+	s = &(*seg)[(*nSeg)*4];
+	s[0] = x1;
+	s[1] = y1;
+	s[2] = x2;
+	s[3] = y2;
+	(*nSeg)++;
+}
+
+/* Preview of a part, from the table of contents of a native part file. */
+static int
+PreviewPart(CAD_Preview *pv)
+{
+	CAD_PartFile *pf;
+	const CAD_PartChunk *c;
+	CAD_Feature *ft;
+	CAD_Part *part;
+	CAD_Mesh m;
+	Uint i;
+
+	if (!CAD_PartFileProbe(pv->path)) {		/* Older format */
+		part = CAD_LoadDocument(&cadPartClass, pv->path);
+		if (part == NULL)
+			return (-1);
+
+		Strlcpy(pv->descr, part->descr, sizeof(pv->descr));
+		TAILQ_FOREACH(ft, &part->features, features) {
+			pv->nFeatures++;
+		}
+		pv->nTris = CAD_PartMesh(part)->nt;
+		RenderMesh(pv, CAD_PartMesh(part));
+		AG_ObjectDestroy(part);
+		return (0);
+	}
+	if ((pf = CAD_PartFileOpen(pv->path)) == NULL) {
+		return (-1);
+	}
+	if (CAD_PartReadInfo(pf, pv->descr, sizeof(pv->descr), &pv->nTris)
+	    == -1) {
+		goto fail;
+	}
+	for (i = 0; i < pf->nChunks; i++) {
+		if (pf->chunks[i].type == CAD_CHUNK_FEAT)
+			pv->nFeatures++;
+	}
+	if ((c = CAD_PartFileFind(pf, CAD_CHUNK_PREV, NULL)) != NULL) {
+		CAD_MeshInit(&m, 0);
+		if (CAD_PartFileReadMesh(pf, c, &m) == -1) {
+			CAD_MeshFree(&m);
+			goto fail;
+		}
+		RenderMesh(pv, &m);
+		CAD_MeshFree(&m);
+	}
+	CAD_PartFileClose(pf);
+	return (0);
+fail:
+	CAD_PartFileClose(pf);
+	return (-1);
+}
+
+/*
+ * Preview of a CNC program. The thumbnail is a plot of the X and Y words
+ * of successive blocks, ignoring comments.
+ */
+static int
+PreviewProgram(CAD_Preview *pv)
+{
+	CAM_Program *prog;
+	char *text, *c;
+	float *seg = NULL, pos[2] = { 0.0f, 0.0f }, next[2];
+	Uint nSeg = 0, maxSeg = 0;
+	int moved, comment = 0;
+
+	if ((prog = CAD_LoadDocument(&camProgramClass, pv->path)) == NULL) {
+		return (-1);
+	}
+	pv->progType = (Uint)prog->type;
+	text = AG_TextDup(&prog->text->text);
+	AG_ObjectDestroy(prog);
+
+	pv->progBytes = (Uint)strlen(text);
+	pv->progLines = (pv->progBytes > 0) ? 1 : 0;
+	next[0] = pos[0];
+	next[1] = pos[1];
+	moved = 0;
+	for (c = text; *c != '\0'; c++) {
+		if (comment) {
+			if ((comment == '(' && *c == ')') ||
+			    (comment == '*' && c[0] == '*' && c[1] == '/')) {
+				comment = 0;
+			} else if (comment == ';' && *c == '\n') {
+				comment = 0;
+			} else {
+				continue;
+			}
+		}
+		switch (*c) {
+		case '(':
+		case ';':
+			comment = *c;
+			continue;
+		case '/':
+			if (c[1] == '*') {
+				comment = '*';
+				c++;
+			}
+			continue;
+		case 'X':
+		case 'x':
+		case 'Y':
+		case 'y':
+			if (isdigit((unsigned char)c[1]) || c[1] == '-' ||
+			    c[1] == '+' || c[1] == '.') {
+				next[toupper((unsigned char)*c) == 'Y'] =
+				    (float)strtod(&c[1], &c);
+				moved = 1;
+				c--;
+			}
+			continue;
+		default:
+			break;
+		}
+		if (*c != '\n') {
+			continue;
+		}
+		if (c[1] != '\0') {
+			pv->progLines++;
+		}
+		if (moved) {
+			AddSegment(&seg, &nSeg, &maxSeg, pos[0], pos[1],
+			    next[0], next[1]);
+			pos[0] = next[0];
+			pos[1] = next[1];
+			moved = 0;
+		}
+	}
+	if (moved) {
+		AddSegment(&seg, &nSeg, &maxSeg, pos[0], pos[1], next[0],
+		    next[1]);
+	}
+	DrawSegments(pv, seg, nSeg);
+	Free(seg);
+	Free(text);
+	return (0);
+}
+
+/* Preview of a sketch, showing its lines and circles. */
+static int
+PreviewSketch(CAD_Preview *pv)
+{
+	SK *sk;
+	SK_Node *node;
+	SK_Line *line;
+	SK_Circle *circle;
+	float *seg = NULL;
+	Uint nSeg = 0, maxSeg = 0, i;
+
+	if ((sk = CAD_LoadDocument(&skClass, pv->path)) == NULL) {
+		return (-1);
+	}
+	SK_FOREACH_NODE(node, sk, sk_node) {
+		pv->nEntities++;
+	}
+	SK_FOREACH_NODE_CLASS(line, sk, sk_line, "Line:*") {
+		M_Vector3 v1 = SK_Pos(line->p1);
+		M_Vector3 v2 = SK_Pos(line->p2);
+
+		AddSegment(&seg, &nSeg, &maxSeg, (float)v1.x, (float)v1.y,
+		    (float)v2.x, (float)v2.y);
+	}
+	SK_FOREACH_NODE_CLASS(circle, sk, sk_circle, "Circle:*") {
+		M_Vector3 c = SK_Pos(circle->p);
+		float r = (float)circle->r, a1, a2;
+
+		for (i = 0; i < 32; i++) {
+			a1 = (float)i*2.0f*(float)M_PI/32.0f;
+			a2 = (float)(i+1)*2.0f*(float)M_PI/32.0f;
+			AddSegment(&seg, &nSeg, &maxSeg,
+			    (float)c.x + r*cosf(a1), (float)c.y + r*sinf(a1),
+			    (float)c.x + r*cosf(a2), (float)c.y + r*sinf(a2));
+		}
+	}
+	AG_ObjectDestroy(sk);
+	DrawSegments(pv, seg, nSeg);
+	Free(seg);
+	return (0);
+}
+
+/* Keep a generated preview in memory, evicting the least recently used. */
+static void
+InsertPreview(CAD_PreviewCache *pc, CAD_Preview *pv)
+{
+	Uint i, iOld = 0;
+
+	pv->lastUsed = ++pc->useCounter;
+	for (i = 0; i < pc->nEnts; i++) {
+		if (strcmp(pc->ents[i]->path, pv->path) == 0) {
+			Free(pc->ents[i]);
+			pc->ents[i] = pv;
+			return;
+		}
+		if (pc->ents[i]->lastUsed < pc->ents[iOld]->lastUsed)
+			iOld = i;
+	}
+	if (pc->nEnts < CAD_PREVIEW_CACHE_MAX) {
+		pc->ents[pc->nEnts++] = pv;
+	} else {
+		Free(pc->ents[iOld]);
+		pc->ents[iOld] = pv;
+	}
+}
+
+/* Generate previews until no more are wanted. */
+static void
+PreviewJob(void *arg)
+{
+	CAD_PreviewCache *pc = arg;
+	CAD_Preview *pv;
+	int rv;
+
+	for (;;) {
+		AG_MutexLock(&pc->lock);
+		if (pc->want[0] == '\0') {
+			pc->cur[0] = '\0';
+			pc->running = 0;
+			AG_MutexUnlock(&pc->lock);
+			return;
+		}
+		pv = Malloc(sizeof(CAD_Preview));
+		memset(pv, 0, sizeof(CAD_Preview));
+		Strlcpy(pv->path, pc->want, sizeof(pv->path));
+		pv->mtime = pc->wantMtime;
+		pv->kind = pc->wantKind;
+		Strlcpy(pc->cur, pc->want, sizeof(pc->cur));
+		pc->want[0] = '\0';
+		AG_MutexUnlock(&pc->lock);
+
+		if (ReadCached(pc, pv) == -1) {
+			ClearImage(pv);
+			switch (pv->kind) {
+			case CAD_PREVIEW_PART:
+				rv = PreviewPart(pv);
+				break;
+			case CAD_PREVIEW_PROGRAM:
+				rv = PreviewProgram(pv);
+				break;
+			default:
+				rv = PreviewSketch(pv);
+				break;
+			}
+			if (rv == 0) {
+				if (WriteCached(pc, pv) == -1)
+					Verbose("%s\n", AG_GetError());
+			} else {
+				Strlcpy(pv->errMsg, AG_GetError(),
+				    sizeof(pv->errMsg));
+			}
+		}
+		AG_MutexLock(&pc->lock);
+		InsertPreview(pc, pv);
+		AG_MutexUnlock(&pc->lock);
+	}
+}
+
+/*
+ * Copy the preview of a document into pv. Return 0 if it is available,
+ * 1 if it is being generated (call again later) or -1 if the file is not
+ * a document. Must be called from the main thread.
+ */
+int
+CAD_PreviewGet(const char *path, CAD_Preview *pv)
+{
+	CAD_PreviewCache *pc = &cadPreviews;
+	AG_ObjectClass *cls;
+	AG_FileInfo fi;
+	int submit = 0;
+	Uint i;
+
+	if ((cls = CAD_DocumentClass(path)) == NULL) {
+		AG_SetError(_("%s: Not a cadtools document"), path);
+		return (-1);
+	}
+	if (AG_GetFileInfo(path, &fi) == -1) {
+		return (-1);
+	}
+	if (!previewsInited) {
+		InitCache(pc);
+	}
+	AG_MutexLock(&pc->lock);
+	for (i = 0; i < pc->nEnts; i++) {
+		CAD_Preview *ent = pc->ents[i];
+
+		if (strcmp(ent->path, path) == 0 &&
+		    ent->mtime == (Uint64)fi.mtime) {
+			ent->lastUsed = ++pc->useCounter;
+			memcpy(pv, ent, sizeof(CAD_Preview));
+			AG_MutexUnlock(&pc->lock);
+			return (0);
+		}
+	}
+	if (strcmp(pc->cur, path) != 0) {
+		Strlcpy(pc->want, path, sizeof(pc->want));
+		pc->wantMtime = (Uint64)fi.mtime;
+		if (cls == &cadPartClass) {
+			pc->wantKind = CAD_PREVIEW_PART;
+		} else if (cls == &camProgramClass) {
+			pc->wantKind = CAD_PREVIEW_PROGRAM;
+		} else {
+			pc->wantKind = CAD_PREVIEW_SKETCH;
+		}
+		if (!pc->running) {
+			pc->running = 1;
+			submit = 1;
+		}
+	}
+	AG_MutexUnlock(&pc->lock);
+
+	if (submit) {
+		CAD_JobSubmit(&pc->group, PreviewJob, pc);
+	}
+	return (1);
+}
+
+/* Wait for the preview generator and release the cache. */
+void
+CAD_PreviewDestroy(void)
+{
+	CAD_PreviewCache *pc = &cadPreviews;
+	Uint i;
+
+	if (!previewsInited) {
+		return;
+	}
+	AG_MutexLock(&pc->lock);
+	pc->want[0] = '\0';
+	AG_MutexUnlock(&pc->lock);
+	CAD_JobGroupWait(&pc->group);
+	CAD_JobGroupDestroy(&pc->group);
+	for (i = 0; i < pc->nEnts; i++) {
+		Free(pc->ents[i]);
+	}
+	Free(pc->ents);
+	AG_MutexDestroy(&pc->lock);
+	previewsInited = 0;
+}
+
+/* Display a preview (or a message if pv is NULL) in the preview pane. */
+static void
+ShowPreview(AG_Box *box, const CAD_Preview *pv, const char *msg)
+{
+	AG_Pixmap *px = AG_GetPointer(box, "pixmap");
+	AG_Surface *su = AG_GetPointer(box, "surface");
+	AG_Label *lbl = AG_GetPointer(box, "label");
+	const Uint8 *p;
+	int x, y;
+
+	for (y = 0; y < CAD_PREVIEW_SIZE; y++) {
+		for (x = 0; x < CAD_PREVIEW_SIZE; x++) {
+			if (pv != NULL) {
+				p = &pv->px[(y*CAD_PREVIEW_SIZE + x)*4];
+				AG_SurfacePut32(su, x, y,
+				    AG_MapPixel_RGBA8(&su->format,
+				    p[0], p[1], p[2], p[3]));
+			} else {
+				AG_SurfacePut32(su, x, y,
+				    AG_MapPixel_RGBA8(&su->format,
+				    245, 245, 245, 255));
+			}
+		}
+	}
+	AG_PixmapUpdateSurface(px, 0);
+
+	if (pv == NULL) {
+		AG_LabelTextS(lbl, msg);
+	} else if (pv->errMsg[0] != '\0') {
+		AG_LabelText(lbl, _("No preview: %s"), pv->errMsg);
+	} else if (pv->kind == CAD_PREVIEW_PART) {
+		if (pv->nTris == CAD_PREVIEW_UNKNOWN) {
+			AG_LabelText(lbl, _("Part: %s\nFeatures: %u"),
+			    pv->descr[0] != '\0' ? pv->descr : _("(none)"),
+			    pv->nFeatures);
+		} else {
+			AG_LabelText(lbl,
+			    _("Part: %s\nFeatures: %u\nTriangles: %u"),
+			    pv->descr[0] != '\0' ? pv->descr : _("(none)"),
+			    pv->nFeatures, pv->nTris);
+		}
+	} else if (pv->kind == CAD_PREVIEW_PROGRAM) {
+		AG_LabelText(lbl, _("Program: %s\nLength: %u lines (%u bytes)"),
+		    pv->progType < CAM_PROGRAM_TYPE_LAST ?
+		    _(camProgramTypeStrings[pv->progType]) : "?",
+		    pv->progLines, pv->progBytes);
+	} else {
+		AG_LabelText(lbl, _("Sketch\nEntities: %u"), pv->nEntities);
+	}
+}
+
+static Uint32
+PollPreview(AG_Timer *to, AG_Event *event)
+{
+	AG_Box *box = AG_PTR(1);
+	char path[AG_PATHNAME_MAX];
+	CAD_Preview *pv;
+	int rv;
+
+	AG_GetString(box, "path", path, sizeof(path));
+	pv = Malloc(sizeof(CAD_Preview));
+	if ((rv = CAD_PreviewGet(path, pv)) == 1) {
+		ShowPreview(box, NULL, _("Generating preview..."));
+		Free(pv);
+		return (PREVIEW_POLL);
+	}
+	if (rv == 0) {
+		ShowPreview(box, pv, NULL);
+	} else {
+		ShowPreview(box, NULL, "");
+	}
+	Free(pv);
+	AG_SetInt(box, "polling", 0);
+	return (0);
+}
+
+static void
+PreviewFileSelected(AG_Event *event)
+{
+	AG_Box *box = AG_PTR(1);
+	const char *path = AG_STRING(2);
+
+	AG_SetString(box, "path", path);
+	if (!AG_GetInt(box, "polling")) {
+		AG_SetInt(box, "polling", 1);
+		AG_AddTimerAuto(box, 1, PollPreview, "%p", box);
+	}
+}
+
+/*
+ * Create a preview pane showing a thumbnail and metadata of the file
+ * selected in a file dialog.
+ */
+void
+CAD_PreviewPaneNew(void *parent, AG_FileDlg *fd)
+{
+	AG_Box *box;
+	AG_Surface *su;
+
+	box = AG_BoxNewVert(parent, AG_BOX_HFILL);
+	su = AG_SurfaceStdRGBA(CAD_PREVIEW_SIZE, CAD_PREVIEW_SIZE);
+	AG_SetPointer(box, "surface", su);
+	AG_SetPointer(box, "pixmap", AG_PixmapFromSurfaceNODUP(box, 0, su));
+	AG_SetPointer(box, "label", AG_LabelNewS(box, AG_LABEL_HFILL, ""));
+	AG_SetString(box, "path", "");
+	AG_SetInt(box, "polling", 0);
+	ShowPreview(box, NULL, "");
+
+	AG_AddEvent(fd, "file-selected", PreviewFileSelected, "%p", box);
+}
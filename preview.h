@@ -0,0 +1,53 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_PREVIEW_H_
+#define _CADTOOLS_PREVIEW_H_
+
+#include "begin_code.h"
+
+#define CAD_PREVIEW_SIZE	96		/* Thumbnail width and height */
+#define CAD_PREVIEW_CACHE_MAX	128		/* Previews kept in memory */
+#define CAD_PREVIEW_UNKNOWN	((Uint)-1)	/* Count not recorded */
+
+/* Thumbnail and metadata of a document file. */
+typedef struct cad_preview {
+	char path[AG_PATHNAME_MAX];		/* Document file */
+	Uint64 mtime;				/* Modification time of file */
+	int kind;
+#define CAD_PREVIEW_PART	0
+#define CAD_PREVIEW_PROGRAM	1
+#define CAD_PREVIEW_SKETCH	2
+	char errMsg[128];			/* Generation failed (or "") */
+	char descr[CAD_PART_DESCR_MAX];		/* Part description */
+	Uint nFeatures;				/* Features of part */
+	Uint nTris;				/* Triangles of part */
+	Uint progType;				/* Program language */
+	Uint progLines, progBytes;		/* Length of program */
+	Uint nEntities;				/* Entities of sketch */
+	Uint32 lastUsed;			/* Use counter */
+	Uint8 px[CAD_PREVIEW_SIZE*CAD_PREVIEW_SIZE*4];	/* Thumbnail (RGBA) */
+} CAD_Preview;
+
+/* Previews of recently browsed files, and their generator. */
+typedef struct cad_preview_cache {
+	AG_Mutex lock;
+	char dir[AG_PATHNAME_MAX];		/* Cache directory */
+	CAD_Preview **ents;			/* Generated previews */
+	Uint nEnts;
+	Uint32 useCounter;
+	char want[AG_PATHNAME_MAX];		/* To generate next (or "") */
+	Uint64 wantMtime;
+	int wantKind;
+	char cur[AG_PATHNAME_MAX];		/* Being generated (or "") */
+	int running;				/* Generator job submitted */
+	CAD_JobGroup group;
+} CAD_PreviewCache;
+
+__BEGIN_DECLS
+int	CAD_PreviewGet(const char *, CAD_Preview *);
+void	CAD_PreviewDestroy(void);
+void	CAD_PreviewPaneNew(void *, AG_FileDlg *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_PREVIEW_H_ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Timing of the startup phases. Phases are recorded unconditionally (the
+ * overhead is a clock read per phase) and reported on the standard error
+ * once startup is complete if the -P option was given.
+ */
+
+#include <agar/core.h>
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "cadtools.h"
+
+int cadProfileStartup = 0;			/* Report startup timings */
+
+static CAD_ProfilePhase phases[CAD_PROFILE_PHASES_MAX];
+static Uint nPhases = 0;
+static Uint64 tStart = 0;			/* First clock reading */
+
+/* Return the current time in microseconds. */
+Uint64
+CAD_ProfileNow(void)
+{
+	struct timeval tv;
+	Uint64 t;
+
+	gettimeofday(&tv, NULL);
+	t = (Uint64)tv.tv_sec*1000000 + (Uint64)tv.tv_usec;
+	if (tStart == 0) {
+		tStart = t;
+	}
+	return (t);
+}
+
+/* Record a phase which started at time t0 and has just completed. */
+void
+CAD_ProfileRecord(const char *name, Uint64 t0)
+{
+	if (nPhases < CAD_PROFILE_PHASES_MAX) {
+		phases[nPhases].name = name;
+		phases[nPhases].usec = CAD_ProfileNow() - t0;
+		nPhases++;
+	}
+}
+
+/* Print the phases recorded so far, and the time elapsed since startup. */
+void
+CAD_ProfileReport(void)
+{
+	Uint i;
+
+	if (!cadProfileStartup) {
+		return;
+	}
+	fprintf(stderr, "Startup profile:\n");
+	for (i = 0; i < nPhases; i++) {
+		fprintf(stderr, "  %-24s %10.3f ms\n", phases[i].name,
+		    (double)phases[i].usec/1000.0);
+	}
+	fprintf(stderr, "  %-24s %10.3f ms\n", "Total (wall clock)",
+	    (double)(CAD_ProfileNow() - tStart)/1000.0);
+}
@@ -0,0 +1,25 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_PROFILE_H_
+#define _CADTOOLS_PROFILE_H_
+
+#include "begin_code.h"
+
+#define CAD_PROFILE_PHASES_MAX	32
+
+/* Time taken by a startup phase. */
+typedef struct cad_profile_phase {
+	const char *name;
+	Uint64 usec;
+} CAD_ProfilePhase;
+
+__BEGIN_DECLS
+extern int cadProfileStartup;
+
+Uint64	CAD_ProfileNow(void);
+void	CAD_ProfileRecord(const char *, Uint64);
+void	CAD_ProfileReport(void);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_PROFILE_H_ */
@@ -44,8 +44,14 @@ Init(void *obj)
 
 	prog->type = CAM_PROGRAM_FABBSD;
 	prog->flags = 0;
-	AG_TextInit(&prog->text, 0);
-	AG_TextSetS(&prog->text, "/* FabBSD program */\n");
+	prog->text = Malloc(sizeof(CAM_ProgramText));
+	AG_MutexInit(&prog->text->lock);
+	prog->text->nRefs = 1;
+	AG_TextInit(&prog->text->text, 0);
+	AG_TextSetS(&prog->text->text, "/* FabBSD program */\n");
+	CAD_JournalInit(&prog->journal, prog);
+	CAD_GenerationInit(&prog->gen);
+	prog->textChanged = 0;
 }
 
 static void
@@ -53,7 +59,8 @@ Destroy(void *obj)
 {
 	CAM_Program *prog = obj;
 
-	AG_TextDestroy(&prog->text);
+	CAM_ProgramReleaseText(prog->text);
+	CAD_JournalDestroy(&prog->journal);
 }
 
 static int
@@ -63,7 +70,7 @@ Load(void *obj, AG_DataSource *ds, const AG_Version *ver)
 
 	prog->type = (enum cam_program_type)AG_ReadUint8(ds);
 	prog->flags = (Uint)AG_ReadUint32(ds);
-	return AG_TextLoad(&prog->text, ds);
+	return AG_TextLoad(&prog->text->text, ds);
 }
 
 static int
@@ -73,10 +80,86 @@ Save(void *obj, AG_DataSource *ds)
 
 	AG_WriteUint8(ds, (Uint8)prog->type);
 	AG_WriteUint32(ds, (Uint32)prog->flags);
-	AG_TextSave(ds, &prog->text);
+	AG_TextSave(ds, &prog->text->text);
 	return (0);
 }
 
+/* Take a reference on the text of a program. */
+CAM_ProgramText *
+CAM_ProgramHoldText(CAM_Program *prog)
+{
+	CAM_ProgramText *pt = prog->text;
+
+	AG_MutexLock(&pt->lock);
+	pt->nRefs++;
+	AG_MutexUnlock(&pt->lock);
+	return (pt);
+}
+
+/* Drop a reference on program text (may be called from a job). */
+void
+CAM_ProgramReleaseText(CAM_ProgramText *pt)
+{
+	Uint nRefs;
+
+	AG_MutexLock(&pt->lock);
+	nRefs = --pt->nRefs;
+	AG_MutexUnlock(&pt->lock);
+	if (nRefs > 0) {
+		return;
+	}
+	AG_TextDestroy(&pt->text);
+	AG_MutexDestroy(&pt->lock);
+	Free(pt);
+}
+
+/*
+ * Serialize a program as by AG_ObjectSerialize(), given its settings and
+ * held text. This may be called from a job, while the original program is
+ * edited or destroyed. The reference on the text is passed on.
+ */
+int
+CAM_ProgramSerialize(const char *name, enum cam_program_type type, Uint flags,
+    CAM_ProgramText *pt, AG_DataSource *ds)
+{
+	CAM_Program *prog;
+	int rv;
+
+	if ((prog = AG_ObjectNew(NULL, name, &camProgramClass)) == NULL) {
+		CAM_ProgramReleaseText(pt);
+		return (-1);
+	}
+	CAM_ProgramReleaseText(prog->text);
+	prog->text = pt;
+	prog->type = type;
+	prog->flags = flags;
+	rv = AG_ObjectSerialize(prog, ds);
+	AG_ObjectDestroy(prog);
+	return (rv);
+}
+
+static void
+TextChanged(AG_Event *event)
+{
+	CAM_Program *prog = AG_PTR(1);
+
+	prog->textChanged = 1;
+}
+
+/* Record text edits in the undo journal once typing pauses. */
+static Uint32
+CommitText(AG_Timer *to, AG_Event *event)
+{
+	CAM_Program *prog = AG_PTR(1);
+
+	if (prog->textChanged) {
+		prog->textChanged = 0;
+		if (CAD_UndoCommit(prog, _("Edit text")) == -1)
+			Verbose("%s\n", AG_GetError());
+	}
+	return (to->ival);
+}
+
 static void *
 Edit(void *obj)
 {
@@ -88,11 +171,15 @@ Edit(void *obj)
 
 	AG_WindowSetCaption(win, _("Program: %s"), AGOBJECT(prog)->name);
 	tb = AG_TextboxNew(win, AG_TEXTBOX_MULTILINE|AG_TEXTBOX_EXPAND, NULL);
-	AG_TextboxBindText(tb, &prog->text);
+	AG_TextboxBindText(tb, &prog->text->text);
+	AG_SetEvent(tb, "textbox-postchg", TextChanged, "%p", prog);
 	
 	AG_LabelNew(win, 0, _("Program type:"));
 	AG_RadioNewUint(win, 0, camProgramTypeStrings, &prog->type);
 
+	AG_InitTimer(&prog->undoTimer, "undo", 0);
+	AG_AddTimer(win, &prog->undoTimer, 1000, CommitText, "%p", prog);
+
 	AG_WindowSetGeometryAlignedPct(win, AG_WINDOW_MC, 60, 50);
 	return (win);
 }
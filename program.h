@@ -11,16 +11,36 @@ enum cam_program_type {
 	CAM_PROGRAM_TYPE_LAST
 };
 
+/*
+ * Program text. It is reference counted so that the autosave job can
+ * serialize it while the program is edited or closed; the text itself is
+ * locked by the textbox and by AG_TextSave().
+ */
+typedef struct cam_program_text {
+	AG_Mutex lock;				/* Protects nRefs */
+	Uint nRefs;				/* Program and holders */
+	AG_Text text;
+} CAM_ProgramText;
+
 typedef struct cam_program {
 	struct ag_object obj;
 	enum cam_program_type type;		/* Program language */
 	Uint flags;
-	AG_Text text;				/* Program text */
+	CAM_ProgramText *text;			/* Program text */
+	CAD_Journal journal;			/* Undo history */
+	CAD_Generation gen;			/* Change tracking */
+	AG_Timer undoTimer;			/* Records text edits */
+	int textChanged;
 } CAM_Program;
 
 __BEGIN_DECLS
 extern AG_ObjectClass camProgramClass;
 extern const char *camProgramTypeStrings[];
+
+CAM_ProgramText	*CAM_ProgramHoldText(CAM_Program *);
+void		 CAM_ProgramReleaseText(CAM_ProgramText *);
+int		 CAM_ProgramSerialize(const char *, enum cam_program_type,
+		                      Uint, CAM_ProgramText *, AG_DataSource *);
 __END_DECLS
 
 #include "close_code.h"
@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Software renderer for meshes, for use without a display or GPU (batch
+ * mode, thumbnails and visual regression tests).
+ *
+ * Vertices are transformed and triangles are set up in parallel, then
+ * binned into tiles of CAD_RENDER_TILE pixels which are rasterized by
+ * independent jobs on the pool. Triangles are flat shaded by a light
+ * fixed relative to the camera. Edge functions are evaluated for four
+ * pixels at a time, in fixed-width loops which the compiler can turn
+ * into vector instructions.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cadtools.h"
+
+#define RENDER_EDGE_EPS	(-1e-5f)	/* Tolerance on edges (barycentric) */
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+static const float renderLight[3] = { -0.199f, 0.398f, 0.896f };
+
+void
+CAD_ImageInit(CAD_Image *img, Uint w, Uint h)
+{
+	img->w = w;
+	img->h = h;
+	img->px = Malloc(w*h*4);
+	img->z = Malloc(w*h*sizeof(float));
+}
+
+void
+CAD_ImageFree(CAD_Image *img)
+{
+	Free(img->px);
+	Free(img->z);
+}
+
+/* Write an image in binary PPM format (the alpha channel is dropped). */
+int
+CAD_ImageSavePPM(const CAD_Image *img, const char *path)
+{
+	char hdr[64];
+	AG_DataSource *ds;
+	Uint8 *row;
+	Uint x, y;
+	int rv = -1;
+
+	if ((ds = AG_OpenFile(path, "wb")) == NULL) {
+		return (-1);
+	}
+	row = Malloc(img->w*3);
+	snprintf(hdr, sizeof(hdr), "P6\n%u %u\n255\n", img->w, img->h);
+	if (AG_Write(ds, hdr, strlen(hdr)) == -1) {
+		goto out;
+	}
+	for (y = 0; y < img->h; y++) {
+		const Uint8 *p = &img->px[y*img->w*4];
+
+		for (x = 0; x < img->w; x++) {
+			row[x*3] = p[x*4];
+			row[x*3+1] = p[x*4+1];
+			row[x*3+2] = p[x*4+2];
+		}
+		if (AG_Write(ds, row, img->w*3) == -1)
+			goto out;
+	}
+	rv = 0;
+out:
+	Free(row);
+	AG_CloseFile(ds);
+	return (rv);
+}
+
+void
+CAD_RenderViewInit(CAD_RenderView *view)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 4; j++)
+			view->T[i][j] = (i == j) ? 1.0f : 0.0f;
+	}
+	view->flags = 0;
+	view->fovY = 60.0f;
+	view->pNear = 0.1f;
+	view->scale = 1.0f;
+	view->color[0] = 140;
+	view->color[1] = 160;
+	view->color[2] = 190;
+	view->color[3] = 255;
+	view->bg[0] = 245;
+	view->bg[1] = 245;
+	view->bg[2] = 245;
+	view->bg[3] = 255;
+}
+
+/*
+ * Set up a view from an SG camera, for geometry positioned by the given
+ * SG node (or in world coordinates if node is NULL).
+ */
+void
+CAD_RenderViewCamera(CAD_RenderView *view, void *pCam, void *node)
+{
+	SG_Camera *cam = pCam;
+	M_Matrix44 V, T;
+	M_Real sum;
+	int i, j, k;
+
+	SG_GetNodeTransformInverse(cam, &V);
+	if (node != NULL) {
+		SG_GetNodeTransform(node, &T);
+	} else {
+		M_MatIdentity44v(&T);
+	}
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 4; j++) {
+			for (k = 0, sum = 0.0; k < 4; k++) {
+				sum += V.m[i][k]*T.m[k][j];
+			}
+			view->T[i][j] = (float)sum;
+		}
+	}
+	view->fovY = (float)cam->fovY;
+	view->pNear = (float)cam->pNear;
+}
+
+/* Transform a range of vertices into camera space. */
+static void
+TransformJob(void *p)
+{
+	CAD_RenderRange *rr = p;
+	const CAD_Mesh *m = rr->r->m;
+	const float (*T)[4] = rr->r->view->T;
+	Uint i;
+
+	for (i = rr->start; i < rr->end; i++) {
+		const float *v = &m->v[i*3];
+		float *vc = &rr->r->vc[i*3];
+
+		vc[0] = T[0][0]*v[0] + T[0][1]*v[1] + T[0][2]*v[2] + T[0][3];
+		vc[1] = T[1][0]*v[0] + T[1][1]*v[1] + T[1][2]*v[2] + T[1][3];
+		vc[2] = T[2][0]*v[0] + T[2][1]*v[1] + T[2][2]*v[2] + T[2][3];
+	}
+}
+
+/* Compute the mapping from (projected) camera space to the image. */
+static void
+SetupProjection(CAD_Render *r)
+{
+	const CAD_RenderView *view = r->view;
+	const CAD_Image *img = r->img;
+	float xMin = FLT_MAX, xMax = -FLT_MAX, yMin = FLT_MAX, yMax = -FLT_MAX;
+	float s, sw, sh;
+	Uint i;
+
+	r->cx = (float)img->w/2.0f;
+	r->cy = (float)img->h/2.0f;
+	if (view->flags & CAD_RENDER_FIT) {
+		for (i = 0; i < r->m->nv; i++) {
+			const float *vc = &r->vc[i*3];
+
+			if (vc[0] < xMin) { xMin = vc[0]; }
+			if (vc[0] > xMax) { xMax = vc[0]; }
+			if (vc[1] < yMin) { yMin = vc[1]; }
+			if (vc[1] > yMax) { yMax = vc[1]; }
+		}
+		sw = (xMax > xMin) ? (float)(img->w-4)/(xMax-xMin) : FLT_MAX;
+		sh = (yMax > yMin) ? (float)(img->h-4)/(yMax-yMin) : FLT_MAX;
+		s = (sw < sh) ? sw : sh;
+		if (s == FLT_MAX) {
+			s = 1.0f;
+		}
+		r->sx = r->sy = s;
+		r->cx -= s*(xMin+xMax)/2.0f;
+		r->cy += s*(yMin+yMax)/2.0f;
+	} else if (view->flags & CAD_RENDER_ORTHO) {
+		r->sx = r->sy = view->scale;
+	} else {
+		r->sx = r->sy = ((float)img->h/2.0f) /
+		    tanf(view->fovY*(float)M_PI/360.0f);
+	}
+}
+
+/*
+ * Set up a range of triangles: project the vertices, compute the edge
+ * functions and depth plane in image space and the shaded color.
+ */
+static void
+SetupJob(void *p)
+{
+	CAD_RenderRange *rr = p;
+	CAD_Render *r = rr->r;
+	const CAD_Mesh *m = r->m;
+	const CAD_RenderView *view = r->view;
+	const int persp = !(view->flags & (CAD_RENDER_ORTHO|CAD_RENDER_FIT));
+	Uint i, j, k;
+
+	for (i = rr->start; i < rr->end; i++) {
+		CAD_RenderTri *t = &r->tris[i];
+		const Uint32 *idx = &m->tri[i*3];
+		const float *vc[3];
+		float p[3][3], e1[3], e2[3], n[3], area, len, shade, c[3];
+		float xMin, xMax, yMin, yMax;
+
+		t->rgba[3] = 0;
+		if (idx[0] >= m->nv || idx[1] >= m->nv || idx[2] >= m->nv) {
+			continue;
+		}
+		for (j = 0; j < 3; j++) {
+			vc[j] = &r->vc[idx[j]*3];
+			if (persp) {
+				if (-vc[j][2] <= view->pNear) {
+					break;			/* Near clip */
+				}
+				p[j][0] = r->cx + r->sx*vc[j][0]/(-vc[j][2]);
+				p[j][1] = r->cy - r->sy*vc[j][1]/(-vc[j][2]);
+				p[j][2] = 1.0f/(-vc[j][2]);
+			} else {
+				p[j][0] = r->cx + r->sx*vc[j][0];
+				p[j][1] = r->cy - r->sy*vc[j][1];
+				p[j][2] = vc[j][2];
+			}
+		}
+		if (j < 3) {
+			continue;
+		}
+		area = (p[1][0]-p[0][0])*(p[2][1]-p[0][1]) -
+		       (p[1][1]-p[0][1])*(p[2][0]-p[0][0]);
+		if (area == 0.0f || !isfinite(area)) {
+			continue;
+		}
+		xMin = xMax = p[0][0];
+		yMin = yMax = p[0][1];
+		for (j = 1; j < 3; j++) {
+			if (p[j][0] < xMin) { xMin = p[j][0]; }
+			if (p[j][0] > xMax) { xMax = p[j][0]; }
+			if (p[j][1] < yMin) { yMin = p[j][1]; }
+			if (p[j][1] > yMax) { yMax = p[j][1]; }
+		}
+		if (xMax < 0.0f || xMin > (float)(r->img->w-1) ||
+		    yMax < 0.0f || yMin > (float)(r->img->h-1)) {
+			continue;				/* Off image */
+		}
+		for (j = 0; j < 3; j++) {
+			const float *a = p[(j+1)%3], *b = p[(j+2)%3];
+
+			t->e[j][0] = (a[1] - b[1])/area;
+			t->e[j][1] = (b[0] - a[0])/area;
+			t->e[j][2] = ((b[1]-a[1])*a[0] - (b[0]-a[0])*a[1])/area;
+		}
+		for (k = 0; k < 3; k++) {
+			t->z[k] = t->e[0][k]*p[0][2] + t->e[1][k]*p[1][2] +
+			          t->e[2][k]*p[2][2];
+		}
+		t->x1 = (xMin > 0.0f) ? (int)xMin : 0;
+		t->y1 = (yMin > 0.0f) ? (int)yMin : 0;
+		t->x2 = (xMax < (float)(r->img->w-1)) ? (int)xMax :
+		        (int)r->img->w-1;
+		t->y2 = (yMax < (float)(r->img->h-1)) ? (int)yMax :
+		        (int)r->img->h-1;
+
+		for (j = 0; j < 3; j++) {
+			e1[j] = vc[1][j] - vc[0][j];
+			e2[j] = vc[2][j] - vc[0][j];
+		}
+		n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+		n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+		n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+		len = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		shade = (len > 0.0f) ? fabsf(n[0]*renderLight[0] +
+		                             n[1]*renderLight[1] +
+		                             n[2]*renderLight[2])/len : 1.0f;
+		shade = 0.25f + 0.75f*shade;
+		for (k = 0; k < 3; k++) {
+			if (m->flags & CAD_MESH_COLORS) {
+				c[k] = ((float)m->c[idx[0]*4+k] +
+				        (float)m->c[idx[1]*4+k] +
+				        (float)m->c[idx[2]*4+k])/3.0f;
+			} else {
+				c[k] = (float)view->color[k];
+			}
+			t->rgba[k] = (Uint8)(c[k]*shade);
+		}
+		t->rgba[3] = 255;
+	}
+}
+
+/* Assign the triangles to the tiles their bounding boxes overlap. */
+static void
+BinTriangles(CAD_Render *r)
+{
+	Uint i, tx, ty;
+
+	for (i = 0; i < r->m->nt; i++) {
+		const CAD_RenderTri *t = &r->tris[i];
+
+		if (t->rgba[3] == 0) {
+			continue;
+		}
+		for (ty = t->y1/CAD_RENDER_TILE;
+		     ty <= (Uint)t->y2/CAD_RENDER_TILE; ty++) {
+			for (tx = t->x1/CAD_RENDER_TILE;
+			     tx <= (Uint)t->x2/CAD_RENDER_TILE; tx++) {
+				CAD_RenderTile *tile;
+
+				tile = &r->tiles[ty*r->nTilesX + tx];
+				if (tile->nTris+1 > tile->maxTris) {
+					tile->maxTris = (tile->maxTris > 0) ?
+					    tile->maxTris*2 : 256;
+					tile->tris = Realloc(tile->tris,
+					    tile->maxTris*sizeof(Uint32));
+				}
+				tile->tris[tile->nTris++] = (Uint32)i;
+			}
+		}
+	}
+}
+
+/* Clear a tile and rasterize the triangles binned into it. */
+static void
+RasterJob(void *p)
+{
+	CAD_RenderTile *tile = p;
+	CAD_Image *img = tile->r->img;
+	const Uint8 *bg = tile->r->view->bg;
+	Uint i, o;
+	int x, y, x1, x2, y1, y2, k;
+
+	for (y = tile->y; y < (int)(tile->y + tile->h); y++) {
+		for (x = tile->x; x < (int)(tile->x + tile->w); x++) {
+			o = y*img->w + x;
+			memcpy(&img->px[o*4], bg, 4);
+			img->z[o] = -FLT_MAX;
+		}
+	}
+	for (i = 0; i < tile->nTris; i++) {
+		const CAD_RenderTri *t = &tile->r->tris[tile->tris[i]];
+
+		x1 = (t->x1 > (int)tile->x) ? t->x1 : (int)tile->x;
+		y1 = (t->y1 > (int)tile->y) ? t->y1 : (int)tile->y;
+		x2 = (t->x2 < (int)(tile->x + tile->w-1)) ? t->x2 :
+		     (int)(tile->x + tile->w-1);
+		y2 = (t->y2 < (int)(tile->y + tile->h-1)) ? t->y2 :
+		     (int)(tile->y + tile->h-1);
+
+		for (y = y1; y <= y2; y++) {
+			const float fy = (float)y + 0.5f;
+
+			for (x = x1; x <= x2; x += 4) {
+				float w0[4], w1[4], w2[4], z[4], fx;
+
+				for (k = 0; k < 4; k++) {
+					fx = (float)(x+k) + 0.5f;
+					w0[k] = t->e[0][0]*fx + t->e[0][1]*fy +
+					        t->e[0][2];
+					w1[k] = t->e[1][0]*fx + t->e[1][1]*fy +
+					        t->e[1][2];
+					w2[k] = t->e[2][0]*fx + t->e[2][1]*fy +
+					        t->e[2][2];
+					z[k] = t->z[0]*fx + t->z[1]*fy +
+					       t->z[2];
+				}
+				for (k = 0; k < 4 && x+k <= x2; k++) {
+					if (w0[k] < RENDER_EDGE_EPS ||
+					    w1[k] < RENDER_EDGE_EPS ||
+					    w2[k] < RENDER_EDGE_EPS) {
+						continue;
+					}
+					o = y*img->w + x+k;
+					if (z[k] <= img->z[o]) {
+						continue;
+					}
+					img->z[o] = z[k];
+					memcpy(&img->px[o*4], t->rgba, 4);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Render a mesh into an image (of any size), clearing it first. The jobs
+ * run on the pool; this may be called from a job itself.
+ */
+void
+CAD_RenderMesh(CAD_Image *img, const CAD_Mesh *m, const CAD_RenderView *view)
+{
+	CAD_Render r;
+	CAD_RenderRange *ranges = NULL;
+	CAD_JobGroup group;
+	Uint i, n, nTiles;
+
+	r.m = m;
+	r.view = view;
+	r.img = img;
+	r.vc = NULL;
+	r.tris = NULL;
+	r.nTilesX = (img->w + CAD_RENDER_TILE-1)/CAD_RENDER_TILE;
+	r.nTilesY = (img->h + CAD_RENDER_TILE-1)/CAD_RENDER_TILE;
+	nTiles = r.nTilesX*r.nTilesY;
+	r.tiles = Malloc(nTiles*sizeof(CAD_RenderTile));
+	for (i = 0; i < nTiles; i++) {
+		CAD_RenderTile *tile = &r.tiles[i];
+
+		tile->r = &r;
+		tile->x = (i % r.nTilesX)*CAD_RENDER_TILE;
+		tile->y = (i / r.nTilesX)*CAD_RENDER_TILE;
+		tile->w = MIN(CAD_RENDER_TILE, img->w - tile->x);
+		tile->h = MIN(CAD_RENDER_TILE, img->h - tile->y);
+		tile->tris = NULL;
+		tile->nTris = 0;
+		tile->maxTris = 0;
+	}
+	CAD_JobGroupInit(&group);
+
+	if (m->nv > 0 && m->nt > 0) {
+		r.vc = Malloc(m->nv*3*sizeof(float));
+		r.tris = Malloc(m->nt*sizeof(CAD_RenderTri));
+		n = MAX((m->nv + CAD_RENDER_VERTS_JOB-1)/CAD_RENDER_VERTS_JOB,
+		        (m->nt + CAD_RENDER_TRIS_JOB-1)/CAD_RENDER_TRIS_JOB);
+		ranges = Malloc(n*sizeof(CAD_RenderRange));
+
+		for (i = 0; i*CAD_RENDER_VERTS_JOB < m->nv; i++) {
+			ranges[i].r = &r;
+			ranges[i].start = i*CAD_RENDER_VERTS_JOB;
+			ranges[i].end = MIN(m->nv, (i+1)*CAD_RENDER_VERTS_JOB);
+			CAD_JobSubmit(&group, TransformJob, &ranges[i]);
+		}
+		CAD_JobGroupWait(&group);
+		SetupProjection(&r);
+
+		for (i = 0; i*CAD_RENDER_TRIS_JOB < m->nt; i++) {
+			ranges[i].r = &r;
+			ranges[i].start = i*CAD_RENDER_TRIS_JOB;
+			ranges[i].end = MIN(m->nt, (i+1)*CAD_RENDER_TRIS_JOB);
+			CAD_JobSubmit(&group, SetupJob, &ranges[i]);
+		}
+		CAD_JobGroupWait(&group);
+		BinTriangles(&r);
+	}
+	for (i = 0; i < nTiles; i++) {
+		CAD_JobSubmit(&group, RasterJob, &r.tiles[i]);
+	}
+	CAD_JobGroupWait(&group);
+	CAD_JobGroupDestroy(&group);
+
+	for (i = 0; i < nTiles; i++) {
+		Free(r.tiles[i].tris);
+	}
+	Free(r.tiles);
+	Free(ranges);
+	Free(r.tris);
+	Free(r.vc);
+}
+
+/*
+ * Render the merged geometry of a part as seen from one of the cameras
+ * of its scene (e.g., "CameraFront"). With CAD_RENDER_FIT, only the
+ * orientation of the camera is used and the part is scaled to fill the
+ * image. The part should have been regenerated.
+ */
+int
+CAD_RenderPart(CAD_Image *img, CAD_Part *part, const char *camName,
+    Uint flags)
+{
+	CAD_RenderView view;
+	SG_Camera *cam;
+
+	if ((cam = SG_FindNode(part->sg, camName)) == NULL ||
+	    !AG_OfClass(cam, "SG_Node:SG_Camera:*")) {
+		AG_SetError(_("No such camera: %s"), camName);
+		return (-1);
+	}
+	CAD_RenderViewInit(&view);
+	CAD_RenderViewCamera(&view, cam, part->so);
+	view.flags |= flags;
+	CAD_RenderMesh(img, CAD_PartMesh(part), &view);
+	return (0);
+}
@@ -0,0 +1,78 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_RENDER_H_
+#define _CADTOOLS_RENDER_H_
+
+#include "begin_code.h"
+
+#define CAD_RENDER_TILE		64		/* Tile width and height */
+#define CAD_RENDER_VERTS_JOB	65536		/* Vertices per setup job */
+#define CAD_RENDER_TRIS_JOB	16384		/* Triangles per setup job */
+
+/* Image rendered in memory. */
+typedef struct cad_image {
+	Uint w, h;
+	Uint8 *px;				/* RGBA, top row first */
+	float *z;				/* Depth (greater is closer) */
+} CAD_Image;
+
+/* Viewing parameters for CAD_RenderMesh(). */
+typedef struct cad_render_view {
+	float T[3][4];				/* Object to camera transform */
+	Uint flags;
+#define CAD_RENDER_ORTHO 0x01			/* Orthographic projection */
+#define CAD_RENDER_FIT	 0x02			/* Fit to image (ortho) */
+	float fovY;				/* Vertical field of view */
+	float pNear;				/* Near plane (perspective) */
+	float scale;				/* Pixels per unit (ortho) */
+	Uint8 color[4];				/* Surface color (RGBA) */
+	Uint8 bg[4];				/* Background color (RGBA) */
+} CAD_RenderView;
+
+/* Triangle set up for rasterization (in image coordinates). */
+typedef struct cad_render_tri {
+	float e[3][3];				/* Normalized edge functions */
+	float z[3];				/* Depth plane */
+	int x1, y1, x2, y2;			/* Bounding box (inclusive) */
+	Uint8 rgba[4];				/* Shaded color (a=0: culled) */
+} CAD_RenderTri;
+
+/* Triangles overlapping a tile of the image. */
+typedef struct cad_render_tile {
+	struct cad_render *r;
+	Uint x, y, w, h;
+	Uint32 *tris;				/* Indices into r->tris */
+	Uint nTris, maxTris;
+} CAD_RenderTile;
+
+/* State of a CAD_RenderMesh() operation, shared by its jobs. */
+typedef struct cad_render {
+	const CAD_Mesh *m;
+	const CAD_RenderView *view;
+	CAD_Image *img;
+	float *vc;				/* Vertices in camera space */
+	float sx, sy, cx, cy;			/* Projection to image */
+	CAD_RenderTri *tris;
+	CAD_RenderTile *tiles;
+	Uint nTilesX, nTilesY;
+} CAD_Render;
+
+/* Range of vertices or triangles processed by a setup job. */
+typedef struct cad_render_range {
+	CAD_Render *r;
+	Uint start, end;
+} CAD_RenderRange;
+
+__BEGIN_DECLS
+void	CAD_ImageInit(CAD_Image *, Uint, Uint);
+void	CAD_ImageFree(CAD_Image *);
+int	CAD_ImageSavePPM(const CAD_Image *, const char *);
+
+void	CAD_RenderViewInit(CAD_RenderView *);
+void	CAD_RenderViewCamera(CAD_RenderView *, void *, void *);
+void	CAD_RenderMesh(CAD_Image *, const CAD_Mesh *, const CAD_RenderView *);
+int	CAD_RenderPart(CAD_Image *, CAD_Part *, const char *, Uint);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_RENDER_H_ */
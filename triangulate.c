@@ -0,0 +1,773 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Triangulation of simple polygons with holes by ear clipping. Holes are
+ * first bridged into the outer contour. For large polygons, vertices are
+ * indexed along a z-order curve so that the "is this an ear" test only
+ * visits the vertices near the candidate triangle instead of the whole
+ * contour, which keeps the cost close to O(n log n) on typical outlines.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <math.h>
+
+#include "cadtools.h"
+#include "triangulate.h"
+
+#define NODES_PER_BLOCK	1024
+#define HASH_THRESHOLD	80		/* Use z-order hashing above this */
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+typedef struct tri_node {
+	Uint i;				/* Vertex index */
+	double x, y;
+	Uint32 z;			/* Z-order curve value */
+	int steiner;
+	struct tri_node *prev, *next;	/* Contour */
+	struct tri_node *prevZ, *nextZ;	/* Z-order list */
+} TriNode;
+
+typedef struct tri_block {
+	TriNode nodes[NODES_PER_BLOCK];
+	Uint n;
+	struct tri_block *next;
+} TriBlock;
+
+typedef struct tri_ctx {
+	TriBlock *blocks;
+	double minX, minY, invSize;
+	Uint32 *tris;			/* Output triangles */
+	Uint nTris, maxTris;
+} TriCtx;
+
+static void EarcutLinked(TriCtx *, TriNode *, int);
+
+static TriNode *
+NewNode(TriCtx *ctx, Uint i, double x, double y)
+{
+	TriBlock *b = ctx->blocks;
+	TriNode *p;
+
+	if (b == NULL || b->n == NODES_PER_BLOCK) {
+		b = Malloc(sizeof(TriBlock));
+		b->n = 0;
+		b->next = ctx->blocks;
+		ctx->blocks = b;
+	}
+	p = &b->nodes[b->n++];
+	p->i = i;
+	p->x = x;
+	p->y = y;
+	p->z = 0;
+	p->steiner = 0;
+	p->prev = NULL;
+	p->next = NULL;
+	p->prevZ = NULL;
+	p->nextZ = NULL;
+	return (p);
+}
+
+static void
+EmitTri(TriCtx *ctx, Uint a, Uint b, Uint c)
+{
+	Uint32 *t;
+
+	if (ctx->nTris+1 > ctx->maxTris) {
+		ctx->maxTris = (ctx->maxTris > 0) ? ctx->maxTris*2 : 64;
+		ctx->tris = Realloc(ctx->tris, ctx->maxTris*3*sizeof(Uint32));
+	}
+	t = &ctx->tris[ctx->nTris*3];
+	t[0] = (Uint32)a;
+	t[1] = (Uint32)b;
+	t[2] = (Uint32)c;
+	ctx->nTris++;
+}
+
+/* Twice the signed area of triangle pqr (negative if counterclockwise). */
+static __inline__ double
+Area(const TriNode *p, const TriNode *q, const TriNode *r)
+{
+	return (q->y - p->y)*(r->x - q->x) - (q->x - p->x)*(r->y - q->y);
+}
+
+static __inline__ int
+Equals(const TriNode *a, const TriNode *b)
+{
+	return (a->x == b->x && a->y == b->y);
+}
+
+static __inline__ int
+Sign(double v)
+{
+	return (v > 0.0) ? 1 : (v < 0.0) ? -1 : 0;
+}
+
+static __inline__ int
+PointInTriangle(double ax, double ay, double bx, double by, double cx,
+    double cy, double px, double py)
+{
+	return ((cx - px)*(ay - py) >= (ax - px)*(cy - py) &&
+	        (ax - px)*(by - py) >= (bx - px)*(ay - py) &&
+	        (bx - px)*(cy - py) >= (cx - px)*(by - py));
+}
+
+static __inline__ int
+OnSegment(const TriNode *p, const TriNode *q, const TriNode *r)
+{
+	return (q->x <= MAX(p->x, r->x) && q->x >= MIN(p->x, r->x) &&
+	        q->y <= MAX(p->y, r->y) && q->y >= MIN(p->y, r->y));
+}
+
+/* Test whether segments p1q1 and p2q2 intersect. */
+static int
+Intersects(const TriNode *p1, const TriNode *q1, const TriNode *p2,
+    const TriNode *q2)
+{
+	int o1 = Sign(Area(p1, q1, p2));
+	int o2 = Sign(Area(p1, q1, q2));
+	int o3 = Sign(Area(p2, q2, p1));
+	int o4 = Sign(Area(p2, q2, q1));
+
+	if (o1 != o2 && o3 != o4) { return (1); }
+	if (o1 == 0 && OnSegment(p1, p2, q1)) { return (1); }
+	if (o2 == 0 && OnSegment(p1, q2, q1)) { return (1); }
+	if (o3 == 0 && OnSegment(p2, p1, q2)) { return (1); }
+	if (o4 == 0 && OnSegment(p2, q1, q2)) { return (1); }
+	return (0);
+}
+
+static TriNode *
+InsertNode(TriCtx *ctx, Uint i, double x, double y, TriNode *last)
+{
+	TriNode *p = NewNode(ctx, i, x, y);
+
+	if (last == NULL) {
+		p->prev = p;
+		p->next = p;
+	} else {
+		p->next = last->next;
+		p->prev = last;
+		last->next->prev = p;
+		last->next = p;
+	}
+	return (p);
+}
+
+static void
+RemoveNode(TriNode *p)
+{
+	p->next->prev = p->prev;
+	p->prev->next = p->next;
+	if (p->prevZ != NULL) { p->prevZ->nextZ = p->nextZ; }
+	if (p->nextZ != NULL) { p->nextZ->prevZ = p->prevZ; }
+}
+
+static double
+SignedArea(const double *xy, Uint start, Uint end)
+{
+	double sum = 0.0;
+	Uint i, j;
+
+	for (i = start, j = end-1; i < end; j = i++) {
+		sum += (xy[j*2] - xy[i*2]) * (xy[i*2+1] + xy[j*2+1]);
+	}
+	return (sum);
+}
+
+/*
+ * Create a circular doubly-linked list from a contour, in the requested
+ * winding (counterclockwise for the outer contour, clockwise for holes).
+ */
+static TriNode *
+LinkedList(TriCtx *ctx, const double *xy, Uint start, Uint end, int ccw)
+{
+	TriNode *last = NULL;
+	Uint i;
+
+	if (ccw == (SignedArea(xy, start, end) > 0.0)) {
+		for (i = start; i < end; i++)
+			last = InsertNode(ctx, i, xy[i*2], xy[i*2+1], last);
+	} else {
+		for (i = end; i > start; i--)
+			last = InsertNode(ctx, i-1, xy[(i-1)*2], xy[(i-1)*2+1],
+			    last);
+	}
+	if (last != NULL && Equals(last, last->next)) {
+		RemoveNode(last);
+		last = last->next;
+	}
+	return (last);
+}
+
+/* Eliminate colinear or duplicate points. */
+static TriNode *
+FilterPoints(TriNode *start, TriNode *end)
+{
+	TriNode *p;
+	int again;
+
+	if (start == NULL) {
+		return (NULL);
+	}
+	if (end == NULL) {
+		end = start;
+	}
+	p = start;
+	do {
+		again = 0;
+		if (!p->steiner &&
+		    (Equals(p, p->next) || Area(p->prev, p, p->next) == 0.0)) {
+			RemoveNode(p);
+			p = end = p->prev;
+			if (p == p->next) {
+				break;
+			}
+			again = 1;
+		} else {
+			p = p->next;
+		}
+	} while (again || p != end);
+
+	return (end);
+}
+
+/* Interleave the bits of the coordinates (z-order / Morton code). */
+static Uint32
+ZOrder(const TriCtx *ctx, double fx, double fy)
+{
+	Uint32 x = (Uint32)((fx - ctx->minX)*ctx->invSize);
+	Uint32 y = (Uint32)((fy - ctx->minY)*ctx->invSize);
+
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	y = (y | (y << 8)) & 0x00FF00FF;
+	y = (y | (y << 4)) & 0x0F0F0F0F;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+	return (x | (y << 1));
+}
+
+/* Merge sort of the z-order linked list. */
+static TriNode *
+SortLinked(TriNode *list)
+{
+	TriNode *p, *q, *e, *tail;
+	Uint i, numMerges, pSize, qSize, inSize = 1;
+
+	do {
+		p = list;
+		list = NULL;
+		tail = NULL;
+		numMerges = 0;
+
+		while (p != NULL) {
+			numMerges++;
+			q = p;
+			pSize = 0;
+			for (i = 0; i < inSize; i++) {
+				pSize++;
+				if ((q = q->nextZ) == NULL)
+					break;
+			}
+			qSize = inSize;
+			while (pSize > 0 || (qSize > 0 && q != NULL)) {
+				if (pSize != 0 &&
+				    (qSize == 0 || q == NULL || p->z <= q->z)) {
+					e = p;
+					p = p->nextZ;
+					pSize--;
+				} else {
+					e = q;
+					q = q->nextZ;
+					qSize--;
+				}
+				if (tail != NULL) {
+					tail->nextZ = e;
+				} else {
+					list = e;
+				}
+				e->prevZ = tail;
+				tail = e;
+			}
+			p = q;
+		}
+		tail->nextZ = NULL;
+		inSize *= 2;
+	} while (numMerges > 1);
+
+	return (list);
+}
+
+static void
+IndexCurve(TriCtx *ctx, TriNode *start)
+{
+	TriNode *p = start;
+
+	do {
+		if (p->z == 0) {
+			p->z = ZOrder(ctx, p->x, p->y);
+		}
+		p->prevZ = p->prev;
+		p->nextZ = p->next;
+		p = p->next;
+	} while (p != start);
+
+	p->prevZ->nextZ = NULL;
+	p->prevZ = NULL;
+	SortLinked(p);
+}
+
+static int
+IsEar(TriNode *ear)
+{
+	TriNode *a = ear->prev, *b = ear, *c = ear->next, *p;
+
+	if (Area(a, b, c) >= 0.0) {
+		return (0);				/* Reflex */
+	}
+	for (p = ear->next->next; p != ear->prev; p = p->next) {
+		if (PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y,
+		    p->x, p->y) && Area(p->prev, p, p->next) >= 0.0)
+			return (0);
+	}
+	return (1);
+}
+
+static __inline__ int
+BlocksEar(TriNode *ear, TriNode *p)
+{
+	TriNode *a = ear->prev, *b = ear, *c = ear->next;
+
+	return (p != ear->prev && p != ear->next &&
+	        PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y,
+	                        p->x, p->y) &&
+	        Area(p->prev, p, p->next) >= 0.0);
+}
+
+/* Ear test visiting only the vertices within the triangle's z-range. */
+static int
+IsEarHashed(TriCtx *ctx, TriNode *ear)
+{
+	TriNode *a = ear->prev, *b = ear, *c = ear->next, *p, *n;
+	double minTX, minTY, maxTX, maxTY;
+	Uint32 minZ, maxZ;
+
+	if (Area(a, b, c) >= 0.0) {
+		return (0);
+	}
+	minTX = MIN(a->x, MIN(b->x, c->x));
+	minTY = MIN(a->y, MIN(b->y, c->y));
+	maxTX = MAX(a->x, MAX(b->x, c->x));
+	maxTY = MAX(a->y, MAX(b->y, c->y));
+	minZ = ZOrder(ctx, minTX, minTY);
+	maxZ = ZOrder(ctx, maxTX, maxTY);
+
+	p = ear->prevZ;
+	n = ear->nextZ;
+	while (p != NULL && p->z >= minZ && n != NULL && n->z <= maxZ) {
+		if (BlocksEar(ear, p)) { return (0); }
+		p = p->prevZ;
+		if (BlocksEar(ear, n)) { return (0); }
+		n = n->nextZ;
+	}
+	for (; p != NULL && p->z >= minZ; p = p->prevZ) {
+		if (BlocksEar(ear, p))
+			return (0);
+	}
+	for (; n != NULL && n->z <= maxZ; n = n->nextZ) {
+		if (BlocksEar(ear, n))
+			return (0);
+	}
+	return (1);
+}
+
+static int
+LocallyInside(const TriNode *a, const TriNode *b)
+{
+	if (Area(a->prev, a, a->next) < 0.0) {
+		return (Area(a, b, a->next) >= 0.0 &&
+		        Area(a, a->prev, b) >= 0.0);
+	} else {
+		return (Area(a, b, a->prev) < 0.0 ||
+		        Area(a, a->next, b) < 0.0);
+	}
+}
+
+/* Go through all polygon nodes and cure small local self-intersections. */
+static TriNode *
+CureLocalIntersections(TriCtx *ctx, TriNode *start)
+{
+	TriNode *p = start, *a, *b;
+
+	do {
+		a = p->prev;
+		b = p->next->next;
+		if (!Equals(a, b) && Intersects(a, p, p->next, b) &&
+		    LocallyInside(a, b) && LocallyInside(b, a)) {
+			EmitTri(ctx, a->i, p->i, b->i);
+			RemoveNode(p);
+			RemoveNode(p->next);
+			p = start = b;
+		}
+		p = p->next;
+	} while (p != start);
+
+	return FilterPoints(p, NULL);
+}
+
+static int
+IntersectsPolygon(const TriNode *a, const TriNode *b)
+{
+	const TriNode *p = a;
+
+	do {
+		if (p->i != a->i && p->next->i != a->i &&
+		    p->i != b->i && p->next->i != b->i &&
+		    Intersects(p, p->next, a, b))
+			return (1);
+		p = p->next;
+	} while (p != a);
+	return (0);
+}
+
+static int
+MiddleInside(const TriNode *a, const TriNode *b)
+{
+	const TriNode *p = a;
+	double px = (a->x + b->x)/2.0;
+	double py = (a->y + b->y)/2.0;
+	int inside = 0;
+
+	do {
+		if (((p->y > py) != (p->next->y > py)) &&
+		    p->next->y != p->y &&
+		    (px < (p->next->x - p->x)*(py - p->y) /
+		          (p->next->y - p->y) + p->x))
+			inside = !inside;
+		p = p->next;
+	} while (p != a);
+	return (inside);
+}
+
+static int
+IsValidDiagonal(const TriNode *a, const TriNode *b)
+{
+	if (a->next->i == b->i || a->prev->i == b->i ||
+	    IntersectsPolygon(a, b)) {
+		return (0);
+	}
+	if (LocallyInside(a, b) && LocallyInside(b, a) && MiddleInside(a, b) &&
+	    (Area(a->prev, a, b->prev) != 0.0 || Area(a, b->prev, b) != 0.0)) {
+		return (1);
+	}
+	return (Equals(a, b) &&
+	        Area(a->prev, a, a->next) > 0.0 &&
+	        Area(b->prev, b, b->next) > 0.0);
+}
+
+/*
+ * Link two polygon vertices with a bridge. If the vertices belong to the
+ * same ring, this splits the polygon in two; if they belong to different
+ * rings, the rings are merged.
+ */
+static TriNode *
+SplitPolygon(TriCtx *ctx, TriNode *a, TriNode *b)
+{
+	TriNode *a2 = NewNode(ctx, a->i, a->x, a->y);
+	TriNode *b2 = NewNode(ctx, b->i, b->x, b->y);
+	TriNode *an = a->next;
+	TriNode *bp = b->prev;
+
+	a->next = b;
+	b->prev = a;
+	a2->next = an;
+	an->prev = a2;
+	b2->next = a2;
+	a2->prev = b2;
+	bp->next = b2;
+	b2->prev = bp;
+	return (b2);
+}
+
+/* Try splitting the polygon into two along a valid diagonal. */
+static void
+SplitEarcut(TriCtx *ctx, TriNode *start)
+{
+	TriNode *a = start, *b, *c;
+
+	do {
+		for (b = a->next->next; b != a->prev; b = b->next) {
+			if (a->i != b->i && IsValidDiagonal(a, b)) {
+				c = SplitPolygon(ctx, a, b);
+				a = FilterPoints(a, a->next);
+				c = FilterPoints(c, c->next);
+				EarcutLinked(ctx, a, 0);
+				EarcutLinked(ctx, c, 0);
+				return;
+			}
+		}
+		a = a->next;
+	} while (a != start);
+}
+
+/*
+ * Main ear slicing loop. Pass 0 is the plain algorithm; if it gets stuck,
+ * pass 1 filters degenerate points, pass 2 cures local self-intersections
+ * and as a last resort the polygon is split along a diagonal.
+ */
+static void
+EarcutLinked(TriCtx *ctx, TriNode *ear, int pass)
+{
+	TriNode *stop, *prev, *next;
+
+	if (ear == NULL) {
+		return;
+	}
+	if (pass == 0 && ctx->invSize != 0.0) {
+		IndexCurve(ctx, ear);
+	}
+	stop = ear;
+	while (ear->prev != ear->next) {
+		prev = ear->prev;
+		next = ear->next;
+
+		if ((ctx->invSize != 0.0) ? IsEarHashed(ctx, ear) :
+		    IsEar(ear)) {
+			EmitTri(ctx, prev->i, ear->i, next->i);
+			RemoveNode(ear);
+			ear = next->next;
+			stop = next->next;
+			continue;
+		}
+		ear = next;
+		if (ear == stop) {
+			switch (pass) {
+			case 0:
+				EarcutLinked(ctx, FilterPoints(ear, NULL), 1);
+				break;
+			case 1:
+				ear = CureLocalIntersections(ctx,
+				    FilterPoints(ear, NULL));
+				EarcutLinked(ctx, ear, 2);
+				break;
+			case 2:
+				SplitEarcut(ctx, ear);
+				break;
+			}
+			break;
+		}
+	}
+}
+
+static int
+SectorContainsSector(const TriNode *m, const TriNode *p)
+{
+	return (Area(m->prev, m, p->prev) < 0.0 &&
+	        Area(p->next, m, m->next) < 0.0);
+}
+
+/* Find a vertex of the outer contour which can be bridged to the hole. */
+static TriNode *
+FindHoleBridge(TriNode *hole, TriNode *outer)
+{
+	TriNode *p = outer, *m = NULL, *stop;
+	double hx = hole->x, hy = hole->y;
+	double qx = -HUGE_VAL, x, mx, my, tanMin = HUGE_VAL, tanCur;
+
+	/*
+	 * Find a segment intersected by a ray from the hole's leftmost
+	 * point to the left; the segment's endpoint with lesser x will be
+	 * the potential connection point.
+	 */
+	do {
+		if (hy <= p->y && hy >= p->next->y && p->next->y != p->y) {
+			x = p->x + (hy - p->y)*(p->next->x - p->x) /
+			    (p->next->y - p->y);
+			if (x <= hx && x > qx) {
+				qx = x;
+				m = (p->x < p->next->x) ? p : p->next;
+				if (x == hx)
+					return (m);
+			}
+		}
+		p = p->next;
+	} while (p != outer);
+
+	if (m == NULL) {
+		return (NULL);
+	}
+
+	/*
+	 * Look for points inside the triangle of hole point, segment
+	 * intersection and endpoint; if there are any, select the one
+	 * with the minimum angle to the ray as the connection point.
+	 */
+	stop = m;
+	mx = m->x;
+	my = m->y;
+	p = m;
+	do {
+		if (hx >= p->x && p->x >= mx && hx != p->x &&
+		    PointInTriangle((hy < my) ? hx : qx, hy, mx, my,
+		                    (hy < my) ? qx : hx, hy, p->x, p->y)) {
+			tanCur = fabs(hy - p->y) / (hx - p->x);
+			if (LocallyInside(p, hole) &&
+			    (tanCur < tanMin ||
+			     (tanCur == tanMin &&
+			      (p->x > m->x ||
+			       (p->x == m->x && SectorContainsSector(m, p)))))) {
+				m = p;
+				tanMin = tanCur;
+			}
+		}
+		p = p->next;
+	} while (p != stop);
+
+	return (m);
+}
+
+static TriNode *
+GetLeftmost(TriNode *start)
+{
+	TriNode *p = start, *leftmost = start;
+
+	do {
+		if (p->x < leftmost->x ||
+		    (p->x == leftmost->x && p->y < leftmost->y))
+			leftmost = p;
+		p = p->next;
+	} while (p != start);
+	return (leftmost);
+}
+
+static int
+CompareX(const void *p1, const void *p2)
+{
+	const TriNode *a = *(const TriNode **)p1;
+	const TriNode *b = *(const TriNode **)p2;
+
+	return (a->x < b->x) ? -1 : (a->x > b->x) ? 1 : 0;
+}
+
+/* Link every hole into the outer loop, producing a single-ring polygon. */
+static TriNode *
+EliminateHoles(TriCtx *ctx, const double *xy, Uint nPts, const Uint *holes,
+    Uint nHoles, TriNode *outer)
+{
+	TriNode **queue, *list, *bridge, *bridgeRev;
+	Uint i, nQueue = 0, start, end;
+
+	queue = Malloc(nHoles*sizeof(TriNode *));
+	for (i = 0; i < nHoles; i++) {
+		start = holes[i];
+		end = (i < nHoles-1) ? holes[i+1] : nPts;
+		if ((list = LinkedList(ctx, xy, start, end, 0)) == NULL) {
+			continue;
+		}
+		if (list == list->next) {
+			list->steiner = 1;
+		}
+		queue[nQueue++] = GetLeftmost(list);
+	}
+	qsort(queue, nQueue, sizeof(TriNode *), CompareX);
+
+	for (i = 0; i < nQueue; i++) {
+		if ((bridge = FindHoleBridge(queue[i], outer)) == NULL) {
+			continue;
+		}
+		bridgeRev = SplitPolygon(ctx, bridge, queue[i]);
+		FilterPoints(bridgeRev, bridgeRev->next);
+		outer = FilterPoints(bridge, bridge->next);
+	}
+	Free(queue);
+	return (outer);
+}
+
+/*
+ * Triangulate a polygon given as nPts 2D points. The first contour is the
+ * outer boundary; holes[] gives the index of the first point of each hole
+ * contour. The resulting triangles are counterclockwise and index into
+ * the input points. The caller must free the returned array.
+ */
+int
+CAD_TriangulatePolygon(const double *xy, Uint nPts, const Uint *holes,
+    Uint nHoles, Uint32 **tris, Uint *nTris)
+{
+	TriCtx ctx;
+	TriNode *outer, *p;
+	TriBlock *b, *bNext;
+	Uint outerLen = (nHoles > 0) ? holes[0] : nPts;
+	double maxX, maxY, size;
+	Uint i;
+
+	ctx.blocks = NULL;
+	ctx.tris = NULL;
+	ctx.nTris = 0;
+	ctx.maxTris = 0;
+	ctx.minX = 0.0;
+	ctx.minY = 0.0;
+	ctx.invSize = 0.0;
+
+	if ((outer = LinkedList(&ctx, xy, 0, outerLen, 1)) == NULL ||
+	    outer->next == outer->prev) {
+		goto out;
+	}
+	if (nHoles > 0) {
+		outer = EliminateHoles(&ctx, xy, nPts, holes, nHoles, outer);
+	}
+	if (nPts > HASH_THRESHOLD) {
+		ctx.minX = maxX = xy[0];
+		ctx.minY = maxY = xy[1];
+		for (i = 1; i < outerLen; i++) {
+			if (xy[i*2] < ctx.minX) { ctx.minX = xy[i*2]; }
+			if (xy[i*2+1] < ctx.minY) { ctx.minY = xy[i*2+1]; }
+			if (xy[i*2] > maxX) { maxX = xy[i*2]; }
+			if (xy[i*2+1] > maxY) { maxY = xy[i*2+1]; }
+		}
+		size = MAX(maxX - ctx.minX, maxY - ctx.minY);
+		ctx.invSize = (size != 0.0) ? 32767.0/size : 0.0;
+	}
+	p = outer;
+	EarcutLinked(&ctx, p, 0);
+out:
+	for (b = ctx.blocks; b != NULL; b = bNext) {
+		bNext = b->next;
+		Free(b);
+	}
+	*tris = ctx.tris;
+	*nTris = ctx.nTris;
+	return (0);
+}
@@ -0,0 +1,14 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_TRIANGULATE_H_
+#define _CADTOOLS_TRIANGULATE_H_
+
+#include "begin_code.h"
+
+__BEGIN_DECLS
+int	CAD_TriangulatePolygon(const double *, Uint, const Uint *, Uint,
+	                       Uint32 **, Uint *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_TRIANGULATE_H_ */
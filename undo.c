@@ -0,0 +1,874 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Undo journal. Each document (part or program) keeps a list of entries
+ * recording the state of one object (the document itself or one of its
+ * features) before and after a change. The state is the output of the
+ * object's save functions, split into content-defined chunks which are
+ * interned in a per-document table: unchanged parts of an object, and
+ * states which recur (as after an undo and redo), share the same chunks,
+ * so an entry only costs the bytes which actually differ. Undoing a
+ * feature edit reloads only that feature and regenerates the part, which
+ * normally hits the tessellation cache.
+ *
+ * Changes to the base mesh of a part are recorded with CAD_UndoCommitMesh()
+ * from payloads chunked in advance by CAD_UndoMeshPrepare(), which may run
+ * in the background; the journal only has to adopt the chunks. Mesh
+ * payloads are held by entries only, never by the tips, so they go away
+ * with the entries when the journal is trimmed.
+ */
+
+#include <agar/core.h>
+#include <agar/gui.h>
+
+#include <string.h>
+
+#include "cadtools.h"
+
+#define CHUNK_MIN	256			/* Content-defined chunk sizes */
+#define CHUNK_MASK	0x7ff
+#define CHUNK_MAX	16384
+#define CHUNK_LIST_MIN	8			/* Initial chunk list length */
+
+size_t cadUndoBudget = CAD_UNDO_BUDGET;
+
+static Uint64 gear[256];			/* Rolling hash table */
+static int gearInited = 0;
+
+/* Sequential reader over the chunks of a state. */
+typedef struct undo_reader {
+	CAD_UndoChunk **chunks;
+	Uint n, i;
+	Uint32 offs;
+} UndoReader;
+
+static void
+InitGear(void)
+{
+	Uint64 x = 0x9e3779b97f4a7c15ULL, z;
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		gear[i] = z ^ (z >> 31);
+	}
+	gearInited = 1;
+}
+
+void
+CAD_JournalInit(CAD_Journal *jnl, void *doc)
+{
+	if (!gearInited) {
+		InitGear();
+	}
+	jnl->doc = doc;
+	memset(jnl->buckets, 0, sizeof(jnl->buckets));
+	TAILQ_INIT(&jnl->entries);
+	jnl->cur = NULL;
+	jnl->nEntries = 0;
+	jnl->tips = NULL;
+	jnl->nTips = 0;
+	jnl->size = 0;
+	jnl->maxSize = cadUndoBudget;
+}
+
+/* Return the journal which records changes to the given object. */
+CAD_Journal *
+CAD_JournalOf(void *p)
+{
+	AG_Object *obj = p;
+
+	if (AG_OfClass(obj, "CAD_Feature:*")) {
+		obj = obj->parent;
+		if (obj == NULL)
+			return (NULL);
+	}
+	if (AG_OfClass(obj, "CAD_Part:*")) {
+		return &((CAD_Part *)obj)->journal;
+	} else if (AG_OfClass(obj, "CAM_Program:*")) {
+		return &((CAM_Program *)obj)->journal;
+	}
+	return (NULL);
+}
+
+static CAD_UndoChunk *
+NewChunk(const Uint8 *data, Uint32 len, Uint64 h)
+{
+	CAD_UndoChunk *c;
+
+	c = Malloc(sizeof(CAD_UndoChunk) + len);
+	c->hash = h;
+	c->len = len;
+	c->nRefs = 1;
+	c->next = NULL;
+	memcpy(c->data, data, len);
+	return (c);
+}
+
+static CAD_UndoChunk *
+InternChunk(CAD_Journal *jnl, const Uint8 *data, Uint32 len)
+{
+	Uint64 h = CAD_HashBytes(CAD_HASH_INIT, data, len);
+	CAD_UndoChunk *c, **bucket = &jnl->buckets[h % CAD_UNDO_BUCKETS];
+
+	for (c = *bucket; c != NULL; c = c->next) {
+		if (c->hash == h && c->len == len &&
+		    memcmp(c->data, data, len) == 0) {
+			c->nRefs++;
+			return (c);
+		}
+	}
+	c = NewChunk(data, len, h);
+	c->next = *bucket;
+	*bucket = c;
+	jnl->size += sizeof(CAD_UndoChunk) + len;
+	return (c);
+}
+
+/*
+ * Intern a chunk allocated by NewChunk(), which is freed if the journal
+ * already has the same content.
+ */
+static CAD_UndoChunk *
+AdoptChunk(CAD_Journal *jnl, CAD_UndoChunk *cNew)
+{
+	CAD_UndoChunk *c, **bucket;
+
+	bucket = &jnl->buckets[cNew->hash % CAD_UNDO_BUCKETS];
+
+	for (c = *bucket; c != NULL; c = c->next) {
+		if (c->hash == cNew->hash && c->len == cNew->len &&
+		    memcmp(c->data, cNew->data, c->len) == 0) {
+			c->nRefs++;
+			Free(cNew);
+			return (c);
+		}
+	}
+	cNew->next = *bucket;
+	*bucket = cNew;
+	jnl->size += sizeof(CAD_UndoChunk) + cNew->len;
+	return (cNew);
+}
+
+static void
+ReleaseChunk(CAD_Journal *jnl, CAD_UndoChunk *c)
+{
+	CAD_UndoChunk **pc;
+
+	if (--c->nRefs > 0) {
+		return;
+	}
+	for (pc = &jnl->buckets[c->hash % CAD_UNDO_BUCKETS]; *pc != c;
+	     pc = &(*pc)->next)
+		;;
+	*pc = c->next;
+	jnl->size -= sizeof(CAD_UndoChunk) + c->len;
+	Free(c);
+}
+
+/*
+ * Split a buffer into chunks at content-defined boundaries (so that an
+ * insertion only affects the chunks around it) and append them to the
+ * given list. The chunks are interned in jnl, or allocated on their own
+ * if jnl is NULL. The list grows by doubling from CHUNK_LIST_MIN entries,
+ * so its capacity follows from its length.
+ */
+static void
+ChunkBuffer(CAD_Journal *jnl, const void *p, size_t len,
+    CAD_UndoChunk ***chunks, Uint *n)
+{
+	const Uint8 *s = p, *start = p;
+	Uint64 h = 0;
+	size_t i, sz;
+
+	for (i = 0; i < len; i++) {
+		h = (h << 1) + gear[s[i]];
+		sz = &s[i+1] - start;
+		if ((sz >= CHUNK_MIN && (h & CHUNK_MASK) == 0) ||
+		    sz >= CHUNK_MAX || i == len-1) {
+			if (*n == 0 ||
+			    (*n >= CHUNK_LIST_MIN && (*n & (*n - 1)) == 0)) {
+				*chunks = Realloc(*chunks, ((*n > 0) ? *n*2 :
+				    CHUNK_LIST_MIN)*sizeof(CAD_UndoChunk *));
+			}
+			if (jnl != NULL) {
+				(*chunks)[(*n)++] = InternChunk(jnl, start,
+				    (Uint32)sz);
+				jnl->size += sizeof(CAD_UndoChunk *);
+			} else {
+				(*chunks)[(*n)++] = NewChunk(start, (Uint32)sz,
+				    CAD_HashBytes(CAD_HASH_INIT, start, sz));
+			}
+			start = &s[i+1];
+			h = 0;
+		}
+	}
+}
+
+static void
+InitState(CAD_UndoState *st)
+{
+	st->data = NULL;
+	st->nData = 0;
+	st->mesh = NULL;
+	st->nMesh = 0;
+	st->hasMesh = 0;
+}
+
+static void
+FreeState(CAD_Journal *jnl, CAD_UndoState *st)
+{
+	Uint i;
+
+	for (i = 0; i < st->nData; i++) {
+		ReleaseChunk(jnl, st->data[i]);
+	}
+	for (i = 0; i < st->nMesh; i++) {
+		ReleaseChunk(jnl, st->mesh[i]);
+	}
+	jnl->size -= (st->nData + st->nMesh)*sizeof(CAD_UndoChunk *);
+	Free(st->data);
+	Free(st->mesh);
+	InitState(st);
+}
+
+/* Release the mesh payload of a state, keeping its dataset. */
+static void
+DropMesh(CAD_Journal *jnl, CAD_UndoState *st)
+{
+	Uint i;
+
+	for (i = 0; i < st->nMesh; i++) {
+		ReleaseChunk(jnl, st->mesh[i]);
+	}
+	jnl->size -= st->nMesh*sizeof(CAD_UndoChunk *);
+	Free(st->mesh);
+	st->mesh = NULL;
+	st->nMesh = 0;
+	st->hasMesh = 0;
+}
+
+static void
+CopyChunks(CAD_Journal *jnl, CAD_UndoChunk ***dst, CAD_UndoChunk **src,
+    Uint n)
+{
+	Uint i;
+
+	*dst = NULL;
+	if (n == 0) {
+		return;
+	}
+	*dst = Malloc(n*sizeof(CAD_UndoChunk *));
+	for (i = 0; i < n; i++) {
+		(*dst)[i] = src[i];
+		src[i]->nRefs++;
+	}
+	jnl->size += n*sizeof(CAD_UndoChunk *);
+}
+
+/* Make dst another reference to the state src. */
+static void
+CopyState(CAD_Journal *jnl, CAD_UndoState *dst, const CAD_UndoState *src)
+{
+	CopyChunks(jnl, &dst->data, src->data, src->nData);
+	dst->nData = src->nData;
+	CopyChunks(jnl, &dst->mesh, src->mesh, src->nMesh);
+	dst->nMesh = src->nMesh;
+	dst->hasMesh = src->hasMesh;
+}
+
+/*
+ * Chunks are interned, so equal contents means equal pointers. The mesh
+ * payload is only compared if both states include it.
+ */
+static int
+SameState(const CAD_UndoState *a, const CAD_UndoState *b)
+{
+	if (a->nData != b->nData ||
+	    (a->nData > 0 &&
+	     memcmp(a->data, b->data, a->nData*sizeof(CAD_UndoChunk *)) != 0)) {
+		return (0);
+	}
+	if (a->hasMesh && b->hasMesh &&
+	    (a->nMesh != b->nMesh ||
+	     memcmp(a->mesh, b->mesh, a->nMesh*sizeof(CAD_UndoChunk *)) != 0))
+		return (0);
+
+	return (1);
+}
+
+static void
+FreeEntry(CAD_Journal *jnl, CAD_UndoEntry *ent)
+{
+	TAILQ_REMOVE(&jnl->entries, ent, entries);
+	FreeState(jnl, &ent->before);
+	FreeState(jnl, &ent->after);
+	jnl->size -= sizeof(CAD_UndoEntry);
+	jnl->nEntries--;
+	Free(ent);
+}
+
+void
+CAD_JournalClear(CAD_Journal *jnl)
+{
+	CAD_UndoEntry *ent;
+	Uint i;
+
+	while ((ent = TAILQ_FIRST(&jnl->entries)) != NULL) {
+		FreeEntry(jnl, ent);
+	}
+	for (i = 0; i < jnl->nTips; i++) {
+		FreeState(jnl, &jnl->tips[i].st);
+	}
+	Free(jnl->tips);
+	jnl->tips = NULL;
+	jnl->nTips = 0;
+	jnl->cur = NULL;
+}
+
+void
+CAD_JournalDestroy(CAD_Journal *jnl)
+{
+	CAD_JournalClear(jnl);
+}
+
+/* Name of an object relative to its document. */
+static int
+TargetName(CAD_Journal *jnl, AG_Object *obj, char *name)
+{
+	if (obj == jnl->doc) {
+		name[0] = '\0';
+	} else if (obj->parent == jnl->doc) {
+		Strlcpy(name, obj->name, AG_OBJECT_NAME_MAX);
+	} else {
+		AG_SetError(_("%s: Not part of %s"), obj->name,
+		    jnl->doc->name);
+		return (-1);
+	}
+	return (0);
+}
+
+static AG_Object *
+FindTarget(CAD_Journal *jnl, const char *name)
+{
+	if (name[0] == '\0') {
+		return (jnl->doc);
+	}
+	return AG_ObjectFindChild(jnl->doc, name);
+}
+
+static CAD_UndoTip *
+GetTip(CAD_Journal *jnl, const char *name, int create)
+{
+	CAD_UndoTip *tip;
+	Uint i;
+
+	for (i = 0; i < jnl->nTips; i++) {
+		if (strcmp(jnl->tips[i].target, name) == 0)
+			return (&jnl->tips[i]);
+	}
+	if (!create) {
+		return (NULL);
+	}
+	jnl->tips = Realloc(jnl->tips, (jnl->nTips+1)*sizeof(CAD_UndoTip));
+	tip = &jnl->tips[jnl->nTips++];
+	Strlcpy(tip->target, name, sizeof(tip->target));
+	InitState(&tip->st);
+	return (tip);
+}
+
+/* Write the dataset of an object, as AG_ObjectSave() would. */
+static int
+SaveDataset(AG_Object *obj, AG_DataSource *ds)
+{
+	AG_ObjectClass **hier;
+	int i, nHier;
+
+	if (AG_ObjectGetInheritHier(obj, &hier, &nHier) == -1) {
+		return (-1);
+	}
+	for (i = 0; i < nHier; i++) {
+		if (hier[i]->save != NULL && hier[i]->save(obj, ds) == -1) {
+			Free(hier);
+			return (-1);
+		}
+	}
+	Free(hier);
+	return (0);
+}
+
+static int
+LoadDataset(AG_Object *obj, AG_DataSource *ds)
+{
+	AG_ObjectClass **hier;
+	int i, nHier;
+
+	if (AG_ObjectGetInheritHier(obj, &hier, &nHier) == -1) {
+		return (-1);
+	}
+	for (i = 0; i < nHier; i++) {
+		if (hier[i]->load != NULL &&
+		    hier[i]->load(obj, ds, &hier[i]->ver) == -1) {
+			Free(hier);
+			return (-1);
+		}
+	}
+	Free(hier);
+	return (0);
+}
+
+/* Size of the mesh payload of a state. */
+static size_t
+MeshPayloadSize(const CAD_Mesh *m)
+{
+	size_t size = 3*sizeof(Uint32) + m->nv*3*sizeof(float) +
+	              m->nt*3*sizeof(Uint32);
+
+	if (m->flags & CAD_MESH_NORMALS) { size += m->nv*3*sizeof(float); }
+	if (m->flags & CAD_MESH_COLORS) { size += m->nv*4; }
+	if (m->flags & CAD_MESH_TEXCOORDS) { size += m->nv*2*sizeof(float); }
+	return (size);
+}
+
+void
+CAD_UndoMeshInit(CAD_UndoMesh *um)
+{
+	um->chunks = NULL;
+	um->n = 0;
+	um->size = 0;
+}
+
+/*
+ * Chunk the payload of a mesh for CAD_UndoCommitMesh(). This does not
+ * involve any journal, so it may run in the background (on a mesh held
+ * with CAD_MeshAcquire()). The payload is only kept in memory, so it is
+ * stored in native byte order. If it exceeds budget bytes, nothing is
+ * chunked and the change will not be undoable.
+ */
+void
+CAD_UndoMeshPrepare(CAD_UndoMesh *um, const CAD_Mesh *m, size_t budget)
+{
+	Uint32 hdr[3];
+
+	CAD_UndoMeshFree(um);
+	if ((um->size = MeshPayloadSize(m)) > budget) {
+		return;
+	}
+	hdr[0] = (Uint32)m->flags;
+	hdr[1] = (Uint32)m->nv;
+	hdr[2] = (Uint32)m->nt;
+	ChunkBuffer(NULL, hdr, sizeof(hdr), &um->chunks, &um->n);
+	if (m->nv > 0) {
+		ChunkBuffer(NULL, m->v, m->nv*3*sizeof(float), &um->chunks,
+		    &um->n);
+		if (m->flags & CAD_MESH_NORMALS)
+			ChunkBuffer(NULL, m->n, m->nv*3*sizeof(float),
+			    &um->chunks, &um->n);
+		if (m->flags & CAD_MESH_COLORS)
+			ChunkBuffer(NULL, m->c, m->nv*4, &um->chunks, &um->n);
+		if (m->flags & CAD_MESH_TEXCOORDS)
+			ChunkBuffer(NULL, m->st, m->nv*2*sizeof(float),
+			    &um->chunks, &um->n);
+	}
+	if (m->nt > 0) {
+		ChunkBuffer(NULL, m->tri, m->nt*3*sizeof(Uint32), &um->chunks,
+		    &um->n);
+	}
+}
+
+void
+CAD_UndoMeshFree(CAD_UndoMesh *um)
+{
+	Uint i;
+
+	for (i = 0; i < um->n; i++) {
+		Free(um->chunks[i]);
+	}
+	Free(um->chunks);
+	CAD_UndoMeshInit(um);
+}
+
+/* Move a prepared payload into a state, interning its chunks. */
+static void
+AdoptMesh(CAD_Journal *jnl, CAD_UndoMesh *um, CAD_UndoState *st)
+{
+	Uint i;
+
+	for (i = 0; i < um->n; i++) {
+		um->chunks[i] = AdoptChunk(jnl, um->chunks[i]);
+	}
+	st->mesh = um->chunks;
+	st->nMesh = um->n;
+	st->hasMesh = 1;
+	jnl->size += um->n*sizeof(CAD_UndoChunk *);
+	CAD_UndoMeshInit(um);
+}
+
+static void
+ReadChunks(UndoReader *r, void *p, size_t len)
+{
+	Uint8 *d = p;
+	size_t n;
+
+	while (len > 0 && r->i < r->n) {
+		CAD_UndoChunk *c = r->chunks[r->i];
+
+		n = c->len - r->offs;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(d, &c->data[r->offs], n);
+		d += n;
+		len -= n;
+		if ((r->offs += (Uint32)n) == c->len) {
+			r->i++;
+			r->offs = 0;
+		}
+	}
+}
+
+static int
+RestoreMesh(const CAD_UndoState *st, CAD_Mesh *m)
+{
+	UndoReader r;
+	Uint32 hdr[3];
+
+	r.chunks = st->mesh;
+	r.n = st->nMesh;
+	r.i = 0;
+	r.offs = 0;
+	ReadChunks(&r, hdr, sizeof(hdr));
+
+	CAD_MeshFree(m);
+	CAD_MeshInit(m, (Uint)hdr[0]);
+	if (CAD_MeshReserve(m, (Uint)hdr[1], (Uint)hdr[2]) == -1) {
+		return (-1);
+	}
+	m->nv = (Uint)hdr[1];
+	m->nt = (Uint)hdr[2];
+	ReadChunks(&r, m->v, m->nv*3*sizeof(float));
+	if (m->flags & CAD_MESH_NORMALS) {
+		ReadChunks(&r, m->n, m->nv*3*sizeof(float));
+	}
+	if (m->flags & CAD_MESH_COLORS) {
+		ReadChunks(&r, m->c, m->nv*4);
+	}
+	if (m->flags & CAD_MESH_TEXCOORDS) {
+		ReadChunks(&r, m->st, m->nv*2*sizeof(float));
+	}
+	ReadChunks(&r, m->tri, m->nt*3*sizeof(Uint32));
+	return (0);
+}
+
+/* Record the current state (dataset) of an object. */
+static int
+Capture(CAD_Journal *jnl, AG_Object *obj, CAD_UndoState *st)
+{
+	AG_DataSource *ds;
+	AG_CoreSource *cs;
+
+	InitState(st);
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	if (SaveDataset(obj, ds) == -1) {
+		AG_CloseAutoCore(ds);
+		return (-1);
+	}
+	cs = AG_CORE_SOURCE(ds);
+	ChunkBuffer(jnl, cs->data, cs->size, &st->data, &st->nData);
+	AG_CloseAutoCore(ds);
+	return (0);
+}
+
+/* Load a recorded state back into an object and update what depends on it. */
+static int
+Restore(AG_Object *obj, const CAD_UndoState *st)
+{
+	AG_DataSource *ds;
+	CAD_Part *part = NULL;
+	Uint i;
+	int rv;
+
+	if (st->hasMesh && AG_OfClass(obj, "CAD_Part:*") &&
+	    (((CAD_Part *)obj)->flags & CAD_PART_BUSY)) {
+		AG_SetError(_("%s is being decimated"), obj->name);
+		return (-1);
+	}
+	if ((ds = AG_OpenAutoCore()) == NULL) {
+		return (-1);
+	}
+	for (i = 0; i < st->nData; i++) {
+		AG_Write(ds, st->data[i]->data, st->data[i]->len);
+	}
+	AG_Seek(ds, 0, AG_SEEK_SET);
+	rv = LoadDataset(obj, ds);
+	AG_CloseAutoCore(ds);
+	if (rv == -1) {
+		return (-1);
+	}
+
+	if (AG_OfClass(obj, "CAD_Feature:*")) {
+		CAD_FeatureChanged(obj);
+		part = (CAD_Part *)obj->parent;
+	} else if (AG_OfClass(obj, "CAD_Part:*")) {
+		part = (CAD_Part *)obj;
+		if (st->hasMesh) {
+			if (RestoreMesh(st, &part->base) == -1) {
+				return (-1);
+			}
+			part->flags |= CAD_PART_REBUILD|CAD_PART_MESH_DIRTY;
+		}
+	}
+	if (part != NULL) {
+		return CAD_PartRegen(part);
+	}
+	return (0);
+}
+
+/*
+ * Drop the oldest entries until the journal fits its memory budget. The
+ * size includes the datasets held by the tips, which are never dropped,
+ * so the last entry goes as well if it does not fit beside them.
+ */
+static void
+Trim(CAD_Journal *jnl)
+{
+	CAD_UndoEntry *ent;
+
+	while (jnl->size > jnl->maxSize &&
+	    (ent = TAILQ_FIRST(&jnl->entries)) != NULL) {
+		if (ent == jnl->cur) {
+			jnl->cur = NULL;
+		}
+		FreeEntry(jnl, ent);
+	}
+}
+
+/*
+ * Record the current state of an object as the starting point of the
+ * next change. This should be called before the object is edited (e.g.,
+ * when its editor is opened).
+ */
+int
+CAD_UndoTrack(void *p)
+{
+	AG_Object *obj = p;
+	CAD_Journal *jnl;
+	CAD_UndoTip *tip;
+	CAD_UndoState st;
+	char name[AG_OBJECT_NAME_MAX];
+
+	if ((jnl = CAD_JournalOf(obj)) == NULL) {
+		return (0);
+	}
+	if (TargetName(jnl, obj, name) == -1 ||
+	    Capture(jnl, obj, &st) == -1) {
+		return (-1);
+	}
+	tip = GetTip(jnl, name, 1);
+	FreeState(jnl, &tip->st);
+	tip->st = st;
+	return (0);
+}
+
+/* Discard the entries after the current one. */
+static void
+DiscardRedo(CAD_Journal *jnl)
+{
+	CAD_UndoEntry *ent, *entNext;
+
+	for (ent = (jnl->cur != NULL) ? TAILQ_NEXT(jnl->cur, entries) :
+	                                TAILQ_FIRST(&jnl->entries);
+	     ent != NULL;
+	     ent = entNext) {
+		entNext = TAILQ_NEXT(ent, entries);
+		FreeEntry(jnl, ent);
+	}
+}
+
+/* Append an entry (taking over the before state) and make it current. */
+static CAD_UndoEntry *
+AddEntry(CAD_Journal *jnl, const char *name, const char *label,
+    CAD_UndoState *before)
+{
+	CAD_UndoEntry *ent;
+
+	DiscardRedo(jnl);
+	ent = Malloc(sizeof(CAD_UndoEntry));
+	Strlcpy(ent->target, name, sizeof(ent->target));
+	Strlcpy(ent->label, (label != NULL) ? label : "", sizeof(ent->label));
+	ent->before = *before;
+	InitState(before);
+	InitState(&ent->after);
+	TAILQ_INSERT_TAIL(&jnl->entries, ent, entries);
+	jnl->cur = ent;
+	jnl->nEntries++;
+	jnl->size += sizeof(CAD_UndoEntry);
+	return (ent);
+}
+
+/*
+ * Record a change to an object since it was last tracked or committed.
+ * Nothing is recorded if the object is unchanged.
+ */
+int
+CAD_UndoCommit(void *p, const char *label)
+{
+	AG_Object *obj = p;
+	CAD_Journal *jnl;
+	CAD_UndoTip *tip;
+	CAD_UndoEntry *ent;
+	CAD_UndoState st;
+	char name[AG_OBJECT_NAME_MAX];
+
+	if ((jnl = CAD_JournalOf(obj)) == NULL) {
+		return (0);
+	}
+	if (TargetName(jnl, obj, name) == -1 ||
+	    Capture(jnl, obj, &st) == -1) {
+		return (-1);
+	}
+	tip = GetTip(jnl, name, 1);
+	if (tip->st.nData == 0 || SameState(&tip->st, &st)) {
+		FreeState(jnl, &tip->st);
+		tip->st = st;
+		return (0);
+	}
+	ent = AddEntry(jnl, name, label, &tip->st);
+	CopyState(jnl, &ent->after, &st);
+	tip->st = st;
+	Trim(jnl);
+	return (0);
+}
+
+/*
+ * Record the replacement of the base mesh of a part, given the payloads of
+ * the previous and new mesh (see CAD_UndoMeshPrepare()), which are
+ * consumed. The dataset of the part is recorded along with the meshes. If
+ * either payload was too large to prepare, the change cannot be undone;
+ * the entries before it no longer lead to the current geometry and are
+ * discarded.
+ */
+int
+CAD_UndoCommitMesh(void *p, const char *label, CAD_UndoMesh *before,
+    CAD_UndoMesh *after)
+{
+	CAD_Part *part = p;
+	CAD_Journal *jnl = &part->journal;
+	CAD_UndoTip *tip;
+	CAD_UndoEntry *ent;
+	CAD_UndoState st;
+
+	if (Capture(jnl, AGOBJECT(part), &st) == -1) {
+		goto fail;
+	}
+	if (before->n == 0 || after->n == 0) {
+		CAD_JournalClear(jnl);
+		tip = GetTip(jnl, "", 1);
+		tip->st = st;
+		CAD_UndoMeshFree(before);
+		CAD_UndoMeshFree(after);
+		return (0);
+	}
+	tip = GetTip(jnl, "", 1);
+	if (tip->st.nData == 0) {
+		CopyState(jnl, &tip->st, &st);
+	}
+	ent = AddEntry(jnl, "", label, &tip->st);
+	AdoptMesh(jnl, before, &ent->before);
+	CopyState(jnl, &ent->after, &st);
+	AdoptMesh(jnl, after, &ent->after);
+	tip->st = st;
+	Trim(jnl);
+	return (0);
+fail:
+	CAD_UndoMeshFree(before);
+	CAD_UndoMeshFree(after);
+	return (-1);
+}
+
+/*
+ * Apply a recorded state and make it the tip of its object. The tip is
+ * left unchanged if the state cannot be restored.
+ */
+static int
+Apply(CAD_Journal *jnl, const CAD_UndoEntry *ent, const CAD_UndoState *st)
+{
+	AG_Object *obj;
+	CAD_UndoTip *tip;
+
+	if ((obj = FindTarget(jnl, ent->target)) == NULL) {
+		AG_SetError(_("Cannot undo %s: %s no longer exists"),
+		    ent->label, ent->target);
+		return (-1);
+	}
+	CAD_ObjectModified(jnl->doc);
+	if (Restore(obj, st) == -1) {
+		return (-1);
+	}
+	tip = GetTip(jnl, ent->target, 1);
+	FreeState(jnl, &tip->st);
+	CopyState(jnl, &tip->st, st);
+	DropMesh(jnl, &tip->st);
+	return (0);
+}
+
+int
+CAD_Undo(CAD_Journal *jnl)
+{
+	CAD_UndoEntry *ent = jnl->cur;
+
+	if (ent == NULL) {
+		AG_SetError(_("Nothing to undo"));
+		return (-1);
+	}
+	if (Apply(jnl, ent, &ent->before) == -1) {
+		return (-1);
+	}
+	jnl->cur = TAILQ_PREV(ent, cad_undo_entryq, entries);
+	return (0);
+}
+
+int
+CAD_Redo(CAD_Journal *jnl)
+{
+	CAD_UndoEntry *ent;
+
+	ent = (jnl->cur != NULL) ? TAILQ_NEXT(jnl->cur, entries) :
+	                           TAILQ_FIRST(&jnl->entries);
+	if (ent == NULL) {
+		AG_SetError(_("Nothing to redo"));
+		return (-1);
+	}
+	if (Apply(jnl, ent, &ent->after) == -1) {
+		return (-1);
+	}
+	jnl->cur = ent;
+	return (0);
+}
@@ -0,0 +1,84 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_UNDO_H_
+#define _CADTOOLS_UNDO_H_
+
+#include "begin_code.h"
+
+#define CAD_UNDO_BUCKETS	256
+#define CAD_UNDO_BUDGET		(16*1024*1024)	/* Default memory budget */
+#define CAD_UNDO_LABEL_MAX	64
+
+/* Immutable piece of saved state, shared between journal entries. */
+typedef struct cad_undo_chunk {
+	Uint64 hash;				/* Content hash */
+	Uint32 len;
+	Uint nRefs;
+	struct cad_undo_chunk *next;		/* In bucket */
+	Uint8 data[1];				/* Content (variable length) */
+} CAD_UndoChunk;
+
+/* Saved state of an object, as a sequence of chunks. */
+typedef struct cad_undo_state {
+	CAD_UndoChunk **data;			/* Dataset of the object */
+	Uint nData;
+	CAD_UndoChunk **mesh;			/* Mesh payload (or NULL) */
+	Uint nMesh;
+	int hasMesh;
+} CAD_UndoState;
+
+typedef struct cad_undo_entry {
+	char target[AG_OBJECT_NAME_MAX];	/* Child name ("" = document) */
+	char label[CAD_UNDO_LABEL_MAX];
+	CAD_UndoState before, after;
+	AG_TAILQ_ENTRY(cad_undo_entry) entries;
+} CAD_UndoEntry;
+
+/* Last recorded state of an object being tracked. */
+typedef struct cad_undo_tip {
+	char target[AG_OBJECT_NAME_MAX];
+	CAD_UndoState st;
+} CAD_UndoTip;
+
+/* Per-document command journal. */
+typedef struct cad_journal {
+	AG_Object *doc;				/* Document object */
+	CAD_UndoChunk *buckets[CAD_UNDO_BUCKETS];
+	AG_TAILQ_HEAD(cad_undo_entryq,cad_undo_entry) entries;
+	CAD_UndoEntry *cur;			/* Last applied entry */
+	Uint nEntries;
+	CAD_UndoTip *tips;
+	Uint nTips;
+	size_t size, maxSize;			/* Memory in use / budget */
+} CAD_Journal;
+
+/* Mesh payload chunked outside of a journal (see CAD_UndoMeshPrepare()). */
+typedef struct cad_undo_mesh {
+	CAD_UndoChunk **chunks;			/* Not interned yet */
+	Uint n;					/* 0 = not prepared */
+	size_t size;				/* Size of payload */
+} CAD_UndoMesh;
+
+struct cad_mesh;
+
+__BEGIN_DECLS
+extern size_t cadUndoBudget;
+
+void	CAD_JournalInit(CAD_Journal *, void *);
+void	CAD_JournalDestroy(CAD_Journal *);
+void	CAD_JournalClear(CAD_Journal *);
+CAD_Journal *CAD_JournalOf(void *);
+
+int	CAD_UndoTrack(void *);
+int	CAD_UndoCommit(void *, const char *);
+void	CAD_UndoMeshInit(CAD_UndoMesh *);
+void	CAD_UndoMeshPrepare(CAD_UndoMesh *, const struct cad_mesh *, size_t);
+void	CAD_UndoMeshFree(CAD_UndoMesh *);
+int	CAD_UndoCommitMesh(void *, const char *, CAD_UndoMesh *,
+	                   CAD_UndoMesh *);
+int	CAD_Undo(CAD_Journal *);
+int	CAD_Redo(CAD_Journal *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_UNDO_H_ */
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2026 Hypertriton, Inc. <http://hypertriton.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Merging of coincident vertices using a uniform spatial hash grid.
+ *
+ * Vertices are binned into grid cells at least eps wide, and the cells
+ * are distributed by hash over a number of partitions. Each job bins its
+ * own range of vertices into per-job partition buckets, which are then
+ * concatenated so that every partition can build its cell table without
+ * locking. Every vertex is then mapped to the lowest-numbered vertex
+ * within eps in its own cell and those of the 26 surrounding cells which
+ * are within eps of it. All passes are linear in the number of vertices.
+ */
+
+#include <agar/core.h>
+
+#include <string.h>
+#include <math.h>
+
+#include "cadtools.h"
+
+#define WELD_CHUNK_MIN	8192		/* Minimum vertices per job */
+#define WELD_CELL_BITS	20		/* Grid resolution limit (per axis) */
+
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+typedef struct weld_cell {
+	Sint32 x, y, z;			/* Cell coordinates */
+	Uint first, count;		/* Range in partition's vertex list */
+} WeldCell;
+
+/* Cells whose hash falls in one partition. */
+typedef struct weld_part {
+	Uint *vtx;			/* Vertices, grouped by cell */
+	Uint nVtx;
+	WeldCell *cells;		/* Open-addressed cell table */
+	Uint mask;
+} WeldPart;
+
+typedef struct weld_ctx {
+	CAD_Mesh *m;
+	float eps, eps2;
+	float min[3];
+	float cellSize, invCell;		/* Grid cell width */
+	Sint32 *cell;			/* Cell coordinates per vertex */
+	Uint *order;			/* Vertices in partition order */
+	Uint *rep;			/* Representative of each vertex */
+	WeldPart *parts;
+	Uint nParts;			/* Power of two */
+	Uint *counts;			/* [job][partition] bucket sizes */
+	Uint nJobs;
+} WeldCtx;
+
+typedef struct weld_job {
+	WeldCtx *ctx;
+	Uint idx;			/* Job index (or partition) */
+	Uint i1, i2;			/* Vertex range */
+} WeldJob;
+
+static __inline__ Uint32
+HashCell(Sint32 x, Sint32 y, Sint32 z)
+{
+	Uint32 h;
+
+	h = (Uint32)x*73856093U ^ (Uint32)y*19349663U ^ (Uint32)z*83492791U;
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	return (h);
+}
+
+/* Compute cell coordinates and count vertices per partition. */
+static void
+BinVertices(void *arg)
+{
+	WeldJob *job = arg;
+	WeldCtx *ctx = job->ctx;
+	Uint *counts = &ctx->counts[job->idx*ctx->nParts];
+	Uint i;
+
+	memset(counts, 0, ctx->nParts*sizeof(Uint));
+	for (i = job->i1; i < job->i2; i++) {
+		const float *v = &ctx->m->v[i*3];
+		Sint32 *c = &ctx->cell[i*3];
+
+		c[0] = (Sint32)floorf((v[0] - ctx->min[0])*ctx->invCell);
+		c[1] = (Sint32)floorf((v[1] - ctx->min[1])*ctx->invCell);
+		c[2] = (Sint32)floorf((v[2] - ctx->min[2])*ctx->invCell);
+		counts[HashCell(c[0],c[1],c[2]) & (ctx->nParts-1)]++;
+	}
+}
+
+/* Scatter vertices into the partition buckets (counts hold offsets). */
+static void
+ScatterVertices(void *arg)
+{
+	WeldJob *job = arg;
+	WeldCtx *ctx = job->ctx;
+	Uint *offs = &ctx->counts[job->idx*ctx->nParts];
+	Uint i;
+
+	for (i = job->i1; i < job->i2; i++) {
+		const Sint32 *c = &ctx->cell[i*3];
+
+		ctx->order[offs[HashCell(c[0],c[1],c[2]) & (ctx->nParts-1)]++] =
+		    i;
+	}
+}
+
+static __inline__ WeldCell *
+FindCell(const WeldPart *wp, Sint32 x, Sint32 y, Sint32 z, Uint32 h)
+{
+	Uint slot;
+
+	for (slot = (h >> 8) & wp->mask; ; slot = (slot+1) & wp->mask) {
+		WeldCell *wc = &wp->cells[slot];
+
+		if (wc->count == 0 ||
+		    (wc->x == x && wc->y == y && wc->z == z))
+			return (wc);
+	}
+}
+
+/*
+ * Build the cell table of a partition and regroup its vertices by cell,
+ * preserving their relative order.
+ */
+static void
+BuildPartition(void *arg)
+{
+	WeldJob *job = arg;
+	WeldCtx *ctx = job->ctx;
+	WeldPart *wp = &ctx->parts[job->idx];
+	Uint *tmp, i, n = wp->nVtx, size, sum = 0;
+
+	for (size = 16; size < n*2; size <<= 1)
+		;;
+	wp->mask = size-1;
+	wp->cells = Malloc(size*sizeof(WeldCell));
+	memset(wp->cells, 0, size*sizeof(WeldCell));
+
+	for (i = 0; i < n; i++) {
+		const Sint32 *c = &ctx->cell[wp->vtx[i]*3];
+		WeldCell *wc;
+
+		wc = FindCell(wp, c[0], c[1], c[2], HashCell(c[0],c[1],c[2]));
+		wc->x = c[0];
+		wc->y = c[1];
+		wc->z = c[2];
+		wc->count++;
+	}
+	for (i = 0; i < size; i++) {
+		wp->cells[i].first = sum;
+		sum += wp->cells[i].count;
+	}
+	tmp = Malloc(n*sizeof(Uint));
+	for (i = 0; i < n; i++) {
+		const Sint32 *c = &ctx->cell[wp->vtx[i]*3];
+		WeldCell *wc;
+
+		wc = FindCell(wp, c[0], c[1], c[2], HashCell(c[0],c[1],c[2]));
+		tmp[wc->first++] = wp->vtx[i];
+	}
+	for (i = 0; i < size; i++) {
+		wp->cells[i].first -= wp->cells[i].count;
+	}
+	memcpy(wp->vtx, tmp, n*sizeof(Uint));
+	Free(tmp);
+}
+
+/*
+ * Map each vertex of a partition to the lowest-numbered vertex within
+ * eps. Vertices are visited cell by cell, and the neighbor cells are
+ * looked up once per cell as they are needed.
+ */
+static void
+FindRepresentatives(void *arg)
+{
+	WeldJob *job = arg;
+	WeldCtx *ctx = job->ctx;
+	const WeldPart *wpSelf = &ctx->parts[job->idx];
+	const float *vtx = ctx->m->v;
+	const WeldCell *nb[27];			/* Neighbor cells */
+	const Uint *nbVtx[27];			/* Their vertex lists */
+	Uint32 nbKnown;
+	float eps = ctx->eps;
+	Uint s, i, k;
+	int dx, dy, dz, lo[3], hi[3], a;
+
+	if (wpSelf->nVtx == 0) {
+		return;
+	}
+	for (s = 0; s <= wpSelf->mask; s++) {
+		const WeldCell *wcSelf = &wpSelf->cells[s];
+
+		if (wcSelf->count == 0) {
+			continue;
+		}
+		nbKnown = 1 << 13;			/* Center cell */
+		nb[13] = wcSelf;
+		nbVtx[13] = &wpSelf->vtx[wcSelf->first];
+
+		for (i = 0; i < wcSelf->count; i++) {
+			Uint vi = wpSelf->vtx[wcSelf->first + i];
+			const float *v = &vtx[vi*3];
+			Uint best = vi;
+
+			/* Only visit the neighbor cells within eps. */
+			for (a = 0; a < 3; a++) {
+				float f = v[a] - ctx->min[a] -
+				          (float)(&wcSelf->x)[a]*ctx->cellSize;
+
+				lo[a] = (f <= eps) ? -1 : 0;
+				hi[a] = (f >= ctx->cellSize - eps) ? 1 : 0;
+			}
+			for (dz = lo[2]; dz <= hi[2]; dz++)
+			for (dy = lo[1]; dy <= hi[1]; dy++)
+			for (dx = lo[0]; dx <= hi[0]; dx++) {
+				int n = (dz+1)*9 + (dy+1)*3 + (dx+1);
+				const WeldCell *wc;
+
+				if (!(nbKnown & (1 << n))) {
+					Sint32 x = wcSelf->x + dx;
+					Sint32 y = wcSelf->y + dy;
+					Sint32 z = wcSelf->z + dz;
+					Uint32 h = HashCell(x, y, z);
+					const WeldPart *wp;
+
+					wp = &ctx->parts[h & (ctx->nParts-1)];
+					nb[n] = NULL;
+					if (wp->nVtx > 0) {
+						nb[n] = FindCell(wp, x, y, z, h);
+						nbVtx[n] = &wp->vtx[nb[n]->first];
+					}
+					nbKnown |= (1 << n);
+				}
+				if ((wc = nb[n]) == NULL) {
+					continue;
+				}
+				for (k = 0; k < wc->count; k++) {
+					Uint j = nbVtx[n][k];
+					const float *u = &vtx[j*3];
+					float d0, d1, d2;
+
+					if (j >= best) {
+						break;	/* Sorted by index */
+					}
+					d0 = u[0] - v[0];
+					d1 = u[1] - v[1];
+					d2 = u[2] - v[2];
+					if (d0*d0 + d1*d1 + d2*d2 <= ctx->eps2)
+						best = j;
+				}
+			}
+			ctx->rep[vi] = best;
+		}
+	}
+}
+
+static void
+RunJobs(CAD_JobFn fn, WeldJob *jobs, Uint nJobs)
+{
+	CAD_JobGroup g;
+	Uint i;
+
+	CAD_JobGroupInit(&g);
+	for (i = 0; i < nJobs; i++) {
+		CAD_JobSubmit(&g, fn, &jobs[i]);
+	}
+	CAD_JobGroupWait(&g);
+	CAD_JobGroupDestroy(&g);
+}
+
+/* Remap the vertex arrays and triangles after welding. */
+static Uint
+Compact(WeldCtx *ctx)
+{
+	CAD_Mesh *m = ctx->m;
+	Uint *rep = ctx->rep;
+	Uint i, nv = 0, nt = 0;
+
+	/* Resolve chains (rep[i] <= i) and assign the new indices. */
+	for (i = 0; i < m->nv; i++) {
+		if (rep[i] == i) {
+			rep[i] = nv;
+			if (nv != i) {
+				memcpy(&m->v[nv*3], &m->v[i*3], 3*sizeof(float));
+				if (m->flags & CAD_MESH_NORMALS) {
+					memcpy(&m->n[nv*3], &m->n[i*3],
+					    3*sizeof(float));
+				}
+				if (m->flags & CAD_MESH_COLORS) {
+					memcpy(&m->c[nv*4], &m->c[i*4], 4);
+				}
+				if (m->flags & CAD_MESH_TEXCOORDS) {
+					memcpy(&m->st[nv*2], &m->st[i*2],
+					    2*sizeof(float));
+				}
+			}
+			nv++;
+		} else {
+			rep[i] = rep[rep[i]];
+		}
+	}
+	for (i = 0; i < m->nt; i++) {
+		Uint32 a = rep[m->tri[i*3]];
+		Uint32 b = rep[m->tri[i*3+1]];
+		Uint32 c = rep[m->tri[i*3+2]];
+
+		if (a == b || b == c || a == c) {
+			continue;			/* Degenerate */
+		}
+		m->tri[nt*3] = a;
+		m->tri[nt*3+1] = b;
+		m->tri[nt*3+2] = c;
+		nt++;
+	}
+	i = m->nv - nv;
+	m->nv = nv;
+	m->nt = nt;
+	return (i);
+}
+
+/*
+ * Merge the vertices of a mesh which lie within eps of each other,
+ * remapping the triangles and removing those which become degenerate.
+ * If nMerged is not NULL, the number of vertices removed is returned.
+ */
+int
+CAD_MeshWeld(CAD_Mesh *m, float eps, Uint *nMerged)
+{
+	WeldCtx ctx;
+	WeldJob *jobs;
+	float max[3], cell, ext = 0.0f;
+	Uint i, j, nThreads, per, sum;
+
+	if (nMerged != NULL) {
+		*nMerged = 0;
+	}
+	if (m->nv < 2) {
+		return (0);
+	}
+	if (CAD_MeshUnshare(m) == -1) {
+		return (-1);
+	}
+	if (eps < 0.0f) {
+		eps = 0.0f;
+	}
+	ctx.m = m;
+	ctx.eps = eps;
+	ctx.eps2 = eps*eps;
+	CAD_MeshBounds(m, ctx.min, max);
+	for (i = 0; i < 3; i++) {
+		if (max[i] - ctx.min[i] > ext)
+			ext = max[i] - ctx.min[i];
+	}
+	cell = ext/(float)(1 << WELD_CELL_BITS);
+	if (cell < eps*4.0f) { cell = eps*4.0f; }
+	if (cell <= 0.0f) { cell = 1.0f; }
+	ctx.cellSize = cell;
+	ctx.invCell = 1.0f/cell;
+
+	/*
+	 * Offset the grid by half a cell so that vertices lying on a regular
+	 * lattice aligned with the bounding box don't all sit on cell
+	 * boundaries, where neighbor cells must be searched.
+	 */
+	for (i = 0; i < 3; i++)
+		ctx.min[i] -= cell*0.5f;
+
+	nThreads = CAD_JobPoolThreads();
+	for (ctx.nParts = 1; ctx.nParts < nThreads*4; ctx.nParts <<= 1)
+		;;
+	ctx.nJobs = nThreads*4;
+	if (m->nv/ctx.nJobs < WELD_CHUNK_MIN) {
+		ctx.nJobs = m->nv/WELD_CHUNK_MIN + 1;
+	}
+	if ((ctx.cell = TryMalloc(m->nv*3*sizeof(Sint32))) == NULL) {
+		return (-1);
+	}
+	if ((ctx.order = TryMalloc(m->nv*sizeof(Uint))) == NULL) {
+		Free(ctx.cell);
+		return (-1);
+	}
+	if ((ctx.rep = TryMalloc(m->nv*sizeof(Uint))) == NULL) {
+		Free(ctx.order);
+		Free(ctx.cell);
+		return (-1);
+	}
+	ctx.counts = Malloc(ctx.nJobs*ctx.nParts*sizeof(Uint));
+	ctx.parts = Malloc(ctx.nParts*sizeof(WeldPart));
+
+	jobs = Malloc(MAX(ctx.nJobs, ctx.nParts)*sizeof(WeldJob));
+	per = m->nv/ctx.nJobs;
+	for (i = 0; i < ctx.nJobs; i++) {
+		jobs[i].ctx = &ctx;
+		jobs[i].idx = i;
+		jobs[i].i1 = i*per;
+		jobs[i].i2 = (i == ctx.nJobs-1) ? m->nv : (i+1)*per;
+	}
+	RunJobs(BinVertices, jobs, ctx.nJobs);
+
+	/* Turn the per-job counts into offsets, partition-major. */
+	sum = 0;
+	for (j = 0; j < ctx.nParts; j++) {
+		ctx.parts[j].vtx = &ctx.order[sum];
+		ctx.parts[j].cells = NULL;
+		for (i = 0; i < ctx.nJobs; i++) {
+			Uint n = ctx.counts[i*ctx.nParts + j];
+
+			ctx.counts[i*ctx.nParts + j] = sum;
+			sum += n;
+		}
+		ctx.parts[j].nVtx = (Uint)(&ctx.order[sum] - ctx.parts[j].vtx);
+	}
+	RunJobs(ScatterVertices, jobs, ctx.nJobs);
+
+	for (j = 0; j < ctx.nParts; j++) {
+		jobs[j].ctx = &ctx;
+		jobs[j].idx = j;
+	}
+	RunJobs(BuildPartition, jobs, ctx.nParts);
+
+	RunJobs(FindRepresentatives, jobs, ctx.nParts);
+	Free(jobs);
+
+	i = Compact(&ctx);
+	if (nMerged != NULL) {
+		*nMerged = i;
+	}
+	for (j = 0; j < ctx.nParts; j++) {
+		Free(ctx.parts[j].cells);
+	}
+	Free(ctx.parts);
+	Free(ctx.counts);
+	Free(ctx.rep);
+	Free(ctx.order);
+	Free(ctx.cell);
+	return (0);
+}
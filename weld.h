@@ -0,0 +1,13 @@
+/*	Public domain	*/
+
+#ifndef _CADTOOLS_WELD_H_
+#define _CADTOOLS_WELD_H_
+
+#include "begin_code.h"
+
+__BEGIN_DECLS
+int	CAD_MeshWeld(CAD_Mesh *, float, Uint *);
+__END_DECLS
+
+#include "close_code.h"
+#endif	/* _CADTOOLS_WELD_H_ */